@@ -0,0 +1,213 @@
+#ifndef _BATCH_LOADER_H_
+#define _BATCH_LOADER_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "mapped_file.h"
+#include "mtl_parser.h"
+#include "obj_parser.h"
+#include "thread_pool.h"
+
+using MaterialLibrary = std::unordered_map<std::string, Material>;
+
+// Parsed material libraries shared between threads. Each path is parsed
+// once; threads asking for a library that is still being parsed wait for
+// that parse instead of starting their own.
+class MaterialLibraryCache {
+ public:
+  MaterialLibraryCache() = default;
+  MaterialLibraryCache(const MaterialLibraryCache&) = delete;
+  MaterialLibraryCache& operator=(const MaterialLibraryCache&) = delete;
+  ~MaterialLibraryCache() = default;
+
+  // Directory for MTLParser's binary caches; empty disables them.
+  void set_cache_directory(const std::string& cache_directory) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    cache_directory_ = cache_directory;
+  }
+
+  // Returns the materials of the library at path, or null if it failed to
+  // parse. Failures are remembered like successes.
+  std::shared_ptr<const MaterialLibrary> Get(const std::string& path) {
+    std::promise<std::shared_ptr<const MaterialLibrary>> promise;
+    std::shared_future<std::shared_ptr<const MaterialLibrary>> pending;
+    std::string cache_directory;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto [itr, is_new] = libraries_.try_emplace(path);
+      if (is_new) {
+        itr->second = promise.get_future().share();
+        cache_directory = cache_directory_;
+      } else {
+        pending = itr->second;
+      }
+    }
+    if (pending.valid()) {
+      return pending.get();
+    }
+    MTLParser parser;
+    parser.set_cache_directory(cache_directory);
+    std::shared_ptr<const MaterialLibrary> library;
+    if (parser.Parse(path) == 0) {
+      library = std::make_shared<const MaterialLibrary>(parser.Release());
+    }
+    promise.set_value(library);
+    return library;
+  }
+
+  std::size_t size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return libraries_.size();
+  }
+
+  void Clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    libraries_.clear();
+  }
+
+ private:
+  mutable std::mutex mutex_;
+  std::unordered_map<std::string,
+                     std::shared_future<std::shared_ptr<const MaterialLibrary>>>
+      libraries_;
+  std::string cache_directory_;
+};
+
+// Parses many OBJ files on a thread pool. Material libraries are resolved
+// relative to the OBJ that names them and parsed once per batch, or once
+// for the loader's lifetime since the cache is kept between batches.
+class BatchLoader {
+ public:
+  struct Result {
+    // Position of the file in the list passed to Load.
+    std::size_t index = 0;
+    std::string path;
+    // 0 if the OBJ parsed; the material library may still have failed.
+    int status = 0;
+    OBJParser::Mesh mesh;
+    // Set when the mesh came from the cache in cache_directory. mesh then
+    // holds only the library and material names, and the rest is read
+    // through this view without being copied.
+    std::shared_ptr<const OBJParser::MeshView> cached_mesh;
+    // Null when the OBJ names no library or it failed to parse. Otherwise
+    // mesh.materials holds the used ones by material id.
+    std::shared_ptr<const MaterialLibrary> materials;
+  };
+
+  // 0 uses every hardware thread.
+  explicit BatchLoader(unsigned thread_count = 0) : pool_(thread_count) {}
+  BatchLoader(const BatchLoader&) = delete;
+  BatchLoader& operator=(const BatchLoader&) = delete;
+  ~BatchLoader() = default;
+
+  unsigned thread_count() const { return pool_.thread_count(); }
+
+  // Options for every OBJParser. Files already load in parallel, so
+  // thread_count usually stays at 1. Meshes cached in cache_directory are
+  // returned as Result::cached_mesh. Libraries always come from the shared
+  // cache, so load_materials is ignored.
+  const OBJParser::ParseOptions& parse_options() const {
+    return parse_options_;
+  }
+  void set_parse_options(const OBJParser::ParseOptions& options) {
+    parse_options_ = options;
+    material_cache_.set_cache_directory(options.cache_directory);
+  }
+
+  MaterialLibraryCache& material_cache() { return material_cache_; }
+
+  // Loads every path and hands each result to on_result as soon as that file
+  // is done, in completion order. on_result is never called concurrently.
+  // Returns once all files are delivered: 0 if every OBJ parsed, else 1.
+  int Load(const std::vector<std::string>& paths,
+           const std::function<void(Result&&)>& on_result) {
+    // Files are handed out one at a time, largest first, so a big file
+    // picked up last cannot leave the other threads idle at the end.
+    std::vector<std::uint64_t> sizes(paths.size(), 0);
+    for (std::size_t i = 0; i < paths.size(); i++) {
+      MappedFile file;
+      if (file.Open(paths[i]) == 0) {
+        sizes[i] = file.size();
+      }
+    }
+    std::vector<std::size_t> order(paths.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+                     [&](std::size_t a, std::size_t b) {
+                       return sizes[a] > sizes[b];
+                     });
+
+    std::mutex result_mutex;
+    int status = 0;
+    pool_.ParallelFor(order.size(), [&](std::size_t i) {
+      Result result = LoadFile(order[i], paths[order[i]]);
+      std::lock_guard<std::mutex> lock(result_mutex);
+      if (result.status != 0) {
+        status = 1;
+      }
+      on_result(std::move(result));
+    });
+    return status;
+  }
+
+  // Loads every path and returns the results in the order of paths.
+  std::vector<Result> Load(const std::vector<std::string>& paths,
+                           int* status = nullptr) {
+    std::vector<Result> results(paths.size());
+    int load_status = Load(paths, [&](Result&& result) {
+      results[result.index] = std::move(result);
+    });
+    if (status != nullptr) {
+      *status = load_status;
+    }
+    return results;
+  }
+
+ private:
+  Result LoadFile(std::size_t index, const std::string& path) {
+    Result result;
+    result.index = index;
+    result.path = path;
+    OBJParser parser;
+    OBJParser::ParseOptions options = parse_options_;
+    options.load_materials = false;
+    parser.set_parse_options(options);
+    result.status = parser.Parse(path);
+    if (result.status != 0) {
+      return result;
+    }
+    result.cached_mesh = parser.cached_mesh();
+    if (result.cached_mesh) {
+      result.mesh.mtl_name = parser.mtl_name();
+      result.mesh.material_names = parser.material_names();
+    } else {
+      result.mesh = parser.Release();
+    }
+    if (!result.mesh.mtl_name.empty()) {
+      result.materials = material_cache_.Get(
+          OBJParser::ResolveMaterialPath(path, result.mesh.mtl_name));
+    }
+    if (result.materials) {
+      result.mesh.materials = OBJParser::FlattenMaterials(
+          result.mesh.material_names, *result.materials);
+    }
+    return result;
+  }
+
+  ThreadPool pool_;
+  OBJParser::ParseOptions parse_options_;
+  MaterialLibraryCache material_cache_;
+};
+
+#endif  // _BATCH_LOADER_H_
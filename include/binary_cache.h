@@ -0,0 +1,356 @@
+#ifndef _BINARY_CACHE_H_
+#define _BINARY_CACHE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "mapped_file.h"
+
+// Building blocks for the parsers' binary caches. A cache file is a header
+// followed by 64-byte aligned sections of fixed-width records, so a mapped
+// file can be used in place without decoding individual elements.
+
+constexpr std::uint32_t kCacheVersion = 6;
+constexpr std::size_t kCacheMaxSections = 32;
+constexpr std::size_t kCacheAlignment = 64;
+
+struct CacheSection {
+  std::uint64_t offset;
+  std::uint64_t size;
+};
+
+struct CacheHeader {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t section_count;
+  std::uint64_t source_size;
+  std::uint64_t source_hash;
+  // Type sizes and parse options the cached result depends on.
+  std::uint64_t fingerprint;
+  // Modification time of the source when it was hashed, or 0. A source
+  // that still has it need not be hashed again.
+  std::uint64_t source_stamp;
+  CacheSection sections[kCacheMaxSections];
+};
+
+// Offset and length into a cache's string section.
+struct CacheStringRef {
+  std::uint64_t offset;
+  std::uint64_t size;
+};
+
+struct CacheSubObject {
+  CacheStringRef name;
+  std::uint64_t first_mesh_group;
+  std::uint64_t mesh_group_count;
+};
+
+struct CacheMeshGroup {
+  CacheStringRef name;
+  std::uint64_t first_index_group;
+  std::uint64_t index_group_count;
+};
+
+struct CacheIndexGroup {
+  CacheStringRef mtl_name;
+  std::uint64_t first_index;
+  std::uint64_t index_count;
+  std::uint8_t is_smooth_shading;
+  std::uint8_t is_smooth_shading_empty;
+  // Set when the indices are 16-bit offsets from base_vertex.
+  std::uint8_t is_narrow;
+  std::uint8_t padding;
+  std::uint32_t material_id;
+  std::uint64_t base_vertex;
+};
+
+struct CacheIndexedPart {
+  CacheStringRef sub_object_name;
+  CacheStringRef mesh_group_name;
+  CacheStringRef material_name;
+  std::uint64_t object_part;
+  std::uint64_t begin;
+  std::uint64_t end;
+  std::uint64_t attribute_base[3];
+  std::uint8_t is_smooth_shading;
+  std::uint8_t padding[7];
+};
+
+// Read-only array inside a mapped cache file.
+template <class T>
+struct CacheArray {
+  const T* data = nullptr;
+  std::size_t size = 0;
+
+  const T* begin() const { return data; }
+  const T* end() const { return data + size; }
+  const T& operator[](std::size_t i) const { return data[i]; }
+  bool empty() const { return size == 0; }
+};
+
+// 64-bit hash of a byte range, eight bytes per step. Used to key cache files
+// by source path and to detect edited sources.
+inline std::uint64_t HashBytes(const void* data, std::size_t size) {
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  const std::uint64_t k1 = 0x9E3779B185EBCA87ull;
+  const std::uint64_t k2 = 0xC2B2AE3D27D4EB4Full;
+  std::uint64_t h = 0x27D4EB2F165667C5ull ^ (size * k1);
+  std::size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    std::uint64_t word;
+    std::memcpy(&word, bytes + i, 8);
+    word *= k2;
+    word = (word << 31) | (word >> 33);
+    h ^= word * k1;
+    h = ((h << 27) | (h >> 37)) * k1 + 0x85EBCA77C2B2AE63ull;
+  }
+  for (; i < size; i++) {
+    h ^= bytes[i] * 0x165667B19E3779F9ull;
+    h = ((h << 11) | (h >> 53)) * k1;
+  }
+  h ^= h >> 33;
+  h *= k2;
+  h ^= h >> 29;
+  h *= 0x165667B19E3779F9ull;
+  h ^= h >> 32;
+  return h;
+}
+
+// Cache file for source_path inside cache_directory, named after the hash of
+// the source path and the fingerprint of the options it was written with, so
+// caches of one source under different options do not replace each other.
+inline std::string CacheFilePath(const std::string& cache_directory,
+                                 const std::string& source_path,
+                                 std::uint64_t fingerprint,
+                                 const std::string& extension) {
+  char name[34];
+  std::snprintf(name, sizeof(name), "%016llx-%016llx",
+                static_cast<unsigned long long>(
+                    HashBytes(source_path.data(), source_path.size())),
+                static_cast<unsigned long long>(fingerprint));
+  std::string path = cache_directory;
+  if (!path.empty() && path.back() != '/' && path.back() != '\\') {
+    path += '/';
+  }
+  return path + name + extension;
+}
+
+// Gathers sections and writes them out behind a header. Sections are lists
+// of borrowed byte ranges that must stay alive until Write returns. The file
+// is written under a temporary name unique to the process, thread and call
+// and then renamed, so readers never observe a partial cache and writers
+// racing on the same cache never share a temporary file.
+class CacheWriter {
+ public:
+  CacheWriter() = default;
+  CacheWriter(const CacheWriter&) = delete;
+  CacheWriter& operator=(const CacheWriter&) = delete;
+  ~CacheWriter() = default;
+
+  CacheStringRef AddString(std::string_view s) {
+    CacheStringRef ref = {strings_.size(), s.size()};
+    strings_.append(s.data(), s.size());
+    return ref;
+  }
+  const std::string& strings() const { return strings_; }
+
+  void Append(std::size_t id, const void* data, std::size_t size) {
+    if (size != 0) {
+      sections_[id].push_back({static_cast<const char*>(data), size});
+    }
+  }
+
+  template <class T>
+  void Append(std::size_t id, const std::vector<T>& records) {
+    Append(id, records.data(), records.size() * sizeof(T));
+  }
+
+  int Write(const std::string& path, const char magic[8],
+            std::uint64_t source_size, std::uint64_t source_hash,
+            std::uint64_t fingerprint, std::uint64_t source_stamp = 0) {
+    CacheHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, magic, sizeof(header.magic));
+    header.version = kCacheVersion;
+    header.section_count = kCacheMaxSections;
+    header.source_size = source_size;
+    header.source_hash = source_hash;
+    header.fingerprint = fingerprint;
+    header.source_stamp = source_stamp;
+    std::uint64_t offset = AlignUp(sizeof(CacheHeader));
+    for (std::size_t i = 0; i < kCacheMaxSections; i++) {
+      std::uint64_t size = 0;
+      for (const Part& part : sections_[i]) {
+        size += part.size;
+      }
+      header.sections[i] = {offset, size};
+      offset = AlignUp(offset + size);
+    }
+
+    const std::string temporary_path = TemporaryPath(path);
+    std::ofstream output(temporary_path, std::ios::binary | std::ios::trunc);
+    if (!output.is_open()) {
+      return 1;
+    }
+    const char zeros[kCacheAlignment] = {};
+    output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    std::uint64_t written = sizeof(header);
+    for (std::size_t i = 0; i < kCacheMaxSections; i++) {
+      output.write(zeros, static_cast<std::streamsize>(
+                              header.sections[i].offset - written));
+      for (const Part& part : sections_[i]) {
+        output.write(part.data, static_cast<std::streamsize>(part.size));
+      }
+      written = header.sections[i].offset + header.sections[i].size;
+    }
+    output.close();
+    if (!output) {
+      std::remove(temporary_path.c_str());
+      return 1;
+    }
+#ifdef _WIN32
+    // rename does not replace an existing file on Windows.
+    std::remove(path.c_str());
+#endif
+    if (std::rename(temporary_path.c_str(), path.c_str()) != 0) {
+      std::remove(temporary_path.c_str());
+      return 1;
+    }
+    return 0;
+  }
+
+ private:
+  struct Part {
+    const char* data;
+    std::size_t size;
+  };
+
+  static std::string TemporaryPath(const std::string& path) {
+    static std::atomic<std::uint64_t> counter{0};
+#ifdef _WIN32
+    const unsigned long long process = GetCurrentProcessId();
+#else
+    const unsigned long long process =
+        static_cast<unsigned long long>(getpid());
+#endif
+    char suffix[64];
+    std::snprintf(
+        suffix, sizeof(suffix), ".%llx.%llx.%llx.tmp", process,
+        static_cast<unsigned long long>(
+            std::hash<std::thread::id>()(std::this_thread::get_id())),
+        static_cast<unsigned long long>(counter.fetch_add(1)));
+    return path + suffix;
+  }
+
+  static std::uint64_t AlignUp(std::uint64_t offset) {
+    return (offset + kCacheAlignment - 1) / kCacheAlignment * kCacheAlignment;
+  }
+
+  std::string strings_;
+  std::vector<Part> sections_[kCacheMaxSections];
+};
+
+// Records stamp as the source_stamp of the cache at path in place, once its
+// source was found unchanged by hash. A reader that maps the cache meanwhile
+// at worst sees a stamp that does not match and hashes the source again.
+inline int UpdateCacheStamp(const std::string& path, std::uint64_t stamp) {
+  std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+  if (!file.is_open()) {
+    return 1;
+  }
+  file.seekp(static_cast<std::streamoff>(offsetof(CacheHeader, source_stamp)));
+  file.write(reinterpret_cast<const char*>(&stamp), sizeof(stamp));
+  file.close();
+  return file ? 0 : 1;
+}
+
+// Maps a cache file and hands out typed pointers into its sections.
+class CacheReader {
+ public:
+  CacheReader() = default;
+  CacheReader(const CacheReader&) = delete;
+  CacheReader& operator=(const CacheReader&) = delete;
+  ~CacheReader() = default;
+
+  const CacheHeader& header() const { return header_; }
+  // Start of the mapped file, which section offsets count from.
+  const char* data() const { return file_.data(); }
+
+  // Fails unless the file is a well-formed cache of the kind named by magic.
+  int Open(const std::string& path, const char magic[8]) {
+    Close();
+    if (file_.Open(path) != 0) {
+      return 1;
+    }
+    if (file_.size() < sizeof(CacheHeader)) {
+      Close();
+      return 1;
+    }
+    std::memcpy(&header_, file_.data(), sizeof(CacheHeader));
+    if (std::memcmp(header_.magic, magic, sizeof(header_.magic)) != 0 ||
+        header_.version != kCacheVersion ||
+        header_.section_count != kCacheMaxSections) {
+      Close();
+      return 1;
+    }
+    for (const CacheSection& section : header_.sections) {
+      if (section.offset % kCacheAlignment != 0 ||
+          section.offset > file_.size() ||
+          section.size > file_.size() - section.offset) {
+        Close();
+        return 1;
+      }
+    }
+    return 0;
+  }
+
+  // True if the cache was written for a source of this size and hash with
+  // the same fingerprint.
+  bool Matches(std::uint64_t source_size, std::uint64_t source_hash,
+               std::uint64_t fingerprint) const {
+    return file_.is_open() && header_.source_size == source_size &&
+           header_.source_hash == source_hash &&
+           header_.fingerprint == fingerprint;
+  }
+
+  int Close() {
+    std::memset(&header_, 0, sizeof(header_));
+    return file_.Close();
+  }
+
+  template <class T>
+  CacheArray<T> Section(std::size_t id) const {
+    const CacheSection& section = header_.sections[id];
+    CacheArray<T> array;
+    array.data = reinterpret_cast<const T*>(file_.data() + section.offset);
+    array.size = static_cast<std::size_t>(section.size / sizeof(T));
+    return array;
+  }
+
+  // Returns false if ref does not lie inside the string section.
+  bool GetString(std::size_t strings_id, const CacheStringRef& ref,
+                 std::string_view& s) const {
+    CacheArray<char> strings = Section<char>(strings_id);
+    if (ref.offset > strings.size || ref.size > strings.size - ref.offset) {
+      return false;
+    }
+    s = std::string_view(strings.data + ref.offset,
+                         static_cast<std::size_t>(ref.size));
+    return true;
+  }
+
+ private:
+  MappedFile file_;
+  CacheHeader header_ = {};
+};
+
+#endif  // _BINARY_CACHE_H_
@@ -0,0 +1,618 @@
+#ifndef _BLOCK_READER_H_
+#define _BLOCK_READER_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#ifdef OBJ_PARSER_ZLIB
+#include <zlib.h>
+#endif
+#ifdef OBJ_PARSER_ZSTD
+#include <zstd.h>
+#endif
+
+#include "mapped_file.h"
+
+// Reads a file, file descriptor or stream in blocks on a background thread,
+// so that reading ahead overlaps with whatever the caller does with the
+// previous blocks. Files are mapped when possible; pipes, character devices
+// and files that cannot be mapped are read with read(). Gzip and zstd input
+// is decompressed on that thread and delivered as plain text. Gzip needs
+// OBJ_PARSER_ZLIB and zstd OBJ_PARSER_ZSTD defined before this header is
+// included, with the program linked against zlib or libzstd.
+//
+// Blocks pass between the two threads through a single-producer,
+// single-consumer ring. Neither side takes a lock while the ring has a block
+// for the consumer and a free slot for the producer; a side only sleeps
+// when it has nothing to do.
+class BlockReader {
+ public:
+  enum class Compression { kNone, kGzip, kZstd };
+
+  // Returned by Open for input compressed in a format this build has no
+  // decoder for; compression() tells which.
+  static constexpr int kUnsupportedCompression = 2;
+
+  static constexpr std::size_t kBlockSize = 1 << 20;
+  static constexpr std::size_t kBlockCount = 4;
+  // Compressed input read from a descriptor or stream is buffered in pieces
+  // of this size.
+  static constexpr std::size_t kInputSize = 256 << 10;
+  // Blocks start on a page boundary.
+  static constexpr std::size_t kBlockAlignment = 4096;
+
+  BlockReader() = default;
+  BlockReader(const BlockReader&) = delete;
+  BlockReader& operator=(const BlockReader&) = delete;
+  ~BlockReader() { Close(); }
+
+  // Compression of a file, from its magic bytes.
+  static Compression DetectCompression(const char* data, std::size_t size) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+    if (size >= 2 && bytes[0] == 0x1f && bytes[1] == 0x8b) {
+      return Compression::kGzip;
+    }
+    if (size >= 4 && bytes[0] == 0x28 && bytes[1] == 0xb5 &&
+        bytes[2] == 0x2f && bytes[3] == 0xfd) {
+      return Compression::kZstd;
+    }
+    return Compression::kNone;
+  }
+
+  static bool IsSupported(Compression compression) {
+    switch (compression) {
+      case Compression::kGzip:
+#ifdef OBJ_PARSER_ZLIB
+        return true;
+#else
+        return false;
+#endif
+      case Compression::kZstd:
+#ifdef OBJ_PARSER_ZSTD
+        return true;
+#else
+        return false;
+#endif
+      default:
+        return true;
+    }
+  }
+
+  // True if path names a regular file, which can be mapped. Other files,
+  // such as named pipes, may only be opened once.
+  static bool IsRegularFile(const std::string& path) {
+#ifdef _WIN32
+    struct _stat64 st;
+    return _stat64(path.c_str(), &st) == 0 && (st.st_mode & _S_IFREG) != 0;
+#else
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+#endif
+  }
+
+  Compression compression() const { return compression_; }
+  bool is_open() const { return is_open_; }
+  // Nonzero once reading or decompressing failed. Blocks delivered before
+  // the failure were valid.
+  int status() const { return status_.load(std::memory_order_acquire); }
+
+  // Reads the file at path, mapping it if it is a regular file that can be
+  // mapped.
+  int Open(const std::string& path) {
+    if (is_open_) {
+      return 1;
+    }
+    if (IsRegularFile(path) && file_.Open(path) == 0) {
+      input_ = file_.data();
+      input_size_ = file_.size();
+      return Start(DetectCompression(input_, input_size_));
+    }
+#ifdef _WIN32
+    const int fd = _open(path.c_str(), _O_RDONLY | _O_BINARY);
+#else
+    const int fd = open(path.c_str(), O_RDONLY);
+#endif
+    if (fd < 0) {
+      return 1;
+    }
+    fd_ = fd;
+    is_fd_owned_ = true;
+    return StartSource();
+  }
+
+  // Reads fd from its current position to its end. The descriptor is not
+  // closed and must stay open until Close.
+  int Open(int fd) {
+    if (is_open_ || fd < 0) {
+      return 1;
+    }
+    fd_ = fd;
+    is_fd_owned_ = false;
+    return StartSource();
+  }
+
+  // Reads stream to its end. The stream must outlive Close, and must not be
+  // used by anyone else until then.
+  int Open(std::istream& stream) {
+    if (is_open_) {
+      return 1;
+    }
+    stream_ = &stream;
+    return StartSource();
+  }
+
+  // Waits for the next block and returns false once the input is exhausted
+  // or failed. A block stays valid until the next call.
+  bool Next(std::string_view& block) {
+    std::uint64_t consumed = consumed_.load(std::memory_order_relaxed);
+    if (is_holding_block_) {
+      consumed_.store(++consumed, std::memory_order_seq_cst);
+      is_holding_block_ = false;
+      WakeIfWaiting(is_producer_waiting_);
+    }
+    auto is_ready = [this, consumed] {
+      return produced_.load() > consumed || is_done_.load();
+    };
+    if (!is_ready()) {
+      Wait(is_consumer_waiting_, is_ready);
+    }
+    // The producer publishes its last block before is_done_, so the count
+    // is read again after seeing it.
+    if (produced_.load(std::memory_order_acquire) == consumed) {
+      return false;
+    }
+    const std::size_t slot = consumed % kBlockCount;
+    block = std::string_view(blocks_[slot].get(), sizes_[slot]);
+    is_holding_block_ = true;
+    return true;
+  }
+
+  // Calls f(line) for every line of the remaining input, without the '\n',
+  // until f returns nonzero. Returns 1 if f or reading failed, else 0.
+  template <class F>
+  int ForEachLine(F&& f) {
+    std::string_view block;
+    while (Next(block)) {
+      const char* cursor = block.data();
+      const char* end = block.data() + block.size();
+      while (cursor < end) {
+        const char* eol = static_cast<const char*>(
+            std::memchr(cursor, '\n', static_cast<std::size_t>(end - cursor)));
+        if (eol == nullptr) {
+          // The rest of the line is in the next block.
+          carry_.append(cursor, end);
+          break;
+        }
+        int result;
+        if (carry_.empty()) {
+          result = f(std::string_view(
+              cursor, static_cast<std::size_t>(eol - cursor)));
+        } else {
+          carry_.append(cursor, eol);
+          result = f(std::string_view(carry_));
+          carry_.clear();
+        }
+        if (result != 0) {
+          return 1;
+        }
+        cursor = eol + 1;
+      }
+    }
+    if (status() != 0) {
+      return 1;
+    }
+    if (!carry_.empty()) {
+      const int result = f(std::string_view(carry_));
+      carry_.clear();
+      return result != 0 ? 1 : 0;
+    }
+    return 0;
+  }
+
+  // Stops the background thread and releases the input. A read from a pipe
+  // or stream that is under way is waited for.
+  void Close() {
+    if (producer_.joinable()) {
+      is_stopping_.store(true, std::memory_order_seq_cst);
+      WakeIfWaiting(is_producer_waiting_);
+      producer_.join();
+    }
+    if (is_fd_owned_) {
+#ifdef _WIN32
+      _close(fd_);
+#else
+      close(fd_);
+#endif
+    }
+    fd_ = -1;
+    is_fd_owned_ = false;
+    stream_ = nullptr;
+    file_.Close();
+    input_ = nullptr;
+    input_size_ = 0;
+    is_open_ = false;
+  }
+
+ private:
+  struct AlignedDelete {
+    void operator()(char* p) const {
+      ::operator delete[](p, std::align_val_t(kBlockAlignment));
+    }
+  };
+  using AlignedBuffer = std::unique_ptr<char[], AlignedDelete>;
+
+  static AlignedBuffer AllocateBuffer(std::size_t size) {
+    return AlignedBuffer(static_cast<char*>(
+        ::operator new[](size, std::align_val_t(kBlockAlignment))));
+  }
+
+  // Reads the first bytes of a descriptor or stream to detect their
+  // compression, then starts the background thread. Plain input skips the
+  // input buffer after these bytes.
+  int StartSource() {
+    if (!input_buffer_) {
+      input_buffer_ = AllocateBuffer(kInputSize);
+    }
+    std::size_t size = 0;
+    if (ReadSource(input_buffer_.get(), kInputSize, size, 4) != 0) {
+      Close();
+      return 1;
+    }
+    input_ = input_buffer_.get();
+    input_size_ = size;
+    return Start(DetectCompression(input_, input_size_));
+  }
+
+  int Start(Compression compression) {
+    is_open_ = true;
+    compression_ = compression;
+    if (!IsSupported(compression_)) {
+      Close();
+      return kUnsupportedCompression;
+    }
+    for (std::size_t i = 0; i < kBlockCount; i++) {
+      if (!blocks_[i]) {
+        blocks_[i] = AllocateBuffer(kBlockSize);
+      }
+    }
+    produced_.store(0, std::memory_order_relaxed);
+    consumed_.store(0, std::memory_order_relaxed);
+    is_holding_block_ = false;
+    is_done_.store(false, std::memory_order_relaxed);
+    is_stopping_.store(false, std::memory_order_relaxed);
+    status_.store(0, std::memory_order_relaxed);
+    carry_.clear();
+    producer_ = std::thread([this] { Produce(); });
+    return 0;
+  }
+
+  // Reads at least min_size bytes from the descriptor or stream into buffer,
+  // fewer only at the end of the input, and at most capacity. Size 0 means
+  // the end.
+  int ReadSource(char* buffer, std::size_t capacity, std::size_t& size,
+                 std::size_t min_size) {
+    size = 0;
+    if (stream_ != nullptr) {
+      stream_->read(buffer, static_cast<std::streamsize>(min_size));
+      size = static_cast<std::size_t>(stream_->gcount());
+      if (size == min_size && size < capacity) {
+        // Whatever the stream has buffered comes along without blocking.
+        size += static_cast<std::size_t>(stream_->readsome(
+            buffer + size, static_cast<std::streamsize>(capacity - size)));
+      }
+      return stream_->bad() ? 1 : 0;
+    }
+    while (size < min_size) {
+#ifdef _WIN32
+      const int count = _read(
+          fd_, buffer + size,
+          static_cast<unsigned>(std::min<std::size_t>(capacity - size,
+                                                      1u << 30)));
+#else
+      const ssize_t count = read(fd_, buffer + size, capacity - size);
+#endif
+      if (count < 0 && errno == EINTR) {
+        continue;
+      }
+      if (count < 0) {
+        return 1;
+      }
+      if (count == 0) {
+        break;
+      }
+      size += static_cast<std::size_t>(count);
+    }
+    return 0;
+  }
+
+  // Sleeps until is_ready() holds. is_waiting tells the other side to wake
+  // this one. It is stored before is_ready loads the other side's counter,
+  // and that side stores its counter before loading is_waiting, all in
+  // sequentially consistent order, so at least one of them sees the other's
+  // store and no wakeup is lost.
+  template <class Predicate>
+  void Wait(std::atomic<bool>& is_waiting, Predicate is_ready) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    is_waiting.store(true, std::memory_order_seq_cst);
+    condition_.wait(lock, is_ready);
+    is_waiting.store(false, std::memory_order_relaxed);
+  }
+
+  void WakeIfWaiting(const std::atomic<bool>& is_waiting) {
+    if (is_waiting.load(std::memory_order_seq_cst)) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      condition_.notify_all();
+    }
+  }
+
+  // Runs on the background thread: fills free blocks until the input ends,
+  // fails or Close is called.
+  void Produce() {
+    Decoder decoder;
+    int result = decoder.Init(compression_, input_, input_size_,
+                              IsSource() ? this : nullptr);
+    std::uint64_t produced = 0;
+    while (result == 0) {
+      auto is_ready = [this, produced] {
+        return produced - consumed_.load() < kBlockCount ||
+               is_stopping_.load();
+      };
+      if (!is_ready()) {
+        Wait(is_producer_waiting_, is_ready);
+      }
+      if (is_stopping_.load(std::memory_order_acquire)) {
+        break;
+      }
+      // The consumer never touches a block it has not been handed, so this
+      // one is filled while it works on the others.
+      const std::size_t slot = produced % kBlockCount;
+      std::size_t size = 0;
+      result = decoder.Read(blocks_[slot].get(), kBlockSize, size);
+      if (result != 0 || size == 0) {
+        break;
+      }
+      sizes_[slot] = size;
+      produced_.store(++produced, std::memory_order_seq_cst);
+      WakeIfWaiting(is_consumer_waiting_);
+    }
+    status_.store(result, std::memory_order_release);
+    is_done_.store(true, std::memory_order_seq_cst);
+    WakeIfWaiting(is_consumer_waiting_);
+  }
+
+  bool IsSource() const { return fd_ >= 0 || stream_ != nullptr; }
+
+  // Turns the input into plain text, one call per block. The input is
+  // either the whole mapped file, or the first piece read from a source
+  // that the rest is read from as it is needed.
+  class Decoder {
+   public:
+    Decoder() = default;
+    Decoder(const Decoder&) = delete;
+    Decoder& operator=(const Decoder&) = delete;
+    ~Decoder() {
+#ifdef OBJ_PARSER_ZLIB
+      if (compression_ == Compression::kGzip) {
+        inflateEnd(&inflate_);
+      }
+#endif
+#ifdef OBJ_PARSER_ZSTD
+      ZSTD_freeDStream(zstd_);
+#endif
+    }
+
+    int Init(Compression compression, const char* data, std::size_t size,
+             BlockReader* source) {
+      compression_ = compression;
+      input_ = data;
+      input_size_ = size;
+      source_ = source;
+      switch (compression) {
+#ifdef OBJ_PARSER_ZLIB
+        case Compression::kGzip:
+          inflate_ = z_stream();
+          // 32 lets zlib detect the gzip header.
+          if (inflateInit2(&inflate_, 15 + 32) != Z_OK) {
+            compression_ = Compression::kNone;
+            return 1;
+          }
+          return 0;
+#endif
+#ifdef OBJ_PARSER_ZSTD
+        case Compression::kZstd:
+          zstd_ = ZSTD_createDStream();
+          return zstd_ == nullptr || ZSTD_isError(ZSTD_initDStream(zstd_))
+                     ? 1
+                     : 0;
+#endif
+        default:
+          return 0;
+      }
+    }
+
+    // Fills output with up to capacity bytes; size 0 means the end.
+    int Read(char* output, std::size_t capacity, std::size_t& size) {
+      switch (compression_) {
+#ifdef OBJ_PARSER_ZLIB
+        case Compression::kGzip:
+          return ReadGzip(output, capacity, size);
+#endif
+#ifdef OBJ_PARSER_ZSTD
+        case Compression::kZstd:
+          return ReadZstd(output, capacity, size);
+#endif
+        default:
+          size = std::min(capacity, input_size_ - position_);
+          if (size > 0) {
+            std::memcpy(output, input_ + position_, size);
+          }
+          position_ += size;
+          if (size < capacity && source_ != nullptr) {
+            // Plain text goes straight from the source into the block.
+            std::size_t read_size = 0;
+            const int result = source_->ReadSource(
+                output + size, capacity - size, read_size, capacity - size);
+            size += read_size;
+            return result;
+          }
+          return 0;
+      }
+    }
+
+   private:
+    // Makes more input available once the current piece is used up. Input
+    // that is all in memory has no more.
+    int Refill() {
+      if (position_ < input_size_ || source_ == nullptr) {
+        return 0;
+      }
+      char* buffer = source_->input_buffer_.get();
+      input_ = buffer;
+      position_ = 0;
+      return source_->ReadSource(buffer, kInputSize, input_size_, kInputSize);
+    }
+
+#ifdef OBJ_PARSER_ZLIB
+    int ReadGzip(char* output, std::size_t capacity, std::size_t& size) {
+      size = 0;
+      while (size < capacity) {
+        if (Refill() != 0) {
+          return 1;
+        }
+        // Once the input is used up, a member in progress may still hold
+        // output that did not fit into the previous block.
+        if (position_ == input_size_ && !is_in_frame_) {
+          break;
+        }
+        // zlib counts in 32-bit units.
+        const uInt input_chunk = static_cast<uInt>(
+            std::min<std::size_t>(input_size_ - position_, 1u << 30));
+        inflate_.next_in = reinterpret_cast<Bytef*>(
+            const_cast<char*>(input_ + position_));
+        inflate_.avail_in = input_chunk;
+        inflate_.next_out = reinterpret_cast<Bytef*>(output + size);
+        inflate_.avail_out = static_cast<uInt>(capacity - size);
+        const int result = inflate(&inflate_, Z_NO_FLUSH);
+        const std::size_t consumed = input_chunk - inflate_.avail_in;
+        const std::size_t previous_size = size;
+        position_ += consumed;
+        size = capacity - inflate_.avail_out;
+        is_in_frame_ = true;
+        if (result == Z_STREAM_END) {
+          // Concatenated gzip members decode as one stream.
+          is_in_frame_ = false;
+          if (inflateReset(&inflate_) != Z_OK) {
+            return 1;
+          }
+        } else if (result == Z_BUF_ERROR && consumed == 0 &&
+                   size == previous_size) {
+          // Nothing left to decode: the input ends inside a member.
+          break;
+        } else if (result != Z_OK) {
+          return 1;
+        }
+      }
+      // Input that ends inside a member is truncated.
+      return size == 0 && is_in_frame_ ? 1 : 0;
+    }
+#endif
+
+#ifdef OBJ_PARSER_ZSTD
+    int ReadZstd(char* output, std::size_t capacity, std::size_t& size) {
+      ZSTD_outBuffer out = {output, capacity, 0};
+      while (out.pos < out.size) {
+        if (Refill() != 0) {
+          return 1;
+        }
+        // As for gzip, a frame in progress may still hold output.
+        if (position_ == input_size_ && !is_in_frame_) {
+          break;
+        }
+        ZSTD_inBuffer input = {input_, input_size_, position_};
+        const std::size_t previous_pos = out.pos;
+        const std::size_t result = ZSTD_decompressStream(zstd_, &out, &input);
+        if (ZSTD_isError(result)) {
+          return 1;
+        }
+        const bool made_progress =
+            input.pos != position_ || out.pos != previous_pos;
+        position_ = input.pos;
+        // 0 once a frame is complete; frames that follow decode in turn.
+        is_in_frame_ = result != 0;
+        if (!made_progress) {
+          // The input ends inside a frame.
+          break;
+        }
+      }
+      size = out.pos;
+      return size == 0 && is_in_frame_ ? 1 : 0;
+    }
+#endif
+
+    Compression compression_ = Compression::kNone;
+    const char* input_ = nullptr;
+    std::size_t input_size_ = 0;
+    std::size_t position_ = 0;
+    BlockReader* source_ = nullptr;
+    bool is_in_frame_ = false;
+#ifdef OBJ_PARSER_ZLIB
+    z_stream inflate_;
+#endif
+#ifdef OBJ_PARSER_ZSTD
+    ZSTD_DStream* zstd_ = nullptr;
+#endif
+  };
+
+  MappedFile file_;
+  int fd_ = -1;
+  bool is_fd_owned_ = false;
+  std::istream* stream_ = nullptr;
+  AlignedBuffer input_buffer_;
+  const char* input_ = nullptr;
+  std::size_t input_size_ = 0;
+  bool is_open_ = false;
+  Compression compression_ = Compression::kNone;
+  AlignedBuffer blocks_[kBlockCount];
+  std::size_t sizes_[kBlockCount] = {};
+  // Blocks filled and blocks released since Open; the ones in between are
+  // waiting for the consumer or held by it. Each is written by one thread
+  // only, and they sit on separate cache lines so that the two threads do
+  // not contend for one.
+  alignas(64) std::atomic<std::uint64_t> produced_{0};
+  alignas(64) std::atomic<std::uint64_t> consumed_{0};
+  alignas(64) bool is_holding_block_ = false;
+  std::atomic<bool> is_done_{false};
+  std::atomic<bool> is_stopping_{false};
+  std::atomic<int> status_{0};
+  // Set by a side about to sleep, so the other knows to wake it.
+  std::atomic<bool> is_producer_waiting_{false};
+  std::atomic<bool> is_consumer_waiting_{false};
+  std::thread producer_;
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  // Start of a line split across blocks.
+  std::string carry_;
+};
+
+#endif  // _BLOCK_READER_H_
@@ -0,0 +1,34 @@
+#ifndef _KEYWORD_CODE_H_
+#define _KEYWORD_CODE_H_
+
+#include <cstdint>
+#include <string_view>
+
+// Code of keywords that cannot be packed: longer than 8 characters or
+// holding a NUL.
+constexpr std::uint64_t kUnpackedKeyword = ~std::uint64_t{0};
+
+// Packs a keyword of up to 8 characters into an integer, one byte per
+// character, so that parsers can switch on it. Distinct keywords get
+// distinct codes, and as a constant expression the case labels cost
+// nothing at run time:
+//
+//   switch (KeywordCode(kwd)) {
+//     case KeywordCode("v"):
+//       ...
+//   }
+constexpr std::uint64_t KeywordCode(std::string_view keyword) {
+  if (keyword.size() > 8) {
+    return kUnpackedKeyword;
+  }
+  std::uint64_t code = 0;
+  for (char c : keyword) {
+    if (c == '\0') {
+      return kUnpackedKeyword;
+    }
+    code = code << 8 | static_cast<unsigned char>(c);
+  }
+  return code;
+}
+
+#endif  // _KEYWORD_CODE_H_
@@ -0,0 +1,562 @@
+#ifndef _MESH_SIMPLIFIER_H_
+#define _MESH_SIMPLIFIER_H_
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Quadric error metric simplification (Garland and Heckbert, "Surface
+// Simplification Using Quadric Error Metrics", 1997) of the triangle lists of
+// one mesh. Edges are removed by half-edge collapses, so the remaining
+// triangles index the original vertices and no vertex data is written.
+//
+// A UV or normal seam is where two vertices share a position. Its vertices
+// only slide along the seam, together with their sibling on the other side,
+// so both sides keep matching edges; seam and border edges also get a plane
+// that keeps them from drifting. Vertices are locked in place when they lie
+// on an open border, on a non-manifold edge, between triangles of different
+// groups or where more than one seam meets. Everything else may collapse
+// into a neighbor, which keeps seams, holes and material boundaries intact.
+// Collapses run in passes ordered by error; each pass only touches disjoint
+// neighborhoods, which keeps the result independent of scheduling.
+class MeshSimplifier {
+ public:
+  // groups are triangle lists over one shared vertex buffer, and position(v)
+  // returns the x, y and z of vertex v.
+  template <class T, class F>
+  MeshSimplifier(const std::vector<const std::vector<T>*>& groups,
+                 F&& position) {
+    Localize(groups);
+    positions_.resize(vertices_.size());
+    for (std::size_t v = 0; v < vertices_.size(); v++) {
+      const auto& p = position(vertices_[v]);
+      positions_[v] = {static_cast<double>(p[0]), static_cast<double>(p[1]),
+                       static_cast<double>(p[2])};
+    }
+    AssignPositionIds();
+    BuildAdjacency();
+    ClassifyPositions();
+    ComputeQuadrics();
+  }
+
+  std::size_t triangle_count() const { return triangles_.size(); }
+
+  // Largest dimension of the mesh bounds; errors are relative to it.
+  double extent() const { return extent_; }
+
+  // Collapses edges until at most target_triangle_count triangles remain or
+  // the cheapest collapse left would move the surface by more than
+  // max_error times extent(). Can be called repeatedly with decreasing
+  // targets to build a chain of levels. Returns the largest relative error
+  // of all collapses so far.
+  double Simplify(std::size_t target_triangle_count, double max_error) {
+    std::vector<Collapse> collapses;
+    std::vector<bool> is_touched(position_count_);
+    while (triangles_.size() > target_triangle_count) {
+      BuildAdjacency();
+      collapses.clear();
+      for (const Triangle& triangle : triangles_) {
+        for (std::size_t c = 0; c < 3; c++) {
+          AddCollapse(triangle.corners[c], triangle.corners[(c + 1) % 3],
+                      collapses);
+          AddCollapse(triangle.corners[(c + 1) % 3], triangle.corners[c],
+                      collapses);
+        }
+      }
+      if (collapses.empty()) {
+        break;
+      }
+      std::sort(collapses.begin(), collapses.end());
+      collapses.erase(std::unique(collapses.begin(), collapses.end()),
+                      collapses.end());
+
+      std::fill(is_touched.begin(), is_touched.end(), false);
+      std::size_t triangle_count = triangles_.size();
+      bool has_collapsed = false;
+      bool is_error_bound_hit = false;
+      for (const Collapse& collapse : collapses) {
+        if (triangle_count <= target_triangle_count) {
+          break;
+        }
+        const double error = std::sqrt(std::max(collapse.cost, 0.0)) / extent_;
+        if (error > max_error) {
+          is_error_bound_hit = true;
+          break;
+        }
+        const std::uint32_t a = collapse.from;
+        const std::uint32_t b = collapse.to;
+        const bool is_seam = collapse.sibling_from != kNoVertex;
+        if (is_touched[position_ids_[a]] || is_touched[position_ids_[b]] ||
+            Flips(a, b) ||
+            (is_seam && Flips(collapse.sibling_from, collapse.sibling_to))) {
+          continue;
+        }
+        triangle_count -= Touch(a, b, is_touched);
+        remap_[a] = b;
+        if (is_seam) {
+          triangle_count -=
+              Touch(collapse.sibling_from, collapse.sibling_to, is_touched);
+          remap_[collapse.sibling_from] = collapse.sibling_to;
+        }
+        quadrics_[position_ids_[b]] += quadrics_[position_ids_[a]];
+        max_error_ = std::max(max_error_, error);
+        has_collapsed = true;
+      }
+      ApplyRemap();
+      if (!has_collapsed || is_error_bound_hit) {
+        break;
+      }
+    }
+    return max_error_;
+  }
+
+  // The current triangles of group, as indices into the original vertices.
+  template <class T>
+  void GetIndexBuffer(std::size_t group, std::vector<T>& indices) const {
+    indices.clear();
+    for (const Triangle& triangle : triangles_) {
+      if (triangle.group == group) {
+        for (std::uint32_t corner : triangle.corners) {
+          indices.push_back(static_cast<T>(vertices_[corner]));
+        }
+      }
+    }
+  }
+
+ private:
+  struct Triangle {
+    std::array<std::uint32_t, 3> corners;
+    std::uint32_t group;
+  };
+
+  enum PositionKind : std::uint8_t { kManifold, kSeam, kLocked };
+
+  struct Collapse {
+    double cost;
+    std::uint32_t from;
+    std::uint32_t to;
+    // The other vertex of a seam position and where it goes, or kNoVertex.
+    std::uint32_t sibling_from;
+    std::uint32_t sibling_to;
+
+    bool operator<(const Collapse& rhs) const {
+      if (cost != rhs.cost) {
+        return cost < rhs.cost;
+      }
+      return from != rhs.from ? from < rhs.from : to < rhs.to;
+    }
+    bool operator==(const Collapse& rhs) const {
+      return from == rhs.from && to == rhs.to;
+    }
+  };
+
+  // Symmetric 4x4 matrix of a sum of area-weighted squared plane distances.
+  struct Quadric {
+    double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+    double b0 = 0, b1 = 0, b2 = 0, c = 0;
+    double weight = 0;
+
+    static Quadric FromPlane(const std::array<double, 3>& n, double d,
+                             double weight) {
+      Quadric q;
+      q.a00 = weight * n[0] * n[0];
+      q.a01 = weight * n[0] * n[1];
+      q.a02 = weight * n[0] * n[2];
+      q.a11 = weight * n[1] * n[1];
+      q.a12 = weight * n[1] * n[2];
+      q.a22 = weight * n[2] * n[2];
+      q.b0 = weight * n[0] * d;
+      q.b1 = weight * n[1] * d;
+      q.b2 = weight * n[2] * d;
+      q.c = weight * d * d;
+      q.weight = weight;
+      return q;
+    }
+
+    Quadric& operator+=(const Quadric& rhs) {
+      a00 += rhs.a00;
+      a01 += rhs.a01;
+      a02 += rhs.a02;
+      a11 += rhs.a11;
+      a12 += rhs.a12;
+      a22 += rhs.a22;
+      b0 += rhs.b0;
+      b1 += rhs.b1;
+      b2 += rhs.b2;
+      c += rhs.c;
+      weight += rhs.weight;
+      return *this;
+    }
+
+    friend Quadric operator+(Quadric lhs, const Quadric& rhs) {
+      return lhs += rhs;
+    }
+
+    // Mean squared distance of p to the planes.
+    double Evaluate(const std::array<double, 3>& p) const {
+      const double x = p[0];
+      const double y = p[1];
+      const double z = p[2];
+      const double sum = a00 * x * x + 2 * a01 * x * y + 2 * a02 * x * z +
+                         a11 * y * y + 2 * a12 * y * z + a22 * z * z +
+                         2 * (b0 * x + b1 * y + b2 * z) + c;
+      return weight == 0 ? 0 : sum / weight;
+    }
+  };
+
+  template <class T>
+  void Localize(const std::vector<const std::vector<T>*>& groups) {
+    for (const std::vector<T>* indices : groups) {
+      vertices_.insert(vertices_.end(), indices->begin(),
+                       indices->begin() + indices->size() / 3 * 3);
+    }
+    std::sort(vertices_.begin(), vertices_.end());
+    vertices_.erase(std::unique(vertices_.begin(), vertices_.end()),
+                    vertices_.end());
+    for (std::size_t g = 0; g < groups.size(); g++) {
+      const std::vector<T>& indices = *groups[g];
+      for (std::size_t i = 0; i + 2 < indices.size(); i += 3) {
+        Triangle triangle;
+        triangle.group = static_cast<std::uint32_t>(g);
+        for (std::size_t c = 0; c < 3; c++) {
+          triangle.corners[c] = static_cast<std::uint32_t>(
+              std::lower_bound(vertices_.begin(), vertices_.end(),
+                               static_cast<std::size_t>(indices[i + c])) -
+              vertices_.begin());
+        }
+        triangles_.push_back(triangle);
+      }
+    }
+    remap_.resize(vertices_.size());
+    for (std::size_t v = 0; v < remap_.size(); v++) {
+      remap_[v] = static_cast<std::uint32_t>(v);
+    }
+  }
+
+  // Vertices at the same position share an id, and position_vertices_
+  // lists them by position.
+  void AssignPositionIds() {
+    std::vector<std::uint32_t>& order = position_vertices_;
+    order.resize(vertices_.size());
+    for (std::size_t v = 0; v < order.size(); v++) {
+      order[v] = static_cast<std::uint32_t>(v);
+    }
+    std::sort(order.begin(), order.end(),
+              [this](std::uint32_t lhs, std::uint32_t rhs) {
+                return positions_[lhs] != positions_[rhs]
+                           ? positions_[lhs] < positions_[rhs]
+                           : lhs < rhs;
+              });
+    position_ids_.resize(vertices_.size());
+    position_vertex_offsets_.clear();
+    for (std::size_t i = 0; i < order.size(); i++) {
+      if (i == 0 || positions_[order[i]] != positions_[order[i - 1]]) {
+        position_vertex_offsets_.push_back(static_cast<std::uint32_t>(i));
+      }
+      position_ids_[order[i]] =
+          static_cast<std::uint32_t>(position_vertex_offsets_.size() - 1);
+    }
+    position_count_ = position_vertex_offsets_.size();
+    position_vertex_offsets_.push_back(static_cast<std::uint32_t>(
+        order.size()));
+    std::array<double, 3> low = {0, 0, 0};
+    std::array<double, 3> high = {0, 0, 0};
+    for (std::size_t v = 0; v < positions_.size(); v++) {
+      for (int k = 0; k < 3; k++) {
+        low[k] = v == 0 ? positions_[v][k] : std::min(low[k], positions_[v][k]);
+        high[k] =
+            v == 0 ? positions_[v][k] : std::max(high[k], positions_[v][k]);
+      }
+    }
+    extent_ = std::max({high[0] - low[0], high[1] - low[1], high[2] - low[2]});
+    if (extent_ == 0) {
+      extent_ = 1;
+    }
+  }
+
+  // A position is manifold when its one vertex has no open edge, and a seam
+  // when it has two vertices with one open edge in and one out each, so a
+  // single seam passes through. Any other position is locked, as are those
+  // on open or non-manifold edges and those shared by triangles of different
+  // groups.
+  void ClassifyPositions() {
+    std::vector<std::uint32_t> open_in(vertices_.size(), 0);
+    std::vector<std::uint32_t> open_out(vertices_.size(), 0);
+    for (const Triangle& triangle : triangles_) {
+      for (std::size_t c = 0; c < 3; c++) {
+        const std::uint32_t a = triangle.corners[c];
+        const std::uint32_t b = triangle.corners[(c + 1) % 3];
+        if (!HasEdge(b, a)) {
+          open_out[a]++;
+          open_in[b]++;
+        }
+      }
+    }
+    kinds_.resize(position_count_);
+    for (std::size_t p = 0; p < position_count_; p++) {
+      const std::uint32_t vertex_count =
+          position_vertex_offsets_[p + 1] - position_vertex_offsets_[p];
+      kinds_[p] = vertex_count == 1   ? kManifold
+                  : vertex_count == 2 ? kSeam
+                                      : kLocked;
+    }
+    for (std::size_t v = 0; v < vertices_.size(); v++) {
+      std::uint8_t& kind = kinds_[position_ids_[v]];
+      if ((kind == kManifold && (open_in[v] != 0 || open_out[v] != 0)) ||
+          (kind == kSeam && (open_in[v] != 1 || open_out[v] != 1))) {
+        kind = kLocked;
+      }
+    }
+
+    std::vector<std::array<std::uint32_t, 3>> edges;
+    edges.reserve(triangles_.size() * 3);
+    std::vector<std::uint32_t> position_groups(position_count_, kNoGroup);
+    for (const Triangle& triangle : triangles_) {
+      for (std::size_t c = 0; c < 3; c++) {
+        const std::uint32_t p = position_ids_[triangle.corners[c]];
+        const std::uint32_t q = position_ids_[triangle.corners[(c + 1) % 3]];
+        edges.push_back({std::min(p, q), std::max(p, q), triangle.group});
+        if (position_groups[p] == kNoGroup) {
+          position_groups[p] = triangle.group;
+        } else if (position_groups[p] != triangle.group) {
+          kinds_[p] = kLocked;
+        }
+      }
+    }
+    std::sort(edges.begin(), edges.end());
+    for (std::size_t i = 0; i < edges.size();) {
+      std::size_t j = i;
+      while (j < edges.size() && edges[j][0] == edges[i][0] &&
+             edges[j][1] == edges[i][1]) {
+        j++;
+      }
+      if (j - i != 2) {
+        kinds_[edges[i][0]] = kLocked;
+        kinds_[edges[i][1]] = kLocked;
+      }
+      i = j;
+    }
+  }
+
+  void ComputeQuadrics() {
+    quadrics_.assign(position_count_, Quadric());
+    for (const Triangle& triangle : triangles_) {
+      const std::array<double, 3>& p0 = positions_[triangle.corners[0]];
+      std::array<double, 3> n =
+          Normal(p0, triangle.corners[1], triangle.corners[2]);
+      const double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+      if (length == 0) {
+        continue;
+      }
+      for (double& component : n) {
+        component /= length;
+      }
+      const double d = -(n[0] * p0[0] + n[1] * p0[1] + n[2] * p0[2]);
+      const Quadric quadric = Quadric::FromPlane(n, d, length * 0.5);
+      for (std::uint32_t corner : triangle.corners) {
+        quadrics_[position_ids_[corner]] += quadric;
+      }
+      // Open edges get the plane through them at right angles to the
+      // triangle, weighted by their squared length.
+      for (std::size_t c = 0; c < 3; c++) {
+        const std::uint32_t a = triangle.corners[c];
+        const std::uint32_t b = triangle.corners[(c + 1) % 3];
+        if (HasEdge(b, a)) {
+          continue;
+        }
+        const std::array<double, 3>& pa = positions_[a];
+        const std::array<double, 3>& pb = positions_[b];
+        const std::array<double, 3> e = {pb[0] - pa[0], pb[1] - pa[1],
+                                         pb[2] - pa[2]};
+        std::array<double, 3> m = {e[1] * n[2] - e[2] * n[1],
+                                   e[2] * n[0] - e[0] * n[2],
+                                   e[0] * n[1] - e[1] * n[0]};
+        const double edge_length =
+            std::sqrt(m[0] * m[0] + m[1] * m[1] + m[2] * m[2]);
+        if (edge_length == 0) {
+          continue;
+        }
+        for (double& component : m) {
+          component /= edge_length;
+        }
+        const Quadric edge_quadric = Quadric::FromPlane(
+            m, -(m[0] * pa[0] + m[1] * pa[1] + m[2] * pa[2]),
+            edge_length * edge_length);
+        quadrics_[position_ids_[a]] += edge_quadric;
+        quadrics_[position_ids_[b]] += edge_quadric;
+      }
+    }
+  }
+
+  // Cross product of the edges of the triangle (p, b, c).
+  std::array<double, 3> Normal(const std::array<double, 3>& p, std::uint32_t b,
+                               std::uint32_t c) const {
+    const std::array<double, 3>& pb = positions_[b];
+    const std::array<double, 3>& pc = positions_[c];
+    const double e1[3] = {pb[0] - p[0], pb[1] - p[1], pb[2] - p[2]};
+    const double e2[3] = {pc[0] - p[0], pc[1] - p[1], pc[2] - p[2]};
+    return {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2],
+            e1[0] * e2[1] - e1[1] * e2[0]};
+  }
+
+  // Adds the collapse of a onto b, costed by the quadrics of both ends at
+  // b. A seam vertex only goes along a seam edge, and its sibling along the
+  // matching edge on the other side.
+  void AddCollapse(std::uint32_t a, std::uint32_t b,
+                   std::vector<Collapse>& collapses) const {
+    const std::uint32_t p = position_ids_[a];
+    const std::uint32_t q = position_ids_[b];
+    Collapse collapse = {(quadrics_[p] + quadrics_[q]).Evaluate(positions_[b]),
+                         a, b, kNoVertex, kNoVertex};
+    if (kinds_[p] == kSeam) {
+      if (!IsSeamEdge(a, b)) {
+        return;
+      }
+      const std::uint32_t* first = &position_vertices_[0];
+      collapse.sibling_from = first[position_vertex_offsets_[p]] == a
+                                  ? first[position_vertex_offsets_[p] + 1]
+                                  : first[position_vertex_offsets_[p]];
+      for (std::uint32_t i = position_vertex_offsets_[q];
+           i < position_vertex_offsets_[q + 1]; i++) {
+        if (IsSeamEdge(collapse.sibling_from, first[i])) {
+          collapse.sibling_to = first[i];
+        }
+      }
+      if (collapse.sibling_to == kNoVertex) {
+        return;
+      }
+    } else if (kinds_[p] != kManifold) {
+      return;
+    }
+    collapses.push_back(collapse);
+  }
+
+  // True if a current triangle has the directed edge from -> to.
+  bool HasEdge(std::uint32_t from, std::uint32_t to) const {
+    for (std::uint32_t k = adjacency_offsets_[from];
+         k < adjacency_offsets_[from + 1]; k++) {
+      const Triangle& triangle = triangles_[adjacency_[k]];
+      for (std::size_t c = 0; c < 3; c++) {
+        if (triangle.corners[c] == from &&
+            triangle.corners[(c + 1) % 3] == to) {
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  // True if the edge between a and b has triangles on one side only.
+  bool IsSeamEdge(std::uint32_t a, std::uint32_t b) const {
+    return HasEdge(a, b) != HasEdge(b, a);
+  }
+
+  // Marks the positions around a as touched and returns how many of its
+  // triangles moving a onto b removes.
+  std::size_t Touch(std::uint32_t a, std::uint32_t b,
+                    std::vector<bool>& is_touched) const {
+    std::size_t degenerate_count = 0;
+    for (std::uint32_t k = adjacency_offsets_[a]; k < adjacency_offsets_[a + 1];
+         k++) {
+      const Triangle& triangle = triangles_[adjacency_[k]];
+      bool is_degenerate = false;
+      for (std::uint32_t corner : triangle.corners) {
+        is_touched[position_ids_[corner]] = true;
+        is_degenerate =
+            is_degenerate || position_ids_[corner] == position_ids_[b];
+      }
+      degenerate_count += is_degenerate;
+    }
+    return degenerate_count;
+  }
+
+  // True if moving a onto b turns any surviving triangle around a over.
+  bool Flips(std::uint32_t a, std::uint32_t b) const {
+    for (std::uint32_t k = adjacency_offsets_[a]; k < adjacency_offsets_[a + 1];
+         k++) {
+      const Triangle& triangle = triangles_[adjacency_[k]];
+      std::size_t c = 0;
+      while (triangle.corners[c] != a) {
+        c++;
+      }
+      const std::uint32_t next = triangle.corners[(c + 1) % 3];
+      const std::uint32_t prev = triangle.corners[(c + 2) % 3];
+      if (position_ids_[next] == position_ids_[b] ||
+          position_ids_[prev] == position_ids_[b]) {
+        continue;
+      }
+      const std::array<double, 3> before = Normal(positions_[a], next, prev);
+      const std::array<double, 3> after = Normal(positions_[b], next, prev);
+      if (before[0] * after[0] + before[1] * after[1] + before[2] * after[2] <=
+          0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void BuildAdjacency() {
+    adjacency_offsets_.assign(vertices_.size() + 1, 0);
+    for (const Triangle& triangle : triangles_) {
+      for (std::uint32_t corner : triangle.corners) {
+        adjacency_offsets_[corner + 1]++;
+      }
+    }
+    for (std::size_t v = 0; v < vertices_.size(); v++) {
+      adjacency_offsets_[v + 1] += adjacency_offsets_[v];
+    }
+    adjacency_.resize(triangles_.size() * 3);
+    std::vector<std::uint32_t> cursors(adjacency_offsets_.begin(),
+                                       adjacency_offsets_.end() - 1);
+    for (std::size_t t = 0; t < triangles_.size(); t++) {
+      for (std::uint32_t corner : triangles_[t].corners) {
+        adjacency_[cursors[corner]++] = static_cast<std::uint32_t>(t);
+      }
+    }
+  }
+
+  // Points collapsed corners at their targets and drops triangles that
+  // lost their area.
+  void ApplyRemap() {
+    std::size_t kept = 0;
+    for (const Triangle& triangle : triangles_) {
+      Triangle remapped = triangle;
+      for (std::uint32_t& corner : remapped.corners) {
+        corner = remap_[corner];
+      }
+      const std::uint32_t p0 = position_ids_[remapped.corners[0]];
+      const std::uint32_t p1 = position_ids_[remapped.corners[1]];
+      const std::uint32_t p2 = position_ids_[remapped.corners[2]];
+      if (p0 != p1 && p1 != p2 && p2 != p0) {
+        triangles_[kept++] = remapped;
+      }
+    }
+    triangles_.resize(kept);
+  }
+
+  static constexpr std::uint32_t kNoGroup = 0xFFFFFFFF;
+  static constexpr std::uint32_t kNoVertex = 0xFFFFFFFF;
+
+  // Original vertex indices of the local vertices, ascending.
+  std::vector<std::size_t> vertices_;
+  std::vector<std::array<double, 3>> positions_;
+  std::vector<std::uint32_t> position_ids_;
+  std::size_t position_count_ = 0;
+  // Local vertices sorted by position, the ones of position p starting at
+  // position_vertex_offsets_[p].
+  std::vector<std::uint32_t> position_vertices_;
+  std::vector<std::uint32_t> position_vertex_offsets_;
+  std::vector<std::uint8_t> kinds_;
+  std::vector<Quadric> quadrics_;
+  std::vector<Triangle> triangles_;
+  std::vector<std::uint32_t> remap_;
+  std::vector<std::uint32_t> adjacency_offsets_;
+  std::vector<std::uint32_t> adjacency_;
+  double extent_ = 1;
+  double max_error_ = 0;
+};
+
+#endif  // _MESH_SIMPLIFIER_H_
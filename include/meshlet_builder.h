@@ -0,0 +1,321 @@
+#ifndef _MESHLET_BUILDER_H_
+#define _MESHLET_BUILDER_H_
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A cluster of at most a few hundred triangles that a mesh shader or a GPU
+// culling pass handles as a unit.
+struct Meshlet {
+  // First entry of the vertex list Build appends to, and first triangle in
+  // its triangle list, which holds three local indices per triangle.
+  std::uint32_t vertex_offset = 0;
+  std::uint32_t triangle_offset = 0;
+  std::uint32_t vertex_count = 0;
+  std::uint32_t triangle_count = 0;
+  std::array<float, 3> center = {0.f, 0.f, 0.f};
+  float radius = 0.f;
+  // Every triangle faces away from a camera at c if
+  // dot(normalize(cone_apex - c), cone_axis) >= cone_cutoff. A cutoff of 1
+  // means the triangles face too many ways to be culled together.
+  std::array<float, 3> cone_apex = {0.f, 0.f, 0.f};
+  std::array<float, 3> cone_axis = {0.f, 0.f, 0.f};
+  float cone_cutoff = 1.f;
+};
+
+// Partitions triangle lists into meshlets. Each meshlet starts at the first
+// triangle not yet assigned and grows by the adjacent triangle that adds the
+// fewest new vertices, so meshlets stay compact without depending on the
+// input order. Output depends only on the input. Scratch space is kept
+// between calls.
+class MeshletBuilder {
+ public:
+  static constexpr std::size_t kMaxVertices = 256;
+
+  MeshletBuilder(std::size_t max_vertices, std::size_t max_triangles)
+      : max_vertices_(std::clamp<std::size_t>(max_vertices, 3, kMaxVertices)),
+        max_triangles_(std::max<std::size_t>(max_triangles, 1)) {}
+
+  // Appends the meshlets of a triangle list. vertices receives the global
+  // vertex index of every meshlet local vertex and triangles three local
+  // indices per triangle. position(v) returns the x, y and z of vertex v.
+  template <class T, class F>
+  void Build(const std::vector<T>& indices, F&& position,
+             std::vector<Meshlet>& meshlets, std::vector<T>& vertices,
+             std::vector<std::uint8_t>& triangles) {
+    const std::size_t triangle_count = indices.size() / 3;
+    const std::size_t vertex_count = Localize(indices);
+    BuildAdjacency(vertex_count, triangle_count);
+    is_assigned_.assign(triangle_count, false);
+    local_ids_.assign(vertex_count, kNone);
+
+    std::size_t next_seed = 0;
+    Meshlet meshlet;
+    meshlet.vertex_offset = static_cast<std::uint32_t>(vertices.size());
+    meshlet.triangle_offset = static_cast<std::uint32_t>(triangles.size() / 3);
+    members_.clear();
+    for (;;) {
+      std::size_t triangle = BestAdjacentTriangle();
+      if (triangle == kNone) {
+        while (next_seed < triangle_count && is_assigned_[next_seed]) {
+          next_seed++;
+        }
+        if (next_seed == triangle_count) {
+          break;
+        }
+        triangle = next_seed;
+      }
+      if (!Fits(meshlet, triangle)) {
+        Finish(meshlet, position, meshlets, vertices, triangles);
+        continue;
+      }
+      is_assigned_[triangle] = true;
+      for (std::size_t c = 0; c < 3; c++) {
+        const std::uint32_t vertex = local_indices_[triangle * 3 + c];
+        if (local_ids_[vertex] == kNone) {
+          local_ids_[vertex] = meshlet.vertex_count++;
+          vertices.push_back(indices[triangle * 3 + c]);
+          members_.push_back(vertex);
+        }
+        triangles.push_back(static_cast<std::uint8_t>(local_ids_[vertex]));
+      }
+      meshlet.triangle_count++;
+    }
+    if (meshlet.triangle_count != 0) {
+      Finish(meshlet, position, meshlets, vertices, triangles);
+    }
+  }
+
+ private:
+  static constexpr std::size_t kNone = static_cast<std::size_t>(-1);
+
+  bool Fits(const Meshlet& meshlet, std::size_t triangle) const {
+    return meshlet.triangle_count < max_triangles_ &&
+           meshlet.vertex_count + NewVertexCount(triangle) <= max_vertices_;
+  }
+
+  std::size_t NewVertexCount(std::size_t triangle) const {
+    std::size_t count = 0;
+    for (std::size_t c = 0; c < 3; c++) {
+      count += local_ids_[local_indices_[triangle * 3 + c]] == kNone;
+    }
+    return count;
+  }
+
+  // The unassigned triangle touching the current meshlet that adds the
+  // fewest vertices and still fits, lowest index first.
+  std::size_t BestAdjacentTriangle() const {
+    std::size_t best = kNone;
+    std::size_t best_new_vertices = 3;
+    for (std::uint32_t vertex : members_) {
+      for (std::uint32_t k = adjacency_offsets_[vertex];
+           k < adjacency_offsets_[vertex + 1]; k++) {
+        const std::size_t triangle = adjacency_[k];
+        if (is_assigned_[triangle]) {
+          continue;
+        }
+        const std::size_t new_vertices = NewVertexCount(triangle);
+        if (members_.size() + new_vertices > max_vertices_) {
+          continue;
+        }
+        if (new_vertices < best_new_vertices ||
+            (new_vertices == best_new_vertices && triangle < best)) {
+          best = triangle;
+          best_new_vertices = new_vertices;
+        }
+      }
+    }
+    return best;
+  }
+
+  // Computes the bounds of meshlet, appends it and starts the next one.
+  template <class T, class F>
+  void Finish(Meshlet& meshlet, F&& position, std::vector<Meshlet>& meshlets,
+              const std::vector<T>& vertices,
+              const std::vector<std::uint8_t>& triangles) {
+    ComputeBoundingSphere(meshlet, &vertices[meshlet.vertex_offset], position);
+    ComputeNormalCone(meshlet, &vertices[meshlet.vertex_offset],
+                      &triangles[meshlet.triangle_offset * 3], position);
+    meshlets.push_back(meshlet);
+    for (std::uint32_t vertex : members_) {
+      local_ids_[vertex] = kNone;
+    }
+    members_.clear();
+    meshlet = Meshlet();
+    meshlet.vertex_offset = static_cast<std::uint32_t>(vertices.size());
+    meshlet.triangle_offset = static_cast<std::uint32_t>(triangles.size() / 3);
+  }
+
+  // Ritter's sphere: the diameter spanned by the vertices farthest apart
+  // along a sweep, grown to cover every vertex.
+  template <class T, class F>
+  static void ComputeBoundingSphere(Meshlet& meshlet, const T* vertices,
+                                    F&& position) {
+    auto distance2 = [](const std::array<float, 3>& a,
+                        const std::array<float, 3>& b) {
+      const float dx = a[0] - b[0];
+      const float dy = a[1] - b[1];
+      const float dz = a[2] - b[2];
+      return dx * dx + dy * dy + dz * dz;
+    };
+    auto farthest = [&](const std::array<float, 3>& from) {
+      std::array<float, 3> best = from;
+      float best_distance2 = -1.f;
+      for (std::uint32_t i = 0; i < meshlet.vertex_count; i++) {
+        const std::array<float, 3> p = Position(position, vertices[i]);
+        const float d2 = distance2(p, from);
+        if (d2 > best_distance2) {
+          best = p;
+          best_distance2 = d2;
+        }
+      }
+      return best;
+    };
+    const std::array<float, 3> a = farthest(Position(position, vertices[0]));
+    const std::array<float, 3> b = farthest(a);
+    std::array<float, 3> center = {(a[0] + b[0]) * 0.5f, (a[1] + b[1]) * 0.5f,
+                                   (a[2] + b[2]) * 0.5f};
+    float radius = std::sqrt(distance2(a, b)) * 0.5f;
+    for (std::uint32_t i = 0; i < meshlet.vertex_count; i++) {
+      const std::array<float, 3> p = Position(position, vertices[i]);
+      const float d = std::sqrt(distance2(p, center));
+      if (d > radius) {
+        const float grown = (radius + d) * 0.5f;
+        const float shift = (grown - radius) / d;
+        for (int k = 0; k < 3; k++) {
+          center[k] += (p[k] - center[k]) * shift;
+        }
+        radius = grown;
+      }
+    }
+    meshlet.center = center;
+    meshlet.radius = radius;
+  }
+
+  // Cone around the mean triangle normal with its apex moved back far
+  // enough that the culling test is conservative for every triangle.
+  template <class T, class F>
+  static void ComputeNormalCone(Meshlet& meshlet, const T* vertices,
+                                const std::uint8_t* triangles, F&& position) {
+    std::vector<std::array<float, 4>> normals(meshlet.triangle_count);
+    std::array<float, 3> axis = {0.f, 0.f, 0.f};
+    for (std::uint32_t t = 0; t < meshlet.triangle_count; t++) {
+      const std::array<float, 3> p0 =
+          Position(position, vertices[triangles[t * 3]]);
+      const std::array<float, 3> p1 =
+          Position(position, vertices[triangles[t * 3 + 1]]);
+      const std::array<float, 3> p2 =
+          Position(position, vertices[triangles[t * 3 + 2]]);
+      const float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+      const float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+      std::array<float, 3> n = {e1[1] * e2[2] - e1[2] * e2[1],
+                                e1[2] * e2[0] - e1[0] * e2[2],
+                                e1[0] * e2[1] - e1[1] * e2[0]};
+      const float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+      if (length == 0.f) {
+        normals[t] = {0.f, 0.f, 0.f, 0.f};
+        continue;
+      }
+      // The fourth element is the plane offset along the normal, relative
+      // to the sphere center.
+      normals[t] = {n[0] / length, n[1] / length, n[2] / length,
+                    ((p0[0] - meshlet.center[0]) * n[0] +
+                     (p0[1] - meshlet.center[1]) * n[1] +
+                     (p0[2] - meshlet.center[2]) * n[2]) /
+                        length};
+      for (int k = 0; k < 3; k++) {
+        axis[k] += normals[t][k];
+      }
+    }
+    const float axis_length =
+        std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+    meshlet.cone_apex = meshlet.center;
+    meshlet.cone_cutoff = 1.f;
+    if (axis_length == 0.f) {
+      return;
+    }
+    for (int k = 0; k < 3; k++) {
+      axis[k] /= axis_length;
+    }
+    meshlet.cone_axis = axis;
+    float min_dot = 1.f;
+    for (const std::array<float, 4>& n : normals) {
+      if (n[0] != 0.f || n[1] != 0.f || n[2] != 0.f) {
+        min_dot = std::min(
+            min_dot, n[0] * axis[0] + n[1] * axis[1] + n[2] * axis[2]);
+      }
+    }
+    if (min_dot <= 0.f) {
+      return;
+    }
+    float max_t = 0.f;
+    for (const std::array<float, 4>& n : normals) {
+      const float dn = n[0] * axis[0] + n[1] * axis[1] + n[2] * axis[2];
+      if (dn > 0.f) {
+        max_t = std::max(max_t, n[3] / dn);
+      }
+    }
+    for (int k = 0; k < 3; k++) {
+      meshlet.cone_apex[k] = meshlet.center[k] - axis[k] * max_t;
+    }
+    meshlet.cone_cutoff = std::sqrt(1.f - min_dot * min_dot);
+  }
+
+  template <class F, class T>
+  static std::array<float, 3> Position(F& position, T vertex) {
+    const auto& p = position(vertex);
+    return {static_cast<float>(p[0]), static_cast<float>(p[1]),
+            static_cast<float>(p[2])};
+  }
+
+  template <class T>
+  std::size_t Localize(const std::vector<T>& indices) {
+    const std::size_t count = indices.size() / 3 * 3;
+    sorted_.assign(indices.begin(), indices.begin() + count);
+    std::sort(sorted_.begin(), sorted_.end());
+    sorted_.erase(std::unique(sorted_.begin(), sorted_.end()), sorted_.end());
+    local_indices_.resize(count);
+    for (std::size_t i = 0; i < count; i++) {
+      local_indices_[i] = static_cast<std::uint32_t>(
+          std::lower_bound(sorted_.begin(), sorted_.end(), indices[i]) -
+          sorted_.begin());
+    }
+    return sorted_.size();
+  }
+
+  void BuildAdjacency(std::size_t vertex_count, std::size_t triangle_count) {
+    adjacency_offsets_.assign(vertex_count + 1, 0);
+    for (std::uint32_t vertex : local_indices_) {
+      adjacency_offsets_[vertex + 1]++;
+    }
+    for (std::size_t v = 0; v < vertex_count; v++) {
+      adjacency_offsets_[v + 1] += adjacency_offsets_[v];
+    }
+    adjacency_.resize(local_indices_.size());
+    std::vector<std::uint32_t> cursors(adjacency_offsets_.begin(),
+                                       adjacency_offsets_.end() - 1);
+    for (std::size_t t = 0; t < triangle_count; t++) {
+      for (std::size_t c = 0; c < 3; c++) {
+        adjacency_[cursors[local_indices_[t * 3 + c]]++] =
+            static_cast<std::uint32_t>(t);
+      }
+    }
+  }
+
+  std::size_t max_vertices_;
+  std::size_t max_triangles_;
+  std::vector<std::uint64_t> sorted_;
+  std::vector<std::uint32_t> local_indices_;
+  std::vector<std::uint32_t> adjacency_offsets_;
+  std::vector<std::uint32_t> adjacency_;
+  std::vector<bool> is_assigned_;
+  // Meshlet local id of every group vertex in the current meshlet, or kNone.
+  std::vector<std::size_t> local_ids_;
+  std::vector<std::uint32_t> members_;
+};
+
+#endif  // _MESHLET_BUILDER_H_
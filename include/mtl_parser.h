@@ -1,20 +1,27 @@
 #ifndef _MATERIAL_PARSER_H_
 #define _MATERIAL_PARSER_H_
 
-#define DEBUG
-
 #define REAL float
 #define INTEGER unsigned int
 
 #include <array>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
 #include <cstdint>
 #include <fstream>
 #include <iostream>
-#include <sstream>
 #include <string>
+#include <string_view>
+#include <system_error>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
+#include "binary_cache.h"
+#include "keyword_code.h"
+#include "parse_stats.h"
+
 struct Material {
   std::string name_;
   std::array<REAL, 3> ambient_color;
@@ -47,292 +54,548 @@ class MTLParser {
   MTLParser& operator=(const MTLParser&) = delete;
   ~MTLParser() = default;
 
-  std::unordered_map<std::string, Material> material_map() const {
+  const std::unordered_map<std::string, Material>& material_map() const {
     return material_map_;
   }
 
-  Material GetMaterial(const std::string& name) {
+  const Material& GetMaterial(const std::string& name) const {
+    static const Material empty_material = Material();
     auto itr = material_map_.find(name);
     if (itr != material_map_.end()) {
       return itr->second;
     }
     // error occur : there is no such material
-    return Material();
+    return empty_material;
+  }
+
+  // Moves the parsed materials out without copying and leaves the parser
+  // empty.
+  std::unordered_map<std::string, Material> Release() {
+    std::unordered_map<std::string, Material> material_map =
+        std::move(material_map_);
+    Clear();
+    return material_map;
+  }
+
+  // Counters and phase times of the last parse of a source file. Only
+  // collected when PARSE_STATS is defined; see parse_stats.h.
+  const ParseStats& stats() const { return stats_; }
+
+  // Directory for binary caches of parsed files; empty disables caching.
+  void set_cache_directory(const std::string& cache_directory) {
+    cache_directory_ = cache_directory;
   }
 
   int Parse(const std::string& path) {
+    if (cache_directory_.empty() || input_stream_.is_open()) {
+      return ParseFile(path);
+    }
+    MappedFile file;
+    if (file.Open(path) != 0) {
+      return ParseFile(path);
+    }
+    const std::uint64_t source_size = file.size();
+    const std::uint64_t source_hash = HashBytes(file.data(), file.size());
+    file.Close();
+    const std::string cache_path =
+        CacheFilePath(cache_directory_, path, CacheFingerprint(), ".mtlcache");
+    if (LoadCache(cache_path, source_size, source_hash) == 0) {
+      return 0;
+    }
+    int result = ParseFile(path);
+    if (result == 0 && WriteCache(cache_path, source_size, source_hash) != 0) {
+#ifdef OBJ_PARSER_DEBUG
+      std::cerr << "[MTLParser] Warning: Failed to write cache: " << cache_path
+                << "\n";
+#endif
+    }
+    return result;
+  }
+
+  // Make Clear(), and so every parse, keep the materials of the previous
+  // result, with their strings and the table's buckets, for reuse. The
+  // memory is only returned when the parser is destroyed.
+  void set_reuse_capacity(bool reuse_capacity) {
+    reuse_capacity_ = reuse_capacity;
+  }
+
+  int Clear() {
+    while (reuse_capacity_ && !material_map_.empty()) {
+      spare_materials_.push_back(material_map_.extract(material_map_.begin()));
+    }
+    material_map_.clear();
+    input_stream_.close();
+    return 0;
+  }
+
+ private:
+  // Fixed-width image of a Material inside a cache file.
+  struct CacheMaterial {
+    CacheStringRef name;
+    std::array<REAL, 3> ambient_color;
+    std::array<REAL, 3> diffuse_color;
+    std::array<REAL, 3> specular_color;
+    std::array<REAL, 3> emmesive_color;
+    std::array<REAL, 3> transmission_filter_color;
+    REAL specular_exponent;
+    REAL opaque;
+    REAL optical_density;
+    std::uint32_t illumination_model;
+    CacheStringRef maps[12];
+  };
+
+  enum CacheSectionId : std::size_t { kCacheStrings, kCacheMaterials };
+
+  static constexpr char kCacheMagic[8] = {'M', 'T', 'L', 'C',
+                                           'A', 'C', 'H', 'E'};
+
+  static constexpr std::string Material::*kMapMembers[12] = {
+      &Material::ambient_map,      &Material::diffuse_map,
+      &Material::specular_map,     &Material::specular_highlight_map,
+      &Material::alpha_map,        &Material::bump_map,
+      &Material::displacement_map, &Material::roughness_map,
+      &Material::metallic_map,     &Material::sheen_map,
+      &Material::emmissive_map,    &Material::normal_map};
+
+  static std::uint64_t CacheFingerprint() {
+    const std::uint64_t fields[] = {sizeof(REAL), sizeof(CacheMaterial)};
+    return HashBytes(fields, sizeof(fields));
+  }
+
+  int LoadCache(const std::string& cache_path, std::uint64_t source_size,
+                std::uint64_t source_hash) {
+    CacheReader reader;
+    if (reader.Open(cache_path, kCacheMagic) != 0 ||
+        !reader.Matches(source_size, source_hash, CacheFingerprint())) {
+      return 1;
+    }
+    std::unordered_map<std::string, Material> material_map;
+    CacheArray<CacheMaterial> materials =
+        reader.Section<CacheMaterial>(kCacheMaterials);
+    material_map.reserve(materials.size);
+    for (const CacheMaterial& cached : materials) {
+      std::string_view s;
+      Material material = Material();
+      if (!reader.GetString(kCacheStrings, cached.name, s)) {
+        return 1;
+      }
+      material.name_ = s;
+      material.ambient_color = cached.ambient_color;
+      material.diffuse_color = cached.diffuse_color;
+      material.specular_color = cached.specular_color;
+      material.emmesive_color = cached.emmesive_color;
+      material.transmission_filter_color = cached.transmission_filter_color;
+      material.specular_exponent = cached.specular_exponent;
+      material.opaque = cached.opaque;
+      material.optical_density = cached.optical_density;
+      material.illumination_model = cached.illumination_model;
+      for (int i = 0; i < 12; i++) {
+        if (!reader.GetString(kCacheStrings, cached.maps[i], s)) {
+          return 1;
+        }
+        material.*kMapMembers[i] = s;
+      }
+      std::string name = material.name_;
+      material_map.insert({std::move(name), std::move(material)});
+    }
+    Clear();
+    material_map_ = std::move(material_map);
+    return 0;
+  }
+
+  int WriteCache(const std::string& cache_path, std::uint64_t source_size,
+                 std::uint64_t source_hash) const {
+    CacheWriter writer;
+    std::vector<CacheMaterial> materials;
+    materials.reserve(material_map_.size());
+    for (const auto& [name, material] : material_map_) {
+      CacheMaterial cached = {};
+      cached.name = writer.AddString(name);
+      cached.ambient_color = material.ambient_color;
+      cached.diffuse_color = material.diffuse_color;
+      cached.specular_color = material.specular_color;
+      cached.emmesive_color = material.emmesive_color;
+      cached.transmission_filter_color = material.transmission_filter_color;
+      cached.specular_exponent = material.specular_exponent;
+      cached.opaque = material.opaque;
+      cached.optical_density = material.optical_density;
+      cached.illumination_model = material.illumination_model;
+      for (int i = 0; i < 12; i++) {
+        cached.maps[i] = writer.AddString(material.*kMapMembers[i]);
+      }
+      materials.push_back(cached);
+    }
+    writer.Append(kCacheMaterials, materials);
+    writer.Append(kCacheStrings, writer.strings().data(),
+                  writer.strings().size());
+    return writer.Write(cache_path, kCacheMagic, source_size, source_hash,
+                        CacheFingerprint());
+  }
+
+  int ParseFile(const std::string& path) {
     if (input_stream_.is_open()) {
-#ifdef DEBUG
+#ifdef OBJ_PARSER_DEBUG
       std::cerr << "[MTLParser] Error: Stream is already open.\n";
 #endif
       return 1;
     }
     if (path.substr(path.size() - 4, 4) != ".mtl") {
-#ifdef DEBUG
+#ifdef OBJ_PARSER_DEBUG
       std::cerr << "[MTLParser] Error: Not a .mtl file.\n";
 #endif
       return 1;
     }
+#ifdef PARSE_STATS
+    stats_ = ParseStats();
+    const auto parse_start = std::chrono::steady_clock::now();
+#endif
     input_stream_.open(path);
+#ifdef PARSE_STATS
+    stats_.io_seconds += ParseStats::SecondsSince(parse_start);
+#endif
     if (!input_stream_.is_open()) {
-#ifdef DEBUG
+#ifdef OBJ_PARSER_DEBUG
       std::cerr << "[MTLParser] Error: Failed to open file '" << path << "'.\n";
 #endif
       return 1;
     }
-    std::string line;
-    std::string kwd;
+    std::string buffer;
     std::unordered_map<std::string, Material>::iterator last_itr;
-    while (std::getline(input_stream_, line)) {
-      if (line.empty()) {
-        continue;
+    while (ReadLine(buffer)) {
+      std::string_view line = buffer;
+      if (!line.empty() && line.back() == '\r') {
+        line.remove_suffix(1);
       }
       Trim(line);
-      kwd = ReadKeyword(line);
-      // parse
-      if (kwd.empty()) {
+      if (line.empty()) {
         continue;
-      } else if (kwd == "#") {
+      }
+      std::string_view kwd = ReadKeyword(line);
+#ifdef PARSE_STATS
+      stats_.CountKeyword(kwd);
+#endif
+      const KeywordHandler handler = ClassifyKeyword(kwd);
+      if (handler.keyword == Keyword::kComment) {
         continue;
-      } else if (kwd == "newmtl") {
-        Material new_material;
-        if (line.empty()) {
-#ifdef DEBUG
-          std::cerr << "[MTLParser] Error: 'newmtl' with no material name.\n";
+      }
+      if (handler.keyword == Keyword::kUnknown) {
+#ifdef OBJ_PARSER_DEBUG
+        std::cerr << "[MTLParser] Error: Unknown keyword '" << kwd << "'.\n";
 #endif
-          return 1;
-        }
-        new_material.name_ = line;
-        material_map_.insert({line, new_material});
-        last_itr = material_map_.find(line);
-      } else if (kwd == "Ka" || kwd == "Kd" || kwd == "Ks" || kwd == "Ke") {
-        if (material_map_.empty()) {
-#ifdef DEBUG
+        return 1;
+      }
+      if (handler.keyword == Keyword::kNewMaterial) {
+        if (line.empty()) {
+#ifdef OBJ_PARSER_DEBUG
           std::cerr << "[MTLParser] Error: 'newmtl' with no material name.\n";
 #endif
           return 1;
         }
-        std::vector<REAL> components = ReadComponents<REAL>(line);
-        if (components.size() != 3) {
-#ifdef DEBUG
-          std::cerr << "[MTLParser] Error: '" << kwd
-                    << "' expects 3 components.\n";
-#endif
-          return 1;
-        }
-        std::array<REAL, 3> vector3;
-        for (int i = 0; i < 3; i++) {
-          vector3[i] = components[i];
-        }
-        if (kwd == "Ka") {
-          last_itr->second.ambient_color = vector3;
-        } else if (kwd == "Kd") {
-          last_itr->second.diffuse_color = vector3;
-        } else if (kwd == "Ks") {
-          last_itr->second.specular_color = vector3;
-        } else {
-          last_itr->second.emmesive_color = vector3;
-        }
-      } else if (kwd == "Ns") {
-        std::vector<REAL> components = ReadComponents<REAL>(line);
-        if (components.size() != 1) {
-#ifdef DEBUG
-          std::cerr << "[MTLParser] Error: '" << kwd
-                    << "' expects 1 component.\n";
-#endif
-          return 1;
-        }
-        last_itr->second.specular_exponent = components[0];
-      } else if (kwd == "d" || kwd == "Tr") {
-        std::vector<REAL> components = ReadComponents<REAL>(line);
-        if (components.size() != 1) {
-#ifdef DEBUG
-          std::cerr << "[MTLParser] Error: '" << kwd
-                    << "' expects 1 component.\n";
-#endif
-          return 1;
-        }
-        if (kwd == "d") {
-          last_itr->second.opaque = components[0];
+        if (spare_materials_.empty()) {
+          std::string name(line);
+          Material new_material = Material();
+          new_material.name_ = name;
+          last_itr =
+              material_map_.insert({std::move(name), std::move(new_material)})
+                  .first;
         } else {
-          last_itr->second.opaque = 1.f - components[0];
+          last_itr = AddSpareMaterial(line);
         }
-      } else if (kwd == "Tf") {
-        std::vector<REAL> components = ReadComponents<REAL>(line);
-        if (components.size() != 3) {
-#ifdef DEBUG
-          std::cerr << "[MTLParser] Error: '" << kwd
-                    << "' expects 3 component.\n";
-#endif
-          return 1;
-        }
-        std::array<REAL, 3> vector3;
-        for (int i = 0; i < 3; i++) {
-          vector3[i] = components[i];
-        }
-        last_itr->second.transmission_filter_color = vector3;
-      } else if (kwd == "Ni") {
-        std::vector<REAL> components = ReadComponents<REAL>(line);
-        if (components.size() != 1) {
-#ifdef DEBUG
-          std::cerr << "[MTLParser] Error: '" << kwd
-                    << "' expects 1 component.\n";
-#endif
-          return 1;
-        }
-        last_itr->second.optical_density = components[0];
-      } else if (kwd == "illum") {
-        std::vector<INTEGER> components = ReadComponents<INTEGER>(line);
-        if (components.size() != 1) {
-#ifdef DEBUG
-          std::cerr << "[MTLParser] Error: '" << kwd
-                    << "' expects 1 component.\n";
-#endif
-          return 1;
-        }
-        last_itr->second.illumination_model = components[0];
-      } else if (kwd == "map_Ka") {
-        std::vector<std::string> components = ReadComponents<std::string>(line);
-        if (components.size() != 1) {
-#ifdef DEBUG
-          std::cerr << "[MTLParser] Error: Texture map '" << kwd
-                    << "' expects 1 filename.\n";
-#endif
-          return 1;
-        }
-        last_itr->second.ambient_map = components[0];
-      } else if (kwd == "map_Kd") {
-        std::vector<std::string> components = ReadComponents<std::string>(line);
-        if (components.size() != 1) {
-#ifdef DEBUG
-          std::cerr << "[MTLParser] Error: Texture map '" << kwd
-                    << "' expects 1 filename.\n";
-#endif
-          return 1;
-        }
-        last_itr->second.diffuse_map = components[0];
-      } else if (kwd == "map_Ks") {
-        std::vector<std::string> components = ReadComponents<std::string>(line);
-        if (components.size() != 1) {
-#ifdef DEBUG
-          std::cerr << "[MTLParser] Error: Texture map '" << kwd
-                    << "' expects 1 filename.\n";
-#endif
-          return 1;
-        }
-        last_itr->second.specular_map = components[0];
-      } else if (kwd == "map_Ns") {
-        std::vector<std::string> components = ReadComponents<std::string>(line);
-        if (components.size() != 1) {
-#ifdef DEBUG
-          std::cerr << "[MTLParser] Error: Texture map '" << kwd
-                    << "' expects 1 filename.\n";
-#endif
-          return 1;
-        }
-        last_itr->second.specular_highlight_map = components[0];
-      } else if (kwd == "map_d") {
-        std::vector<std::string> components = ReadComponents<std::string>(line);
-        if (components.size() != 1) {
-#ifdef DEBUG
-          std::cerr << "[MTLParser] Error: Texture map '" << kwd
-                    << "' expects 1 filename.\n";
+        continue;
+      }
+      if (material_map_.empty()) {
+#ifdef OBJ_PARSER_DEBUG
+        std::cerr << "[MTLParser] Error: 'newmtl' with no material name.\n";
 #endif
-          return 1;
-        }
-        last_itr->second.alpha_map = components[0];
-      } else if (kwd == "map_Bump" || kwd == "bump") {
-        std::vector<std::string> components = ReadComponents<std::string>(line);
-        if (components.size() != 1) {
-#ifdef DEBUG
-          std::cerr << "[MTLParser] Error: Texture map '" << kwd
-                    << "' expects 1 filename.\n";
+        return 1;
+      }
+      Material& material = last_itr->second;
+      std::array<REAL, 3> vector3;
+      std::array<REAL, 1> scalar;
+      std::array<INTEGER, 1> integer;
+      switch (handler.keyword) {
+        case Keyword::kColor:
+        case Keyword::kTransmissionFilter:
+          if (ReadComponents(line, vector3) != 3) {
+#ifdef OBJ_PARSER_DEBUG
+            std::cerr << "[MTLParser] Error: '" << kwd
+                      << "' expects 3 components.\n";
 #endif
-          return 1;
-        }
-        last_itr->second.bump_map = components[0];
-      } else if (kwd == "disp") {
-        std::vector<std::string> components = ReadComponents<std::string>(line);
-        if (components.size() != 1) {
-#ifdef DEBUG
-          std::cerr << "[MTLParser] Error: Texture map '" << kwd
-                    << "' expects 1 filename.\n";
+            return 1;
+          }
+          if (handler.keyword == Keyword::kColor) {
+            material.*kColorMembers[handler.member] = vector3;
+          } else {
+            material.transmission_filter_color = vector3;
+          }
+          break;
+        case Keyword::kSpecularExponent:
+        case Keyword::kDissolve:
+        case Keyword::kTransparency:
+        case Keyword::kOpticalDensity:
+          if (ReadComponents(line, scalar) != 1) {
+#ifdef OBJ_PARSER_DEBUG
+            std::cerr << "[MTLParser] Error: '" << kwd
+                      << "' expects 1 component.\n";
 #endif
-          return 1;
-        }
-        last_itr->second.displacement_map = components[0];
-      } else if (kwd == "Pr" || kwd == "map_Pr") {
-        std::vector<std::string> components = ReadComponents<std::string>(line);
-        if (components.size() != 1) {
-#ifdef DEBUG
-          std::cerr << "[MTLParser] Error: Texture map '" << kwd
-                    << "' expects 1 filename.\n";
+            return 1;
+          }
+          if (handler.keyword == Keyword::kSpecularExponent) {
+            material.specular_exponent = scalar[0];
+          } else if (handler.keyword == Keyword::kDissolve) {
+            material.opaque = scalar[0];
+          } else if (handler.keyword == Keyword::kTransparency) {
+            material.opaque = 1.f - scalar[0];
+          } else {
+            material.optical_density = scalar[0];
+          }
+          break;
+        case Keyword::kIllumination:
+          if (ReadComponents(line, integer) != 1) {
+#ifdef OBJ_PARSER_DEBUG
+            std::cerr << "[MTLParser] Error: '" << kwd
+                      << "' expects 1 component.\n";
 #endif
-          return 1;
-        }
-        last_itr->second.roughness_map = components[0];
-      } else if (kwd == "Pm" || kwd == "map_Pm") {
-        std::vector<std::string> components = ReadComponents<std::string>(line);
-        if (components.size() != 1) {
-#ifdef DEBUG
-          std::cerr << "[MTLParser] Error: Texture map '" << kwd
-                    << "' expects 1 filename.\n";
+            return 1;
+          }
+          material.illumination_model = integer[0];
+          break;
+        default: {
+          std::string_view filename = ReadToken(line);
+          if (filename.empty() || !IsBlank(line)) {
+#ifdef OBJ_PARSER_DEBUG
+            std::cerr << "[MTLParser] Error: Texture map '" << kwd
+                      << "' expects 1 filename.\n";
 #endif
-          return 1;
+            return 1;
+          }
+          material.*kMapMembers[handler.member] = filename;
+          break;
         }
-        last_itr->second.metallic_map = components[0];
-      } else {
-#ifdef DEBUG
-        std::cerr << "[MTLParser] Error: Unknown keyword '" << kwd << "'.\n";
-#endif
-        return 1;
       }
     }
+#ifdef PARSE_STATS
+    stats_.total_seconds = ParseStats::SecondsSince(parse_start);
+    stats_.tokenize_seconds = stats_.total_seconds - stats_.io_seconds;
+    stats_.peak_material_capacity = material_map_.bucket_count();
+#endif
     return 0;
   }
 
-  int Clear() {
-    material_map_.clear();
-    input_stream_.close();
-    return 0;
+  bool ReadLine(std::string& line) {
+#ifdef PARSE_STATS
+    const auto read_start = std::chrono::steady_clock::now();
+    const bool is_read = static_cast<bool>(std::getline(input_stream_, line));
+    stats_.io_seconds += ParseStats::SecondsSince(read_start);
+    stats_.bytes_read += is_read ? line.size() + 1 : 0;
+    return is_read;
+#else
+    return static_cast<bool>(std::getline(input_stream_, line));
+#endif
   }
 
- private:
-  std::string& Trim(std::string& s) {
-    if (s.empty()) {
-      return s;
+  // Inserts a recycled material named name, or finds the one of that name
+  // parsed before.
+  std::unordered_map<std::string, Material>::iterator AddSpareMaterial(
+      std::string_view name) {
+    auto node = std::move(spare_materials_.back());
+    spare_materials_.pop_back();
+    node.key() = name;
+    ResetMaterial(node.mapped());
+    node.mapped().name_ = name;
+    auto result = material_map_.insert(std::move(node));
+    if (!result.inserted) {
+      spare_materials_.push_back(std::move(result.node));
+    }
+    return result.position;
+  }
+
+  // Sets material to Material() but keeps the capacity of its strings.
+  static void ResetMaterial(Material& material) {
+    std::string strings[13];
+    strings[0] = std::move(material.name_);
+    for (int i = 0; i < 12; i++) {
+      strings[i + 1] = std::move(material.*kMapMembers[i]);
+    }
+    material = Material();
+    material.name_ = std::move(strings[0]);
+    material.name_.clear();
+    for (int i = 0; i < 12; i++) {
+      material.*kMapMembers[i] = std::move(strings[i + 1]);
+      (material.*kMapMembers[i]).clear();
+    }
+  }
+
+  enum class Keyword {
+    kUnknown,
+    kComment,
+    kNewMaterial,
+    kColor,
+    kSpecularExponent,
+    kDissolve,
+    kTransparency,
+    kTransmissionFilter,
+    kOpticalDensity,
+    kIllumination,
+    kMap
+  };
+
+  // What a keyword sets: member indexes kColorMembers for kColor and
+  // kMapMembers for kMap.
+  struct KeywordHandler {
+    Keyword keyword;
+    int member;
+  };
+
+  static constexpr std::array<REAL, 3> Material::*kColorMembers[4] = {
+      &Material::ambient_color, &Material::diffuse_color,
+      &Material::specular_color, &Material::emmesive_color};
+
+  static KeywordHandler ClassifyKeyword(std::string_view kwd) {
+    if (kwd.front() == '#') {
+      return {Keyword::kComment, 0};
     }
-    size_t first = s.find_first_not_of(" ");
-    size_t last = s.find_last_not_of(" ");
-    if (first == last) {
+    switch (KeywordCode(kwd)) {
+      case KeywordCode("newmtl"):
+        return {Keyword::kNewMaterial, 0};
+      case KeywordCode("Ka"):
+        return {Keyword::kColor, 0};
+      case KeywordCode("Kd"):
+        return {Keyword::kColor, 1};
+      case KeywordCode("Ks"):
+        return {Keyword::kColor, 2};
+      case KeywordCode("Ke"):
+        return {Keyword::kColor, 3};
+      case KeywordCode("Ns"):
+        return {Keyword::kSpecularExponent, 0};
+      case KeywordCode("d"):
+        return {Keyword::kDissolve, 0};
+      case KeywordCode("Tr"):
+        return {Keyword::kTransparency, 0};
+      case KeywordCode("Tf"):
+        return {Keyword::kTransmissionFilter, 0};
+      case KeywordCode("Ni"):
+        return {Keyword::kOpticalDensity, 0};
+      case KeywordCode("illum"):
+        return {Keyword::kIllumination, 0};
+      case KeywordCode("map_Ka"):
+        return {Keyword::kMap, 0};
+      case KeywordCode("map_Kd"):
+        return {Keyword::kMap, 1};
+      case KeywordCode("map_Ks"):
+        return {Keyword::kMap, 2};
+      case KeywordCode("map_Ns"):
+        return {Keyword::kMap, 3};
+      case KeywordCode("map_d"):
+        return {Keyword::kMap, 4};
+      case KeywordCode("map_Bump"):
+      case KeywordCode("bump"):
+        return {Keyword::kMap, 5};
+      case KeywordCode("disp"):
+        return {Keyword::kMap, 6};
+      case KeywordCode("Pr"):
+      case KeywordCode("map_Pr"):
+        return {Keyword::kMap, 7};
+      case KeywordCode("Pm"):
+      case KeywordCode("map_Pm"):
+        return {Keyword::kMap, 8};
+      default:
+        return {Keyword::kUnknown, 0};
+    }
+  }
+
+  static std::string_view& Trim(std::string_view& s) {
+    std::size_t first = s.find_first_not_of(' ');
+    if (first == std::string_view::npos) {
+      s = std::string_view();
       return s;
     }
-    return s = s.substr(first, last - first + 1);
+    s = s.substr(first, s.find_last_not_of(' ') - first + 1);
+    return s;
   }
 
-  std::string ReadKeyword(std::string& s) {
-    size_t found;
-    if ((found = s.find_first_of(" ")) == std::string::npos) {
+  static std::string_view ReadKeyword(std::string_view& s) {
+    std::size_t found;
+    if ((found = s.find(' ')) == std::string_view::npos) {
       return s;
     }
-    std::string kwd = s.substr(0, found);
-    s = s.substr(found + 1);
+    std::string_view kwd = s.substr(0, found);
+    s.remove_prefix(found + 1);
     return kwd;
   }
 
+  static bool IsSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' ||
+           c == '\f';
+  }
+
+  static void SkipSpaces(std::string_view& s) {
+    std::size_t i = 0;
+    while (i < s.size() && IsSpace(s[i])) {
+      i++;
+    }
+    s.remove_prefix(i);
+  }
+
+  static bool IsBlank(std::string_view s) {
+    SkipSpaces(s);
+    return s.empty();
+  }
+
+  // Reads one whitespace separated token from the front of s.
+  static std::string_view ReadToken(std::string_view& s) {
+    SkipSpaces(s);
+    std::size_t size = 0;
+    while (size < s.size() && !IsSpace(s[size])) {
+      size++;
+    }
+    std::string_view token = s.substr(0, size);
+    s.remove_prefix(size);
+    return token;
+  }
+
+  // Reads one number from the front of s with std::from_chars, which unlike
+  // stream extraction neither allocates nor consults the locale.
   template <class T>
-  std::vector<T> ReadComponents(std::string s) {
-    std::istringstream iss(s);
-    std::vector<T> components;
+  static bool ReadNumber(std::string_view& s, T& value) {
+    SkipSpaces(s);
+    const char* first = s.data();
+    const char* last = s.data() + s.size();
+    if (first != last && *first == '+' && last - first > 1 &&
+        first[1] != '-') {
+      first++;
+    }
+    std::from_chars_result result = std::from_chars(first, last, value);
+    if (result.ec != std::errc()) {
+      return false;
+    }
+    s.remove_prefix(static_cast<std::size_t>(result.ptr - s.data()));
+    return true;
+  }
+
+  // Returns the number of components read, or N + 1 if s holds more than N.
+  template <class T, std::size_t N>
+  static std::size_t ReadComponents(std::string_view s,
+                                    std::array<T, N>& components) {
+    std::size_t count = 0;
     T component;
-    while (iss >> component) {
-      components.push_back(component);
+    while (ReadNumber(s, component)) {
+      if (count == N) {
+        return N + 1;
+      }
+      components[count++] = component;
     }
-    return components;
+    return count;
   }
 
   std::unordered_map<std::string, Material> material_map_;
   std::ifstream input_stream_;
+  std::string cache_directory_;
+  ParseStats stats_;
+  bool reuse_capacity_ = false;
+  // Materials kept by set_reuse_capacity, emptied on reuse.
+  std::vector<std::unordered_map<std::string, Material>::node_type>
+      spare_materials_;
 };
 
 #endif  // _MATERIAL_PARSER_H_
\ No newline at end of file
@@ -0,0 +1,618 @@
+#ifndef _NORMAL_GENERATOR_H_
+#define _NORMAL_GENERATOR_H_
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+#include <vector>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// How the faces around a smooth vertex contribute to its normal: by the
+// angle of their corner at the vertex, or by their area.
+enum class NormalWeighting : std::uint32_t { kAngle, kArea };
+
+// Generates vertex normals and tangents for the triangles of one group of
+// faces. Corners of smooth triangles at equal positions share a normal
+// summed over the faces around them; other triangles get their face normal.
+// Tangents follow MikkTSpace: every face's direction of increasing u is
+// projected onto each corner's normal plane and summed with angle weights
+// over corners sharing position, normal, texture coordinate and handedness,
+// with the handedness in w. Per-face math runs in AVX2 or SSE lanes when the
+// compiler targets them. Output depends only on the input. Scratch space is
+// kept between calls.
+class NormalGenerator {
+ public:
+  // Attributes of one vertex. Absent attributes are nullptr.
+  struct Input {
+    const float* position = nullptr;
+    const float* texture_coordinate = nullptr;
+    const float* normal = nullptr;
+  };
+
+  // "avx2", "sse2" or "scalar": the widest kernels this build has.
+  static const char* simd_name() {
+#if defined(__AVX2__)
+    return "avx2";
+#elif defined(__SSE2__)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+  }
+
+  // use_simd = false runs the scalar kernels, for comparison.
+  explicit NormalGenerator(NormalWeighting weighting, bool use_simd = true)
+      : weighting_(weighting), use_simd_(use_simd) {}
+
+  void Clear() {
+    for (std::vector<float>& component : positions_) {
+      component.clear();
+    }
+    for (std::vector<float>& component : texture_coordinates_) {
+      component.clear();
+    }
+    for (std::vector<float>& component : corner_normals_) {
+      component.clear();
+    }
+    is_smooth_.clear();
+    has_normal_.clear();
+    has_texture_coordinates_.clear();
+  }
+
+  std::size_t triangle_count() const { return is_smooth_.size(); }
+
+  // Appends the triangles of a triangle list. vertex(v) returns the Input of
+  // vertex v. Corners whose vertex has a normal keep it.
+  template <class T, class F>
+  void AddTriangles(const std::vector<T>& indices, bool is_smooth,
+                    F&& vertex) {
+    for (std::size_t i = 0; i + 2 < indices.size(); i += 3) {
+      bool has_texture_coordinates = true;
+      for (std::size_t c = 0; c < 3; c++) {
+        const Input input = vertex(indices[i + c]);
+        for (std::size_t a = 0; a < 3; a++) {
+          positions_[c * 3 + a].push_back(input.position[a]);
+          corner_normals_[c * 3 + a].push_back(
+              input.normal != nullptr ? input.normal[a] : 0.f);
+        }
+        for (std::size_t a = 0; a < 2; a++) {
+          texture_coordinates_[c * 2 + a].push_back(
+              input.texture_coordinate != nullptr
+                  ? input.texture_coordinate[a]
+                  : 0.f);
+        }
+        has_normal_.push_back(input.normal != nullptr);
+        has_texture_coordinates =
+            has_texture_coordinates && input.texture_coordinate != nullptr;
+      }
+      is_smooth_.push_back(is_smooth);
+      has_texture_coordinates_.push_back(has_texture_coordinates);
+    }
+  }
+
+  // Writes a unit normal for every corner added since Clear(), three per
+  // triangle in order. Degenerate faces count as facing +z.
+  void GenerateNormals(std::vector<std::array<float, 3>>& normals) {
+    const std::size_t count = triangle_count();
+    for (std::vector<float>& component : face_normals_) {
+      component.resize(count);
+    }
+    for (std::vector<float>& component : angles_) {
+      component.resize(count);
+    }
+    areas_.resize(count);
+    RunKernel([this](auto lanes, std::size_t begin) {
+      return FaceKernel(lanes, begin);
+    });
+
+    // Sum the weighted face normals of smooth corners at equal positions.
+    std::vector<std::uint32_t>& order = order_;
+    order.clear();
+    for (std::size_t t = 0; t < count; t++) {
+      if (is_smooth_[t]) {
+        for (std::uint32_t c = 0; c < 3; c++) {
+          order.push_back(static_cast<std::uint32_t>(t * 3 + c));
+        }
+      }
+    }
+    const std::vector<std::uint32_t>& runs = GroupCorners(
+        order, 3, [this](std::uint32_t corner, std::uint32_t* key) {
+          PositionKey(corner, key);
+        });
+    for (std::size_t i = 0; i < order.size(); i++) {
+      const std::size_t t = order[i] / 3;
+      const std::size_t c = order[i] % 3;
+      const std::uint32_t run = runs[i];
+      const float weight =
+          weighting_ == NormalWeighting::kArea ? areas_[t] : angles_[c][t];
+      for (std::size_t a = 0; a < 3; a++) {
+        sums_[a][run] += face_normals_[a][t] * weight;
+      }
+      weight_sums_[run] += weight;
+    }
+    NormalizeSums();
+
+    for (std::size_t i = 0; i < order.size(); i++) {
+      const std::size_t t = order[i] / 3;
+      const std::size_t c = order[i] % 3;
+      if (has_normal_[order[i]]) {
+        continue;
+      }
+      const std::uint32_t run = runs[i];
+      const bool is_zero = sums_[0][run] == 0.f && sums_[1][run] == 0.f &&
+                           sums_[2][run] == 0.f;
+      for (std::size_t a = 0; a < 3; a++) {
+        corner_normals_[c * 3 + a][t] =
+            is_zero ? face_normals_[a][t] : sums_[a][run];
+      }
+    }
+    for (std::size_t t = 0; t < count; t++) {
+      for (std::size_t c = 0; c < 3; c++) {
+        if (!is_smooth_[t] && !has_normal_[t * 3 + c]) {
+          for (std::size_t a = 0; a < 3; a++) {
+            corner_normals_[c * 3 + a][t] = face_normals_[a][t];
+          }
+        }
+      }
+    }
+
+    normals.resize(count * 3);
+    for (std::size_t t = 0; t < count; t++) {
+      for (std::size_t c = 0; c < 3; c++) {
+        std::array<float, 3>& normal = normals[t * 3 + c];
+        for (std::size_t a = 0; a < 3; a++) {
+          normal[a] = corner_normals_[c * 3 + a][t];
+        }
+        if (!has_normal_[t * 3 + c] && normal[0] == 0.f && normal[1] == 0.f &&
+            normal[2] == 0.f) {
+          normal[2] = 1.f;
+          corner_normals_[c * 3 + 2][t] = 1.f;
+        }
+      }
+    }
+  }
+
+  // Writes a tangent for every corner, with w = 1 where the texture space is
+  // right-handed and -1 where it is mirrored, so that the bitangent is
+  // w * cross(normal, tangent). Corners of triangles without texture
+  // coordinates or with degenerate ones get some unit vector perpendicular
+  // to the normal. Call after GenerateNormals.
+  void GenerateTangents(std::vector<std::array<float, 4>>& tangents) {
+    const std::size_t count = triangle_count();
+    for (std::vector<float>& component : corner_tangents_) {
+      component.resize(count);
+    }
+    orientations_.resize(count);
+    RunKernel([this](auto lanes, std::size_t begin) {
+      return TangentKernel(lanes, begin);
+    });
+
+    std::vector<std::uint32_t>& order = order_;
+    order.clear();
+    for (std::size_t t = 0; t < count; t++) {
+      if (has_texture_coordinates_[t]) {
+        for (std::uint32_t c = 0; c < 3; c++) {
+          order.push_back(static_cast<std::uint32_t>(t * 3 + c));
+        }
+      }
+    }
+    const std::vector<std::uint32_t>& runs = GroupCorners(
+        order, kMaxKeySize, [this](std::uint32_t corner, std::uint32_t* key) {
+          TangentKey(corner, key);
+        });
+    for (std::size_t i = 0; i < order.size(); i++) {
+      const std::size_t t = order[i] / 3;
+      const std::size_t c = order[i] % 3;
+      const std::uint32_t run = runs[i];
+      for (std::size_t a = 0; a < 3; a++) {
+        sums_[a][run] += corner_tangents_[c * 3 + a][t];
+      }
+      weight_sums_[run] += angles_[c][t];
+    }
+    NormalizeSums();
+
+    tangents.resize(count * 3);
+    for (std::size_t t = 0; t < count; t++) {
+      for (std::size_t c = 0; c < 3; c++) {
+        tangents[t * 3 + c] = PerpendicularTangent(t, c);
+      }
+    }
+    for (std::size_t i = 0; i < order.size(); i++) {
+      const std::uint32_t run = runs[i];
+      if (sums_[0][run] == 0.f && sums_[1][run] == 0.f &&
+          sums_[2][run] == 0.f) {
+        continue;
+      }
+      tangents[order[i]] = {sums_[0][run], sums_[1][run], sums_[2][run],
+                            orientations_[order[i] / 3]};
+    }
+  }
+
+ private:
+  // Degenerate edges, faces and projections are shorter than this.
+  static constexpr float kEpsilon = 1e-20f;
+  // Relative length below which a sum counts as cancelled.
+  static constexpr float kCancellation = 1e-4f;
+  // Position, texture coordinate, normal and handedness.
+  static constexpr std::size_t kMaxKeySize = 9;
+
+  struct ScalarLanes {
+    using V = float;
+    static constexpr std::size_t kWidth = 1;
+    static V Load(const float* p) { return *p; }
+    static void Store(float* p, V v) { *p = v; }
+    static V Set(float x) { return x; }
+    static V Add(V a, V b) { return a + b; }
+    static V Sub(V a, V b) { return a - b; }
+    static V Mul(V a, V b) { return a * b; }
+    static V Div(V a, V b) { return a / b; }
+    static V Sqrt(V a) { return std::sqrt(a); }
+    static V Min(V a, V b) { return b < a ? b : a; }
+    static V Max(V a, V b) { return a < b ? b : a; }
+    static V Abs(V a) { return std::fabs(a); }
+    // a < b ? x : y
+    static V SelectLess(V a, V b, V x, V y) { return a < b ? x : y; }
+  };
+
+#if defined(__SSE2__)
+  struct SseLanes {
+    using V = __m128;
+    static constexpr std::size_t kWidth = 4;
+    static V Load(const float* p) { return _mm_loadu_ps(p); }
+    static void Store(float* p, V v) { _mm_storeu_ps(p, v); }
+    static V Set(float x) { return _mm_set1_ps(x); }
+    static V Add(V a, V b) { return _mm_add_ps(a, b); }
+    static V Sub(V a, V b) { return _mm_sub_ps(a, b); }
+    static V Mul(V a, V b) { return _mm_mul_ps(a, b); }
+    static V Div(V a, V b) { return _mm_div_ps(a, b); }
+    static V Sqrt(V a) { return _mm_sqrt_ps(a); }
+    static V Min(V a, V b) { return _mm_min_ps(b, a); }
+    static V Max(V a, V b) { return _mm_max_ps(b, a); }
+    static V Abs(V a) { return _mm_andnot_ps(_mm_set1_ps(-0.f), a); }
+    static V SelectLess(V a, V b, V x, V y) {
+      const V mask = _mm_cmplt_ps(a, b);
+      return _mm_or_ps(_mm_and_ps(mask, x), _mm_andnot_ps(mask, y));
+    }
+  };
+#endif
+
+#if defined(__AVX2__)
+  struct AvxLanes {
+    using V = __m256;
+    static constexpr std::size_t kWidth = 8;
+    static V Load(const float* p) { return _mm256_loadu_ps(p); }
+    static void Store(float* p, V v) { _mm256_storeu_ps(p, v); }
+    static V Set(float x) { return _mm256_set1_ps(x); }
+    static V Add(V a, V b) { return _mm256_add_ps(a, b); }
+    static V Sub(V a, V b) { return _mm256_sub_ps(a, b); }
+    static V Mul(V a, V b) { return _mm256_mul_ps(a, b); }
+    static V Div(V a, V b) { return _mm256_div_ps(a, b); }
+    static V Sqrt(V a) { return _mm256_sqrt_ps(a); }
+    static V Min(V a, V b) { return _mm256_min_ps(b, a); }
+    static V Max(V a, V b) { return _mm256_max_ps(b, a); }
+    static V Abs(V a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.f), a); }
+    static V SelectLess(V a, V b, V x, V y) {
+      return _mm256_blendv_ps(y, x, _mm256_cmp_ps(a, b, _CMP_LT_OQ));
+    }
+  };
+#endif
+
+  // Runs kernel(lanes, begin) over every triangle with the widest lanes
+  // available, finishing the remainder with scalar lanes. The kernel returns
+  // the first triangle it did not process.
+  template <class K>
+  void RunKernel(K&& kernel) {
+    std::size_t done = 0;
+    if (use_simd_) {
+#if defined(__AVX2__)
+      done = kernel(AvxLanes(), done);
+#endif
+#if defined(__SSE2__)
+      done = kernel(SseLanes(), done);
+#endif
+    }
+    kernel(ScalarLanes(), done);
+  }
+
+  // acos with an absolute error below 7e-5 (Abramowitz and Stegun 4.4.45),
+  // evaluated the same way by every lane width.
+  template <class L>
+  static typename L::V Acos(typename L::V x) {
+    using V = typename L::V;
+    x = L::Max(L::Set(-1.f), L::Min(L::Set(1.f), x));
+    const V ax = L::Abs(x);
+    V p = L::Set(-0.0187293f);
+    p = L::Add(L::Mul(p, ax), L::Set(0.0742610f));
+    p = L::Add(L::Mul(p, ax), L::Set(-0.2121144f));
+    p = L::Add(L::Mul(p, ax), L::Set(1.5707288f));
+    const V r = L::Mul(L::Sqrt(L::Sub(L::Set(1.f), ax)), p);
+    return L::SelectLess(x, L::Set(0.f), L::Sub(L::Set(3.14159265f), r), r);
+  }
+
+  // 1 / length, or 0 for lengths below kEpsilon.
+  template <class L>
+  static typename L::V InverseLength(typename L::V length_squared) {
+    using V = typename L::V;
+    const V length = L::Sqrt(length_squared);
+    return L::SelectLess(L::Set(kEpsilon), length,
+                         L::Div(L::Set(1.f), L::Max(length, L::Set(kEpsilon))),
+                         L::Set(0.f));
+  }
+
+  template <class L>
+  static typename L::V Dot(const typename L::V* a, const typename L::V* b) {
+    return L::Add(L::Add(L::Mul(a[0], b[0]), L::Mul(a[1], b[1])),
+                  L::Mul(a[2], b[2]));
+  }
+
+  // Cosine of the angle between a and b scaled by their inverse lengths.
+  template <class L>
+  static typename L::V CornerAngle(typename L::V dot, typename L::V inverse_a,
+                                   typename L::V inverse_b) {
+    return Acos<L>(L::Mul(L::Mul(dot, inverse_a), inverse_b));
+  }
+
+  // Unit face normal, twice the area and the corner angles of every
+  // triangle.
+  template <class L>
+  std::size_t FaceKernel(L, std::size_t begin) {
+    using V = typename L::V;
+    const std::size_t count = triangle_count();
+    std::size_t t = begin;
+    for (; t + L::kWidth <= count; t += L::kWidth) {
+      V p[9];
+      for (std::size_t i = 0; i < 9; i++) {
+        p[i] = L::Load(&positions_[i][t]);
+      }
+      V e01[3], e02[3], e12[3];
+      for (std::size_t a = 0; a < 3; a++) {
+        e01[a] = L::Sub(p[3 + a], p[a]);
+        e02[a] = L::Sub(p[6 + a], p[a]);
+        e12[a] = L::Sub(p[6 + a], p[3 + a]);
+      }
+      V n[3] = {L::Sub(L::Mul(e01[1], e02[2]), L::Mul(e01[2], e02[1])),
+                L::Sub(L::Mul(e01[2], e02[0]), L::Mul(e01[0], e02[2])),
+                L::Sub(L::Mul(e01[0], e02[1]), L::Mul(e01[1], e02[0]))};
+      const V n_length_squared = Dot<L>(n, n);
+      const V inverse_n = InverseLength<L>(n_length_squared);
+      for (std::size_t a = 0; a < 3; a++) {
+        L::Store(&face_normals_[a][t], L::Mul(n[a], inverse_n));
+      }
+      L::Store(&areas_[t], L::Sqrt(n_length_squared));
+      const V inverse_01 = InverseLength<L>(Dot<L>(e01, e01));
+      const V inverse_02 = InverseLength<L>(Dot<L>(e02, e02));
+      const V inverse_12 = InverseLength<L>(Dot<L>(e12, e12));
+      L::Store(&angles_[0][t],
+               CornerAngle<L>(Dot<L>(e01, e02), inverse_01, inverse_02));
+      L::Store(&angles_[1][t],
+               CornerAngle<L>(L::Sub(L::Set(0.f), Dot<L>(e01, e12)),
+                              inverse_01, inverse_12));
+      L::Store(&angles_[2][t],
+               CornerAngle<L>(Dot<L>(e02, e12), inverse_02, inverse_12));
+    }
+    return t;
+  }
+
+  // Direction of increasing u and handedness of every triangle, then each
+  // corner's share of its vertex tangent: that direction projected onto the
+  // corner's normal plane, normalized and scaled by the corner angle.
+  template <class L>
+  std::size_t TangentKernel(L, std::size_t begin) {
+    using V = typename L::V;
+    const std::size_t count = triangle_count();
+    std::size_t t = begin;
+    for (; t + L::kWidth <= count; t += L::kWidth) {
+      V e01[3], e02[3];
+      for (std::size_t a = 0; a < 3; a++) {
+        const V p0 = L::Load(&positions_[a][t]);
+        e01[a] = L::Sub(L::Load(&positions_[3 + a][t]), p0);
+        e02[a] = L::Sub(L::Load(&positions_[6 + a][t]), p0);
+      }
+      const V s0 = L::Load(&texture_coordinates_[0][t]);
+      const V t0 = L::Load(&texture_coordinates_[1][t]);
+      const V s01 = L::Sub(L::Load(&texture_coordinates_[2][t]), s0);
+      const V t01 = L::Sub(L::Load(&texture_coordinates_[3][t]), t0);
+      const V s02 = L::Sub(L::Load(&texture_coordinates_[4][t]), s0);
+      const V t02 = L::Sub(L::Load(&texture_coordinates_[5][t]), t0);
+      const V signed_area = L::Sub(L::Mul(s01, t02), L::Mul(t01, s02));
+      const V zero = L::Set(0.f);
+      const V orientation =
+          L::SelectLess(zero, signed_area, L::Set(1.f), L::Set(-1.f));
+      L::Store(&orientations_[t], orientation);
+      V u[3];
+      for (std::size_t a = 0; a < 3; a++) {
+        u[a] = L::Sub(L::Mul(t02, e01[a]), L::Mul(t01, e02[a]));
+      }
+      // Mirrored faces point u the other way; MikkTSpace flips it back.
+      // Degenerate texture space contributes nothing.
+      const V scale = L::SelectLess(L::Set(kEpsilon), L::Abs(signed_area),
+                                    L::Mul(orientation, InverseLength<L>(
+                                                            Dot<L>(u, u))),
+                                    zero);
+      for (std::size_t a = 0; a < 3; a++) {
+        u[a] = L::Mul(u[a], scale);
+      }
+      for (std::size_t c = 0; c < 3; c++) {
+        V n[3];
+        for (std::size_t a = 0; a < 3; a++) {
+          n[a] = L::Load(&corner_normals_[c * 3 + a][t]);
+        }
+        const V d = Dot<L>(n, u);
+        V projected[3];
+        for (std::size_t a = 0; a < 3; a++) {
+          projected[a] = L::Sub(u[a], L::Mul(n[a], d));
+        }
+        const V weight = L::Mul(InverseLength<L>(Dot<L>(projected, projected)),
+                                L::Load(&angles_[c][t]));
+        for (std::size_t a = 0; a < 3; a++) {
+          L::Store(&corner_tangents_[c * 3 + a][t],
+                   L::Mul(projected[a], weight));
+        }
+      }
+    }
+    return t;
+  }
+
+  // Scales every vector of v to unit length, leaving degenerate ones zero.
+  template <class L>
+  static std::size_t NormalizeKernel(L, std::array<std::vector<float>, 3>& v,
+                                     std::size_t begin) {
+    using V = typename L::V;
+    const std::size_t count = v[0].size();
+    std::size_t i = begin;
+    for (; i + L::kWidth <= count; i += L::kWidth) {
+      V x[3] = {L::Load(&v[0][i]), L::Load(&v[1][i]), L::Load(&v[2][i])};
+      const V inverse = InverseLength<L>(Dot<L>(x, x));
+      for (std::size_t a = 0; a < 3; a++) {
+        L::Store(&v[a][i], L::Mul(x[a], inverse));
+      }
+    }
+    return i;
+  }
+
+  // Normalizes sums_. Sums much shorter than the weights that went into
+  // them are rounding noise left after their terms cancelled, and are zeroed
+  // instead.
+  void NormalizeSums() {
+    for (std::size_t i = 0; i < weight_sums_.size(); i++) {
+      const float x = sums_[0][i];
+      const float y = sums_[1][i];
+      const float z = sums_[2][i];
+      const float min_length = kCancellation * weight_sums_[i];
+      if (x * x + y * y + z * z <= min_length * min_length) {
+        sums_[0][i] = 0.f;
+        sums_[1][i] = 0.f;
+        sums_[2][i] = 0.f;
+      }
+    }
+    RunKernel([this](auto lanes, std::size_t begin) {
+      return NormalizeKernel(lanes, sums_, begin);
+    });
+  }
+
+  static std::uint32_t Bits(float x) {
+    std::uint32_t bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    return bits;
+  }
+
+  void PositionKey(std::uint32_t corner, std::uint32_t* key) const {
+    const std::size_t t = corner / 3;
+    const std::size_t c = corner % 3;
+    for (std::size_t a = 0; a < 3; a++) {
+      key[a] = Bits(positions_[c * 3 + a][t]);
+    }
+  }
+
+  void TangentKey(std::uint32_t corner, std::uint32_t* key) const {
+    const std::size_t t = corner / 3;
+    const std::size_t c = corner % 3;
+    PositionKey(corner, key);
+    key[3] = Bits(texture_coordinates_[c * 2][t]);
+    key[4] = Bits(texture_coordinates_[c * 2 + 1][t]);
+    for (std::size_t a = 0; a < 3; a++) {
+      key[5 + a] = Bits(corner_normals_[c * 3 + a][t]);
+    }
+    key[8] = Bits(orientations_[t]);
+  }
+
+  // Numbers the distinct keys of corners in order of first occurrence and
+  // returns the number of each corner's key, one per entry of corners.
+  // key_of(corner, key) writes key_size words. Sizes sums_ and weight_sums_
+  // to the key count, zeroed.
+  template <class F>
+  const std::vector<std::uint32_t>& GroupCorners(
+      const std::vector<std::uint32_t>& corners, std::size_t key_size,
+      F&& key_of) {
+    std::size_t capacity = 16;
+    while (capacity < corners.size() * 2) {
+      capacity *= 2;
+    }
+    const std::uint32_t empty = ~std::uint32_t{0};
+    table_.assign(capacity, empty);
+    keys_.clear();
+    runs_.clear();
+    std::uint32_t key[kMaxKeySize];
+    std::uint32_t run_count = 0;
+    for (std::uint32_t corner : corners) {
+      key_of(corner, key);
+      std::uint64_t hash = 0;
+      for (std::size_t i = 0; i < key_size; i++) {
+        hash = (hash ^ key[i]) * 0x9E3779B97F4A7C15ull;
+      }
+      std::size_t slot = static_cast<std::size_t>(hash ^ hash >> 32);
+      for (;; slot++) {
+        slot &= capacity - 1;
+        const std::uint32_t run = table_[slot];
+        if (run == empty) {
+          table_[slot] = run_count;
+          keys_.insert(keys_.end(), key, key + key_size);
+          runs_.push_back(run_count++);
+          break;
+        }
+        if (std::equal(key, key + key_size, &keys_[run * key_size])) {
+          runs_.push_back(run);
+          break;
+        }
+      }
+    }
+    for (std::vector<float>& component : sums_) {
+      component.assign(run_count, 0.f);
+    }
+    weight_sums_.assign(run_count, 0.f);
+    return runs_;
+  }
+
+  // A unit vector perpendicular to the normal of corner c of triangle t.
+  std::array<float, 4> PerpendicularTangent(std::size_t t,
+                                            std::size_t c) const {
+    const float n[3] = {corner_normals_[c * 3][t],
+                        corner_normals_[c * 3 + 1][t],
+                        corner_normals_[c * 3 + 2][t]};
+    // Cross the normal with whichever of x and y it is further from.
+    const float axis[3] = {std::fabs(n[0]) < 0.9f ? 1.f : 0.f,
+                           std::fabs(n[0]) < 0.9f ? 0.f : 1.f, 0.f};
+    float v[3] = {n[1] * axis[2] - n[2] * axis[1],
+                  n[2] * axis[0] - n[0] * axis[2],
+                  n[0] * axis[1] - n[1] * axis[0]};
+    const float length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    if (length <= kEpsilon) {
+      return {1.f, 0.f, 0.f, 1.f};
+    }
+    return {v[0] / length, v[1] / length, v[2] / length, 1.f};
+  }
+
+  NormalWeighting weighting_;
+  bool use_simd_;
+  // Per triangle, one array per corner and component: positions_[c * 3 + a]
+  // holds component a of corner c.
+  std::array<std::vector<float>, 9> positions_;
+  std::array<std::vector<float>, 6> texture_coordinates_;
+  std::array<std::vector<float>, 9> corner_normals_;
+  std::vector<bool> is_smooth_;
+  std::vector<bool> has_texture_coordinates_;
+  // Per corner.
+  std::vector<bool> has_normal_;
+  // Kernel outputs.
+  std::array<std::vector<float>, 3> face_normals_;
+  std::array<std::vector<float>, 3> angles_;
+  std::vector<float> areas_;
+  std::array<std::vector<float>, 9> corner_tangents_;
+  std::vector<float> orientations_;
+  // Welding scratch.
+  std::vector<std::uint32_t> order_;
+  std::vector<std::uint32_t> runs_;
+  std::vector<std::uint32_t> keys_;
+  std::vector<std::uint32_t> table_;
+  std::array<std::vector<float>, 3> sums_;
+  std::vector<float> weight_sums_;
+};
+
+#endif  // _NORMAL_GENERATOR_H_
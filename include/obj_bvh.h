@@ -0,0 +1,33 @@
+#ifndef _OBJ_BVH_H_
+#define _OBJ_BVH_H_
+
+#include <array>
+#include <cstddef>
+#include <vector>
+
+#include "obj_parser.h"
+#include "thread_pool.h"
+#include "triangle_bvh.h"
+
+// Builds a bounding volume hierarchy over the triangles of every index group
+// of mesh for ray and box queries. Index buffers must be triangle lists, as
+// ParseOptions::triangulate leaves them. Returns one hierarchy per index
+// group in the order of OBJParser::IndexGroups.
+inline std::vector<TriangleBvh> BuildBvhs(const OBJParser::Mesh& mesh,
+                                          ThreadPool& pool) {
+  std::vector<const OBJParser::IndexGroup*> index_groups =
+      OBJParser::IndexGroups(mesh.sub_objects);
+  std::vector<TriangleBvh> bvhs(index_groups.size());
+  pool.ParallelFor(index_groups.size(), [&](std::size_t i) {
+    bvhs[i].Build(
+        index_groups[i]->index_buffer_,
+        [&mesh](INTEGER vertex) {
+          const std::array<REAL, 4>& p = mesh.vertex_buffer[vertex].position;
+          return std::array<REAL, 3>{p[0], p[1], p[2]};
+        },
+        &pool);
+  });
+  return bvhs;
+}
+
+#endif  // _OBJ_BVH_H_
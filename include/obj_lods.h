@@ -0,0 +1,70 @@
+#ifndef _OBJ_LODS_H_
+#define _OBJ_LODS_H_
+
+#include <array>
+#include <cstddef>
+#include <vector>
+
+#include "mesh_simplifier.h"
+#include "obj_parser.h"
+#include "thread_pool.h"
+
+// A simplified level of detail. It keeps collapsing edges of the previous
+// level until it is down to triangle_ratio of the full triangle count or the
+// next collapse would exceed max_error.
+struct LodLevel {
+  double triangle_ratio = 0.5;
+  double max_error = 0.01;
+};
+
+// Levels of detail of one sub-object.
+struct SubObjectLods {
+  // Geometric error of each level, relative to the largest dimension of the
+  // sub-object's bounds.
+  std::vector<double> errors;
+  // For each index group of the sub-object in order, one triangle list per
+  // level, coarsest last, over the same vertices as its index_buffer_.
+  std::vector<std::vector<std::vector<INTEGER>>> index_buffers;
+};
+
+// Builds levels of detail for every sub-object of mesh, finest first. UV
+// and normal seams are simplified along their length on both sides at once;
+// vertices on open borders and material boundaries stay in place. All index
+// groups of a sub-object are simplified together so the boundaries between
+// their materials survive every level. Index buffers must be triangle lists,
+// as ParseOptions::triangulate leaves them, that have not been narrowed.
+// Returns one entry per sub-object.
+inline std::vector<SubObjectLods> BuildLods(const OBJParser::Mesh& mesh,
+                                            const std::vector<LodLevel>& levels,
+                                            ThreadPool& pool) {
+  std::vector<SubObjectLods> lods(mesh.sub_objects.size());
+  pool.ParallelFor(lods.size(), [&](std::size_t i) {
+    std::vector<const std::vector<INTEGER>*> index_buffers;
+    for (const OBJParser::MeshGroup& mesh_group :
+         mesh.sub_objects[i].mesh_groups) {
+      for (const OBJParser::IndexGroup& index_group :
+           mesh_group.index_groups) {
+        index_buffers.push_back(&index_group.index_buffer_);
+      }
+    }
+    MeshSimplifier simplifier(index_buffers, [&mesh](INTEGER vertex) {
+      const std::array<REAL, 4>& p = mesh.vertex_buffer[vertex].position;
+      return std::array<REAL, 3>{p[0], p[1], p[2]};
+    });
+    const std::size_t triangle_count = simplifier.triangle_count();
+    SubObjectLods& sub_object = lods[i];
+    sub_object.index_buffers.resize(index_buffers.size());
+    for (const LodLevel& level : levels) {
+      sub_object.errors.push_back(simplifier.Simplify(
+          static_cast<std::size_t>(triangle_count * level.triangle_ratio),
+          level.max_error));
+      for (std::size_t g = 0; g < index_buffers.size(); g++) {
+        sub_object.index_buffers[g].emplace_back();
+        simplifier.GetIndexBuffer(g, sub_object.index_buffers[g].back());
+      }
+    }
+  });
+  return lods;
+}
+
+#endif  // _OBJ_LODS_H_
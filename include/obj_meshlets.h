@@ -0,0 +1,45 @@
+#ifndef _OBJ_MESHLETS_H_
+#define _OBJ_MESHLETS_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "meshlet_builder.h"
+#include "obj_parser.h"
+#include "thread_pool.h"
+
+// Meshlets of one index group. vertices maps meshlet local vertices to the
+// vertex buffer; triangles holds three local indices per triangle.
+struct IndexGroupMeshlets {
+  std::vector<Meshlet> meshlets;
+  std::vector<INTEGER> vertices;
+  std::vector<std::uint8_t> triangles;
+};
+
+// Partitions every index group of mesh into meshlets of at most max_vertices
+// (up to 256) vertices and max_triangles triangles, with bounding spheres
+// and normal cones. Index buffers must be triangle lists, as
+// ParseOptions::triangulate leaves them. Returns one entry per index group
+// in the order of OBJParser::IndexGroups.
+inline std::vector<IndexGroupMeshlets> BuildMeshlets(
+    const OBJParser::Mesh& mesh, std::size_t max_vertices,
+    std::size_t max_triangles, ThreadPool& pool) {
+  std::vector<const OBJParser::IndexGroup*> index_groups =
+      OBJParser::IndexGroups(mesh.sub_objects);
+  std::vector<IndexGroupMeshlets> meshlets(index_groups.size());
+  pool.ParallelFor(index_groups.size(), [&](std::size_t i) {
+    MeshletBuilder builder(max_vertices, max_triangles);
+    builder.Build(
+        index_groups[i]->index_buffer_,
+        [&mesh](INTEGER vertex) {
+          const std::array<REAL, 4>& p = mesh.vertex_buffer[vertex].position;
+          return std::array<REAL, 3>{p[0], p[1], p[2]};
+        },
+        meshlets[i].meshlets, meshlets[i].vertices, meshlets[i].triangles);
+  });
+  return meshlets;
+}
+
+#endif  // _OBJ_MESHLETS_H_
@@ -0,0 +1,146 @@
+#ifndef _OBJ_NORMALS_H_
+#define _OBJ_NORMALS_H_
+
+#include <array>
+#include <cstddef>
+#include <iostream>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+#include "normal_generator.h"
+#include "obj_parser.h"
+#include "thread_pool.h"
+
+// Gives every face corner of mesh without a vn a generated normal. Within a
+// mesh group, corners of smooth index groups at equal positions share one
+// normal weighted by weighting; index groups with `s off` use face normals.
+// With generate_tangents, also fills mesh.tangents with one MikkTSpace style
+// tangent per vertex if any vertex has a texture coordinate; vertices no
+// face uses get zeros. Index buffers must be triangle lists, as
+// ParseOptions::triangulate leaves them, and must not have been narrowed;
+// otherwise mesh is left untouched and 1 is returned.
+//
+// Normals and tangents are generated one mesh group per task. Merging then
+// gives every corner a vertex with exactly its normal and tangent: the first
+// corner of a vertex claims it, later ones reuse a matching copy or add one.
+// Merging runs in file order, so the result does not depend on the thread
+// count.
+inline int GenerateNormals(OBJParser::Mesh& mesh, NormalWeighting weighting,
+                           bool generate_tangents, ThreadPool& pool) {
+  static_assert(std::is_same<REAL, float>::value,
+                "The normal generator reads attributes as float.");
+  std::vector<OBJParser::Vertex>& vertices = mesh.vertex_buffer;
+  for (const OBJParser::IndexGroup* index_group :
+       OBJParser::IndexGroups(mesh.sub_objects)) {
+    bool is_triangle_list = index_group->index_buffer_16_.empty() &&
+                            index_group->index_buffer_.size() % 3 == 0;
+    for (INTEGER index : index_group->index_buffer_) {
+      is_triangle_list = is_triangle_list && index < vertices.size();
+    }
+    if (!is_triangle_list) {
+#ifdef OBJ_PARSER_DEBUG
+      std::cerr << "[GenerateNormals] Error: Index group '"
+                << index_group->mtl_name << "' is not a triangle list.\n";
+#endif
+      return 1;
+    }
+  }
+  auto generator_input = [&vertices](INTEGER vertex) {
+    NormalGenerator::Input input;
+    const OBJParser::Vertex& v = vertices[vertex];
+    input.position = v.position.data();
+    if (v.texture_coordinate != OBJParser::kMissingAttribute) {
+      input.texture_coordinate = v.texture_coordinate.data();
+    }
+    if (v.normal != OBJParser::kMissingAttribute) {
+      input.normal = v.normal.data();
+    }
+    return input;
+  };
+  // Keeps the stored normal when it compares equal, so that a 0 read from
+  // the file does not turn into a generated -0.
+  auto set_normal = [&vertices](INTEGER vertex,
+                                const std::array<REAL, 3>& normal) {
+    if (vertices[vertex].normal != normal) {
+      vertices[vertex].normal = normal;
+    }
+  };
+
+  std::vector<OBJParser::MeshGroup*> mesh_groups;
+  for (OBJParser::SubObject& sub_object : mesh.sub_objects) {
+    for (OBJParser::MeshGroup& mesh_group : sub_object.mesh_groups) {
+      mesh_groups.push_back(&mesh_group);
+    }
+  }
+  const std::size_t vertex_count = vertices.size();
+  bool has_texture_coordinates = false;
+  for (std::size_t v = 0; v < vertex_count && !has_texture_coordinates; v++) {
+    has_texture_coordinates =
+        vertices[v].texture_coordinate != OBJParser::kMissingAttribute;
+  }
+  const bool has_tangents = generate_tangents && has_texture_coordinates;
+  std::vector<std::vector<std::array<REAL, 3>>> normals(mesh_groups.size());
+  std::vector<std::vector<std::array<REAL, 4>>> tangents(mesh_groups.size());
+  pool.ParallelFor(mesh_groups.size(), [&](std::size_t i) {
+    NormalGenerator generator(weighting);
+    for (OBJParser::IndexGroup& index_group : mesh_groups[i]->index_groups) {
+      generator.AddTriangles(index_group.index_buffer_,
+                             index_group.is_smooth_shading, generator_input);
+    }
+    generator.GenerateNormals(normals[i]);
+    if (has_tangents) {
+      generator.GenerateTangents(tangents[i]);
+    }
+  });
+
+  const INTEGER none = std::numeric_limits<INTEGER>::max();
+  std::vector<bool> is_claimed(vertex_count, false);
+  // Next copy of a vertex with another normal or tangent.
+  std::vector<INTEGER> next_copies(vertex_count, none);
+  if (has_tangents) {
+    mesh.tangents.assign(vertex_count, {0, 0, 0, 0});
+  }
+  auto matches = [&](INTEGER vertex, const std::array<REAL, 3>& normal,
+                     const std::array<REAL, 4>* tangent) {
+    return vertices[vertex].normal == normal &&
+           (tangent == nullptr || mesh.tangents[vertex] == *tangent);
+  };
+  for (std::size_t i = 0; i < mesh_groups.size(); i++) {
+    std::size_t corner = 0;
+    for (OBJParser::IndexGroup& index_group : mesh_groups[i]->index_groups) {
+      for (INTEGER& index : index_group.index_buffer_) {
+        const std::array<REAL, 3>& normal = normals[i][corner];
+        const std::array<REAL, 4>* tangent =
+            has_tangents ? &tangents[i][corner] : nullptr;
+        corner++;
+        if (!is_claimed[index]) {
+          is_claimed[index] = true;
+          set_normal(index, normal);
+          if (tangent != nullptr) {
+            mesh.tangents[index] = *tangent;
+          }
+          continue;
+        }
+        INTEGER vertex = index;
+        while (!matches(vertex, normal, tangent)) {
+          if (next_copies[vertex] == none) {
+            const INTEGER copy = static_cast<INTEGER>(next_copies.size());
+            vertices.push_back(vertices[index]);
+            set_normal(copy, normal);
+            if (tangent != nullptr) {
+              mesh.tangents.push_back(*tangent);
+            }
+            next_copies[vertex] = copy;
+            next_copies.push_back(none);
+          }
+          vertex = next_copies[vertex];
+        }
+        index = vertex;
+      }
+    }
+  }
+  return 0;
+}
+
+#endif  // _OBJ_NORMALS_H_
@@ -3,20 +3,42 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
+#include <charconv>
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
-#include <fstream>
+#include <cstring>
 #include <functional>
+#include <future>
 #include <iostream>
 #include <limits>
-#include <sstream>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "binary_cache.h"
+#include "block_reader.h"
+#include "keyword_code.h"
+#include "mapped_file.h"
 #include "mtl_parser.h"
+#include "parse_stats.h"
+#include "polygon_triangulator.h"
+#include "thread_pool.h"
+#include "vertex_index_map.h"
 
 class OBJParser {
+ public:
   struct Vertex {
     bool operator==(const Vertex& rhs) const {
       return position == rhs.position &&
@@ -28,11 +50,31 @@ class OBJParser {
     std::array<REAL, 3> normal;
   };
 
+  // texture_coordinate and normal of vertices whose face corner has none.
+  static constexpr std::array<REAL, 3> kMissingAttribute = {
+      std::numeric_limits<REAL>::max(), std::numeric_limits<REAL>::max(),
+      std::numeric_limits<REAL>::max()};
+
+  // material_id of index groups that come before any usemtl.
+  static constexpr std::uint32_t kNoMaterial =
+      std::numeric_limits<std::uint32_t>::max();
+
   struct IndexGroup {
     std::string mtl_name;
+    // Index of mtl_name in material_names() and materials(), or kNoMaterial.
+    std::uint32_t material_id = kNoMaterial;
     bool is_smooth_shading = true;
     bool is_smooth_shading_empty = true;
     std::vector<INTEGER> index_buffer_;
+    // Corner count of every face in index_buffer_. Only recorded while
+    // ParseOptions::triangulate is set, and emptied once the faces are
+    // triangles.
+    std::vector<std::uint32_t> face_sizes;
+    // With ParseOptions::narrow_indices, groups whose vertices span at most
+    // 65536 indices keep them here as offsets from base_vertex and leave
+    // index_buffer_ empty.
+    std::vector<std::uint16_t> index_buffer_16_;
+    INTEGER base_vertex = 0;
   };
 
   struct MeshGroup {
@@ -45,172 +87,1912 @@ class OBJParser {
     std::vector<MeshGroup> mesh_groups;
   };
 
- public:
+  // Tightly packed per-attribute streams, filled instead of the interleaved
+  // vertex buffer when ParseOptions::vertex_layout is kPlanar. Attributes no
+  // face corner refers to are dropped and have 0 components. Corners that
+  // lack an attribute present elsewhere get max() sentinels, as in Vertex.
+  struct PlanarVertexBuffer {
+    std::size_t vertex_count = 0;
+    std::size_t position_components = 0;
+    std::size_t texture_coordinate_components = 0;
+    std::size_t normal_components = 0;
+    std::vector<REAL> positions;
+    std::vector<REAL> texture_coordinates;
+    std::vector<REAL> normals;
+  };
+
+  enum class VertexLayout { kInterleaved, kPlanar };
+
+  // Everything a parse produces, detached from the parser by Release().
+  struct Mesh {
+    std::string mtl_name;
+    std::vector<std::string> material_names;
+    std::vector<Material> materials;
+    std::vector<Vertex> vertex_buffer;
+    PlanarVertexBuffer planar_vertex_buffer;
+    // xyz and handedness w per vertex, empty until GenerateNormals of
+    // obj_normals.h fills it.
+    std::vector<std::array<REAL, 4>> tangents;
+    std::vector<SubObject> sub_objects;
+    std::vector<std::size_t> line_indices;
+  };
+
+  struct ParseOptions {
+    // Threads used to tokenize v/vt/vn/f records. 1 parses serially and 0
+    // uses every hardware thread.
+    unsigned thread_count = 1;
+    // Collect raw face corners while parsing and deduplicate them afterwards
+    // in a separate stage sharded across thread_count threads.
+    bool deferred_dedup = false;
+    // With deferred_dedup, number vertices in order of first use exactly like
+    // the inline path. Otherwise vertices are numbered shard by shard, which
+    // skips one pass over the corners.
+    bool first_occurrence_order = true;
+    // kPlanar fills planar_vertex_buffer() straight from the v, vt and vn
+    // records and leaves vertex_buffer() empty, so the stages of the other
+    // headers, which read vertex_buffer, do not apply to it.
+    VertexLayout vertex_layout = VertexLayout::kInterleaved;
+    // Keep the w component of positions in the planar layout.
+    bool keep_position_w = false;
+    // Turn every index buffer into a triangle list. Convex faces are fanned
+    // and concave ones ear clipped; faces with fewer than 3 corners are
+    // dropped.
+    bool triangulate = false;
+    // Emit the indices of every index group whose vertices fit in 16 bits
+    // as index_buffer_16_ plus base_vertex, as the group is built. The
+    // stages of the other headers read index_buffer_ only and refuse or
+    // skip such groups.
+    bool narrow_indices = false;
+    // Make Clear(), and so every parse, keep the groups, index buffers and
+    // vertex buffers of the previous result for reuse. Parsing files of
+    // similar shape one after another then allocates next to nothing. The
+    // memory is only returned when the parser is destroyed.
+    bool reuse_capacity = false;
+    // Parse the mtllib library on a separate thread while the geometry is
+    // parsed, filling materials(). Relative paths are resolved against the
+    // directory of the OBJ file.
+    bool load_materials = false;
+    // Directory for binary caches. Parse(path) keeps whole meshes there and
+    // maps them on later parses of the unchanged file; see cached_mesh().
+    // IndexFile keeps part indices there, and load_materials parsed material
+    // libraries. Empty disables them.
+    std::string cache_directory;
+  };
+
+  // Read-only view of a mesh cache file written by Parse(path). Every array
+  // points into the mapped file, so opening a view does not decode any
+  // vertex or index.
+  class MeshView {
+   public:
+    MeshView() = default;
+    MeshView(const MeshView&) = delete;
+    MeshView& operator=(const MeshView&) = delete;
+    ~MeshView() = default;
+
+    const CacheReader& reader() const { return reader_; }
+    std::string_view mtl_name() const { return String(Meta()[0]); }
+    // Material names in order of IndexGroup::material_id.
+    std::size_t material_count() const { return Meta().size - 1; }
+    std::string_view material_name(std::size_t id) const {
+      return String(Meta()[id + 1]);
+    }
+    CacheArray<Vertex> vertex_buffer() const {
+      return reader_.Section<Vertex>(kMeshCacheVertices);
+    }
+    // vertex_count, position_components, texture_coordinate_components and
+    // normal_components of the planar layout, or empty.
+    CacheArray<std::uint64_t> planar_layout() const {
+      return reader_.Section<std::uint64_t>(kMeshCachePlanarLayout);
+    }
+    CacheArray<REAL> planar_positions() const {
+      return reader_.Section<REAL>(kMeshCachePlanarPositions);
+    }
+    CacheArray<REAL> planar_texture_coordinates() const {
+      return reader_.Section<REAL>(kMeshCachePlanarTextureCoordinates);
+    }
+    CacheArray<REAL> planar_normals() const {
+      return reader_.Section<REAL>(kMeshCachePlanarNormals);
+    }
+    CacheArray<CacheSubObject> sub_objects() const {
+      return reader_.Section<CacheSubObject>(kMeshCacheSubObjects);
+    }
+    CacheArray<CacheMeshGroup> mesh_groups() const {
+      return reader_.Section<CacheMeshGroup>(kMeshCacheMeshGroups);
+    }
+    CacheArray<CacheIndexGroup> index_groups() const {
+      return reader_.Section<CacheIndexGroup>(kMeshCacheIndexGroups);
+    }
+    // Empty for narrowed groups, which use index_buffer_16.
+    CacheArray<INTEGER> index_buffer(const CacheIndexGroup& group) const {
+      return Slice<INTEGER>(kMeshCacheIndices, group, group.is_narrow == 0);
+    }
+    // Offsets from group.base_vertex of a narrowed group, else empty.
+    CacheArray<std::uint16_t> index_buffer_16(
+        const CacheIndexGroup& group) const {
+      return Slice<std::uint16_t>(kMeshCacheIndices16, group,
+                                  group.is_narrow != 0);
+    }
+    CacheArray<std::uint64_t> line_indices() const {
+      return reader_.Section<std::uint64_t>(kMeshCacheLineIndices);
+    }
+    std::string_view String(const CacheStringRef& ref) const {
+      std::string_view s;
+      reader_.GetString(kMeshCacheStrings, ref, s);
+      return s;
+    }
+
+    // Maps the cache and checks that every record refers to data inside it.
+    int Open(const std::string& cache_path) {
+      if (reader_.Open(cache_path, kMeshCacheMagic) != 0) {
+        return 1;
+      }
+      if (Meta().empty() || !IsValid()) {
+        reader_.Close();
+        return 1;
+      }
+      return 0;
+    }
+
+    int Close() { return reader_.Close(); }
+
+    // Copies the cached mesh out of the mapping. Materials are not cached
+    // and stay empty.
+    Mesh ToMesh() const {
+      Mesh mesh;
+      mesh.mtl_name = mtl_name();
+      for (std::size_t id = 0; id < material_count(); id++) {
+        mesh.material_names.emplace_back(material_name(id));
+      }
+      CacheArray<Vertex> vertices = vertex_buffer();
+      mesh.vertex_buffer.assign(vertices.begin(), vertices.end());
+      CacheArray<std::uint64_t> layout = planar_layout();
+      if (!layout.empty()) {
+        PlanarVertexBuffer& planar = mesh.planar_vertex_buffer;
+        planar.vertex_count = static_cast<std::size_t>(layout[0]);
+        planar.position_components = static_cast<std::size_t>(layout[1]);
+        planar.texture_coordinate_components =
+            static_cast<std::size_t>(layout[2]);
+        planar.normal_components = static_cast<std::size_t>(layout[3]);
+        CacheArray<REAL> positions = planar_positions();
+        CacheArray<REAL> texture_coordinates = planar_texture_coordinates();
+        CacheArray<REAL> normals = planar_normals();
+        planar.positions.assign(positions.begin(), positions.end());
+        planar.texture_coordinates.assign(texture_coordinates.begin(),
+                                          texture_coordinates.end());
+        planar.normals.assign(normals.begin(), normals.end());
+      }
+      CacheArray<CacheMeshGroup> cached_mesh_groups = mesh_groups();
+      CacheArray<CacheIndexGroup> cached_index_groups = index_groups();
+      mesh.sub_objects.reserve(sub_objects().size);
+      for (const CacheSubObject& cached_sub : sub_objects()) {
+        SubObject sub_object;
+        sub_object.sub_object_name = String(cached_sub.name);
+        for (std::uint64_t m = 0; m < cached_sub.mesh_group_count; m++) {
+          const CacheMeshGroup& cached_mesh =
+              cached_mesh_groups[cached_sub.first_mesh_group + m];
+          MeshGroup mesh_group;
+          mesh_group.mesh_group_name = String(cached_mesh.name);
+          for (std::uint64_t g = 0; g < cached_mesh.index_group_count; g++) {
+            const CacheIndexGroup& cached_group =
+                cached_index_groups[cached_mesh.first_index_group + g];
+            IndexGroup index_group;
+            index_group.mtl_name = String(cached_group.mtl_name);
+            index_group.material_id = cached_group.material_id;
+            index_group.is_smooth_shading = cached_group.is_smooth_shading != 0;
+            index_group.is_smooth_shading_empty =
+                cached_group.is_smooth_shading_empty != 0;
+            CacheArray<INTEGER> indices = index_buffer(cached_group);
+            index_group.index_buffer_.assign(indices.begin(), indices.end());
+            CacheArray<std::uint16_t> indices_16 =
+                index_buffer_16(cached_group);
+            index_group.index_buffer_16_.assign(indices_16.begin(),
+                                                indices_16.end());
+            index_group.base_vertex =
+                static_cast<INTEGER>(cached_group.base_vertex);
+            mesh_group.index_groups.push_back(std::move(index_group));
+          }
+          sub_object.mesh_groups.push_back(std::move(mesh_group));
+        }
+        mesh.sub_objects.push_back(std::move(sub_object));
+      }
+      CacheArray<std::uint64_t> cached_line_indices = line_indices();
+      mesh.line_indices.assign(cached_line_indices.begin(),
+                               cached_line_indices.end());
+      return mesh;
+    }
+
+   private:
+    CacheArray<CacheStringRef> Meta() const {
+      return reader_.Section<CacheStringRef>(kMeshCacheMeta);
+    }
+
+    // The indices of group in section id, or nothing unless is_used.
+    template <class T>
+    CacheArray<T> Slice(std::size_t id, const CacheIndexGroup& group,
+                        bool is_used) const {
+      CacheArray<T> indices;
+      if (is_used) {
+        indices = reader_.Section<T>(id);
+        indices.data += group.first_index;
+        indices.size = static_cast<std::size_t>(group.index_count);
+      }
+      return indices;
+    }
+
+    bool IsValidString(const CacheStringRef& ref) const {
+      std::string_view s;
+      return reader_.GetString(kMeshCacheStrings, ref, s);
+    }
+
+    bool IsValid() const {
+      for (const CacheStringRef& ref : Meta()) {
+        if (!IsValidString(ref)) {
+          return false;
+        }
+      }
+      CacheArray<std::uint64_t> layout = planar_layout();
+      std::uint64_t vertex_count = vertex_buffer().size;
+      if (!layout.empty()) {
+        if (layout.size != 4 || !vertex_buffer().empty() ||
+            planar_positions().size != layout[0] * layout[1] ||
+            planar_texture_coordinates().size != layout[0] * layout[2] ||
+            planar_normals().size != layout[0] * layout[3]) {
+          return false;
+        }
+        vertex_count = layout[0];
+      }
+      CacheArray<INTEGER> indices = reader_.Section<INTEGER>(kMeshCacheIndices);
+      for (INTEGER index : indices) {
+        if (index >= vertex_count) {
+          return false;
+        }
+      }
+      CacheArray<CacheMeshGroup> meshes = mesh_groups();
+      CacheArray<CacheIndexGroup> groups = index_groups();
+      for (const CacheSubObject& sub_object : sub_objects()) {
+        if (!IsValidString(sub_object.name) ||
+            sub_object.first_mesh_group > meshes.size ||
+            sub_object.mesh_group_count >
+                meshes.size - sub_object.first_mesh_group) {
+          return false;
+        }
+      }
+      for (const CacheMeshGroup& mesh : meshes) {
+        if (!IsValidString(mesh.name) ||
+            mesh.first_index_group > groups.size ||
+            mesh.index_group_count > groups.size - mesh.first_index_group) {
+          return false;
+        }
+      }
+      CacheArray<std::uint16_t> indices_16 =
+          reader_.Section<std::uint16_t>(kMeshCacheIndices16);
+      for (const CacheIndexGroup& group : groups) {
+        const std::size_t section_size =
+            group.is_narrow != 0 ? indices_16.size : indices.size;
+        if (!IsValidString(group.mtl_name) ||
+            group.first_index > section_size ||
+            group.index_count > section_size - group.first_index ||
+            (group.material_id != kNoMaterial &&
+             group.material_id >= material_count())) {
+          return false;
+        }
+        for (std::uint16_t offset : index_buffer_16(group)) {
+          if (group.base_vertex + offset >= vertex_count) {
+            return false;
+          }
+        }
+      }
+      return true;
+    }
+
+    CacheReader reader_;
+  };
+
+  // Records streamed since the previous batch. Face corners and line indices
+  // are the 1-based indices of the file, with 0 for an absent vt or vn, so
+  // positions[i] has index position_base + i + 1.
+  struct StreamBatch {
+    std::size_t position_base = 0;
+    std::size_t texture_coordinate_base = 0;
+    std::size_t normal_base = 0;
+    std::vector<std::array<REAL, 4>> positions;
+    std::vector<std::array<REAL, 3>> texture_coordinates;
+    std::vector<std::array<REAL, 3>> normals;
+    // Corners of all faces back to back; face_sizes holds each face's arity.
+    std::vector<std::array<std::size_t, 3>> face_corners;
+    std::vector<std::uint32_t> face_sizes;
+    std::vector<std::size_t> line_indices;
+
+    std::size_t record_count() const {
+      return positions.size() + texture_coordinates.size() + normals.size() +
+             face_corners.size() + line_indices.size();
+    }
+  };
+
+  // Receives the records of ParseStream in file order. A batch is delivered
+  // before every o, g, usemtl, mtllib and s record, so state changes apply to
+  // exactly the faces that follow them. Callbacks return 0 to continue and
+  // nonzero to stop the parse with an error.
+  class StreamHandler {
+   public:
+    virtual ~StreamHandler() = default;
+    virtual int OnBatch(const StreamBatch& /*batch*/) { return 0; }
+    virtual int OnObject(std::string_view /*name*/) { return 0; }
+    virtual int OnGroup(std::string_view /*name*/) { return 0; }
+    virtual int OnMaterial(std::string_view /*name*/) { return 0; }
+    virtual int OnMaterialLibrary(std::string_view /*name*/) { return 0; }
+    virtual int OnSmoothShading(bool /*is_smooth_shading*/) { return 0; }
+  };
+
+  static constexpr std::size_t kDefaultStreamBatchSize = 1 << 16;
+
+  // One o or g section of a file, from the record that opens it up to the
+  // next o or g record. Faces, usemtl or s records before the first of them
+  // form a part of their own, whose sub-object ParseLine names "Unnamed".
+  struct IndexedPart {
+    std::string sub_object_name;
+    // Empty unless a g record opens the part.
+    std::string mesh_group_name;
+    // Position in PartIndex::parts of the part that opened the sub-object
+    // this one belongs to.
+    std::uint64_t object_part = 0;
+    // Byte range in the file.
+    std::uint64_t begin = 0;
+    std::uint64_t end = 0;
+    // v, vt and vn records before begin.
+    std::array<std::uint64_t, 3> attribute_base = {0, 0, 0};
+    // Material and smoothing mode in effect at begin.
+    std::string material_name;
+    bool is_smooth_shading = true;
+  };
+
+  // Spacing of the records in PartIndex::attribute_offsets.
+  static constexpr std::size_t kPartIndexStride = 1024;
+
+  // Where the parts of a file and its attribute records lie, so that
+  // ParseParts can read a few parts without going through the rest.
+  struct PartIndex {
+    std::uint64_t source_size = 0;
+    std::string mtl_name;
+    std::vector<IndexedPart> parts;
+    // v, vt and vn records in the file.
+    std::array<std::uint64_t, 3> attribute_counts = {0, 0, 0};
+    // Byte offsets of records 0, kPartIndexStride, 2 * kPartIndexStride, ...
+    // of each kind.
+    std::array<std::vector<std::uint64_t>, 3> attribute_offsets;
+
+    // Positions in parts of every part of the sub-objects named
+    // sub_object_name, or only of their g parts named mesh_group_name when
+    // that is given.
+    std::vector<std::size_t> Find(
+        std::string_view sub_object_name,
+        std::string_view mesh_group_name = std::string_view()) const {
+      std::vector<std::size_t> found;
+      for (std::size_t i = 0; i < parts.size(); i++) {
+        if (parts[i].sub_object_name == sub_object_name &&
+            (mesh_group_name.empty() ||
+             parts[i].mesh_group_name == mesh_group_name)) {
+          found.push_back(i);
+        }
+      }
+      return found;
+    }
+  };
+
   OBJParser() = default;
   OBJParser(const OBJParser&) = delete;
   OBJParser& operator=(const OBJParser&) = delete;
   ~OBJParser() = default;
 
-  std::vector<Vertex> vertex_buffer() const { return vertex_buffer_; }
-  std::vector<SubObject> sub_objects() const { return sub_objects_; }
-  std::vector<std::size_t> line_indices() const { return line_indices_; }
+  const std::string& mtl_name() const { return mtl_name_; }
+  // Distinct usemtl names in order of first use; IndexGroup::material_id
+  // indexes this.
+  const std::vector<std::string>& material_names() const {
+    return material_names_;
+  }
+  // One material per entry of material_names(), filled with
+  // ParseOptions::load_materials. Names the library lacks get a default
+  // material; a library that failed to parse leaves this empty.
+  const std::vector<Material>& materials() const { return materials_; }
+  // After a cache hit these copy the mesh out of cached_mesh() on
+  // first use.
+  const std::vector<Vertex>& vertex_buffer() const {
+    CopyCachedMesh();
+    return vertex_buffer_;
+  }
+  const PlanarVertexBuffer& planar_vertex_buffer() const {
+    CopyCachedMesh();
+    return planar_vertex_buffer_;
+  }
+  const std::vector<SubObject>& sub_objects() const {
+    CopyCachedMesh();
+    return sub_objects_;
+  }
+  const std::vector<std::size_t>& line_indices() const {
+    CopyCachedMesh();
+    return line_indices_;
+  }
+
+  // The mapped cache the last Parse(path) took its result from, or null if
+  // it parsed the file. Reading the mesh through it copies nothing; the
+  // mapping lives as long as the returned pointer or the parser's result.
+  std::shared_ptr<const MeshView> cached_mesh() const { return cached_mesh_; }
+
+  // Cache file that Parse(path) keeps the mesh of path in under the current
+  // options. Caches of other options are kept separately.
+  std::string MeshCachePath(const std::string& path) const {
+    return CacheFilePath(parse_options_.cache_directory, path,
+                         MeshCacheFingerprint(), ".objcache");
+  }
+
+  // Moves the result of the last parse out without copying and leaves the
+  // parser empty. A result taken from the cache is copied out of it first.
+  Mesh Release() {
+    CopyCachedMesh();
+    Mesh mesh;
+    mesh.mtl_name = std::move(mtl_name_);
+    mesh.material_names = std::move(material_names_);
+    mesh.materials = std::move(materials_);
+    mesh.vertex_buffer = std::move(vertex_buffer_);
+    mesh.planar_vertex_buffer = std::move(planar_vertex_buffer_);
+    mesh.sub_objects = std::move(sub_objects_);
+    mesh.line_indices = std::move(line_indices_);
+    Clear();
+    return mesh;
+  }
+
+  // Size, load factor and probe lengths of the (v, vt, vn) lookup tables used
+  // by the last parse. With deferred_dedup the shard tables are summed.
+  VertexIndexMap::Stats dedup_stats() const {
+    return parse_options_.deferred_dedup ? dedup_stats_ : vertex_map_.stats();
+  }
+
+  // Counters and phase times of the last parse. Only collected when
+  // PARSE_STATS is defined; see parse_stats.h.
+  const ParseStats& stats() const { return stats_; }
+
+  const ParseOptions& parse_options() const { return parse_options_; }
+  void set_parse_options(const ParseOptions& options) {
+    parse_options_ = options;
+  }
+
+  // Threads the parser runs on, as many as ParseOptions::thread_count asks
+  // for. The stages of the other obj_*.h headers can share them.
+  ThreadPool& thread_pool() {
+    unsigned thread_count = parse_options_.thread_count;
+    if (thread_count == 0) {
+      thread_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+    if (!thread_pool_ || thread_pool_->thread_count() != thread_count) {
+      thread_pool_ = std::make_unique<ThreadPool>(thread_count);
+    }
+    return *thread_pool_;
+  }
+
+  // Every index group of sub_objects in order. Stages that give one result
+  // per index group give them in this order.
+  static std::vector<IndexGroup*> IndexGroups(
+      std::vector<SubObject>& sub_objects) {
+    std::vector<IndexGroup*> index_groups;
+    for (SubObject& sub_object : sub_objects) {
+      for (MeshGroup& mesh_group : sub_object.mesh_groups) {
+        for (IndexGroup& index_group : mesh_group.index_groups) {
+          index_groups.push_back(&index_group);
+        }
+      }
+    }
+    return index_groups;
+  }
+
+  static std::vector<const IndexGroup*> IndexGroups(
+      const std::vector<SubObject>& sub_objects) {
+    std::vector<const IndexGroup*> index_groups;
+    for (const SubObject& sub_object : sub_objects) {
+      for (const MeshGroup& mesh_group : sub_object.mesh_groups) {
+        for (const IndexGroup& index_group : mesh_group.index_groups) {
+          index_groups.push_back(&index_group);
+        }
+      }
+    }
+    return index_groups;
+  }
 
+  // Path of the library mtl_name as named by mtllib in the OBJ at obj_path.
+  static std::string ResolveMaterialPath(const std::string& obj_path,
+                                         const std::string& mtl_name) {
+    const bool is_absolute =
+        mtl_name.empty() || mtl_name.front() == '/' ||
+        mtl_name.front() == '\\' ||
+        (mtl_name.size() > 1 && mtl_name[1] == ':');
+    const std::size_t slash = obj_path.find_last_of("/\\");
+    if (is_absolute || slash == std::string::npos) {
+      return mtl_name;
+    }
+    return obj_path.substr(0, slash + 1) + mtl_name;
+  }
+
+  // The materials of library in the order of names, for indexing by
+  // IndexGroup::material_id.
+  static std::vector<Material> FlattenMaterials(
+      const std::vector<std::string>& names,
+      const std::unordered_map<std::string, Material>& library) {
+    std::vector<Material> materials(names.size(), Material());
+    for (std::size_t i = 0; i < names.size(); i++) {
+      auto itr = library.find(names[i]);
+      if (itr != library.end()) {
+        materials[i] = itr->second;
+      } else {
+        materials[i].name_ = names[i];
+      }
+    }
+    return materials;
+  }
+
+  // Parses an .obj file, or an .obj.gz or .obj.zst one. Compressed files,
+  // and files that cannot be mapped such as named pipes, are read and
+  // decompressed on a background thread while the text already read is
+  // parsed, which is always done serially; thread_count still applies to
+  // later stages. Input whose decoder block_reader.h was built without
+  // returns BlockReader::kUnsupportedCompression.
+  //
+  // With cache_directory set, a plain .obj file is parsed once and its mesh
+  // cached there. Later calls map the cache instead while the file keeps its
+  // size and modification time, or failing that, its content hash.
   int Parse(const std::string& path) {
-    if (input_stream_.is_open()) {
-#ifdef DEBUG
+    if (mapped_file_.is_open()) {
+#ifdef OBJ_PARSER_DEBUG
       std::cerr << "[OBJParser] Error: Stream is already open.\n";
 #endif
       return 1;
     }
-    if (path.substr(path.size() - 4) != ".obj") {
-#ifdef DEBUG
+    if (IsCompressedPath(path)) {
+      return ParseBlocks(block_reader_.Open(path), path);
+    }
+    if (!EndsWith(path, ".obj")) {
+#ifdef OBJ_PARSER_DEBUG
+      std::cerr << "[OBJParser] Error: File is not an .obj file.\n";
+#endif
+      return 1;
+    }
+#ifdef PARSE_STATS
+    const auto open_start = std::chrono::steady_clock::now();
+#endif
+    if (!BlockReader::IsRegularFile(path) || mapped_file_.Open(path) != 0) {
+      return ParseBlocks(block_reader_.Open(path), path);
+    }
+    if (!parse_options_.cache_directory.empty()) {
+      const int result = ParseCached(path);
+      mapped_file_.Close();
+      return result;
+    }
+#ifdef PARSE_STATS
+    const double open_seconds = ParseStats::SecondsSince(open_start);
+#endif
+    int result =
+        ParseFromMemory(mapped_file_.data(), mapped_file_.size(), path);
+    mapped_file_.Close();
+#ifdef PARSE_STATS
+    stats_.io_seconds += open_seconds;
+    stats_.total_seconds += open_seconds;
+#endif
+    return result;
+  }
+
+  // Parses OBJ text read from stream until its end, plain or compressed.
+  // Reading happens on a background thread, as for a pipe passed to
+  // Parse(path); the stream must not be used elsewhere during the call.
+  // Relative mtllib paths are resolved against the working directory.
+  int Parse(std::istream& stream) {
+    return ParseBlocks(block_reader_.Open(stream), std::string());
+  }
+
+  // Parses OBJ text read from fd, such as a pipe or socket, from its current
+  // position until its end. The descriptor is left open.
+  int Parse(int fd) {
+    return ParseBlocks(block_reader_.Open(fd), std::string());
+  }
+
+  // Parses OBJ text held in memory. The buffer only has to outlive the call.
+  // source_path is where the text came from; relative mtllib paths are
+  // resolved against its directory, or the working directory if empty.
+  int ParseFromMemory(const char* data, std::size_t size,
+                      const std::string& source_path = std::string()) {
+    BeginParse(source_path);
+#ifdef PARSE_STATS
+    stats_.bytes_read = size;
+#endif
+    int result;
+    if (parse_options_.thread_count != 1 && size >= 2 * kMinChunkSize) {
+      result = ParseChunks(data, size);
+    } else {
+      result = ForEachLine(data, data + size, [this](std::string_view line) {
+        return ParseLine(line);
+      });
+#ifdef PARSE_STATS
+      SplitSerialParseTime();
+#endif
+    }
+    return FinishParse(result);
+  }
+
+  // Parses the file without building a mesh. Records are handed to handler in
+  // batches, each delivered once it holds batch_size attributes, face corners
+  // and line indices. Nothing is kept between batches, so memory use does not
+  // grow with the file. The file is mapped for sequential access; .obj.gz
+  // and .obj.zst files are decompressed block by block as in Parse.
+  int ParseStream(const std::string& path, StreamHandler& handler,
+                  std::size_t batch_size = kDefaultStreamBatchSize) {
+    if (IsCompressedPath(path)) {
+      const int open_result = block_reader_.Open(path);
+      if (open_result != 0) {
+        ReportOpenError(open_result, path);
+        return open_result;
+      }
+      StreamBatch batch;
+      batch_size = std::max<std::size_t>(batch_size, 1);
+      int result = block_reader_.ForEachLine([&](std::string_view line) {
+        return StreamRecord(line, batch, handler, batch_size);
+      });
+      block_reader_.Close();
+      return result == 0 ? FlushBatch(batch, handler) : result;
+    }
+    if (!EndsWith(path, ".obj")) {
+#ifdef OBJ_PARSER_DEBUG
       std::cerr << "[OBJParser] Error: File is not an .obj file.\n";
 #endif
       return 1;
     }
-    input_stream_.open(path);
-    if (!input_stream_.is_open()) {
-#ifdef DEBUG
+    MappedFile file;
+    if (file.Open(path) != 0) {
+#ifdef OBJ_PARSER_DEBUG
       std::cerr << "[OBJParser] Error: Failed to open file: " << path << "\n";
 #endif
       return 1;
     }
+    return ParseStreamFromMemory(file.data(), file.size(), handler,
+                                 batch_size);
+  }
+
+  int ParseStreamFromMemory(const char* data, std::size_t size,
+                            StreamHandler& handler,
+                            std::size_t batch_size = kDefaultStreamBatchSize) {
+    StreamBatch batch;
+    batch_size = std::max<std::size_t>(batch_size, 1);
+    int result = ForEachLine(data, data + size, [&](std::string_view line) {
+      return StreamRecord(line, batch, handler, batch_size);
+    });
+    return result == 0 ? FlushBatch(batch, handler) : result;
+  }
+
+  // Builds the part index of an .obj file. Only keywords and names are
+  // tokenized. With cache_directory set the index is stored there and reused
+  // while the file keeps its size and modification time.
+  int IndexFile(const std::string& path, PartIndex& index) {
+    if (!EndsWith(path, ".obj")) {
+#ifdef OBJ_PARSER_DEBUG
+      std::cerr << "[OBJParser] Error: Only .obj files can be indexed.\n";
+#endif
+      return 1;
+    }
+    MappedFile file;
+    if (file.Open(path) != 0) {
+#ifdef OBJ_PARSER_DEBUG
+      std::cerr << "[OBJParser] Error: Failed to open file: " << path << "\n";
+#endif
+      return 1;
+    }
+    if (parse_options_.cache_directory.empty()) {
+      return IndexFromMemory(file.data(), file.size(), index);
+    }
+    const std::uint64_t stamp = ModificationTime(path);
+    const std::string cache_path =
+        CacheFilePath(parse_options_.cache_directory, path,
+                      PartIndexFingerprint(), ".objindex");
+    if (LoadPartIndex(cache_path, file.size(), stamp, index) == 0) {
+      return 0;
+    }
+    if (IndexFromMemory(file.data(), file.size(), index) != 0) {
+      return 1;
+    }
+    if (WritePartIndex(cache_path, stamp, index) != 0) {
+#ifdef OBJ_PARSER_DEBUG
+      std::cerr << "[OBJParser] Warning: Failed to write index: " << cache_path
+                << "\n";
+#endif
+    }
+    return 0;
+  }
+
+  static int IndexFromMemory(const char* data, std::size_t size,
+                             PartIndex& index) {
+    index = PartIndex();
+    index.source_size = size;
+    std::string material_name;
+    bool is_smooth_shading = true;
+    std::uint64_t object_part = kNoPart;
+    auto add_part = [&](std::uint64_t begin, std::string_view sub_object_name,
+                        std::string_view mesh_group_name) {
+      if (!index.parts.empty()) {
+        index.parts.back().end = begin;
+      }
+      IndexedPart part;
+      part.sub_object_name = sub_object_name;
+      part.mesh_group_name = mesh_group_name;
+      if (mesh_group_name.empty() || object_part == kNoPart) {
+        object_part = index.parts.size();
+      }
+      part.object_part = object_part;
+      part.begin = begin;
+      part.attribute_base = index.attribute_counts;
+      part.material_name = material_name;
+      part.is_smooth_shading = is_smooth_shading;
+      index.parts.push_back(std::move(part));
+    };
+    auto add_attribute = [&](std::size_t kind, std::uint64_t offset) {
+      if (index.attribute_counts[kind] % kPartIndexStride == 0) {
+        index.attribute_offsets[kind].push_back(offset);
+      }
+      index.attribute_counts[kind]++;
+    };
+    // Records that need a sub-object. Before any o or g they start the
+    // leading part.
+    auto add_record = [&] {
+      if (index.parts.empty()) {
+        add_part(0, "Unnamed", std::string_view());
+      }
+    };
+    int result =
+        ForEachLine(data, data + size, [&](std::string_view line) {
+          const std::uint64_t offset =
+              static_cast<std::uint64_t>(line.data() - data);
+          std::string_view rest = line;
+          Keyword keyword = QuickKeyword(line);
+          if (keyword == Keyword::kUnknown) {
+            keyword = ClassifyKeyword(ReadRecord(rest));
+          }
+          switch (keyword) {
+            case Keyword::kPosition:
+              add_attribute(0, offset);
+              break;
+            case Keyword::kTextureCoordinate:
+              add_attribute(1, offset);
+              break;
+            case Keyword::kNormal:
+              add_attribute(2, offset);
+              break;
+            case Keyword::kObject:
+              add_part(offset, rest, std::string_view());
+              break;
+            case Keyword::kGroup:
+              add_part(offset,
+                       object_part == kNoPart
+                           ? std::string_view("Unnamed")
+                           : std::string_view(
+                                 index.parts[object_part].sub_object_name),
+                       rest);
+              break;
+            case Keyword::kMaterial:
+              add_record();
+              material_name = rest;
+              break;
+            case Keyword::kSmoothShading:
+              add_record();
+              if (rest == "1") {
+                is_smooth_shading = true;
+              } else if (rest == "off") {
+                is_smooth_shading = false;
+              }
+              break;
+            case Keyword::kMaterialLibrary:
+              index.mtl_name = rest;
+              break;
+            case Keyword::kFace:
+            case Keyword::kLine:
+              add_record();
+              break;
+            default:
+              break;
+          }
+          return 0;
+        });
+    if (!index.parts.empty()) {
+      index.parts.back().end = size;
+    }
+    return result;
+  }
+
+  // Parses only the given parts of the file index was built from, as if the
+  // file held nothing but them and the attributes they use. Those are read
+  // from the checkpoints of the index, so the time taken depends on the
+  // size of the parts and not of the file. Attribute numbers change with
+  // the selection: line indices count the positions read, in file order.
+  // Parsing is serial; thread_count applies to the stages after it.
+  int ParseParts(const std::string& path, const PartIndex& index,
+                 const std::vector<std::size_t>& parts) {
+    MappedFile file;
+    if (file.Open(path) != 0) {
+#ifdef OBJ_PARSER_DEBUG
+      std::cerr << "[OBJParser] Error: Failed to open file: " << path << "\n";
+#endif
+      return 1;
+    }
+    return ParsePartsFromMemory(file.data(), file.size(), index, parts, path);
+  }
+
+  int ParsePartsFromMemory(const char* data, std::size_t size,
+                           const PartIndex& index,
+                           const std::vector<std::size_t>& parts,
+                           const std::string& source_path = std::string()) {
+    std::vector<std::size_t> selected = parts;
+    std::sort(selected.begin(), selected.end());
+    selected.erase(std::unique(selected.begin(), selected.end()),
+                   selected.end());
+    if (size != index.source_size ||
+        (!selected.empty() && selected.back() >= index.parts.size())) {
+#ifdef OBJ_PARSER_DEBUG
+      std::cerr << "[OBJParser] Error: Index does not match the file.\n";
+#endif
+      return 1;
+    }
+    BeginParse(source_path);
+    mtl_name_ = index.mtl_name;
+    if (parse_options_.load_materials && !mtl_name_.empty()) {
+      LoadMaterialsAsync();
+    }
+    // v, vt and vn numbers the parts refer to, sorted. positions_,
+    // texture_coordinates_ and normals_ hold just these.
+    std::array<std::vector<std::size_t>, 3> used;
+    int result = 0;
+    for (std::size_t i = 0; i < selected.size() && result == 0; i++) {
+      result = CollectPartReferences(data, index.parts[selected[i]], used);
+    }
+    for (std::size_t kind = 0; kind < 3 && result == 0; kind++) {
+      std::sort(used[kind].begin(), used[kind].end());
+      used[kind].erase(std::unique(used[kind].begin(), used[kind].end()),
+                       used[kind].end());
+      result = ReadUsedAttributes(data, size, index, kind, used[kind]);
+    }
+    std::uint64_t open_object_part = kNoPart;
+    for (std::size_t i = 0; i < selected.size() && result == 0; i++) {
+      const IndexedPart& part = index.parts[selected[i]];
+      result = ParsePart(data, part, open_object_part, used);
+      open_object_part = part.object_part;
+#ifdef PARSE_STATS
+      stats_.bytes_read += part.end - part.begin;
+#endif
+    }
+#ifdef PARSE_STATS
+    SplitSerialParseTime();
+#endif
+    return FinishParse(result);
+  }
+
+  int Clear() {
+    is_cache_pending_.store(false, std::memory_order_relaxed);
+    cached_mesh_.reset();
+    object_name_.clear();
+    mtl_name_.clear();
+    // Waits for a library still being parsed.
+    material_future_ = std::future<MaterialLoad>();
+    material_names_.clear();
+    materials_.clear();
+    positions_.clear();
+    texture_coordinates_.clear();
+    normals_.clear();
+    vertex_map_.Clear();
+    dedup_stats_ = VertexIndexMap::Stats();
+    corners_.clear();
+    vertex_buffer_.clear();
+    vertex_keys_.clear();
+    if (parse_options_.reuse_capacity) {
+      PlanarVertexBuffer& planar = planar_vertex_buffer_;
+      planar.vertex_count = 0;
+      planar.position_components = 0;
+      planar.texture_coordinate_components = 0;
+      planar.normal_components = 0;
+      planar.positions.clear();
+      planar.texture_coordinates.clear();
+      planar.normals.clear();
+      RecycleSubObjects();
+    } else {
+      planar_vertex_buffer_ = PlanarVertexBuffer();
+      sub_objects_.clear();
+    }
+    line_indices_.clear();
+#ifdef PARSE_STATS
+    stats_ = ParseStats();
+#endif
+    return 0;
+  }
+
+ private:
+  // Result of parsing a material library in the background.
+  struct MaterialLoad {
+    int status = 1;
+    std::unordered_map<std::string, Material> materials;
+  };
+
+  // Records of one newline-aligned slice of the input. Attribute records and
+  // face corners are parsed on a worker thread; everything else is kept as
+  // text and replayed through ParseLine in file order.
+  struct Chunk {
+    struct DeferredLine {
+      std::string_view line;
+      std::size_t corner_offset;
+      std::array<std::size_t, 3> attribute_counts;
+    };
+
+    const char* begin;
+    const char* end;
+    int result = 0;
+    std::vector<std::array<REAL, 4>> positions;
+    std::vector<std::array<REAL, 3>> texture_coordinates;
+    std::vector<std::array<REAL, 3>> normals;
+    std::vector<std::array<std::size_t, 3>> corners;
+    std::vector<std::uint32_t> face_sizes;
+    std::vector<DeferredLine> deferred_lines;
+    // Largest amount by which a corner reaches past the v/vt/vn records read
+    // so far in this chunk. The preceding chunks have to cover it.
+    std::array<std::size_t, 3> max_overshoot = {0, 0, 0};
+#ifdef PARSE_STATS
+    // Lines and times of the records parsed on the worker.
+    ParseStats stats;
+#endif
+  };
+
+  enum MeshCacheSectionId : std::size_t {
+    kMeshCacheStrings,
+    kMeshCacheMeta,
+    kMeshCacheVertices,
+    kMeshCacheSubObjects,
+    kMeshCacheMeshGroups,
+    kMeshCacheIndexGroups,
+    kMeshCacheIndices,
+    kMeshCacheLineIndices,
+    kMeshCachePlanarLayout,
+    kMeshCachePlanarPositions,
+    kMeshCachePlanarTextureCoordinates,
+    kMeshCachePlanarNormals,
+    kMeshCacheIndices16,
+  };
+
+  static constexpr char kMeshCacheMagic[8] = {'O', 'B', 'J', 'C',
+                                               'A', 'C', 'H', 'E'};
+
+  enum PartIndexSectionId : std::size_t {
+    kPartIndexStrings,
+    kPartIndexMeta,
+    kPartIndexParts,
+    kPartIndexAttributeCounts,
+    kPartIndexPositionOffsets,
+    kPartIndexTextureCoordinateOffsets,
+    kPartIndexNormalOffsets,
+  };
+
+  static constexpr char kPartIndexMagic[8] = {'O', 'B', 'J', 'I',
+                                               'N', 'D', 'E', 'X'};
+
+  // object_part of no part yet.
+  static constexpr std::uint64_t kNoPart =
+      std::numeric_limits<std::uint64_t>::max();
+
+  static constexpr std::size_t kMinChunkSize = 1 << 20;
+  static constexpr std::size_t kMinDedupBlockSize = 1 << 16;
+  // Largest v, vt or vn number a face may use, as VertexIndexMap keys hold
+  // them in 32 bits and a v number that wrapped to 0 would read as empty.
+  static constexpr std::size_t kMaxAttributeNumber =
+      std::numeric_limits<std::uint32_t>::max();
+  // Most vertices, or with deferred_dedup face corners, a parse may give.
+  // Their numbers must fit INTEGER, whose max() later stages keep free as a
+  // marker.
+  static constexpr std::size_t kMaxVertexCount =
+      std::numeric_limits<INTEGER>::max();
+
+  template <class F>
+  static int ForEachLine(const char* cursor, const char* end, F&& f) {
+    while (cursor < end) {
+      const char* eol = static_cast<const char*>(
+          std::memchr(cursor, '\n', static_cast<std::size_t>(end - cursor)));
+      if (eol == nullptr) {
+        eol = end;
+      }
+      std::string_view line(cursor, static_cast<std::size_t>(eol - cursor));
+      cursor = eol == end ? end : eol + 1;
+      if (f(line) != 0) {
+        return 1;
+      }
+    }
+    return 0;
+  }
+
+  void BeginParse(const std::string& source_path) {
     Clear();
-    std::string line;
-    std::string kwd;
-    std::size_t found;
-    while (std::getline(input_stream_, line)) {
+    source_path_ = source_path;
+#ifdef PARSE_STATS
+    parse_start_ = std::chrono::steady_clock::now();
+#endif
+  }
+
+  // Runs the stages after tokenizing and returns result.
+  int FinishParse(int result) {
+#ifdef PARSE_STATS
+    RecordCapacities();
+#endif
+    if (result == 0 && parse_options_.deferred_dedup) {
+#ifdef PARSE_STATS
+      const auto dedup_start = std::chrono::steady_clock::now();
+#endif
+      DeduplicateCorners();
+#ifdef PARSE_STATS
+      stats_.dedup_seconds += ParseStats::SecondsSince(dedup_start);
+#endif
+    }
+    if (result == 0 && parse_options_.triangulate) {
+      TriangulateIndexGroups();
+    }
+    if (result == 0 && IsPlanar()) {
+      BuildPlanarVertexBuffer();
+    }
+    if (result == 0) {
+      AssignMaterialIds();
+      FinishMaterials();
+    }
+#ifdef PARSE_STATS
+    stats_.vertex_map = dedup_stats();
+    stats_.total_seconds += ParseStats::SecondsSince(parse_start_);
+#endif
+    return result;
+  }
+
+#ifdef PARSE_STATS
+  // Splits the time since BeginParse of a serial parse into phases. Face
+  // times include the deduplication of their corners.
+  void SplitSerialParseTime() {
+    stats_.tokenize_seconds +=
+        ParseStats::SecondsSince(parse_start_) - stats_.face_seconds;
+    stats_.face_seconds -= stats_.dedup_seconds;
+  }
+#endif
+
+  // Parses the input block_reader_ was opened on; open_result is what Open
+  // returned.
+  int ParseBlocks(int open_result, const std::string& source_path) {
+    if (open_result != 0) {
+      ReportOpenError(open_result, source_path);
+      return open_result;
+    }
+    BeginParse(source_path);
+    int result = block_reader_.ForEachLine([this](std::string_view line) {
+#ifdef PARSE_STATS
+      stats_.bytes_read += line.size() + 1;
+#endif
+      return ParseLine(line);
+    });
+    block_reader_.Close();
+#ifdef PARSE_STATS
+    SplitSerialParseTime();
+#endif
+    return FinishParse(result);
+  }
+
+  void ReportOpenError(int open_result, const std::string& source_path) const {
+#ifdef OBJ_PARSER_DEBUG
+    if (open_result == BlockReader::kUnsupportedCompression) {
+      std::cerr << "[OBJParser] Error: No decoder for "
+                << (block_reader_.compression() ==
+                            BlockReader::Compression::kGzip
+                        ? "gzip; define OBJ_PARSER_ZLIB"
+                        : "zstd; define OBJ_PARSER_ZSTD")
+                << " and link the library: " << source_path << "\n";
+    } else {
+      std::cerr << "[OBJParser] Error: Failed to open input: " << source_path
+                << "\n";
+    }
+#endif
+  }
+
+  // Records the v, vt and vn numbers the faces and lines of part use,
+  // checking them as ParseLine would.
+  static int CollectPartReferences(
+      const char* data, const IndexedPart& part,
+      std::array<std::vector<std::size_t>, 3>& used) {
+    std::array<std::uint64_t, 3> counts = part.attribute_base;
+    return ForEachLine(
+        data + part.begin, data + part.end, [&](std::string_view line) {
+          Keyword keyword = QuickKeyword(line);
+          if (keyword == Keyword::kUnknown || keyword == Keyword::kFace) {
+            keyword = ClassifyKeyword(ReadRecord(line));
+          }
+          switch (keyword) {
+            case Keyword::kPosition:
+              counts[0]++;
+              break;
+            case Keyword::kTextureCoordinate:
+              counts[1]++;
+              break;
+            case Keyword::kNormal:
+              counts[2]++;
+              break;
+            case Keyword::kFace:
+              return ReadFace(
+                  line, [&](const std::array<std::size_t, 3>& corner) {
+                    if (corner[0] == 0 || corner[0] > counts[0] ||
+                        corner[1] > counts[1] || corner[2] > counts[2]) {
+#ifdef OBJ_PARSER_DEBUG
+                      std::cerr
+                          << "[OBJParser] Error: Face index out of range.\n";
+#endif
+                      return 1;
+                    }
+                    for (std::size_t kind = 0; kind < 3; kind++) {
+                      if (corner[kind] != 0) {
+                        used[kind].push_back(corner[kind]);
+                      }
+                    }
+                    return 0;
+                  });
+            case Keyword::kLine: {
+              if (line.empty()) {
+#ifdef OBJ_PARSER_DEBUG
+                std::cerr
+                    << "[OBJParser] Error: 'l' keyword with empty indices.\n";
+#endif
+                return 1;
+              }
+              std::size_t index;
+              while (ReadNumber(line, index)) {
+                if (index >= counts[0]) {
+#ifdef OBJ_PARSER_DEBUG
+                  std::cerr << "[OBJParser] Error: Line index out of range.\n";
+#endif
+                  return 1;
+                }
+                if (index != 0) {
+                  used[0].push_back(index);
+                }
+              }
+              break;
+            }
+            default:
+              break;
+          }
+          return 0;
+        });
+  }
+
+  // Reads the records of one kind whose numbers are in used, sorted, into
+  // positions_, texture_coordinates_ or normals_. Each run of them starts
+  // from the nearest checkpoint of the index.
+  int ReadUsedAttributes(const char* data, std::size_t size,
+                         const PartIndex& index, std::size_t kind,
+                         const std::vector<std::size_t>& used) {
+    const std::vector<std::uint64_t>& offsets = index.attribute_offsets[kind];
+    const Keyword keyword = kind == 0   ? Keyword::kPosition
+                            : kind == 1 ? Keyword::kTextureCoordinate
+                                        : Keyword::kNormal;
+    const char* end = data + size;
+    const char* cursor = end;
+    // Number of the next record of this kind at or after cursor, 0-based.
+    std::size_t record = 0;
+    for (std::size_t number : used) {
+      const std::size_t target = number - 1;
+      const std::size_t checkpoint = target / kPartIndexStride;
+      if (cursor == end || record / kPartIndexStride < checkpoint) {
+        if (checkpoint >= offsets.size() || offsets[checkpoint] >= size) {
+#ifdef OBJ_PARSER_DEBUG
+          std::cerr << "[OBJParser] Error: Index does not match the file.\n";
+#endif
+          return 1;
+        }
+        cursor = data + offsets[checkpoint];
+        record = checkpoint * kPartIndexStride;
+      }
+      bool is_found = false;
+      while (!is_found && cursor < end) {
+        const char* eol = static_cast<const char*>(std::memchr(
+            cursor, '\n', static_cast<std::size_t>(end - cursor)));
+        if (eol == nullptr) {
+          eol = end;
+        }
+        std::string_view line(cursor, static_cast<std::size_t>(eol - cursor));
+        cursor = eol == end ? end : eol + 1;
+        std::string_view rest = line;
+        Keyword line_keyword = QuickKeyword(line);
+        if (line_keyword == Keyword::kUnknown) {
+          line_keyword = ClassifyKeyword(ReadRecord(rest));
+        }
+        if (line_keyword != keyword) {
+          continue;
+        }
+        if (record++ == target) {
+          is_found = true;
+          rest = line;
+          ReadRecord(rest);
+          const int result =
+              kind == 0   ? ReadPosition(rest, positions_)
+              : kind == 1 ? ReadTextureCoordinate(rest, texture_coordinates_)
+                          : ReadNormal(rest, normals_);
+          if (result != 0) {
+            return 1;
+          }
+        }
+      }
+      if (!is_found) {
+#ifdef OBJ_PARSER_DEBUG
+        std::cerr << "[OBJParser] Error: Index does not match the file.\n";
+#endif
+        return 1;
+      }
+    }
+    return 0;
+  }
+
+  // Parses the records of part other than attributes, with the v, vt and vn
+  // numbers of faces and lines renumbered to their position in used. A g
+  // part whose sub-object is not the open one gets it opened first.
+  int ParsePart(const char* data, const IndexedPart& part,
+                std::uint64_t open_object_part,
+                const std::array<std::vector<std::size_t>, 3>& used) {
+    material_name_ = part.material_name;
+    is_smooth_shading_mode_ = part.is_smooth_shading;
+    if (!part.mesh_group_name.empty() &&
+        open_object_part != part.object_part) {
+      AddSubObject(part.sub_object_name);
+    }
+    auto renumber = [&used](std::size_t kind, std::size_t number) {
+      if (number == 0) {
+        return number;
+      }
+      return static_cast<std::size_t>(
+          std::lower_bound(used[kind].begin(), used[kind].end(), number) -
+          used[kind].begin() + 1);
+    };
+    return ForEachLine(
+        data + part.begin, data + part.end, [&](std::string_view line) {
+          const Keyword quick_keyword = QuickKeyword(line);
+          if (quick_keyword == Keyword::kPosition ||
+              quick_keyword == Keyword::kTextureCoordinate ||
+              quick_keyword == Keyword::kNormal) {
+            return 0;
+          }
+          std::string_view rest = line;
+          switch (ClassifyKeyword(ReadRecord(rest))) {
+            case Keyword::kPosition:
+            case Keyword::kTextureCoordinate:
+            case Keyword::kNormal:
+            case Keyword::kMaterialLibrary:
+              return 0;
+            case Keyword::kFace: {
+              EnsureIndexGroup();
+              std::uint32_t face_size = 0;
+              int result = ReadFace(
+                  rest, [&](const std::array<std::size_t, 3>& corner) {
+                    if (AddVertex(renumber(0, corner[0]),
+                                  renumber(1, corner[1]),
+                                  renumber(2, corner[2])) != 0) {
+                      return 1;
+                    }
+                    face_size++;
+                    return 0;
+                  });
+              if (result == 0) {
+                AddFace(face_size);
+              }
+              return result;
+            }
+            case Keyword::kLine: {
+              std::size_t index;
+              while (ReadNumber(rest, index)) {
+                line_indices_.push_back(renumber(0, index));
+              }
+              return 0;
+            }
+            default:
+              return ParseLine(line);
+          }
+        });
+  }
+
+  // Modification time of the file at path in nanoseconds, as precise as
+  // the platform records it, or 0 if unknown.
+  static std::uint64_t ModificationTime(const std::string& path) {
+    constexpr std::uint64_t kNanoseconds = 1000000000;
+#ifdef _WIN32
+    struct _stat64 st;
+    if (_stat64(path.c_str(), &st) != 0) {
+      return 0;
+    }
+    return static_cast<std::uint64_t>(st.st_mtime) * kNanoseconds;
+#else
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+      return 0;
+    }
+#ifdef __APPLE__
+    const struct timespec& time = st.st_mtimespec;
+#else
+    const struct timespec& time = st.st_mtim;
+#endif
+    return static_cast<std::uint64_t>(time.tv_sec) * kNanoseconds +
+           static_cast<std::uint64_t>(time.tv_nsec);
+#endif
+  }
+
+  // Hash of everything besides the source that decides the cached mesh.
+  std::uint64_t MeshCacheFingerprint() const {
+    const std::uint64_t fields[] = {
+        sizeof(REAL), sizeof(INTEGER), sizeof(Vertex),
+        static_cast<std::uint64_t>(parse_options_.vertex_layout),
+        parse_options_.keep_position_w,
+        parse_options_.deferred_dedup &&
+            !parse_options_.first_occurrence_order,
+        parse_options_.triangulate, parse_options_.narrow_indices};
+    return HashBytes(fields, sizeof(fields));
+  }
+
+  // Parses the file at path, already in mapped_file_, through its mesh
+  // cache. The cache is used as is while it records the file's size and
+  // modification time. Otherwise the file is hashed, and a cache with the
+  // same hash gets the new time recorded; any other cache is replaced.
+  int ParseCached(const std::string& path) {
+    const std::uint64_t size = mapped_file_.size();
+    const std::uint64_t stamp = ModificationTime(path);
+    const std::uint64_t fingerprint = MeshCacheFingerprint();
+    const std::string cache_path = MeshCachePath(path);
+    std::uint64_t hash = 0;
+    bool is_hashed = false;
+    auto view = std::make_shared<MeshView>();
+    if (view->Open(cache_path) == 0) {
+      const CacheHeader& header = view->reader().header();
+      bool is_current =
+          header.source_size == size && header.fingerprint == fingerprint;
+      if (is_current && (stamp == 0 || header.source_stamp != stamp)) {
+        hash = HashBytes(mapped_file_.data(), mapped_file_.size());
+        is_hashed = true;
+        is_current = header.source_hash == hash;
+        if (is_current && stamp != 0) {
+          UpdateCacheStamp(cache_path, stamp);
+        }
+      }
+      if (is_current) {
+        UseCachedMesh(path, std::move(view));
+        return 0;
+      }
+    }
+    const int result =
+        ParseFromMemory(mapped_file_.data(), mapped_file_.size(), path);
+    if (result != 0) {
+      return result;
+    }
+    if (!is_hashed) {
+      hash = HashBytes(mapped_file_.data(), mapped_file_.size());
+    }
+    if (WriteMeshCache(cache_path, size, hash, stamp) != 0) {
+#ifdef OBJ_PARSER_DEBUG
+      std::cerr << "[OBJParser] Warning: Failed to write cache: " << cache_path
+                << "\n";
+#endif
+    }
+    return 0;
+  }
+
+  // Makes view the result of the parse. Only the library and material names
+  // are read out now; the mesh stays in the mapping until an accessor
+  // needs it as vectors.
+  void UseCachedMesh(const std::string& path,
+                     std::shared_ptr<const MeshView> view) {
+    BeginParse(path);
+    mtl_name_ = view->mtl_name();
+    for (std::size_t id = 0; id < view->material_count(); id++) {
+      material_names_.emplace_back(view->material_name(id));
+    }
+    if (parse_options_.load_materials && !mtl_name_.empty()) {
+      LoadMaterialsAsync();
+    }
+    FinishMaterials();
+    cached_mesh_ = std::move(view);
+    is_cache_pending_.store(true, std::memory_order_release);
+#ifdef PARSE_STATS
+    stats_.total_seconds += ParseStats::SecondsSince(parse_start_);
+#endif
+  }
+
+  // Fills the vertex buffers, sub_objects_ and line_indices_ from a cache hit
+  // the first time they are asked for, from whichever thread asks first.
+  void CopyCachedMesh() const {
+    if (!is_cache_pending_.load(std::memory_order_acquire)) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    if (!is_cache_pending_.load(std::memory_order_relaxed)) {
+      return;
+    }
+    Mesh mesh = cached_mesh_->ToMesh();
+    vertex_buffer_ = std::move(mesh.vertex_buffer);
+    planar_vertex_buffer_ = std::move(mesh.planar_vertex_buffer);
+    sub_objects_ = std::move(mesh.sub_objects);
+    line_indices_ = std::move(mesh.line_indices);
+    is_cache_pending_.store(false, std::memory_order_release);
+  }
+
+  int WriteMeshCache(const std::string& cache_path, std::uint64_t source_size,
+                     std::uint64_t source_hash,
+                     std::uint64_t source_stamp) const {
+    static_assert(std::is_trivially_copyable<Vertex>::value,
+                  "Vertex is written to the cache as raw bytes.");
+    CacheWriter writer;
+    std::vector<CacheStringRef> meta = {writer.AddString(mtl_name_)};
+    for (const std::string& name : material_names_) {
+      meta.push_back(writer.AddString(name));
+    }
+    std::vector<CacheSubObject> sub_objects;
+    std::vector<CacheMeshGroup> mesh_groups;
+    std::vector<CacheIndexGroup> index_groups;
+    std::uint64_t index_count = 0;
+    std::uint64_t index_count_16 = 0;
+    for (const SubObject& sub_object : sub_objects_) {
+      sub_objects.push_back({writer.AddString(sub_object.sub_object_name),
+                             mesh_groups.size(),
+                             sub_object.mesh_groups.size()});
+      for (const MeshGroup& mesh_group : sub_object.mesh_groups) {
+        mesh_groups.push_back({writer.AddString(mesh_group.mesh_group_name),
+                               index_groups.size(),
+                               mesh_group.index_groups.size()});
+        for (const IndexGroup& index_group : mesh_group.index_groups) {
+          const bool is_narrow = !index_group.index_buffer_16_.empty();
+          CacheIndexGroup cached_group = {};
+          cached_group.mtl_name = writer.AddString(index_group.mtl_name);
+          cached_group.is_smooth_shading = index_group.is_smooth_shading;
+          cached_group.is_smooth_shading_empty =
+              index_group.is_smooth_shading_empty;
+          cached_group.is_narrow = is_narrow;
+          cached_group.material_id = index_group.material_id;
+          cached_group.base_vertex = index_group.base_vertex;
+          if (is_narrow) {
+            cached_group.first_index = index_count_16;
+            cached_group.index_count = index_group.index_buffer_16_.size();
+            writer.Append(kMeshCacheIndices16, index_group.index_buffer_16_);
+            index_count_16 += index_group.index_buffer_16_.size();
+          } else {
+            cached_group.first_index = index_count;
+            cached_group.index_count = index_group.index_buffer_.size();
+            writer.Append(kMeshCacheIndices, index_group.index_buffer_);
+            index_count += index_group.index_buffer_.size();
+          }
+          index_groups.push_back(cached_group);
+        }
+      }
+    }
+    std::vector<std::uint64_t> planar_layout;
+    if (IsPlanar()) {
+      const PlanarVertexBuffer& planar = planar_vertex_buffer_;
+      planar_layout = {planar.vertex_count, planar.position_components,
+                       planar.texture_coordinate_components,
+                       planar.normal_components};
+    }
+    std::vector<std::uint64_t> line_indices(line_indices_.begin(),
+                                            line_indices_.end());
+    writer.Append(kMeshCacheMeta, meta);
+    writer.Append(kMeshCacheVertices, vertex_buffer_);
+    writer.Append(kMeshCachePlanarLayout, planar_layout);
+    writer.Append(kMeshCachePlanarPositions, planar_vertex_buffer_.positions);
+    writer.Append(kMeshCachePlanarTextureCoordinates,
+                  planar_vertex_buffer_.texture_coordinates);
+    writer.Append(kMeshCachePlanarNormals, planar_vertex_buffer_.normals);
+    writer.Append(kMeshCacheSubObjects, sub_objects);
+    writer.Append(kMeshCacheMeshGroups, mesh_groups);
+    writer.Append(kMeshCacheIndexGroups, index_groups);
+    writer.Append(kMeshCacheLineIndices, line_indices);
+    writer.Append(kMeshCacheStrings, writer.strings().data(),
+                  writer.strings().size());
+    return writer.Write(cache_path, kMeshCacheMagic, source_size, source_hash,
+                        MeshCacheFingerprint(), source_stamp);
+  }
+
+  static std::uint64_t PartIndexFingerprint() {
+    const std::uint64_t fields[] = {kPartIndexStride, sizeof(CacheIndexedPart)};
+    return HashBytes(fields, sizeof(fields));
+  }
+
+  // Loads an index written by WritePartIndex for a file of this size and
+  // modification time.
+  static int LoadPartIndex(const std::string& cache_path,
+                           std::uint64_t source_size, std::uint64_t stamp,
+                           PartIndex& index) {
+    CacheReader reader;
+    if (reader.Open(cache_path, kPartIndexMagic) != 0 ||
+        !reader.Matches(source_size, stamp, PartIndexFingerprint())) {
+      return 1;
+    }
+    CacheArray<CacheStringRef> meta =
+        reader.Section<CacheStringRef>(kPartIndexMeta);
+    CacheArray<CacheIndexedPart> parts =
+        reader.Section<CacheIndexedPart>(kPartIndexParts);
+    CacheArray<std::uint64_t> counts =
+        reader.Section<std::uint64_t>(kPartIndexAttributeCounts);
+    std::string_view mtl_name;
+    if (meta.size != 1 || counts.size != 3 ||
+        !reader.GetString(kPartIndexStrings, meta[0], mtl_name)) {
+      return 1;
+    }
+    PartIndex loaded;
+    loaded.source_size = source_size;
+    loaded.mtl_name = mtl_name;
+    loaded.parts.resize(parts.size);
+    for (std::size_t i = 0; i < parts.size; i++) {
+      const CacheIndexedPart& cached = parts[i];
+      IndexedPart& part = loaded.parts[i];
+      std::string_view sub_object_name;
+      std::string_view mesh_group_name;
+      std::string_view material_name;
+      if (!reader.GetString(kPartIndexStrings, cached.sub_object_name,
+                            sub_object_name) ||
+          !reader.GetString(kPartIndexStrings, cached.mesh_group_name,
+                            mesh_group_name) ||
+          !reader.GetString(kPartIndexStrings, cached.material_name,
+                            material_name) ||
+          cached.object_part > i || cached.begin > cached.end ||
+          cached.end > source_size) {
+        return 1;
+      }
+      part.sub_object_name = sub_object_name;
+      part.mesh_group_name = mesh_group_name;
+      part.material_name = material_name;
+      part.object_part = cached.object_part;
+      part.begin = cached.begin;
+      part.end = cached.end;
+      for (std::size_t kind = 0; kind < 3; kind++) {
+        part.attribute_base[kind] = cached.attribute_base[kind];
+      }
+      part.is_smooth_shading = cached.is_smooth_shading != 0;
+    }
+    for (std::size_t kind = 0; kind < 3; kind++) {
+      CacheArray<std::uint64_t> offsets = reader.Section<std::uint64_t>(
+          kPartIndexPositionOffsets + kind);
+      loaded.attribute_counts[kind] = counts[kind];
+      if (offsets.size != (counts[kind] + kPartIndexStride - 1) /
+                              kPartIndexStride) {
+        return 1;
+      }
+      loaded.attribute_offsets[kind].assign(offsets.begin(), offsets.end());
+    }
+    index = std::move(loaded);
+    return 0;
+  }
+
+  static int WritePartIndex(const std::string& cache_path, std::uint64_t stamp,
+                            const PartIndex& index) {
+    static_assert(std::is_trivially_copyable<CacheIndexedPart>::value,
+                  "CacheIndexedPart is written to the index as raw bytes.");
+    CacheWriter writer;
+    std::vector<CacheStringRef> meta = {writer.AddString(index.mtl_name)};
+    std::vector<CacheIndexedPart> parts(index.parts.size());
+    for (std::size_t i = 0; i < parts.size(); i++) {
+      const IndexedPart& part = index.parts[i];
+      CacheIndexedPart& cached = parts[i];
+      std::memset(&cached, 0, sizeof(cached));
+      cached.sub_object_name = writer.AddString(part.sub_object_name);
+      cached.mesh_group_name = writer.AddString(part.mesh_group_name);
+      cached.material_name = writer.AddString(part.material_name);
+      cached.object_part = part.object_part;
+      cached.begin = part.begin;
+      cached.end = part.end;
+      for (std::size_t kind = 0; kind < 3; kind++) {
+        cached.attribute_base[kind] = part.attribute_base[kind];
+      }
+      cached.is_smooth_shading = part.is_smooth_shading ? 1 : 0;
+    }
+    writer.Append(kPartIndexMeta, meta);
+    writer.Append(kPartIndexParts, parts);
+    writer.Append(kPartIndexAttributeCounts, index.attribute_counts.data(),
+                  sizeof(index.attribute_counts));
+    for (std::size_t kind = 0; kind < 3; kind++) {
+      writer.Append(kPartIndexPositionOffsets + kind,
+                    index.attribute_offsets[kind]);
+    }
+    writer.Append(kPartIndexStrings, writer.strings().data(),
+                  writer.strings().size());
+    return writer.Write(cache_path, kPartIndexMagic, index.source_size, stamp,
+                        PartIndexFingerprint());
+  }
+
+  static bool EndsWith(const std::string& s, std::string_view suffix) {
+    return s.size() >= suffix.size() &&
+           std::string_view(s).substr(s.size() - suffix.size()) == suffix;
+  }
+
+  static bool IsCompressedPath(const std::string& path) {
+    return EndsWith(path, ".obj.gz") || EndsWith(path, ".obj.zst");
+  }
+
+  int ParseChunks(const char* data, std::size_t size) {
+    ThreadPool& pool = thread_pool();
+    std::size_t chunk_count = std::min<std::size_t>(
+        std::size_t{pool.thread_count()} * 4, size / kMinChunkSize);
+    std::vector<Chunk> chunks;
+    const char* end = data + size;
+    const char* begin = data;
+    for (std::size_t i = 1; i <= chunk_count && begin < end; i++) {
+      const char* split =
+          i == chunk_count ? end : data + size / chunk_count * i;
+      if (split < begin) {
+        continue;
+      }
+      const char* eol = static_cast<const char*>(
+          std::memchr(split, '\n', static_cast<std::size_t>(end - split)));
+      split = eol == nullptr ? end : eol + 1;
+      Chunk chunk;
+      chunk.begin = begin;
+      chunk.end = split;
+      chunks.push_back(std::move(chunk));
+      begin = split;
+    }
+    pool.ParallelFor(chunks.size(), [&chunks](std::size_t i) {
+#ifdef PARSE_STATS
+      const auto chunk_start = std::chrono::steady_clock::now();
+#endif
+      chunks[i].result = ParseChunk(chunks[i]);
+#ifdef PARSE_STATS
+      ParseStats& stats = chunks[i].stats;
+      stats.tokenize_seconds =
+          ParseStats::SecondsSince(chunk_start) - stats.face_seconds;
+#endif
+    });
+#ifdef PARSE_STATS
+    for (const Chunk& chunk : chunks) {
+      for (const auto& [keyword, count] : chunk.stats.keyword_lines) {
+        stats_.CountKeyword(keyword, count);
+      }
+      stats_.tokenize_seconds += chunk.stats.tokenize_seconds;
+      stats_.face_seconds += chunk.stats.face_seconds;
+    }
+    const auto merge_start = std::chrono::steady_clock::now();
+    const double dedup_start_seconds = stats_.dedup_seconds;
+#endif
+
+    std::array<std::size_t, 3> totals = {0, 0, 0};
+    for (const Chunk& chunk : chunks) {
+      totals[0] += chunk.positions.size();
+      totals[1] += chunk.texture_coordinates.size();
+      totals[2] += chunk.normals.size();
+    }
+    positions_.reserve(totals[0]);
+    texture_coordinates_.reserve(totals[1]);
+    normals_.reserve(totals[2]);
+    for (Chunk& chunk : chunks) {
+      if (chunk.result != 0) {
+        return 1;
+      }
+      if (chunk.max_overshoot[0] > positions_.size() ||
+          chunk.max_overshoot[1] > texture_coordinates_.size() ||
+          chunk.max_overshoot[2] > normals_.size()) {
+#ifdef OBJ_PARSER_DEBUG
+        std::cerr << "[OBJParser] Error: Face index out of range.\n";
+#endif
+        return 1;
+      }
+      std::array<std::size_t, 3> appended = {0, 0, 0};
+      std::size_t corner = 0;
+      std::size_t face = 0;
+      for (const Chunk::DeferredLine& deferred : chunk.deferred_lines) {
+        AppendChunkAttributes(chunk, deferred.attribute_counts, appended);
+        if (AddChunkFaces(chunk, deferred.corner_offset, corner, face) != 0 ||
+            ParseLine(deferred.line) != 0) {
+          return 1;
+        }
+      }
+      AppendChunkAttributes(chunk,
+                            {chunk.positions.size(),
+                             chunk.texture_coordinates.size(),
+                             chunk.normals.size()},
+                            appended);
+      if (AddChunkFaces(chunk, chunk.corners.size(), corner, face) != 0) {
+        return 1;
+      }
+      chunk = Chunk();
+    }
+#ifdef PARSE_STATS
+    // Replayed lines and attribute appends count as tokenizing.
+    stats_.tokenize_seconds += ParseStats::SecondsSince(merge_start) -
+                               (stats_.dedup_seconds - dedup_start_seconds);
+#endif
+    return 0;
+  }
+
+  static int ParseChunk(Chunk& chunk) {
+    return ForEachLine(chunk.begin, chunk.end, [&chunk](std::string_view raw) {
+      std::string_view line = raw;
+      if (!line.empty() && line.back() == '\r') {
+        line.remove_suffix(1);
+      }
       Trim(line);
       if (line.empty()) {
-        continue;
+        return 0;
+      }
+      std::string_view kwd = ReadKeyword(line);
+      const Keyword keyword = ClassifyKeyword(kwd);
+#ifdef PARSE_STATS
+      // Other lines are counted when they are replayed through ParseLine.
+      if (keyword == Keyword::kPosition ||
+          keyword == Keyword::kTextureCoordinate ||
+          keyword == Keyword::kNormal || keyword == Keyword::kFace) {
+        chunk.stats.CountKeyword(kwd);
       }
-      kwd = ReadKeyword(line);
-      // parse
-      if (kwd == "o") {
+#endif
+      switch (keyword) {
+        case Keyword::kPosition:
+          return ReadPosition(line, chunk.positions);
+        case Keyword::kTextureCoordinate:
+          return ReadTextureCoordinate(line, chunk.texture_coordinates);
+        case Keyword::kNormal:
+          return ReadNormal(line, chunk.normals);
+        case Keyword::kFace: {
+#ifdef PARSE_STATS
+          const auto face_start = std::chrono::steady_clock::now();
+#endif
+          const std::array<std::size_t, 3> counts = {
+              chunk.positions.size(), chunk.texture_coordinates.size(),
+              chunk.normals.size()};
+          const std::size_t first_corner = chunk.corners.size();
+          if (ReadFace(line, [&](const std::array<std::size_t, 3>& corner) {
+                if (corner[0] == 0) {
+#ifdef OBJ_PARSER_DEBUG
+                  std::cerr << "[OBJParser] Error: Face index out of range.\n";
+#endif
+                  return 1;
+                }
+                for (int i = 0; i < 3; i++) {
+                  if (corner[i] > counts[i]) {
+                    chunk.max_overshoot[i] = std::max(chunk.max_overshoot[i],
+                                                      corner[i] - counts[i]);
+                  }
+                }
+                chunk.corners.push_back(corner);
+                return 0;
+              }) != 0) {
+            return 1;
+          }
+          chunk.face_sizes.push_back(
+              static_cast<std::uint32_t>(chunk.corners.size() - first_corner));
+#ifdef PARSE_STATS
+          chunk.stats.face_seconds += ParseStats::SecondsSince(face_start);
+#endif
+          return 0;
+        }
+        default:
+          break;
+      }
+      chunk.deferred_lines.push_back(
+          {raw, chunk.corners.size(),
+           {chunk.positions.size(), chunk.texture_coordinates.size(),
+            chunk.normals.size()}});
+      return 0;
+    });
+  }
+
+  // Adds the faces of chunk whose corners lie before corner_end.
+  int AddChunkFaces(const Chunk& chunk, std::size_t corner_end,
+                    std::size_t& corner, std::size_t& face) {
+    if (corner < corner_end) {
+      EnsureIndexGroup();
+    }
+    while (corner < corner_end) {
+      const std::uint32_t face_size = chunk.face_sizes[face++];
+#ifdef PARSE_STATS
+      const auto dedup_start = std::chrono::steady_clock::now();
+#endif
+      for (std::uint32_t i = 0; i < face_size; i++, corner++) {
+        const std::array<std::size_t, 3>& c = chunk.corners[corner];
+        if (AddVertex(c[0], c[1], c[2]) != 0) {
+          return 1;
+        }
+      }
+#ifdef PARSE_STATS
+      stats_.dedup_seconds += ParseStats::SecondsSince(dedup_start);
+#endif
+      AddFace(face_size);
+    }
+    return 0;
+  }
+
+  void AppendChunkAttributes(const Chunk& chunk,
+                             const std::array<std::size_t, 3>& counts,
+                             std::array<std::size_t, 3>& appended) {
+    positions_.insert(positions_.end(), chunk.positions.begin() + appended[0],
+                      chunk.positions.begin() + counts[0]);
+    texture_coordinates_.insert(
+        texture_coordinates_.end(),
+        chunk.texture_coordinates.begin() + appended[1],
+        chunk.texture_coordinates.begin() + counts[1]);
+    normals_.insert(normals_.end(), chunk.normals.begin() + appended[2],
+                    chunk.normals.begin() + counts[2]);
+    appended = counts;
+  }
+
+  int ParseLine(std::string_view line) {
+    if (!line.empty() && line.back() == '\r') {
+      line.remove_suffix(1);
+    }
+    Trim(line);
+    if (line.empty()) {
+      return 0;
+    }
+    std::string_view kwd = ReadKeyword(line);
+#ifdef PARSE_STATS
+    stats_.CountKeyword(kwd);
+#endif
+    switch (ClassifyKeyword(kwd)) {
+      case Keyword::kObject:
         if (line.empty()) {
-#ifdef DEBUG
+#ifdef OBJ_PARSER_DEBUG
           std::cerr << "[OBJParser] Error: 'o' keyword with empty name.\n";
 #endif
           return 1;
         }
-        SubObject new_sub;
-        new_sub.sub_object_name = line;
-        sub_objects_.push_back(new_sub);
-      } else if (kwd == "mtllib") {
+        AddSubObject(line);
+        break;
+      case Keyword::kMaterialLibrary:
         if (line.empty()) {
-#ifdef DEBUG
+#ifdef OBJ_PARSER_DEBUG
           std::cerr << "[OBJParser] Error: 'matlib' keyword with empty name.\n";
 #endif
           return 1;
         }
         mtl_name_ = line;
-      } else if (kwd == "g") {
+        if (parse_options_.load_materials) {
+          LoadMaterialsAsync();
+        }
+        break;
+      case Keyword::kGroup:
         if (line.empty()) {
-#ifdef DEBUG
+#ifdef OBJ_PARSER_DEBUG
           std::cerr << "[OBJParser] Error: This parser ignore 'g' keyword.\n";
 #endif
           return 1;
         }
-        if (sub_objects_.empty()) {
-          SubObject new_sub;
-          new_sub.sub_object_name = "Unnamed";
-        }
-        MeshGroup new_group;
-        new_group.mesh_group_name = line;
-        sub_objects_.back().mesh_groups.push_back(new_group);
-      } else if (kwd == "usemtl") {
+        EnsureSubObject();
+        AddMeshGroup(line);
+        break;
+      case Keyword::kMaterial:
         if (line.empty()) {
-#ifdef DEBUG
+#ifdef OBJ_PARSER_DEBUG
           std::cerr << "[OBJParser] Error: 'usemtl' keyword with empty name.\n";
 #endif
           return 1;
         }
-        if (sub_objects_.empty()) {
-          SubObject new_sub;
-          new_sub.sub_object_name = "Unnamed";
-          sub_objects_.push_back(new_sub);
-        }
-        if (sub_objects_.back().mesh_groups.empty()) {
-          MeshGroup new_mesh;
-          new_mesh.mesh_group_name = "Unnamed";
-          sub_objects_.back().mesh_groups.push_back(new_mesh);
-        }
+        EnsureMeshGroup();
         material_name_ = line;
         if (sub_objects_.back().mesh_groups.back().index_groups.empty() ||
             !sub_objects_.back()
                  .mesh_groups.back()
                  .index_groups.back()
                  .mtl_name.empty()) {
-          IndexGroup new_index;
+          IndexGroup& new_index = AddIndexGroup();
           new_index.mtl_name = material_name_;
           new_index.is_smooth_shading = is_smooth_shading_mode_;
-          sub_objects_.back().mesh_groups.back().index_groups.push_back(
-              new_index);
         }
         if (sub_objects_.back()
                 .mesh_groups.back()
                 .index_groups.back()
                 .mtl_name.empty()) {
-          sub_objects_.back().mesh_groups.back().index_groups.back().mtl_name =
-              material_name_;
-        }
-
-      } else if (kwd == "v") {
-        std::array<REAL, 4> vector4;
-        std::vector<REAL> g_components = ReadComponents<REAL>(line);
-        if (g_components.size() < 3 || g_components.size() > 4) {
-#ifdef DEBUG
-          std::cerr << "[OBJParser] Error: 'v' expects 3 or 4 components.\n";
-#endif
-          return 1;
-        }
-        g_components.push_back(1.f);
-        for (int i = 0; i < 4; i++) {
-          vector4[i] = g_components[i];
-        }
-        positions_.push_back(vector4);
-      } else if (kwd == "vt") {
-        std::array<REAL, 3> vector3;
-        std::vector<REAL> t_components = ReadComponents<REAL>(line);
-        if (t_components.size() < 2 || t_components.size() > 3) {
-#ifdef DEBUG
-          std::cerr << "[OBJParser] Error: 'vt' expects 2 or 3 components.\n";
-#endif
-          return 1;
-        }
-        t_components.push_back(0.f);
-        for (int i = 0; i < 3; i++) {
-          vector3[i] = t_components[i];
-        }
-        texture_coordinates_.push_back(vector3);
-      } else if (kwd == "vn") {
-        std::array<REAL, 3> vector3;
-        std::vector<REAL> t_components = ReadComponents<REAL>(line);
-        if (t_components.size() != 3) {
-#ifdef DEBUG
-          std::cerr << "[OBJParser] Error: 'vn' expects 3 components.\n";
-#endif
-          return 1;
-        }
-        for (int i = 0; i < 3; i++) {
-          vector3[i] = t_components[i];
-        }
-        normals_.push_back(vector3);
-      } else if (kwd == "s") {
-        if (sub_objects_.empty()) {
-          SubObject new_sub;
-          new_sub.sub_object_name = "Unnamed";
-        }
-        if (sub_objects_.back().mesh_groups.empty()) {
-          MeshGroup new_mesh;
-          new_mesh.mesh_group_name = "Unnamed";
+          sub_objects_.back().mesh_groups.back().index_groups.back().mtl_name =
+              material_name_;
         }
+        break;
+      case Keyword::kPosition:
+        return ReadPosition(line, positions_);
+      case Keyword::kTextureCoordinate:
+        return ReadTextureCoordinate(line, texture_coordinates_);
+      case Keyword::kNormal:
+        return ReadNormal(line, normals_);
+      case Keyword::kSmoothShading:
+        EnsureMeshGroup();
         if (line == "1") {
           is_smooth_shading_mode_ = true;
         } else if (line == "off") {
           is_smooth_shading_mode_ = false;
         } else {
-#ifdef DEBUG
+#ifdef OBJ_PARSER_DEBUG
           std::cerr << "[OBJParser] Error: 's' keyword with empty option.\n";
 #endif
           return 1;
@@ -220,12 +2002,10 @@ class OBJParser {
                  .mesh_groups.back()
                  .index_groups.back()
                  .is_smooth_shading_empty) {
-          IndexGroup new_index;
+          IndexGroup& new_index = AddIndexGroup();
           new_index.is_smooth_shading = is_smooth_shading_mode_;
           new_index.is_smooth_shading_empty = false;
           new_index.mtl_name = material_name_;
-          sub_objects_.back().mesh_groups.back().index_groups.push_back(
-              new_index);
         }
         if (sub_objects_.back()
                 .mesh_groups.back()
@@ -240,184 +2020,1045 @@ class OBJParser {
               .index_groups.back()
               .is_smooth_shading = is_smooth_shading_mode_;
         }
-      } else if (kwd == "f") {
-        std::istringstream iss(line);
-        std::string indices_buf;
-        while (iss >> indices_buf) {
-          std::size_t first_slash = indices_buf.find("/");
-          std::size_t second_slash = indices_buf.find("/", first_slash + 1);
-          // v
-          if (first_slash == std::string::npos &&
-              second_slash == std::string::npos) {
-            indices_buf.append("/0/0");
-          }
-          // v/vt
-          else if (first_slash != std::string::npos &&
-                   second_slash == std::string::npos) {
-            indices_buf.append("/0");
-          }
-          // v//vn
-          else if ((first_slash != std::string::npos &&
-                    second_slash != std::string::npos) &&
-                   (second_slash - first_slash) == 1) {
-            indices_buf.insert(second_slash, "0");
-          }
-          // v/vt/vn
-          else if ((first_slash != std::string::npos &&
-                    second_slash != std::string::npos) &&
-                   (second_slash - first_slash) > 1) {
-            // do nothing
-          } else {
-#ifdef DEBUG
-            std::cerr << "[OBJParser] Error: Malformed face index format.\n";
+        break;
+      case Keyword::kFace: {
+#ifdef PARSE_STATS
+        const auto face_start = std::chrono::steady_clock::now();
 #endif
-            return 1;
-          }
-          std::replace(indices_buf.begin(), indices_buf.end(), '/', ' ');
-          std::istringstream buf_iss(indices_buf);
-          std::size_t g_index, t_index, n_index;
-          buf_iss >> g_index >> t_index >> n_index;
-          AddVertex(g_index, t_index, n_index);
+        EnsureIndexGroup();
+        std::uint32_t face_size = 0;
+        int result =
+            ReadFace(line, [&](const std::array<std::size_t, 3>& corner) {
+              if (corner[0] == 0 || corner[0] > positions_.size() ||
+                  corner[1] > texture_coordinates_.size() ||
+                  corner[2] > normals_.size()) {
+#ifdef OBJ_PARSER_DEBUG
+                std::cerr << "[OBJParser] Error: Face index out of range.\n";
+#endif
+                return 1;
+              }
+#ifdef PARSE_STATS
+              const auto dedup_start = std::chrono::steady_clock::now();
+#endif
+              const int vertex_result =
+                  AddVertex(corner[0], corner[1], corner[2]);
+#ifdef PARSE_STATS
+              stats_.dedup_seconds += ParseStats::SecondsSince(dedup_start);
+#endif
+              face_size++;
+              return vertex_result;
+            });
+        if (result == 0) {
+          AddFace(face_size);
         }
-      } else if (kwd == "l") {
+#ifdef PARSE_STATS
+        stats_.face_seconds += ParseStats::SecondsSince(face_start);
+#endif
+        return result;
+      }
+      case Keyword::kLine: {
         if (line.empty()) {
-#ifdef DEBUG
+#ifdef OBJ_PARSER_DEBUG
           std::cerr << "[OBJParser] Error: 'l' keyword with empty indices.\n";
 #endif
           return 1;
         }
-        std::istringstream iss(line);
         std::size_t index;
-        while (iss >> index) {
-          if (index < 0 || index >= positions_.size()) {
-#ifdef DEBUG
+        while (ReadNumber(line, index)) {
+          if (index >= positions_.size()) {
+#ifdef OBJ_PARSER_DEBUG
             std::cerr << "[OBJParser] Error: Line index out of range.\n";
 #endif
             return 1;
           }
           line_indices_.push_back(index);
         }
-      } else {
-#ifdef DEBUG
+        break;
+      }
+      default:
+#ifdef OBJ_PARSER_DEBUG
         std::cerr << "[OBJParser] Error: Unknown keyword '" << kwd << "'.\n";
 #endif
         return 1;
-      }
     }
-    input_stream_.close();
     return 0;
   }
 
-  int Clear() {
-    object_name_.clear();
-    mtl_name_.clear();
-    positions_.clear();
-    texture_coordinates_.clear();
-    normals_.clear();
-    vertex_map_.clear();
-    vertex_buffer_.clear();
-    sub_objects_.clear();
-    line_indices_.clear();
+  static int StreamRecord(std::string_view line, StreamBatch& batch,
+                          StreamHandler& handler, std::size_t batch_size) {
+    if (StreamLine(line, batch, handler) != 0) {
+      return 1;
+    }
+    return batch.record_count() >= batch_size ? FlushBatch(batch, handler) : 0;
+  }
+
+  // Delivers the pending records and starts an empty batch that keeps the
+  // storage of the last one.
+  static int FlushBatch(StreamBatch& batch, StreamHandler& handler) {
+    if (batch.record_count() == 0) {
+      return 0;
+    }
+    if (handler.OnBatch(batch) != 0) {
+      return 1;
+    }
+    batch.position_base += batch.positions.size();
+    batch.texture_coordinate_base += batch.texture_coordinates.size();
+    batch.normal_base += batch.normals.size();
+    batch.positions.clear();
+    batch.texture_coordinates.clear();
+    batch.normals.clear();
+    batch.face_corners.clear();
+    batch.face_sizes.clear();
+    batch.line_indices.clear();
     return 0;
   }
 
- private:
-  const std::array<REAL, 3> max_vector3 = {std::numeric_limits<REAL>::max(),
-                                           std::numeric_limits<REAL>::max(),
-                                           std::numeric_limits<REAL>::max()};
+  // ParseLine for ParseStream: the same records and checks, but attributes
+  // are only counted and state changes go to handler.
+  static int StreamLine(std::string_view line, StreamBatch& batch,
+                        StreamHandler& handler) {
+    if (!line.empty() && line.back() == '\r') {
+      line.remove_suffix(1);
+    }
+    Trim(line);
+    if (line.empty()) {
+      return 0;
+    }
+    std::string_view kwd = ReadKeyword(line);
+    const Keyword keyword = ClassifyKeyword(kwd);
+    switch (keyword) {
+      case Keyword::kPosition:
+        return ReadPosition(line, batch.positions);
+      case Keyword::kTextureCoordinate:
+        return ReadTextureCoordinate(line, batch.texture_coordinates);
+      case Keyword::kNormal:
+        return ReadNormal(line, batch.normals);
+      case Keyword::kFace: {
+        const std::size_t position_count =
+            batch.position_base + batch.positions.size();
+        const std::size_t texture_coordinate_count =
+            batch.texture_coordinate_base + batch.texture_coordinates.size();
+        const std::size_t normal_count =
+            batch.normal_base + batch.normals.size();
+        const std::size_t first_corner = batch.face_corners.size();
+        int result =
+            ReadFace(line, [&](const std::array<std::size_t, 3>& corner) {
+              if (corner[0] == 0 || corner[0] > position_count ||
+                  corner[1] > texture_coordinate_count ||
+                  corner[2] > normal_count) {
+#ifdef OBJ_PARSER_DEBUG
+                std::cerr << "[OBJParser] Error: Face index out of range.\n";
+#endif
+                return 1;
+              }
+              batch.face_corners.push_back(corner);
+              return 0;
+            });
+        if (result == 0) {
+          batch.face_sizes.push_back(static_cast<std::uint32_t>(
+              batch.face_corners.size() - first_corner));
+        }
+        return result;
+      }
+      case Keyword::kLine: {
+        if (line.empty()) {
+#ifdef OBJ_PARSER_DEBUG
+          std::cerr << "[OBJParser] Error: 'l' keyword with empty indices.\n";
+#endif
+          return 1;
+        }
+        std::size_t index;
+        while (ReadNumber(line, index)) {
+          if (index >= batch.position_base + batch.positions.size()) {
+#ifdef OBJ_PARSER_DEBUG
+            std::cerr << "[OBJParser] Error: Line index out of range.\n";
+#endif
+            return 1;
+          }
+          batch.line_indices.push_back(index);
+        }
+        return 0;
+      }
+      case Keyword::kObject:
+      case Keyword::kGroup:
+      case Keyword::kMaterial:
+      case Keyword::kMaterialLibrary:
+      case Keyword::kSmoothShading:
+        break;
+      default:
+#ifdef OBJ_PARSER_DEBUG
+        std::cerr << "[OBJParser] Error: Unknown keyword '" << kwd << "'.\n";
+#endif
+        return 1;
+    }
+    if (line.empty()) {
+#ifdef OBJ_PARSER_DEBUG
+      std::cerr << "[OBJParser] Error: '" << kwd << "' keyword with empty "
+                << "name.\n";
+#endif
+      return 1;
+    }
+    if (keyword == Keyword::kSmoothShading && line != "1" && line != "off") {
+#ifdef OBJ_PARSER_DEBUG
+      std::cerr << "[OBJParser] Error: 's' keyword with empty option.\n";
+#endif
+      return 1;
+    }
+    if (FlushBatch(batch, handler) != 0) {
+      return 1;
+    }
+    switch (keyword) {
+      case Keyword::kObject:
+        return handler.OnObject(line);
+      case Keyword::kGroup:
+        return handler.OnGroup(line);
+      case Keyword::kMaterial:
+        return handler.OnMaterial(line);
+      case Keyword::kMaterialLibrary:
+        return handler.OnMaterialLibrary(line);
+      default:
+        return handler.OnSmoothShading(line == "1");
+    }
+  }
+
+  const std::array<REAL, 3> max_vector3 = kMissingAttribute;
 
   const std::array<REAL, 4> max_vector4 = {
       std::numeric_limits<REAL>::max(), std::numeric_limits<REAL>::max(),
       std::numeric_limits<REAL>::max(), std::numeric_limits<REAL>::max()};
 
-  struct HashFunction {
-    std::size_t operator()(Vertex key) const {
-      std::hash<REAL> v_hash;
-      std::size_t g_hash = v_hash(key.position[0]) ^ v_hash(key.position[1]) ^
-                           v_hash(key.position[2]) ^ v_hash(key.position[3]);
-      std::size_t t_hash = v_hash(key.texture_coordinate[0]) ^
-                           v_hash(key.texture_coordinate[1]) ^
-                           v_hash(key.texture_coordinate[2]);
-      std::size_t n_hash =
-          v_hash(key.normal[0]) ^ v_hash(key.normal[1]) ^ v_hash(key.normal[2]);
-
-      return g_hash ^ (t_hash << 1) ^ (n_hash << 2);
-    }
-  };
-
-  std::string& Trim(std::string& s) {
+  static std::string_view& Trim(std::string_view& s) {
     if (s.empty()) {
       return s;
     }
-    size_t first = s.find_first_not_of(" ");
-    size_t last = s.find_last_not_of(" ");
-    if (first == std::string::npos || last == std::string::npos) {
-      s.clear();
+    size_t first = s.find_first_not_of(' ');
+    size_t last = s.find_last_not_of(' ');
+    if (first == std::string_view::npos || last == std::string_view::npos) {
+      s = std::string_view();
       return s;
     }
     s = s.substr(first, last - first + 1);
     size_t comment = s.find('#');
-    if (comment != std::string::npos) s = s.substr(0, comment);
+    if (comment != std::string_view::npos) s = s.substr(0, comment);
     return s;
   }
 
-  std::string ReadKeyword(std::string& s) {
+  enum class Keyword {
+    kUnknown,
+    kObject,
+    kGroup,
+    kMaterial,
+    kMaterialLibrary,
+    kSmoothShading,
+    kPosition,
+    kTextureCoordinate,
+    kNormal,
+    kFace,
+    kLine
+  };
+
+  static Keyword ClassifyKeyword(std::string_view kwd) {
+    switch (KeywordCode(kwd)) {
+      case KeywordCode("v"):
+        return Keyword::kPosition;
+      case KeywordCode("vt"):
+        return Keyword::kTextureCoordinate;
+      case KeywordCode("vn"):
+        return Keyword::kNormal;
+      case KeywordCode("f"):
+        return Keyword::kFace;
+      case KeywordCode("l"):
+        return Keyword::kLine;
+      case KeywordCode("o"):
+        return Keyword::kObject;
+      case KeywordCode("g"):
+        return Keyword::kGroup;
+      case KeywordCode("usemtl"):
+        return Keyword::kMaterial;
+      case KeywordCode("mtllib"):
+        return Keyword::kMaterialLibrary;
+      case KeywordCode("s"):
+        return Keyword::kSmoothShading;
+      default:
+        return Keyword::kUnknown;
+    }
+  }
+
+  // Keyword of a line that starts with "v ", "vt ", "vn " or "f ", which make
+  // up nearly all lines, without trimming it. Other lines give kUnknown and
+  // have to go through ReadRecord.
+  static Keyword QuickKeyword(std::string_view line) {
+    if (line.size() > 2 && line[0] == 'v') {
+      if (line[1] == ' ') {
+        return Keyword::kPosition;
+      }
+      if (line[2] == ' ' && line[1] == 't') {
+        return Keyword::kTextureCoordinate;
+      }
+      if (line[2] == ' ' && line[1] == 'n') {
+        return Keyword::kNormal;
+      }
+    } else if (line.size() > 1 && line[0] == 'f' && line[1] == ' ') {
+      return Keyword::kFace;
+    }
+    return Keyword::kUnknown;
+  }
+
+  // Splits a line as ParseLine does: returns its keyword, empty for blank
+  // lines and comments, and leaves the rest of the record in line.
+  static std::string_view ReadRecord(std::string_view& line) {
+    if (!line.empty() && line.back() == '\r') {
+      line.remove_suffix(1);
+    }
+    Trim(line);
+    return line.empty() ? line : ReadKeyword(line);
+  }
+
+  static std::string_view ReadKeyword(std::string_view& s) {
     size_t found;
-    if ((found = s.find(" ")) == std::string::npos) {
+    if ((found = s.find(' ')) == std::string_view::npos) {
       return s;
     }
-    std::string kwd = s.substr(0, found);
-    s = s.substr(found + 1);
+    std::string_view kwd = s.substr(0, found);
+    s.remove_prefix(found + 1);
     return kwd;
   }
 
+  static int ReadPosition(std::string_view line,
+                          std::vector<std::array<REAL, 4>>& positions) {
+    std::array<REAL, 4> vector4;
+    std::size_t count = ReadComponents(line, vector4);
+    if (count < 3 || count > 4) {
+#ifdef OBJ_PARSER_DEBUG
+      std::cerr << "[OBJParser] Error: 'v' expects 3 or 4 components.\n";
+#endif
+      return 1;
+    }
+    if (count == 3) {
+      vector4[3] = 1.f;
+    }
+    positions.push_back(vector4);
+    return 0;
+  }
+
+  static int ReadTextureCoordinate(
+      std::string_view line,
+      std::vector<std::array<REAL, 3>>& texture_coordinates) {
+    std::array<REAL, 3> vector3;
+    std::size_t count = ReadComponents(line, vector3);
+    if (count < 2 || count > 3) {
+#ifdef OBJ_PARSER_DEBUG
+      std::cerr << "[OBJParser] Error: 'vt' expects 2 or 3 components.\n";
+#endif
+      return 1;
+    }
+    if (count == 2) {
+      vector3[2] = 0.f;
+    }
+    texture_coordinates.push_back(vector3);
+    return 0;
+  }
+
+  static int ReadNormal(std::string_view line,
+                        std::vector<std::array<REAL, 3>>& normals) {
+    std::array<REAL, 3> vector3;
+    if (ReadComponents(line, vector3) != 3) {
+#ifdef OBJ_PARSER_DEBUG
+      std::cerr << "[OBJParser] Error: 'vn' expects 3 components.\n";
+#endif
+      return 1;
+    }
+    normals.push_back(vector3);
+    return 0;
+  }
+
+  // Calls on_corner for every corner of an 'f' record.
+  template <class F>
+  static int ReadFace(std::string_view line, F&& on_corner) {
+    std::array<std::size_t, 3> corner;
+    SkipSpaces(line);
+    while (!line.empty()) {
+      if (ReadFaceCorner(line, corner) != 0) {
+#ifdef OBJ_PARSER_DEBUG
+        std::cerr << "[OBJParser] Error: Malformed face index format.\n";
+#endif
+        return 1;
+      }
+      if (on_corner(corner) != 0) {
+        return 1;
+      }
+      SkipSpaces(line);
+    }
+    return 0;
+  }
+
+  static bool IsSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' ||
+           c == '\f';
+  }
+
+  static void SkipSpaces(std::string_view& s) {
+    std::size_t i = 0;
+    while (i < s.size() && IsSpace(s[i])) {
+      i++;
+    }
+    s.remove_prefix(i);
+  }
+
+  // Reads one number from the front of s with std::from_chars, which unlike
+  // stream extraction neither allocates nor consults the locale.
   template <class T>
-  std::vector<T> ReadComponents(std::string s) {
-    std::istringstream iss(s);
-    std::vector<T> components;
+  static bool ReadNumber(std::string_view& s, T& value) {
+    SkipSpaces(s);
+    const char* first = s.data();
+    const char* last = s.data() + s.size();
+    if (first != last && *first == '+' && last - first > 1 &&
+        first[1] != '-') {
+      first++;
+    }
+    std::from_chars_result result = std::from_chars(first, last, value);
+    if (result.ec != std::errc()) {
+      return false;
+    }
+    s.remove_prefix(static_cast<std::size_t>(result.ptr - s.data()));
+    return true;
+  }
+
+  // Returns the number of components read, or N + 1 if s holds more than N.
+  template <class T, std::size_t N>
+  static std::size_t ReadComponents(std::string_view s,
+                                    std::array<T, N>& components) {
+    std::size_t count = 0;
     T component;
-    while (iss >> component) {
-      components.push_back(component);
+    while (ReadNumber(s, component)) {
+      if (count == N) {
+        return N + 1;
+      }
+      components[count++] = component;
+    }
+    return count;
+  }
+
+  // Reads a "v", "v/vt", "v//vn" or "v/vt/vn" corner from the front of s.
+  // Absent indices are stored as 0.
+  static int ReadFaceCorner(std::string_view& s,
+                            std::array<std::size_t, 3>& corner) {
+    corner = {0, 0, 0};
+    const char* cursor = s.data();
+    const char* end = s.data() + s.size();
+    for (int i = 0; i < 3; i++) {
+      if (i > 0) {
+        if (cursor == end || *cursor != '/') {
+          break;
+        }
+        cursor++;
+        if (i == 1 && cursor != end && *cursor == '/') {
+          continue;
+        }
+      }
+      std::from_chars_result result = std::from_chars(cursor, end, corner[i]);
+      if (result.ec != std::errc()) {
+        return 1;
+      }
+      cursor = result.ptr;
+    }
+    if (cursor != end && !IsSpace(*cursor)) {
+      return 1;
     }
-    return components;
+    s.remove_prefix(static_cast<std::size_t>(cursor - s.data()));
+    return 0;
   }
 
-  void AddVertex(std::size_t g_index, std::size_t t_index,
-                 std::size_t n_index) {
+  Vertex MakeVertex(std::size_t g_index, std::size_t t_index,
+                    std::size_t n_index) const {
     Vertex new_vertex;
     new_vertex.position = positions_[g_index - 1];
     new_vertex.texture_coordinate =
         t_index != 0 ? texture_coordinates_[t_index - 1] : max_vector3;
     new_vertex.normal = n_index != 0 ? normals_[n_index - 1] : max_vector3;
-    auto found = vertex_map_.find(new_vertex);
-    if (found != vertex_map_.end()) {
-      sub_objects_.back()
-          .mesh_groups.back()
-          .index_groups.back()
-          .index_buffer_.push_back(found->second);
+    return new_vertex;
+  }
+
+  Vertex MakeVertex(INTEGER corner) const {
+    const VertexIndexMap::Key& c = corners_[corner];
+    return MakeVertex(c[0], c[1], c[2]);
+  }
+
+  // Fails on attribute numbers or vertex counts that the 32-bit keys and
+  // indices cannot hold, rather than letting them wrap.
+  int AddVertex(std::size_t g_index, std::size_t t_index,
+                std::size_t n_index) {
+    if (g_index > kMaxAttributeNumber || t_index > kMaxAttributeNumber ||
+        n_index > kMaxAttributeNumber) {
+#ifdef OBJ_PARSER_DEBUG
+      std::cerr << "[OBJParser] Error: Face index exceeds 32 bits.\n";
+#endif
+      return 1;
+    }
+    IndexGroup& index_group =
+        sub_objects_.back().mesh_groups.back().index_groups.back();
+    const VertexIndexMap::Key key = {static_cast<std::uint32_t>(g_index),
+                                     static_cast<std::uint32_t>(t_index),
+                                     static_cast<std::uint32_t>(n_index)};
+    if (parse_options_.deferred_dedup) {
+      if (corners_.size() >= kMaxVertexCount) {
+        return ReportTooManyVertices();
+      }
+      // DeduplicateCorners swaps the corner ordinal for a vertex index.
+      index_group.index_buffer_.push_back(
+          static_cast<INTEGER>(corners_.size()));
+      corners_.push_back(key);
+      return 0;
+    }
+    const std::size_t vertex_count =
+        IsPlanar() ? vertex_keys_.size() : vertex_buffer_.size();
+    std::pair<std::uint32_t, bool> found =
+        vertex_map_.Insert(key, static_cast<std::uint32_t>(vertex_count));
+    if (found.second && vertex_count >= kMaxVertexCount) {
+      return ReportTooManyVertices();
+    }
+    PushIndex(index_group, found.first);
+    if (found.second && IsPlanar()) {
+      vertex_keys_.push_back(key);
+    } else if (found.second) {
+      vertex_buffer_.push_back(MakeVertex(g_index, t_index, n_index));
+    }
+    return 0;
+  }
+
+  // Appends vertex to index_group, as an offset from base_vertex with
+  // narrow_indices while all vertices of the group so far span at most
+  // 65536 indices. The first vertex that does not fit widens the group for
+  // good. Only the last group of the mesh is ever appended to.
+  void PushIndex(IndexGroup& index_group, INTEGER vertex) {
+    std::vector<std::uint16_t>& offsets = index_group.index_buffer_16_;
+    if (!parse_options_.narrow_indices ||
+        !index_group.index_buffer_.empty()) {
+      index_group.index_buffer_.push_back(vertex);
+      return;
+    }
+    INTEGER& base_vertex = index_group.base_vertex;
+    if (offsets.empty()) {
+      base_vertex = vertex;
+      narrow_max_vertex_ = vertex;
+    }
+    const INTEGER low = std::min(base_vertex, vertex);
+    const INTEGER high = std::max(narrow_max_vertex_, vertex);
+    if (high - low > std::numeric_limits<std::uint16_t>::max()) {
+      index_group.index_buffer_.reserve(offsets.size() + 1);
+      for (std::uint16_t offset : offsets) {
+        index_group.index_buffer_.push_back(base_vertex + offset);
+      }
+      index_group.index_buffer_.push_back(vertex);
+      std::vector<std::uint16_t>().swap(offsets);
+      base_vertex = 0;
+      return;
+    }
+    if (low < base_vertex) {
+      for (std::uint16_t& offset : offsets) {
+        offset = static_cast<std::uint16_t>(offset + (base_vertex - low));
+      }
+      base_vertex = low;
+    }
+    narrow_max_vertex_ = high;
+    offsets.push_back(static_cast<std::uint16_t>(vertex - base_vertex));
+  }
+
+  static int ReportTooManyVertices() {
+#ifdef OBJ_PARSER_DEBUG
+    std::cerr << "[OBJParser] Error: More vertices than INTEGER indices can "
+                 "number.\n";
+#endif
+    return 1;
+  }
+
+  // New groups come from the spare lists RecycleSubObjects fills, so their
+  // names and buffers start out with the capacity of an earlier parse.
+  template <class T>
+  static T TakeSpare(std::vector<T>& spares) {
+    if (spares.empty()) {
+      return T();
+    }
+    T spare = std::move(spares.back());
+    spares.pop_back();
+    return spare;
+  }
+
+  void AddSubObject(std::string_view name) {
+    sub_objects_.push_back(TakeSpare(spare_sub_objects_));
+    sub_objects_.back().sub_object_name = name;
+  }
+
+  void AddMeshGroup(std::string_view name) {
+    std::vector<MeshGroup>& mesh_groups = sub_objects_.back().mesh_groups;
+    mesh_groups.push_back(TakeSpare(spare_mesh_groups_));
+    mesh_groups.back().mesh_group_name = name;
+  }
+
+  IndexGroup& AddIndexGroup() {
+    std::vector<IndexGroup>& index_groups =
+        sub_objects_.back().mesh_groups.back().index_groups;
+    index_groups.push_back(TakeSpare(spare_index_groups_));
+    return index_groups.back();
+  }
+
+  // Faces, and g, usemtl and s records, may come before the o, g, usemtl or
+  // s that would open their group. They go to unnamed groups opened here.
+  void EnsureSubObject() {
+    if (sub_objects_.empty()) {
+      AddSubObject("Unnamed");
+    }
+  }
+
+  void EnsureMeshGroup() {
+    EnsureSubObject();
+    if (sub_objects_.back().mesh_groups.empty()) {
+      AddMeshGroup("Unnamed");
+    }
+  }
+
+  void EnsureIndexGroup() {
+    EnsureMeshGroup();
+    if (sub_objects_.back().mesh_groups.back().index_groups.empty()) {
+      IndexGroup& new_index = AddIndexGroup();
+      new_index.mtl_name = material_name_;
+      new_index.is_smooth_shading = is_smooth_shading_mode_;
+    }
+  }
+
+  // Starts parsing the library named by mtl_name_ on its own thread. A
+  // later mtllib record replaces it, after waiting for it to finish.
+  void LoadMaterialsAsync() {
+    material_future_ = std::async(
+        std::launch::async,
+        [path = ResolveMaterialPath(source_path_, mtl_name_),
+         cache_directory = parse_options_.cache_directory] {
+          MTLParser parser;
+          parser.set_cache_directory(cache_directory);
+          MaterialLoad load;
+          load.status = parser.Parse(path);
+          load.materials = parser.Release();
+          return load;
+        });
+  }
+
+  // Interns the usemtl names of all index groups.
+  void AssignMaterialIds() {
+    std::map<std::string_view, std::uint32_t> ids;
+    std::vector<const std::string*> names;
+    for (IndexGroup* index_group : IndexGroups(sub_objects_)) {
+      if (index_group->mtl_name.empty()) {
+        index_group->material_id = kNoMaterial;
+        continue;
+      }
+      auto [itr, is_new] = ids.try_emplace(
+          index_group->mtl_name, static_cast<std::uint32_t>(names.size()));
+      if (is_new) {
+        names.push_back(&index_group->mtl_name);
+      }
+      index_group->material_id = itr->second;
+    }
+    for (const std::string* name : names) {
+      material_names_.push_back(*name);
+    }
+  }
+
+  void FinishMaterials() {
+    if (!material_future_.valid()) {
+      return;
+    }
+    MaterialLoad load = material_future_.get();
+    if (load.status != 0) {
+#ifdef OBJ_PARSER_DEBUG
+      std::cerr << "[OBJParser] Warning: Failed to load material library: "
+                << mtl_name_ << "\n";
+#endif
+      return;
+    }
+    materials_ = FlattenMaterials(material_names_, load.materials);
+  }
+
+  // Empties every group into the spare lists, keeping its capacity. Groups
+  // go in back to front, so the next parse takes them in their old order.
+  void RecycleSubObjects() {
+    for (auto sub_object = sub_objects_.rbegin();
+         sub_object != sub_objects_.rend(); ++sub_object) {
+      for (auto mesh_group = sub_object->mesh_groups.rbegin();
+           mesh_group != sub_object->mesh_groups.rend(); ++mesh_group) {
+        for (auto index_group = mesh_group->index_groups.rbegin();
+             index_group != mesh_group->index_groups.rend(); ++index_group) {
+          index_group->mtl_name.clear();
+          index_group->material_id = kNoMaterial;
+          index_group->is_smooth_shading = true;
+          index_group->is_smooth_shading_empty = true;
+          index_group->index_buffer_.clear();
+          index_group->face_sizes.clear();
+          index_group->index_buffer_16_.clear();
+          index_group->base_vertex = 0;
+          spare_index_groups_.push_back(std::move(*index_group));
+        }
+        mesh_group->mesh_group_name.clear();
+        mesh_group->index_groups.clear();
+        spare_mesh_groups_.push_back(std::move(*mesh_group));
+      }
+      sub_object->sub_object_name.clear();
+      sub_object->mesh_groups.clear();
+      spare_sub_objects_.push_back(std::move(*sub_object));
+    }
+    sub_objects_.clear();
+  }
+
+  // Capacities right after tokenizing, before later stages free or swap
+  // the containers.
+  void RecordCapacities() {
+    stats_.peak_position_capacity = positions_.capacity();
+    stats_.peak_texture_coordinate_capacity = texture_coordinates_.capacity();
+    stats_.peak_normal_capacity = normals_.capacity();
+    stats_.peak_vertex_capacity =
+        std::max({vertex_buffer_.capacity(), vertex_keys_.capacity(),
+                  corners_.capacity()});
+    for (IndexGroup* index_group : IndexGroups(sub_objects_)) {
+      stats_.peak_index_capacity = std::max(
+          stats_.peak_index_capacity, index_group->index_buffer_.capacity());
+    }
+  }
+
+  // The planar layout collects unique (v, vt, vn) triples and expands them
+  // once parsing is done.
+  bool IsPlanar() const {
+    return parse_options_.vertex_layout == VertexLayout::kPlanar;
+  }
+
+  // Position of a vertex once corners are resolved to vertices.
+  const std::array<REAL, 4>& VertexPosition(INTEGER vertex) const {
+    return IsPlanar() ? positions_[vertex_keys_[vertex][0] - 1]
+                      : vertex_buffer_[vertex].position;
+  }
+
+  void AddFace(std::uint32_t face_size) {
+    if (parse_options_.triangulate) {
+      IndexGroup& index_group =
+          sub_objects_.back().mesh_groups.back().index_groups.back();
+      index_group.face_sizes.push_back(face_size);
+    }
+  }
+
+  // Rewrites every index buffer as a triangle list using the face sizes
+  // recorded while parsing.
+  void TriangulateIndexGroups() {
+    std::vector<IndexGroup*> index_groups = IndexGroups(sub_objects_);
+    thread_pool().ParallelFor(index_groups.size(), [&](std::size_t i) {
+      IndexGroup& index_group = *index_groups[i];
+      if (index_group.index_buffer_16_.empty()) {
+        TriangulateIndexBuffer(index_group.face_sizes, 0,
+                               index_group.index_buffer_);
+      } else {
+        TriangulateIndexBuffer(index_group.face_sizes,
+                               index_group.base_vertex,
+                               index_group.index_buffer_16_);
+      }
+      std::vector<std::uint32_t>().swap(index_group.face_sizes);
+    });
+  }
+
+  // Rewrites polygons, whose entries are vertices less base_vertex, as a
+  // triangle list of the same kind.
+  template <class T>
+  void TriangulateIndexBuffer(const std::vector<std::uint32_t>& face_sizes,
+                              INTEGER base_vertex,
+                              std::vector<T>& polygons) const {
+    std::vector<T> triangles;
+    triangles.reserve(polygons.size() * 3 / 2);
+    PolygonTriangulator triangulator;
+    std::vector<std::uint32_t> corners;
+    std::size_t offset = 0;
+    for (std::uint32_t face_size : face_sizes) {
+      const T* face = &polygons[offset];
+      offset += face_size;
+      if (face_size == 3) {
+        triangles.insert(triangles.end(), face, face + 3);
+        continue;
+      }
+      corners.clear();
+      triangulator.Triangulate(
+          face_size,
+          [&](std::size_t corner) -> const std::array<REAL, 4>& {
+            return VertexPosition(base_vertex + face[corner]);
+          },
+          corners);
+      for (std::uint32_t corner : corners) {
+        triangles.push_back(face[corner]);
+      }
+    }
+    polygons.swap(triangles);
+  }
+
+  // Expands vertex_keys_ into planar_vertex_buffer_, leaving out attributes
+  // that no vertex refers to.
+  void BuildPlanarVertexBuffer() {
+    PlanarVertexBuffer& planar = planar_vertex_buffer_;
+    const std::size_t vertex_count = vertex_keys_.size();
+    bool has_texture_coordinates = false;
+    bool has_texture_w = false;
+    bool has_normals = false;
+    for (const VertexIndexMap::Key& key : vertex_keys_) {
+      if (key[1] != 0) {
+        has_texture_coordinates = true;
+        has_texture_w =
+            has_texture_w || texture_coordinates_[key[1] - 1][2] != 0;
+      }
+      has_normals = has_normals || key[2] != 0;
+    }
+    planar.vertex_count = vertex_count;
+    planar.position_components = parse_options_.keep_position_w ? 4 : 3;
+    planar.texture_coordinate_components =
+        has_texture_coordinates ? (has_texture_w ? 3 : 2) : 0;
+    planar.normal_components = has_normals ? 3 : 0;
+    planar.positions.resize(vertex_count * planar.position_components);
+    planar.texture_coordinates.resize(vertex_count *
+                                      planar.texture_coordinate_components);
+    planar.normals.resize(vertex_count * planar.normal_components);
+
+    ThreadPool& pool = thread_pool();
+    const std::size_t block_count = std::max<std::size_t>(
+        1, std::min<std::size_t>(std::size_t{pool.thread_count()} * 4,
+                                 vertex_count / kMinDedupBlockSize));
+    pool.ParallelFor(block_count, [&](std::size_t block) {
+      for (std::size_t i = vertex_count * block / block_count;
+           i < vertex_count * (block + 1) / block_count; i++) {
+        const VertexIndexMap::Key& key = vertex_keys_[i];
+        const std::array<REAL, 4>& position = positions_[key[0] - 1];
+        std::copy_n(position.begin(), planar.position_components,
+                    &planar.positions[i * planar.position_components]);
+        if (has_texture_coordinates) {
+          const std::array<REAL, 3>& texture_coordinate =
+              key[1] != 0 ? texture_coordinates_[key[1] - 1] : max_vector3;
+          std::copy_n(texture_coordinate.begin(),
+                      planar.texture_coordinate_components,
+                      &planar.texture_coordinates
+                           [i * planar.texture_coordinate_components]);
+        }
+        if (has_normals) {
+          const std::array<REAL, 3>& normal =
+              key[2] != 0 ? normals_[key[2] - 1] : max_vector3;
+          std::copy_n(normal.begin(), 3, &planar.normals[i * 3]);
+        }
+      }
+    });
+    std::vector<VertexIndexMap::Key>().swap(vertex_keys_);
+  }
+
+  // Builds vertex_buffer_, or vertex_keys_ for kPlanar, from corners_ and
+  // rewrites the index buffers.
+  // Corners are bucketed by hash so that each shard owns a disjoint set of
+  // index triples and can be deduplicated without locking. Within a shard
+  // corners keep file order, so every vertex is represented by its first
+  // corner.
+  void DeduplicateCorners() {
+    ThreadPool& pool = thread_pool();
+    const std::size_t corner_count = corners_.size();
+    const std::size_t shard_count = std::size_t{pool.thread_count()} * 4;
+    const std::size_t block_count = std::max<std::size_t>(
+        1, std::min(shard_count, corner_count / kMinDedupBlockSize));
+    auto block_begin = [&](std::size_t block) {
+      return corner_count * block / block_count;
+    };
+    // The shard tables index slots with the low hash bits, so shards are
+    // picked with the high ones.
+    auto shard_of = [shard_count](std::uint64_t hash) {
+      return static_cast<std::size_t>((hash >> 32) % shard_count);
+    };
+
+    // Hash every corner and count corners per (block, shard).
+    std::vector<std::uint64_t> hashes(corner_count);
+    std::vector<std::size_t> offsets(block_count * shard_count, 0);
+    pool.ParallelFor(block_count, [&](std::size_t block) {
+      std::size_t* counts = &offsets[block * shard_count];
+      for (std::size_t i = block_begin(block); i < block_begin(block + 1);
+           i++) {
+        hashes[i] = VertexIndexMap::Hash(corners_[i]);
+        counts[shard_of(hashes[i])]++;
+      }
+    });
+    // Lay shards out one after another, each in file order.
+    std::vector<std::size_t> shard_begin(shard_count + 1);
+    std::size_t offset = 0;
+    for (std::size_t shard = 0; shard < shard_count; shard++) {
+      shard_begin[shard] = offset;
+      for (std::size_t block = 0; block < block_count; block++) {
+        std::size_t count = offsets[block * shard_count + shard];
+        offsets[block * shard_count + shard] = offset;
+        offset += count;
+      }
+    }
+    shard_begin[shard_count] = offset;
+    std::vector<INTEGER> order(corner_count);
+    pool.ParallelFor(block_count, [&](std::size_t block) {
+      std::size_t* cursors = &offsets[block * shard_count];
+      for (std::size_t i = block_begin(block); i < block_begin(block + 1);
+           i++) {
+        order[cursors[shard_of(hashes[i])]++] = static_cast<INTEGER>(i);
+      }
+    });
+
+    // Map every corner to the first corner with the same index triple.
+    // Unique corners get a shard local id in vertex_ids.
+    std::vector<INTEGER> representatives(corner_count);
+    std::vector<INTEGER> vertex_ids(corner_count);
+    std::vector<std::size_t> shard_vertex_offsets(shard_count + 1, 0);
+    std::vector<VertexIndexMap::Stats> shard_stats(shard_count);
+    pool.ParallelFor(shard_count, [&](std::size_t shard) {
+      VertexIndexMap seen;
+      INTEGER local_id = 0;
+      for (std::size_t k = shard_begin[shard]; k < shard_begin[shard + 1];
+           k++) {
+        INTEGER corner = order[k];
+        std::pair<std::uint32_t, bool> found =
+            seen.Insert(corners_[corner], hashes[corner], corner);
+        representatives[corner] = found.first;
+        if (found.second) {
+          vertex_ids[corner] = local_id++;
+        }
+      }
+      shard_vertex_offsets[shard + 1] = local_id;
+      shard_stats[shard] = seen.stats();
+    });
+    for (const VertexIndexMap::Stats& stats : shard_stats) {
+      dedup_stats_ += stats;
+    }
+    std::vector<std::uint64_t>().swap(hashes);
+    std::vector<INTEGER>().swap(order);
+
+    // Give unique corners their final vertex index.
+    std::size_t vertex_count = 0;
+    if (parse_options_.first_occurrence_order) {
+      std::vector<std::size_t> block_vertex_offsets(block_count + 1, 0);
+      pool.ParallelFor(block_count, [&](std::size_t block) {
+        std::size_t count = 0;
+        for (std::size_t i = block_begin(block); i < block_begin(block + 1);
+             i++) {
+          count += representatives[i] == i;
+        }
+        block_vertex_offsets[block + 1] = count;
+      });
+      for (std::size_t block = 0; block < block_count; block++) {
+        block_vertex_offsets[block + 1] += block_vertex_offsets[block];
+      }
+      vertex_count = block_vertex_offsets[block_count];
+      pool.ParallelFor(block_count, [&](std::size_t block) {
+        INTEGER vertex_id = static_cast<INTEGER>(block_vertex_offsets[block]);
+        for (std::size_t i = block_begin(block); i < block_begin(block + 1);
+             i++) {
+          if (representatives[i] == i) {
+            vertex_ids[i] = vertex_id++;
+          }
+        }
+      });
     } else {
-      sub_objects_.back()
-          .mesh_groups.back()
-          .index_groups.back()
-          .index_buffer_.push_back(vertex_buffer_.size());
-      vertex_map_.insert({new_vertex, vertex_buffer_.size()});
-      vertex_buffer_.push_back(new_vertex);
+      for (std::size_t shard = 0; shard < shard_count; shard++) {
+        shard_vertex_offsets[shard + 1] += shard_vertex_offsets[shard];
+      }
+      vertex_count = shard_vertex_offsets[shard_count];
+      pool.ParallelFor(block_count, [&](std::size_t block) {
+        for (std::size_t i = block_begin(block); i < block_begin(block + 1);
+             i++) {
+          if (representatives[i] == i) {
+            std::size_t shard = shard_of(VertexIndexMap::Hash(corners_[i]));
+            vertex_ids[i] += static_cast<INTEGER>(shard_vertex_offsets[shard]);
+          }
+        }
+      });
+    }
+
+    // Fill the vertex buffer and resolve duplicates to their representative.
+    if (IsPlanar()) {
+      vertex_keys_.resize(vertex_count);
+    } else {
+      vertex_buffer_.resize(vertex_count);
     }
+    pool.ParallelFor(block_count, [&](std::size_t block) {
+      for (std::size_t i = block_begin(block); i < block_begin(block + 1);
+           i++) {
+        if (representatives[i] == i && IsPlanar()) {
+          vertex_keys_[vertex_ids[i]] = corners_[i];
+        } else if (representatives[i] == i) {
+          vertex_buffer_[vertex_ids[i]] = MakeVertex(static_cast<INTEGER>(i));
+        } else {
+          vertex_ids[i] = vertex_ids[representatives[i]];
+        }
+      }
+    });
+    std::vector<IndexGroup*> index_groups = IndexGroups(sub_objects_);
+    pool.ParallelFor(index_groups.size(), [&](std::size_t i) {
+      IndexGroup& index_group = *index_groups[i];
+      std::vector<INTEGER>& indices = index_group.index_buffer_;
+      if (parse_options_.narrow_indices && !indices.empty()) {
+        INTEGER low = std::numeric_limits<INTEGER>::max();
+        INTEGER high = 0;
+        for (INTEGER corner : indices) {
+          low = std::min(low, vertex_ids[corner]);
+          high = std::max(high, vertex_ids[corner]);
+        }
+        if (high - low <= std::numeric_limits<std::uint16_t>::max()) {
+          index_group.base_vertex = low;
+          index_group.index_buffer_16_.resize(indices.size());
+          for (std::size_t j = 0; j < indices.size(); j++) {
+            index_group.index_buffer_16_[j] =
+                static_cast<std::uint16_t>(vertex_ids[indices[j]] - low);
+          }
+          std::vector<INTEGER>().swap(indices);
+          return;
+        }
+      }
+      for (INTEGER& index : indices) {
+        index = vertex_ids[index];
+      }
+    });
+    std::vector<VertexIndexMap::Key>().swap(corners_);
   }
 
   std::string object_name_;
   std::string mtl_name_;
+  // Path given to Parse, for resolving mtllib.
+  std::string source_path_;
+  std::future<MaterialLoad> material_future_;
+  std::vector<std::string> material_names_;
+  std::vector<Material> materials_;
   std::vector<std::array<REAL, 4>> positions_;
   std::vector<std::array<REAL, 3>> texture_coordinates_;
   std::vector<std::array<REAL, 3>> normals_;
-  std::unordered_map<Vertex, std::size_t, HashFunction> vertex_map_;
+  VertexIndexMap vertex_map_;
+  VertexIndexMap::Stats dedup_stats_;
+  std::vector<VertexIndexMap::Key> corners_;
+  // Unique (v, vt, vn) triples, kept instead of vertex_buffer_ for kPlanar.
+  std::vector<VertexIndexMap::Key> vertex_keys_;
+  // Largest vertex of the last index group while PushIndex narrows it.
+  INTEGER narrow_max_vertex_ = 0;
 
-  std::vector<Vertex> vertex_buffer_;
-  std::vector<SubObject> sub_objects_;
-  std::vector<std::size_t> line_indices_;
-  std::ifstream input_stream_;
+  // Mutable so that a cache hit can be copied out on first use.
+  mutable std::vector<Vertex> vertex_buffer_;
+  mutable PlanarVertexBuffer planar_vertex_buffer_;
+  mutable std::vector<SubObject> sub_objects_;
+  mutable std::vector<std::size_t> line_indices_;
+  std::shared_ptr<const MeshView> cached_mesh_;
+  // Whether cached_mesh_ still has to be copied into the buffers above.
+  mutable std::atomic<bool> is_cache_pending_{false};
+  mutable std::mutex cache_mutex_;
+  // Emptied groups kept by ParseOptions::reuse_capacity.
+  std::vector<SubObject> spare_sub_objects_;
+  std::vector<MeshGroup> spare_mesh_groups_;
+  std::vector<IndexGroup> spare_index_groups_;
+  ParseStats stats_;
+#ifdef PARSE_STATS
+  std::chrono::steady_clock::time_point parse_start_;
+#endif
+  MappedFile mapped_file_;
+  BlockReader block_reader_;
 
   std::string material_name_;
   bool is_smooth_shading_mode_ = true;
+
+  ParseOptions parse_options_;
+  std::unique_ptr<ThreadPool> thread_pool_;
 };
 #endif  // _OBJ_PARESR_H_
\ No newline at end of file
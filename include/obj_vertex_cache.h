@@ -0,0 +1,152 @@
+#ifndef _OBJ_VERTEX_CACHE_H_
+#define _OBJ_VERTEX_CACHE_H_
+
+#include <array>
+#include <cstddef>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+#include "obj_parser.h"
+#include "thread_pool.h"
+#include "vertex_cache_optimizer.h"
+
+// Simulated post-transform cache behavior of all index groups before and
+// after OptimizeVertexCache.
+struct VertexCacheReport {
+  VertexCacheOptimizer::Stats before;
+  VertexCacheOptimizer::Stats after;
+};
+
+// Whether every index group of mesh holds indices into its vertex buffer,
+// not narrowed, and, with is_triangle_list, a whole number of triangles.
+inline bool HasValidIndices(const OBJParser::Mesh& mesh,
+                            bool is_triangle_list) {
+  for (const OBJParser::IndexGroup* index_group :
+       OBJParser::IndexGroups(mesh.sub_objects)) {
+    if (!index_group->index_buffer_16_.empty() ||
+        (is_triangle_list && index_group->index_buffer_.size() % 3 != 0)) {
+      return false;
+    }
+    for (INTEGER index : index_group->index_buffer_) {
+      if (index >= mesh.vertex_buffer.size()) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Reorders the triangles of every index group of mesh for a cache_size
+// entry post-transform cache, one index group per task, and fills report.
+// Index buffers must be triangle lists, as ParseOptions::triangulate
+// leaves them, and must not have been narrowed; otherwise mesh is left
+// untouched and 1 is returned.
+inline int OptimizeVertexCache(OBJParser::Mesh& mesh, std::size_t cache_size,
+                               ThreadPool& pool, VertexCacheReport& report) {
+  if (!HasValidIndices(mesh, true)) {
+#ifdef OBJ_PARSER_DEBUG
+    std::cerr << "[OptimizeVertexCache] Error: Index buffers are not "
+                 "triangle lists.\n";
+#endif
+    return 1;
+  }
+  std::vector<OBJParser::IndexGroup*> index_groups =
+      OBJParser::IndexGroups(mesh.sub_objects);
+  std::vector<VertexCacheReport> reports(index_groups.size());
+  pool.ParallelFor(index_groups.size(), [&](std::size_t i) {
+    VertexCacheOptimizer optimizer(cache_size);
+    std::vector<INTEGER>& indices = index_groups[i]->index_buffer_;
+    reports[i].before = optimizer.Measure(indices);
+    optimizer.Optimize(indices);
+    reports[i].after = optimizer.Measure(indices);
+  });
+  report = VertexCacheReport();
+  for (const VertexCacheReport& group_report : reports) {
+    report.before += group_report.before;
+    report.after += group_report.after;
+  }
+  return 0;
+}
+
+// Reorders the triangles of every index group of mesh, as left by
+// OptimizeVertexCache with the same cache_size, so that triangles likely to
+// occlude others are drawn first, by sorting clusters of them as Tipsify
+// does. threshold is at least 1 and bounds how much the miss ratio of a
+// cluster may grow; 1.05 is typical. Index buffers must be
+// triangle lists that have not been narrowed; otherwise mesh is left
+// untouched and 1 is returned.
+inline int OptimizeOverdraw(OBJParser::Mesh& mesh, std::size_t cache_size,
+                            float threshold, ThreadPool& pool) {
+  if (!HasValidIndices(mesh, true)) {
+#ifdef OBJ_PARSER_DEBUG
+    std::cerr << "[OptimizeOverdraw] Error: Index buffers are not triangle "
+                 "lists.\n";
+#endif
+    return 1;
+  }
+  std::vector<OBJParser::IndexGroup*> index_groups =
+      OBJParser::IndexGroups(mesh.sub_objects);
+  const std::vector<OBJParser::Vertex>& vertices = mesh.vertex_buffer;
+  pool.ParallelFor(index_groups.size(), [&](std::size_t i) {
+    VertexCacheOptimizer optimizer(cache_size);
+    optimizer.OptimizeOverdraw(
+        index_groups[i]->index_buffer_,
+        [&vertices](INTEGER vertex) -> const std::array<REAL, 4>& {
+          return vertices[vertex].position;
+        },
+        threshold);
+  });
+  return 0;
+}
+
+// Renumbers the vertices and tangents of mesh in the order the index groups
+// first use them, so vertex fetches walk the buffer forwards. Vertices no
+// index refers to keep their relative order at the end. Index buffers must
+// not have been narrowed and must index the vertex buffer, and tangents
+// must be empty or one per vertex; otherwise mesh is left untouched and 1
+// is returned.
+inline int OptimizeVertexFetch(OBJParser::Mesh& mesh) {
+  if (!HasValidIndices(mesh, false) ||
+      (!mesh.tangents.empty() &&
+       mesh.tangents.size() != mesh.vertex_buffer.size())) {
+#ifdef OBJ_PARSER_DEBUG
+    std::cerr << "[OptimizeVertexFetch] Error: Index buffers do not index "
+                 "the vertex buffer.\n";
+#endif
+    return 1;
+  }
+  const std::size_t vertex_count = mesh.vertex_buffer.size();
+  const INTEGER unused = std::numeric_limits<INTEGER>::max();
+  std::vector<INTEGER> remap(vertex_count, unused);
+  INTEGER next = 0;
+  for (OBJParser::IndexGroup* index_group :
+       OBJParser::IndexGroups(mesh.sub_objects)) {
+    for (INTEGER& index : index_group->index_buffer_) {
+      if (remap[index] == unused) {
+        remap[index] = next++;
+      }
+      index = remap[index];
+    }
+  }
+  for (INTEGER& new_index : remap) {
+    if (new_index == unused) {
+      new_index = next++;
+    }
+  }
+  if (!mesh.tangents.empty()) {
+    std::vector<std::array<REAL, 4>> tangents(vertex_count);
+    for (std::size_t i = 0; i < vertex_count; i++) {
+      tangents[remap[i]] = mesh.tangents[i];
+    }
+    mesh.tangents.swap(tangents);
+  }
+  std::vector<OBJParser::Vertex> vertex_buffer(vertex_count);
+  for (std::size_t i = 0; i < vertex_count; i++) {
+    vertex_buffer[remap[i]] = mesh.vertex_buffer[i];
+  }
+  mesh.vertex_buffer.swap(vertex_buffer);
+  return 0;
+}
+
+#endif  // _OBJ_VERTEX_CACHE_H_
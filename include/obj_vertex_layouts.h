@@ -0,0 +1,111 @@
+#ifndef _OBJ_VERTEX_LAYOUTS_H_
+#define _OBJ_VERTEX_LAYOUTS_H_
+
+#include <array>
+#include <cstddef>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+#include "obj_parser.h"
+#include "thread_pool.h"
+#include "vertex_quantizer.h"
+
+// Renumbers the vertices of mesh so that every sub-object uses one
+// contiguous run of them in order of first use, copying vertices an earlier
+// sub-object already claimed and dropping those no face uses. The vertex
+// buffer, tangents and index buffers of mesh are rewritten, and the runs are
+// returned.
+inline std::vector<QuantizedVertexBuffer::Range> SplitVerticesBySubObject(
+    OBJParser::Mesh& mesh) {
+  const std::size_t vertex_count = mesh.vertex_buffer.size();
+  const std::size_t unowned = std::numeric_limits<std::size_t>::max();
+  std::vector<std::size_t> owners(vertex_count, unowned);
+  std::vector<INTEGER> remap(vertex_count);
+  std::vector<OBJParser::Vertex> vertices;
+  vertices.reserve(vertex_count);
+  std::vector<std::array<REAL, 4>> tangents;
+  std::vector<QuantizedVertexBuffer::Range> ranges;
+  for (std::size_t s = 0; s < mesh.sub_objects.size(); s++) {
+    QuantizedVertexBuffer::Range range;
+    range.first_vertex = vertices.size();
+    for (OBJParser::MeshGroup& mesh_group : mesh.sub_objects[s].mesh_groups) {
+      for (OBJParser::IndexGroup& index_group : mesh_group.index_groups) {
+        for (INTEGER& index : index_group.index_buffer_) {
+          if (owners[index] != s) {
+            owners[index] = s;
+            remap[index] = static_cast<INTEGER>(vertices.size());
+            vertices.push_back(mesh.vertex_buffer[index]);
+            if (!mesh.tangents.empty()) {
+              tangents.push_back(mesh.tangents[index]);
+            }
+          }
+          index = remap[index];
+        }
+      }
+    }
+    range.vertex_count = vertices.size() - range.first_vertex;
+    ranges.push_back(range);
+  }
+  mesh.vertex_buffer.swap(vertices);
+  if (!mesh.tangents.empty()) {
+    mesh.tangents.swap(tangents);
+  }
+  return ranges;
+}
+
+// Encodes the vertices of mesh with 16-bit positions, octahedral normals of
+// the given precision and half float texture coordinates. Every sub-object
+// gets its own range of vertices and bounding box; SplitVerticesBySubObject
+// renumbers mesh to match, so its index buffers index the returned buffer.
+// The mesh must have been parsed without ParseOptions::narrow_indices.
+inline QuantizedVertexBuffer BuildQuantizedVertexBuffer(
+    OBJParser::Mesh& mesh, NormalEncoding normal_encoding, ThreadPool& pool) {
+  static_assert(std::is_same<REAL, float>::value,
+                "The quantizer reads attributes as float.");
+  QuantizedVertexBuffer quantized;
+  quantized.normal_encoding = normal_encoding;
+  quantized.ranges = SplitVerticesBySubObject(mesh);
+  const std::vector<OBJParser::Vertex>& vertices = mesh.vertex_buffer;
+  bool has_texture_coordinates = false;
+  bool has_normals = false;
+  for (const OBJParser::Vertex& vertex : vertices) {
+    has_texture_coordinates =
+        has_texture_coordinates ||
+        vertex.texture_coordinate != OBJParser::kMissingAttribute;
+    has_normals =
+        has_normals || vertex.normal != OBJParser::kMissingAttribute;
+  }
+  VertexQuantizer::Resize(quantized, vertices.size(), has_normals,
+                          has_texture_coordinates);
+  std::vector<QuantizedVertexBuffer::Error> errors(quantized.ranges.size());
+  pool.ParallelFor(errors.size(), [&](std::size_t r) {
+    const OBJParser::Vertex* range_vertices =
+        vertices.data() + quantized.ranges[r].first_vertex;
+    errors[r] = VertexQuantizer::QuantizeRange(
+        quantized, r, [&](std::size_t i) {
+          const OBJParser::Vertex& vertex = range_vertices[i];
+          VertexQuantizer::Input input;
+          input.position = vertex.position.data();
+          if (vertex.texture_coordinate != OBJParser::kMissingAttribute) {
+            input.texture_coordinate = vertex.texture_coordinate.data();
+          }
+          if (vertex.normal != OBJParser::kMissingAttribute) {
+            input.normal = vertex.normal.data();
+          }
+          return input;
+        });
+  });
+  std::size_t merged_count = 0;
+  for (std::size_t r = 0; r < errors.size(); r++) {
+    const std::size_t count =
+        static_cast<std::size_t>(quantized.ranges[r].vertex_count);
+    quantized.error = VertexQuantizer::MergeErrors(quantized.error,
+                                                   merged_count, errors[r],
+                                                   count);
+    merged_count += count;
+  }
+  return quantized;
+}
+
+#endif  // _OBJ_VERTEX_LAYOUTS_H_
@@ -0,0 +1,71 @@
+#ifndef _PARSE_STATS_H_
+#define _PARSE_STATS_H_
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+
+#include "vertex_index_map.h"
+
+// What the last parse did and where its time went. The parsers only fill it
+// when PARSE_STATS is defined before they are included. Otherwise every
+// recording site is preprocessed away and stats() stays zero, so builds
+// without it pay nothing.
+struct ParseStats {
+  std::uint64_t bytes_read = 0;
+  std::uint64_t line_count = 0;
+  // Non-blank lines by their first token; comments count under "#".
+  std::map<std::string, std::uint64_t, std::less<>> keyword_lines;
+
+  // Phase times in seconds. Phases that run on several threads add up the
+  // time of every thread, so the sum can exceed total_seconds.
+  // io_seconds covers opening or mapping the file and, for streamed
+  // input, reading lines. Pages of a mapped file are faulted in while they
+  // are tokenized and count there.
+  double io_seconds = 0.0;
+  // Splitting lines and parsing every record other than faces.
+  double tokenize_seconds = 0.0;
+  // Parsing face records, without vertex deduplication.
+  double face_seconds = 0.0;
+  // Looking up and inserting (v, vt, vn) triples.
+  double dedup_seconds = 0.0;
+  double total_seconds = 0.0;
+
+  // The (v, vt, vn) lookup table, summed over shards with deferred_dedup.
+  VertexIndexMap::Stats vertex_map;
+
+  // Largest capacity, in elements, the main containers reached.
+  std::size_t peak_position_capacity = 0;
+  std::size_t peak_texture_coordinate_capacity = 0;
+  std::size_t peak_normal_capacity = 0;
+  std::size_t peak_vertex_capacity = 0;
+  // Of any single index buffer.
+  std::size_t peak_index_capacity = 0;
+  std::size_t peak_material_capacity = 0;
+
+  // Probes past the home slot over all lookups.
+  std::size_t collision_count() const {
+    return vertex_map.total_probes - vertex_map.lookups;
+  }
+
+  void CountKeyword(std::string_view keyword, std::uint64_t count = 1) {
+    auto itr = keyword_lines.find(keyword);
+    if (itr == keyword_lines.end()) {
+      itr = keyword_lines.emplace(std::string(keyword), 0).first;
+    }
+    itr->second += count;
+    line_count += count;
+  }
+
+  static double SecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         start)
+        .count();
+  }
+};
+
+#endif  // _PARSE_STATS_H_
@@ -0,0 +1,135 @@
+#ifndef _POLYGON_TRIANGULATOR_H_
+#define _POLYGON_TRIANGULATOR_H_
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Splits simple polygons into triangles. Convex polygons are fanned from their
+// first corner. Concave ones are ear clipped after projecting them onto the
+// axis plane their Newell normal is closest to. Scratch space is kept between
+// calls, so one triangulator should be reused for many faces.
+class PolygonTriangulator {
+ public:
+  PolygonTriangulator() = default;
+
+  // Appends the triangles of a polygon with count corners to triangles, as
+  // corner numbers in [0, count). position(i) returns the x, y and z of
+  // corner i in its first three elements. Polygons with fewer than three
+  // corners produce nothing.
+  template <class F>
+  void Triangulate(std::size_t count, F&& position,
+                   std::vector<std::uint32_t>& triangles) {
+    if (count < 3) {
+      return;
+    }
+    if (count == 3 || IsConvex(count, position)) {
+      for (std::uint32_t i = 1; i + 1 < count; i++) {
+        triangles.insert(triangles.end(), {0, i, i + 1});
+      }
+      return;
+    }
+    ClipEars(triangles);
+  }
+
+ private:
+  using Point = std::array<double, 2>;
+
+  static double Cross(const Point& a, const Point& b, const Point& c) {
+    return (b[0] - a[0]) * (c[1] - a[1]) - (b[1] - a[1]) * (c[0] - a[0]);
+  }
+
+  // Projects the polygon into points_ and reports whether every corner turns
+  // the same way.
+  template <class F>
+  bool IsConvex(std::size_t count, F&& position) {
+    std::array<double, 3> normal = {0.0, 0.0, 0.0};
+    for (std::size_t i = 0; i < count; i++) {
+      const auto& p = position(i);
+      const auto& q = position(i + 1 == count ? 0 : i + 1);
+      normal[0] += (static_cast<double>(p[1]) - q[1]) * (p[2] + q[2]);
+      normal[1] += (static_cast<double>(p[2]) - q[2]) * (p[0] + q[0]);
+      normal[2] += (static_cast<double>(p[0]) - q[0]) * (p[1] + q[1]);
+    }
+    std::size_t axis = 0;
+    for (std::size_t i = 1; i < 3; i++) {
+      if (std::fabs(normal[i]) > std::fabs(normal[axis])) {
+        axis = i;
+      }
+    }
+    // Dropping the dominant axis keeps the winding of the normal's sign, so
+    // flipping v for negative normals makes every polygon counterclockwise.
+    const std::size_t u_axis = (axis + 1) % 3;
+    const std::size_t v_axis = (axis + 2) % 3;
+    const double flip = normal[axis] < 0 ? -1.0 : 1.0;
+    points_.resize(count);
+    for (std::size_t i = 0; i < count; i++) {
+      const auto& p = position(i);
+      points_[i] = {static_cast<double>(p[u_axis]), flip * p[v_axis]};
+    }
+    for (std::size_t i = 0; i < count; i++) {
+      if (Cross(points_[i], points_[(i + 1) % count],
+                points_[(i + 2) % count]) < 0) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool IsEar(std::size_t prev, std::size_t curr, std::size_t next) const {
+    const Point& a = points_[remaining_[prev]];
+    const Point& b = points_[remaining_[curr]];
+    const Point& c = points_[remaining_[next]];
+    if (Cross(a, b, c) <= 0) {
+      return false;
+    }
+    for (std::uint32_t corner : remaining_) {
+      if (corner == remaining_[prev] || corner == remaining_[curr] ||
+          corner == remaining_[next]) {
+        continue;
+      }
+      const Point& p = points_[corner];
+      if (Cross(a, b, p) >= 0 && Cross(b, c, p) >= 0 && Cross(c, a, p) >= 0) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Repeatedly cuts off the first ear. If no ear is left, which happens for
+  // self-intersecting or degenerate input, the rest is fanned.
+  void ClipEars(std::vector<std::uint32_t>& triangles) {
+    remaining_.resize(points_.size());
+    for (std::size_t i = 0; i < remaining_.size(); i++) {
+      remaining_[i] = static_cast<std::uint32_t>(i);
+    }
+    std::size_t curr = 0;
+    std::size_t misses = 0;
+    while (remaining_.size() > 3 && misses < remaining_.size()) {
+      const std::size_t size = remaining_.size();
+      const std::size_t prev = (curr + size - 1) % size;
+      const std::size_t next = (curr + 1) % size;
+      if (IsEar(prev, curr, next)) {
+        triangles.insert(triangles.end(), {remaining_[prev], remaining_[curr],
+                                           remaining_[next]});
+        remaining_.erase(remaining_.begin() + curr);
+        curr = curr == 0 ? 0 : curr - 1;
+        misses = 0;
+      } else {
+        curr = next;
+        misses++;
+      }
+    }
+    for (std::size_t i = 1; i + 1 < remaining_.size(); i++) {
+      triangles.insert(triangles.end(),
+                       {remaining_[0], remaining_[i], remaining_[i + 1]});
+    }
+  }
+
+  std::vector<Point> points_;
+  std::vector<std::uint32_t> remaining_;
+};
+
+#endif  // _POLYGON_TRIANGULATOR_H_
@@ -0,0 +1,116 @@
+#ifndef _THREAD_POOL_H_
+#define _THREAD_POOL_H_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads. The thread calling ParallelFor works on the
+// loop as well, so a pool of N threads spawns N - 1 workers.
+class ThreadPool {
+ public:
+  explicit ThreadPool(unsigned thread_count) {
+    if (thread_count == 0) {
+      thread_count = std::thread::hardware_concurrency();
+    }
+    thread_count_ = thread_count == 0 ? 1 : thread_count;
+    for (unsigned i = 1; i < thread_count_; i++) {
+      workers_.emplace_back([this] { WorkerLoop(); });
+    }
+  }
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      is_stopping_ = true;
+    }
+    condition_.notify_all();
+    for (std::thread& worker : workers_) {
+      worker.join();
+    }
+  }
+
+  unsigned thread_count() const { return thread_count_; }
+
+  // Calls f(i) for every i in [0, count) and returns once all calls finished.
+  // Indices are handed out one at a time, so uneven items balance out. It is
+  // safe to call ParallelFor again from inside f.
+  template <class F>
+  void ParallelFor(std::size_t count, F&& f) {
+    if (count == 0) {
+      return;
+    }
+    if (count == 1 || workers_.empty()) {
+      for (std::size_t i = 0; i < count; i++) {
+        f(i);
+      }
+      return;
+    }
+    struct Loop {
+      std::atomic<std::size_t> next{0};
+      std::atomic<std::size_t> done{0};
+      std::mutex mutex;
+      std::condition_variable finished;
+    };
+    // Helpers may be dequeued after the loop is over, so the shared state is
+    // reference counted rather than living on this stack frame.
+    std::shared_ptr<Loop> loop = std::make_shared<Loop>();
+    auto run = [loop, count, &f] {
+      std::size_t i;
+      while ((i = loop->next.fetch_add(1)) < count) {
+        f(i);
+        if (loop->done.fetch_add(1) + 1 == count) {
+          std::lock_guard<std::mutex> lock(loop->mutex);
+          loop->finished.notify_all();
+        }
+      }
+    };
+    std::size_t helper_count =
+        std::min<std::size_t>(workers_.size(), count - 1);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (std::size_t i = 0; i < helper_count; i++) {
+        tasks_.push(run);
+      }
+    }
+    condition_.notify_all();
+    run();
+    std::unique_lock<std::mutex> lock(loop->mutex);
+    loop->finished.wait(lock, [&] { return loop->done.load() == count; });
+  }
+
+ private:
+  void WorkerLoop() {
+    for (;;) {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        condition_.wait(lock,
+                        [this] { return is_stopping_ || !tasks_.empty(); });
+        if (is_stopping_ && tasks_.empty()) {
+          return;
+        }
+        task = std::move(tasks_.front());
+        tasks_.pop();
+      }
+      task();
+    }
+  }
+
+  unsigned thread_count_ = 1;
+  std::vector<std::thread> workers_;
+  std::queue<std::function<void()>> tasks_;
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  bool is_stopping_ = false;
+};
+
+#endif  // _THREAD_POOL_H_
@@ -0,0 +1,490 @@
+#ifndef _TRIANGLE_BVH_H_
+#define _TRIANGLE_BVH_H_
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "thread_pool.h"
+
+// A bounding box and either two children or a run of triangles, in 32 bytes.
+// Siblings are stored next to each other at an even index, so a traversal
+// visiting both children reads a single 64-byte line.
+struct BvhNode {
+  std::array<float, 3> bounds_min;
+  // Index of the left child, whose sibling follows it, for interior nodes;
+  // first entry of TriangleBvh::triangles() for leaves.
+  std::uint32_t first;
+  std::array<float, 3> bounds_max;
+  // Triangles in a leaf, 0 for interior nodes.
+  std::uint32_t count;
+
+  bool is_leaf() const { return count != 0; }
+};
+
+// Bounding volume hierarchy over a triangle list, split by the surface area
+// heuristic evaluated at binned centroid positions on all three axes. The
+// top of the tree is split serially into subtrees of at most
+// kSubtreeTriangles triangles, which are then built in parallel and spliced
+// in order, so the tree does not depend on the thread count.
+class TriangleBvh {
+ public:
+  static constexpr std::size_t kBinCount = 16;
+  static constexpr std::size_t kSubtreeTriangles = 1 << 14;
+
+  struct Hit {
+    // Index of the triangle in the input triangle list.
+    std::uint32_t triangle = 0;
+    float distance = 0.f;
+    // Barycentric coordinates of the second and third corner.
+    float u = 0.f;
+    float v = 0.f;
+  };
+
+  explicit TriangleBvh(std::size_t max_leaf_triangles = 4)
+      : max_leaf_triangles_(std::max<std::size_t>(max_leaf_triangles, 1)) {}
+
+  const BvhNode& node(std::size_t i) const {
+    return node_pairs_[i / 2].nodes[i % 2];
+  }
+  // Slots in the node array; index 1 is padding so siblings pair up.
+  std::size_t node_count() const { return node_pairs_.size() * 2; }
+  // Input triangle indices in leaf order.
+  const std::vector<std::uint32_t>& triangles() const { return triangles_; }
+  bool empty() const { return triangles_.empty(); }
+
+  // Builds the hierarchy of a triangle list. position(v) returns the x, y and
+  // z of vertex v. With a pool, subtrees are built on its threads.
+  template <class T, class F>
+  void Build(const std::vector<T>& indices, F&& position,
+             ThreadPool* pool = nullptr) {
+    const std::size_t triangle_count = indices.size() / 3;
+    node_pairs_.clear();
+    triangles_.resize(triangle_count);
+    corners_.resize(triangle_count);
+    std::vector<Box> boxes(triangle_count);
+    for (std::size_t t = 0; t < triangle_count; t++) {
+      triangles_[t] = static_cast<std::uint32_t>(t);
+      Box& box = boxes[t];
+      for (std::size_t c = 0; c < 3; c++) {
+        const auto& p = position(indices[t * 3 + c]);
+        for (std::size_t k = 0; k < 3; k++) {
+          const float x = static_cast<float>(p[k]);
+          corners_[t][c * 3 + k] = x;
+          box.min[k] = c == 0 ? x : std::min(box.min[k], x);
+          box.max[k] = c == 0 ? x : std::max(box.max[k], x);
+        }
+      }
+    }
+    if (triangle_count == 0) {
+      return;
+    }
+
+    std::vector<Subtree> subtrees;
+    node_pairs_.emplace_back();
+    Split(boxes, 0, 0, static_cast<std::uint32_t>(triangle_count), 0,
+          node_pairs_, &subtrees);
+    std::vector<std::vector<NodePair>> subtree_pairs(subtrees.size());
+    auto build_subtree = [&](std::size_t i) {
+      subtree_pairs[i].emplace_back();
+      Split(boxes, 0, subtrees[i].begin, subtrees[i].end, subtrees[i].depth,
+            subtree_pairs[i], nullptr);
+    };
+    if (pool != nullptr) {
+      pool->ParallelFor(subtrees.size(), build_subtree);
+    } else {
+      for (std::size_t i = 0; i < subtrees.size(); i++) {
+        build_subtree(i);
+      }
+    }
+    for (std::size_t i = 0; i < subtrees.size(); i++) {
+      Splice(subtrees[i].node, subtree_pairs[i]);
+    }
+
+    // Store corners in leaf order so leaves read them sequentially.
+    std::vector<std::array<float, 9>> corners(triangle_count);
+    for (std::size_t t = 0; t < triangle_count; t++) {
+      corners[t] = corners_[triangles_[t]];
+    }
+    corners_.swap(corners);
+  }
+
+  // Finds the closest triangle hit by the ray origin + t * direction with
+  // t in [0, max_distance]. Both sides of a triangle count.
+  bool Intersect(const std::array<float, 3>& origin,
+                 const std::array<float, 3>& direction, float max_distance,
+                 Hit& hit) const {
+    if (empty()) {
+      return false;
+    }
+    std::array<float, 3> inverse;
+    for (std::size_t k = 0; k < 3; k++) {
+      inverse[k] = 1.f / direction[k];
+    }
+    bool is_hit = false;
+    std::uint32_t stack[kStackSize];
+    std::size_t stack_size = 0;
+    std::uint32_t current = 0;
+    for (;;) {
+      const BvhNode& n = node(current);
+      if (n.is_leaf()) {
+        for (std::uint32_t t = n.first; t < n.first + n.count; t++) {
+          if (IntersectTriangle(t, origin, direction, max_distance, hit)) {
+            max_distance = hit.distance;
+            is_hit = true;
+          }
+        }
+      } else {
+        const float left = IntersectBox(node(n.first), origin, inverse,
+                                        max_distance);
+        const float right = IntersectBox(node(n.first + 1), origin, inverse,
+                                         max_distance);
+        if (left <= right && left != kMiss) {
+          if (right != kMiss) {
+            stack[stack_size++] = n.first + 1;
+          }
+          current = n.first;
+          continue;
+        }
+        if (right != kMiss) {
+          if (left != kMiss) {
+            stack[stack_size++] = n.first;
+          }
+          current = n.first + 1;
+          continue;
+        }
+      }
+      // Entries may have been pushed before a closer hit was found, so
+      // re-test them against the current distance when popping.
+      bool is_found = false;
+      while (stack_size != 0 && !is_found) {
+        current = stack[--stack_size];
+        is_found = IntersectBox(node(current), origin, inverse,
+                                max_distance) != kMiss;
+      }
+      if (!is_found) {
+        return is_hit;
+      }
+    }
+  }
+
+  // Appends the input index of every triangle whose bounding box overlaps
+  // the box [bounds_min, bounds_max].
+  void Query(const std::array<float, 3>& bounds_min,
+             const std::array<float, 3>& bounds_max,
+             std::vector<std::uint32_t>& triangles) const {
+    if (empty()) {
+      return;
+    }
+    std::uint32_t stack[kStackSize];
+    std::size_t stack_size = 0;
+    stack[stack_size++] = 0;
+    while (stack_size != 0) {
+      const BvhNode& n = node(stack[--stack_size]);
+      if (!Overlaps(n.bounds_min, n.bounds_max, bounds_min, bounds_max)) {
+        continue;
+      }
+      if (!n.is_leaf()) {
+        stack[stack_size++] = n.first + 1;
+        stack[stack_size++] = n.first;
+        continue;
+      }
+      for (std::uint32_t t = n.first; t < n.first + n.count; t++) {
+        const std::array<float, 9>& p = corners_[t];
+        std::array<float, 3> low;
+        std::array<float, 3> high;
+        for (std::size_t k = 0; k < 3; k++) {
+          low[k] = std::min({p[k], p[3 + k], p[6 + k]});
+          high[k] = std::max({p[k], p[3 + k], p[6 + k]});
+        }
+        if (Overlaps(low, high, bounds_min, bounds_max)) {
+          triangles.push_back(triangles_[t]);
+        }
+      }
+    }
+  }
+
+ private:
+  struct alignas(64) NodePair {
+    BvhNode nodes[2];
+  };
+
+  struct Box {
+    std::array<float, 3> min;
+    std::array<float, 3> max;
+
+    void Grow(const Box& box) {
+      for (std::size_t k = 0; k < 3; k++) {
+        min[k] = std::min(min[k], box.min[k]);
+        max[k] = std::max(max[k], box.max[k]);
+      }
+    }
+    float HalfArea() const {
+      const float x = max[0] - min[0];
+      const float y = max[1] - min[1];
+      const float z = max[2] - min[2];
+      return x * y + y * z + z * x;
+    }
+    float Centroid(std::size_t axis) const {
+      return (min[axis] + max[axis]) * 0.5f;
+    }
+  };
+
+  struct Subtree {
+    std::uint32_t node;
+    std::uint32_t begin;
+    std::uint32_t end;
+    std::uint32_t depth;
+  };
+
+  // Below kSahDepth nodes are split at the median, which keeps the depth of
+  // any tree with 32-bit triangle counts, and so the traversal stacks, below
+  // kStackSize.
+  static constexpr std::uint32_t kSahDepth = 64;
+  static constexpr std::size_t kStackSize = kSahDepth + 40;
+  static constexpr float kMiss = std::numeric_limits<float>::infinity();
+
+  static Box EmptyBox() {
+    const float inf = std::numeric_limits<float>::infinity();
+    return {{inf, inf, inf}, {-inf, -inf, -inf}};
+  }
+
+  static BvhNode& NodeAt(std::vector<NodePair>& pairs, std::uint32_t i) {
+    return pairs[i / 2].nodes[i % 2];
+  }
+
+  // Fills node index for triangles_[begin, end) and splits it. With
+  // subtrees, nodes of at most kSubtreeTriangles triangles are left for
+  // later and recorded instead.
+  void Split(const std::vector<Box>& boxes, std::uint32_t index,
+             std::uint32_t begin, std::uint32_t end, std::uint32_t depth,
+             std::vector<NodePair>& pairs, std::vector<Subtree>* subtrees) {
+    Box bounds = EmptyBox();
+    Box centroids = EmptyBox();
+    for (std::uint32_t i = begin; i < end; i++) {
+      const Box& box = boxes[triangles_[i]];
+      bounds.Grow(box);
+      for (std::size_t k = 0; k < 3; k++) {
+        centroids.min[k] = std::min(centroids.min[k], box.Centroid(k));
+        centroids.max[k] = std::max(centroids.max[k], box.Centroid(k));
+      }
+    }
+    BvhNode& n = NodeAt(pairs, index);
+    n.bounds_min = bounds.min;
+    n.bounds_max = bounds.max;
+    n.first = begin;
+    n.count = end - begin;
+    if (end - begin <= max_leaf_triangles_) {
+      return;
+    }
+    if (subtrees != nullptr && end - begin <= kSubtreeTriangles) {
+      subtrees->push_back({index, begin, end, depth});
+      return;
+    }
+
+    std::size_t best_axis = 3;
+    std::size_t best_bin = 0;
+    float best_cost = bounds.HalfArea() * static_cast<float>(end - begin);
+    for (std::size_t axis = 0; axis < 3 && depth < kSahDepth; axis++) {
+      const float extent = centroids.max[axis] - centroids.min[axis];
+      if (!(extent > 0.f)) {
+        continue;
+      }
+      const float scale = kBinCount / extent;
+      Box bin_bounds[kBinCount];
+      std::uint32_t bin_counts[kBinCount] = {};
+      for (Box& box : bin_bounds) {
+        box = EmptyBox();
+      }
+      for (std::uint32_t i = begin; i < end; i++) {
+        const Box& box = boxes[triangles_[i]];
+        const std::size_t bin = Bin(box.Centroid(axis), centroids.min[axis],
+                                    scale);
+        bin_bounds[bin].Grow(box);
+        bin_counts[bin]++;
+      }
+      // right_costs[b] is the cost of bins b and above.
+      float right_costs[kBinCount];
+      Box right = EmptyBox();
+      std::uint32_t right_count = 0;
+      for (std::size_t b = kBinCount - 1; b > 0; b--) {
+        right.Grow(bin_bounds[b]);
+        right_count += bin_counts[b];
+        right_costs[b] = right_count == 0
+                             ? 0.f
+                             : right.HalfArea() * static_cast<float>(
+                                                      right_count);
+      }
+      Box left = EmptyBox();
+      std::uint32_t left_count = 0;
+      for (std::size_t b = 0; b + 1 < kBinCount; b++) {
+        left.Grow(bin_bounds[b]);
+        left_count += bin_counts[b];
+        if (left_count == 0 || left_count == end - begin) {
+          continue;
+        }
+        const float cost =
+            left.HalfArea() * static_cast<float>(left_count) +
+            right_costs[b + 1];
+        if (cost < best_cost) {
+          best_cost = cost;
+          best_axis = axis;
+          best_bin = b;
+        }
+      }
+    }
+
+    std::uint32_t middle;
+    if (best_axis < 3) {
+      const float scale =
+          kBinCount / (centroids.max[best_axis] - centroids.min[best_axis]);
+      const float low = centroids.min[best_axis];
+      middle = static_cast<std::uint32_t>(
+          std::partition(triangles_.begin() + begin, triangles_.begin() + end,
+                         [&](std::uint32_t t) {
+                           return Bin(boxes[t].Centroid(best_axis), low,
+                                      scale) <= best_bin;
+                         }) -
+          triangles_.begin());
+    } else if (end - begin > kMaxLeafTriangles || depth >= kSahDepth) {
+      // Either too deep for the heuristic, or no split beats a leaf but a
+      // leaf this large would make queries linear. Split at the median of
+      // the longest centroid axis instead.
+      std::size_t axis = 0;
+      for (std::size_t k = 1; k < 3; k++) {
+        if (centroids.max[k] - centroids.min[k] >
+            centroids.max[axis] - centroids.min[axis]) {
+          axis = k;
+        }
+      }
+      middle = begin + (end - begin) / 2;
+      std::nth_element(triangles_.begin() + begin,
+                       triangles_.begin() + middle, triangles_.begin() + end,
+                       [&](std::uint32_t lhs, std::uint32_t rhs) {
+                         return boxes[lhs].Centroid(axis) <
+                                boxes[rhs].Centroid(axis);
+                       });
+    } else {
+      return;
+    }
+
+    const std::uint32_t left = static_cast<std::uint32_t>(pairs.size() * 2);
+    pairs.emplace_back();
+    NodeAt(pairs, index).first = left;
+    NodeAt(pairs, index).count = 0;
+    Split(boxes, left, begin, middle, depth + 1, pairs, subtrees);
+    Split(boxes, left + 1, middle, end, depth + 1, pairs, subtrees);
+  }
+
+  static std::size_t Bin(float centroid, float low, float scale) {
+    const float bin = (centroid - low) * scale;
+    return std::min(static_cast<std::size_t>(std::max(bin, 0.f)),
+                    kBinCount - 1);
+  }
+
+  // Moves a subtree built with its root at index 0 into node_pairs_,
+  // replacing the placeholder leaf at index.
+  void Splice(std::uint32_t index, const std::vector<NodePair>& pairs) {
+    const std::uint32_t offset =
+        static_cast<std::uint32_t>(node_pairs_.size() * 2) - 2;
+    BvhNode root = pairs[0].nodes[0];
+    if (!root.is_leaf()) {
+      root.first += offset;
+    }
+    NodeAt(node_pairs_, index) = root;
+    for (std::size_t p = 1; p < pairs.size(); p++) {
+      NodePair pair = pairs[p];
+      for (BvhNode& n : pair.nodes) {
+        if (!n.is_leaf()) {
+          n.first += offset;
+        }
+      }
+      node_pairs_.push_back(pair);
+    }
+  }
+
+  // Distance at which the ray enters the node, or kMiss.
+  static float IntersectBox(const BvhNode& n,
+                            const std::array<float, 3>& origin,
+                            const std::array<float, 3>& inverse,
+                            float max_distance) {
+    float entry = 0.f;
+    float exit = max_distance;
+    for (std::size_t k = 0; k < 3; k++) {
+      float t0 = (n.bounds_min[k] - origin[k]) * inverse[k];
+      float t1 = (n.bounds_max[k] - origin[k]) * inverse[k];
+      if (t0 > t1) {
+        std::swap(t0, t1);
+      }
+      // NaN from 0 * inf means the ray lies in a slab plane; keep going.
+      entry = t0 > entry ? t0 : entry;
+      exit = t1 < exit ? t1 : exit;
+    }
+    return entry <= exit ? entry : kMiss;
+  }
+
+  // Moller-Trumbore test against triangles_[t].
+  bool IntersectTriangle(std::uint32_t t, const std::array<float, 3>& origin,
+                         const std::array<float, 3>& direction,
+                         float max_distance, Hit& hit) const {
+    const std::array<float, 9>& p = corners_[t];
+    const float e1[3] = {p[3] - p[0], p[4] - p[1], p[5] - p[2]};
+    const float e2[3] = {p[6] - p[0], p[7] - p[1], p[8] - p[2]};
+    const float h[3] = {direction[1] * e2[2] - direction[2] * e2[1],
+                        direction[2] * e2[0] - direction[0] * e2[2],
+                        direction[0] * e2[1] - direction[1] * e2[0]};
+    const float det = e1[0] * h[0] + e1[1] * h[1] + e1[2] * h[2];
+    if (det == 0.f) {
+      return false;
+    }
+    const float inverse_det = 1.f / det;
+    const float s[3] = {origin[0] - p[0], origin[1] - p[1], origin[2] - p[2]};
+    const float u = (s[0] * h[0] + s[1] * h[1] + s[2] * h[2]) * inverse_det;
+    if (u < 0.f || u > 1.f) {
+      return false;
+    }
+    const float q[3] = {s[1] * e1[2] - s[2] * e1[1],
+                        s[2] * e1[0] - s[0] * e1[2],
+                        s[0] * e1[1] - s[1] * e1[0]};
+    const float v =
+        (direction[0] * q[0] + direction[1] * q[1] + direction[2] * q[2]) *
+        inverse_det;
+    if (v < 0.f || u + v > 1.f) {
+      return false;
+    }
+    const float distance =
+        (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * inverse_det;
+    if (distance < 0.f || distance > max_distance) {
+      return false;
+    }
+    hit.triangle = triangles_[t];
+    hit.distance = distance;
+    hit.u = u;
+    hit.v = v;
+    return true;
+  }
+
+  static bool Overlaps(const std::array<float, 3>& min_a,
+                       const std::array<float, 3>& max_a,
+                       const std::array<float, 3>& min_b,
+                       const std::array<float, 3>& max_b) {
+    return min_a[0] <= max_b[0] && min_b[0] <= max_a[0] &&
+           min_a[1] <= max_b[1] && min_b[1] <= max_a[1] &&
+           min_a[2] <= max_b[2] && min_b[2] <= max_a[2];
+  }
+
+  // Leaves never grow past this, whatever the heuristic prefers.
+  static constexpr std::size_t kMaxLeafTriangles = 16;
+
+  std::size_t max_leaf_triangles_;
+  std::vector<NodePair> node_pairs_;
+  std::vector<std::uint32_t> triangles_;
+  // Corner positions of triangles_[i], x, y and z of each corner.
+  std::vector<std::array<float, 9>> corners_;
+};
+
+#endif  // _TRIANGLE_BVH_H_
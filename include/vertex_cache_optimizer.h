@@ -0,0 +1,362 @@
+#ifndef _VERTEX_CACHE_OPTIMIZER_H_
+#define _VERTEX_CACHE_OPTIMIZER_H_
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Reorders triangle lists for a post-transform vertex cache with Tipsify
+// (Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality
+// and Reduced Overdraw", 2007). Triangles are emitted in fans around one
+// vertex at a time, and the next fan center is picked among the vertices
+// likely still in the cache. Runs in time linear in the index count and
+// gives the same order for the same input. OptimizeOverdraw then sorts
+// clusters of that order as in the second half of the paper. Scratch space
+// is kept between calls, so one optimizer should be reused for many index
+// buffers.
+class VertexCacheOptimizer {
+ public:
+  // FIFO cache simulation of a triangle list.
+  struct Stats {
+    std::size_t triangle_count = 0;
+    std::size_t vertex_count = 0;
+    std::size_t miss_count = 0;
+
+    // Average cache miss ratio, transformed vertices per triangle. 3 is the
+    // worst case and about 0.5 the best for large regular meshes.
+    double acmr() const {
+      return triangle_count == 0
+                 ? 0.0
+                 : static_cast<double>(miss_count) / triangle_count;
+    }
+    // Average transform to vertex ratio; 1 means every vertex is transformed
+    // exactly once.
+    double atvr() const {
+      return vertex_count == 0
+                 ? 0.0
+                 : static_cast<double>(miss_count) / vertex_count;
+    }
+
+    Stats& operator+=(const Stats& rhs) {
+      triangle_count += rhs.triangle_count;
+      vertex_count += rhs.vertex_count;
+      miss_count += rhs.miss_count;
+      return *this;
+    }
+  };
+
+  explicit VertexCacheOptimizer(std::size_t cache_size = 16)
+      : cache_size_(std::max<std::size_t>(cache_size, 3)) {}
+
+  std::size_t cache_size() const { return cache_size_; }
+
+  template <class T>
+  Stats Measure(const std::vector<T>& indices) {
+    Stats stats;
+    const std::size_t vertex_count = Localize(indices);
+    stats.triangle_count = indices.size() / 3;
+    stats.vertex_count = vertex_count;
+    // A vertex is cached if fewer than cache_size_ misses happened since the
+    // one that loaded it.
+    std::vector<std::size_t>& loaded_at = cache_time_;
+    loaded_at.assign(vertex_count, 0);
+    for (std::uint32_t vertex : local_indices_) {
+      if (loaded_at[vertex] == 0 ||
+          stats.miss_count - loaded_at[vertex] >= cache_size_) {
+        loaded_at[vertex] = ++stats.miss_count;
+      }
+    }
+    return stats;
+  }
+
+  // Reorders the triangles of a triangle list in place. The corners of each
+  // triangle keep their order, so winding is preserved.
+  template <class T>
+  void Optimize(std::vector<T>& indices) {
+    const std::size_t triangle_count = indices.size() / 3;
+    if (triangle_count < 2) {
+      return;
+    }
+    const std::size_t vertex_count = Localize(indices);
+    BuildAdjacency(vertex_count, triangle_count);
+
+    live_triangles_.assign(vertex_count, 0);
+    for (std::size_t v = 0; v < vertex_count; v++) {
+      live_triangles_[v] = adjacency_offsets_[v + 1] - adjacency_offsets_[v];
+    }
+    cache_time_.assign(vertex_count, 0);
+    is_emitted_.assign(triangle_count, false);
+    dead_ends_.clear();
+    std::vector<T> optimized;
+    optimized.reserve(triangle_count * 3);
+
+    std::size_t time = cache_size_ + 1;
+    std::size_t cursor = 1;
+    std::int64_t fan = 0;
+    while (fan >= 0) {
+      candidates_.clear();
+      for (std::size_t k = adjacency_offsets_[fan];
+           k < adjacency_offsets_[fan + 1]; k++) {
+        const std::uint32_t triangle = adjacency_[k];
+        if (is_emitted_[triangle]) {
+          continue;
+        }
+        is_emitted_[triangle] = true;
+        for (std::size_t c = 0; c < 3; c++) {
+          const std::uint32_t vertex = local_indices_[triangle * 3 + c];
+          optimized.push_back(indices[triangle * 3 + c]);
+          dead_ends_.push_back(vertex);
+          candidates_.push_back(vertex);
+          live_triangles_[vertex]--;
+          if (time - cache_time_[vertex] > cache_size_) {
+            cache_time_[vertex] = time++;
+          }
+        }
+      }
+      fan = NextFan(time, cursor);
+    }
+    optimized.insert(optimized.end(), indices.begin() + triangle_count * 3,
+                     indices.end());
+    indices.swap(optimized);
+  }
+
+  // Reorders a triangle list that Optimize already ordered so that faces
+  // likely to occlude others are drawn first. The list is split into
+  // clusters where the simulated cache restarts, and those are split again
+  // once their miss ratio so far is within threshold times that of the
+  // whole cluster, so that larger thresholds give more, smaller clusters
+  // at some cost in cache misses. Clusters keep their inner order and are
+  // sorted by how far their area weighted normal points away from the
+  // centroid of the list, outward facing first. position(index) gives the
+  // xyz of a vertex.
+  template <class T, class F>
+  void OptimizeOverdraw(std::vector<T>& indices, F&& position,
+                        float threshold) {
+    const std::size_t triangle_count = indices.size() / 3;
+    if (triangle_count < 2) {
+      return;
+    }
+    const std::size_t vertex_count = Localize(indices);
+    cache_time_.assign(vertex_count, 0);
+    std::size_t time = 0;
+    auto misses = [&](std::size_t triangle) {
+      std::size_t count = 0;
+      for (std::size_t c = 0; c < 3; c++) {
+        const std::uint32_t vertex = local_indices_[triangle * 3 + c];
+        if (cache_time_[vertex] == 0 ||
+            time - cache_time_[vertex] >= cache_size_) {
+          cache_time_[vertex] = ++time;
+          count++;
+        }
+      }
+      return count;
+    };
+    // Moving time past every entry empties the simulated cache.
+    auto flush = [&] { time += cache_size_; };
+
+    // A triangle that misses with all corners starts a new patch.
+    hard_boundaries_.clear();
+    for (std::size_t t = 0; t < triangle_count; t++) {
+      if (misses(t) == 3 || t == 0) {
+        hard_boundaries_.push_back(t);
+      }
+    }
+    hard_boundaries_.push_back(triangle_count);
+
+    boundaries_.clear();
+    for (std::size_t h = 0; h + 1 < hard_boundaries_.size(); h++) {
+      const std::size_t begin = hard_boundaries_[h];
+      const std::size_t end = hard_boundaries_[h + 1];
+      flush();
+      std::size_t cluster_misses = 0;
+      for (std::size_t t = begin; t < end; t++) {
+        cluster_misses += misses(t);
+      }
+      const double target =
+          threshold * static_cast<double>(cluster_misses) / (end - begin);
+      boundaries_.push_back(begin);
+      flush();
+      std::size_t running_misses = 0;
+      std::size_t running_triangles = 0;
+      for (std::size_t t = begin; t + 1 < end; t++) {
+        running_misses += misses(t);
+        running_triangles++;
+        if (running_misses <= target * running_triangles) {
+          boundaries_.push_back(t + 1);
+          flush();
+          running_misses = 0;
+          running_triangles = 0;
+        }
+      }
+    }
+    const std::size_t cluster_count = boundaries_.size();
+    boundaries_.push_back(triangle_count);
+
+    std::array<double, 3> center = {0, 0, 0};
+    for (std::size_t i = 0; i < triangle_count * 3; i++) {
+      const auto& p = position(indices[i]);
+      for (std::size_t a = 0; a < 3; a++) {
+        center[a] += p[a];
+      }
+    }
+    for (double& a : center) {
+      a /= static_cast<double>(triangle_count * 3);
+    }
+    cluster_keys_.resize(cluster_count);
+    for (std::size_t k = 0; k < cluster_count; k++) {
+      std::array<double, 3> centroid = {0, 0, 0};
+      std::array<double, 3> normal = {0, 0, 0};
+      for (std::size_t t = boundaries_[k]; t < boundaries_[k + 1]; t++) {
+        std::array<std::array<double, 3>, 3> corners;
+        for (std::size_t c = 0; c < 3; c++) {
+          const auto& p = position(indices[t * 3 + c]);
+          for (std::size_t a = 0; a < 3; a++) {
+            corners[c][a] = p[a];
+            centroid[a] += p[a];
+          }
+        }
+        const std::array<double, 3> cross = Cross(corners);
+        for (std::size_t a = 0; a < 3; a++) {
+          normal[a] += cross[a];
+        }
+      }
+      const double corner_count =
+          static_cast<double>(boundaries_[k + 1] - boundaries_[k]) * 3;
+      const double length = std::sqrt(normal[0] * normal[0] +
+                                       normal[1] * normal[1] +
+                                       normal[2] * normal[2]);
+      double key = 0;
+      for (std::size_t a = 0; a < 3 && length > 0; a++) {
+        key += (centroid[a] / corner_count - center[a]) * normal[a] / length;
+      }
+      cluster_keys_[k] = {key, static_cast<std::uint32_t>(k)};
+    }
+    std::stable_sort(cluster_keys_.begin(), cluster_keys_.end(),
+                     [](const ClusterKey& a, const ClusterKey& b) {
+                       return a.key > b.key;
+                     });
+
+    std::vector<T> sorted;
+    sorted.reserve(indices.size());
+    for (const ClusterKey& cluster : cluster_keys_) {
+      sorted.insert(sorted.end(),
+                    indices.begin() + boundaries_[cluster.index] * 3,
+                    indices.begin() + boundaries_[cluster.index + 1] * 3);
+    }
+    sorted.insert(sorted.end(), indices.begin() + triangle_count * 3,
+                  indices.end());
+    indices.swap(sorted);
+  }
+
+ private:
+  // Renumbers the vertices of indices densely into local_indices_ and
+  // returns their count.
+  template <class T>
+  std::size_t Localize(const std::vector<T>& indices) {
+    const std::size_t count = indices.size() / 3 * 3;
+    sorted_.assign(indices.begin(), indices.begin() + count);
+    std::sort(sorted_.begin(), sorted_.end());
+    sorted_.erase(std::unique(sorted_.begin(), sorted_.end()), sorted_.end());
+    local_indices_.resize(count);
+    for (std::size_t i = 0; i < count; i++) {
+      local_indices_[i] = static_cast<std::uint32_t>(
+          std::lower_bound(sorted_.begin(), sorted_.end(), indices[i]) -
+          sorted_.begin());
+    }
+    return sorted_.size();
+  }
+
+  void BuildAdjacency(std::size_t vertex_count, std::size_t triangle_count) {
+    adjacency_offsets_.assign(vertex_count + 1, 0);
+    for (std::uint32_t vertex : local_indices_) {
+      adjacency_offsets_[vertex + 1]++;
+    }
+    for (std::size_t v = 0; v < vertex_count; v++) {
+      adjacency_offsets_[v + 1] += adjacency_offsets_[v];
+    }
+    adjacency_.resize(local_indices_.size());
+    cursors_.assign(adjacency_offsets_.begin(), adjacency_offsets_.end() - 1);
+    for (std::size_t t = 0; t < triangle_count; t++) {
+      for (std::size_t c = 0; c < 3; c++) {
+        adjacency_[cursors_[local_indices_[t * 3 + c]]++] =
+            static_cast<std::uint32_t>(t);
+      }
+    }
+  }
+
+  struct ClusterKey {
+    double key;
+    std::uint32_t index;
+  };
+
+  // Twice the area weighted normal of a triangle.
+  static std::array<double, 3> Cross(
+      const std::array<std::array<double, 3>, 3>& corners) {
+    std::array<double, 3> u;
+    std::array<double, 3> v;
+    for (std::size_t a = 0; a < 3; a++) {
+      u[a] = corners[1][a] - corners[0][a];
+      v[a] = corners[2][a] - corners[0][a];
+    }
+    return {u[1] * v[2] - u[2] * v[1], u[2] * v[0] - u[0] * v[2],
+            u[0] * v[1] - u[1] * v[0]};
+  }
+
+  // The candidate that stays in the cache after its remaining triangles are
+  // emitted and entered the cache earliest, else a dead end vertex or the
+  // next vertex in order that still has triangles; -1 when all are done.
+  std::int64_t NextFan(std::size_t time, std::size_t& cursor) {
+    std::int64_t best = -1;
+    std::size_t best_priority = 0;
+    for (std::uint32_t vertex : candidates_) {
+      if (live_triangles_[vertex] == 0) {
+        continue;
+      }
+      std::size_t priority = 1;
+      const std::size_t age = time - cache_time_[vertex];
+      if (age + 2 * live_triangles_[vertex] <= cache_size_) {
+        priority += age;
+      }
+      if (priority > best_priority) {
+        best = vertex;
+        best_priority = priority;
+      }
+    }
+    if (best >= 0) {
+      return best;
+    }
+    while (!dead_ends_.empty()) {
+      const std::uint32_t vertex = dead_ends_.back();
+      dead_ends_.pop_back();
+      if (live_triangles_[vertex] > 0) {
+        return vertex;
+      }
+    }
+    for (; cursor < live_triangles_.size(); cursor++) {
+      if (live_triangles_[cursor] > 0) {
+        return static_cast<std::int64_t>(cursor++);
+      }
+    }
+    return -1;
+  }
+
+  std::size_t cache_size_;
+  std::vector<std::uint64_t> sorted_;
+  std::vector<std::uint32_t> local_indices_;
+  std::vector<std::uint32_t> adjacency_offsets_;
+  std::vector<std::uint32_t> adjacency_;
+  std::vector<std::uint32_t> cursors_;
+  std::vector<std::uint32_t> live_triangles_;
+  std::vector<std::size_t> cache_time_;
+  std::vector<bool> is_emitted_;
+  std::vector<std::uint32_t> dead_ends_;
+  std::vector<std::uint32_t> candidates_;
+  std::vector<std::size_t> hard_boundaries_;
+  std::vector<std::size_t> boundaries_;
+  std::vector<ClusterKey> cluster_keys_;
+};
+
+#endif  // _VERTEX_CACHE_OPTIMIZER_H_
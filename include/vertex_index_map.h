@@ -0,0 +1,156 @@
+#ifndef _VERTEX_INDEX_MAP_H_
+#define _VERTEX_INDEX_MAP_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Open-addressing hash table from a face corner's (v, vt, vn) index triple to
+// a vertex index. Slots are 16 bytes and stored inline, so a lookup touches
+// one cache line in the common case. Position indices are 1-based, which lets
+// a zero v index mark an empty slot.
+class VertexIndexMap {
+ public:
+  using Key = std::array<std::uint32_t, 3>;
+
+  struct Stats {
+    std::size_t size = 0;
+    std::size_t capacity = 0;
+    std::size_t lookups = 0;
+    // Slots inspected over all lookups; a hit in the home slot counts as 1.
+    std::size_t total_probes = 0;
+    std::size_t max_probe_length = 0;
+
+    double load_factor() const {
+      return capacity == 0 ? 0.0 : static_cast<double>(size) / capacity;
+    }
+    double average_probe_length() const {
+      return lookups == 0 ? 0.0 : static_cast<double>(total_probes) / lookups;
+    }
+    std::size_t memory_bytes() const { return capacity * sizeof(Slot); }
+
+    Stats& operator+=(const Stats& rhs) {
+      size += rhs.size;
+      capacity += rhs.capacity;
+      lookups += rhs.lookups;
+      total_probes += rhs.total_probes;
+      if (rhs.max_probe_length > max_probe_length) {
+        max_probe_length = rhs.max_probe_length;
+      }
+      return *this;
+    }
+  };
+
+  VertexIndexMap() = default;
+
+  std::size_t size() const { return size_; }
+  Stats stats() const {
+    Stats stats = stats_;
+    stats.size = size_;
+    stats.capacity = slots_.size();
+    return stats;
+  }
+
+  // 64-bit finalizer of MurmurHash3 over the packed triple. Every input bit
+  // affects every output bit, so permuted triples do not collide the way
+  // XOR-combined hashes do.
+  static std::uint64_t Hash(const Key& key) {
+    std::uint64_t h = (static_cast<std::uint64_t>(key[0]) << 32) ^ key[1];
+    h ^= static_cast<std::uint64_t>(key[2]) * 0x9E3779B97F4A7C15ull;
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDull;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ull;
+    h ^= h >> 33;
+    return h;
+  }
+
+  // Returns the value stored for key. If key is absent, value is stored and
+  // returned and the second member is true.
+  std::pair<std::uint32_t, bool> Insert(const Key& key, std::uint32_t value) {
+    return Insert(key, Hash(key), value);
+  }
+
+  std::pair<std::uint32_t, bool> Insert(const Key& key, std::uint64_t hash,
+                                        std::uint32_t value) {
+    if ((size_ + 1) * 4 > slots_.size() * 3) {
+      Rehash(slots_.empty() ? kMinCapacity : slots_.size() * 2);
+    }
+    std::size_t mask = slots_.size() - 1;
+    std::size_t i = static_cast<std::size_t>(hash) & mask;
+    std::size_t probes = 1;
+    for (;; i = (i + 1) & mask, probes++) {
+      Slot& slot = slots_[i];
+      if (slot.key[0] == 0) {
+        slot.key = key;
+        slot.value = value;
+        size_++;
+        RecordLookup(probes);
+        return {value, true};
+      }
+      if (slot.key == key) {
+        RecordLookup(probes);
+        return {slot.value, false};
+      }
+    }
+  }
+
+  void Reserve(std::size_t count) {
+    std::size_t capacity = kMinCapacity;
+    while (capacity * 3 < count * 4) {
+      capacity *= 2;
+    }
+    if (capacity > slots_.size()) {
+      Rehash(capacity);
+    }
+  }
+
+  // Empties the table but keeps its slots allocated.
+  void Clear() {
+    for (Slot& slot : slots_) {
+      slot.key[0] = 0;
+    }
+    size_ = 0;
+    stats_ = Stats();
+  }
+
+ private:
+  struct Slot {
+    Key key;
+    std::uint32_t value;
+  };
+
+  static constexpr std::size_t kMinCapacity = 64;
+
+  void RecordLookup(std::size_t probes) {
+    stats_.lookups++;
+    stats_.total_probes += probes;
+    if (probes > stats_.max_probe_length) {
+      stats_.max_probe_length = probes;
+    }
+  }
+
+  void Rehash(std::size_t capacity) {
+    std::vector<Slot> old_slots(capacity, Slot{{0, 0, 0}, 0});
+    old_slots.swap(slots_);
+    std::size_t mask = capacity - 1;
+    for (const Slot& slot : old_slots) {
+      if (slot.key[0] == 0) {
+        continue;
+      }
+      std::size_t i = static_cast<std::size_t>(Hash(slot.key)) & mask;
+      while (slots_[i].key[0] != 0) {
+        i = (i + 1) & mask;
+      }
+      slots_[i] = slot;
+    }
+  }
+
+  std::vector<Slot> slots_;
+  std::size_t size_ = 0;
+  Stats stats_;
+};
+
+#endif  // _VERTEX_INDEX_MAP_H_
@@ -0,0 +1,329 @@
+#ifndef _VERTEX_QUANTIZER_H_
+#define _VERTEX_QUANTIZER_H_
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+enum class NormalEncoding : std::uint32_t { kOctahedral16, kOctahedral8 };
+
+// Compact vertex attributes. Positions are 16-bit unsigned normalized values
+// inside the bounding box of their range, normals are octahedral encoded as
+// two signed normalized values, and texture coordinates are two half floats.
+// Vertices without a normal or texture coordinate encode zeros, which decode
+// to +z and (0, 0). With both attributes a vertex takes 14 bytes, or 12 with
+// kOctahedral8, against 40 for an OBJParser::Vertex of floats.
+struct QuantizedVertexBuffer {
+  // A run of vertices sharing one bounding box; each component decodes as
+  // offset + scale * q.
+  struct Range {
+    std::uint64_t first_vertex = 0;
+    std::uint64_t vertex_count = 0;
+    std::array<float, 3> offset = {0.f, 0.f, 0.f};
+    std::array<float, 3> scale = {0.f, 0.f, 0.f};
+  };
+
+  // Largest and root mean square differences between the source attributes
+  // and their decoded values. Position errors are in model units.
+  struct Error {
+    double max_position_error = 0.0;
+    double rms_position_error = 0.0;
+    double max_normal_error_degrees = 0.0;
+    double max_texture_coordinate_error = 0.0;
+  };
+
+  std::size_t vertex_count = 0;
+  NormalEncoding normal_encoding = NormalEncoding::kOctahedral16;
+  std::vector<Range> ranges;
+  // 3 per vertex.
+  std::vector<std::uint16_t> positions;
+  // 2 per vertex in whichever of the two matches normal_encoding, or empty
+  // if no vertex has a normal.
+  std::vector<std::int16_t> normals_16;
+  std::vector<std::int8_t> normals_8;
+  // 2 per vertex, or empty if no vertex has a texture coordinate.
+  std::vector<std::uint16_t> texture_coordinates;
+  Error error;
+};
+
+// Encoders and decoders for QuantizedVertexBuffer.
+class VertexQuantizer {
+ public:
+  // Source attributes of one vertex. Absent attributes are nullptr.
+  struct Input {
+    const float* position = nullptr;
+    const float* normal = nullptr;
+    const float* texture_coordinate = nullptr;
+  };
+
+  // Round-to-nearest-even conversion to IEEE 754 binary16. Values beyond the
+  // half range become infinities.
+  static std::uint16_t FloatToHalf(float value) {
+    std::uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    const std::uint16_t sign =
+        static_cast<std::uint16_t>((bits >> 16) & 0x8000);
+    const std::uint32_t magnitude = bits & 0x7FFFFFFF;
+    if (magnitude >= 0x7F800000) {
+      return sign | (magnitude > 0x7F800000 ? 0x7E00 : 0x7C00);
+    }
+    if (magnitude >= 0x477FF000) {
+      return sign | 0x7C00;
+    }
+    if (magnitude < 0x38800000) {
+      float subnormal;
+      std::memcpy(&subnormal, &magnitude, sizeof(subnormal));
+      return sign |
+             static_cast<std::uint16_t>(std::nearbyint(subnormal * 16777216.f));
+    }
+    const std::uint32_t rebiased = magnitude - 0x38000000;
+    return sign | static_cast<std::uint16_t>(
+                      (rebiased + 0x0FFF + ((rebiased >> 13) & 1)) >> 13);
+  }
+
+  static float HalfToFloat(std::uint16_t half) {
+    const std::uint32_t sign = static_cast<std::uint32_t>(half & 0x8000) << 16;
+    const std::uint32_t exponent = (half >> 10) & 0x1F;
+    const std::uint32_t mantissa = half & 0x3FF;
+    std::uint32_t bits;
+    if (exponent == 0) {
+      const float value = std::ldexp(static_cast<float>(mantissa), -24);
+      return sign != 0 ? -value : value;
+    } else if (exponent == 0x1F) {
+      bits = sign | 0x7F800000 | (mantissa << 13);
+    } else {
+      bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    }
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+  }
+
+  // Octahedral encoding of a direction. Of the four grid points around the
+  // exact projection, the one decoding closest to the input is kept.
+  template <class T>
+  static std::array<T, 2> EncodeOctahedral(const float* normal) {
+    const float length = std::sqrt(normal[0] * normal[0] +
+                                   normal[1] * normal[1] +
+                                   normal[2] * normal[2]);
+    const float l1 =
+        std::fabs(normal[0]) + std::fabs(normal[1]) + std::fabs(normal[2]);
+    if (length == 0.f || !std::isfinite(l1)) {
+      return {0, 0};
+    }
+    float u = normal[0] / l1;
+    float v = normal[1] / l1;
+    if (normal[2] < 0.f) {
+      const float folded_u = (1.f - std::fabs(v)) * Sign(u);
+      v = (1.f - std::fabs(u)) * Sign(v);
+      u = folded_u;
+    }
+    const float max = std::numeric_limits<T>::max();
+    std::array<T, 2> best = {0, 0};
+    float best_dot = -2.f;
+    for (int du = 0; du < 2; du++) {
+      for (int dv = 0; dv < 2; dv++) {
+        std::array<T, 2> candidate = {
+            static_cast<T>(std::clamp(std::floor(u * max) + du, -max, max)),
+            static_cast<T>(std::clamp(std::floor(v * max) + dv, -max, max))};
+        std::array<float, 3> decoded = DecodeOctahedral(candidate);
+        const float dot = (decoded[0] * normal[0] + decoded[1] * normal[1] +
+                           decoded[2] * normal[2]) /
+                          length;
+        if (dot > best_dot) {
+          best = candidate;
+          best_dot = dot;
+        }
+      }
+    }
+    return best;
+  }
+
+  template <class T>
+  static std::array<float, 3> DecodeOctahedral(const std::array<T, 2>& q) {
+    const float max = std::numeric_limits<T>::max();
+    float u = std::max(q[0] / max, -1.f);
+    float v = std::max(q[1] / max, -1.f);
+    const float z = 1.f - std::fabs(u) - std::fabs(v);
+    if (z < 0.f) {
+      const float unfolded_u = (1.f - std::fabs(v)) * Sign(u);
+      v = (1.f - std::fabs(u)) * Sign(v);
+      u = unfolded_u;
+    }
+    const float length = std::sqrt(u * u + v * v + z * z);
+    return {u / length, v / length, z / length};
+  }
+
+  // Sizes the attribute arrays of buffer for vertex_count vertices.
+  static void Resize(QuantizedVertexBuffer& buffer, std::size_t vertex_count,
+                     bool has_normals, bool has_texture_coordinates) {
+    buffer.vertex_count = vertex_count;
+    buffer.positions.assign(vertex_count * 3, 0);
+    const bool is_8_bit =
+        buffer.normal_encoding == NormalEncoding::kOctahedral8;
+    buffer.normals_16.assign(has_normals && !is_8_bit ? vertex_count * 2 : 0,
+                             0);
+    buffer.normals_8.assign(has_normals && is_8_bit ? vertex_count * 2 : 0, 0);
+    buffer.texture_coordinates.assign(
+        has_texture_coordinates ? vertex_count * 2 : 0, 0);
+  }
+
+  // Encodes the vertices of buffer.ranges[range_index], reading vertex i of
+  // the range through input(i), and returns the error of that range.
+  // Different ranges may be encoded concurrently.
+  template <class F>
+  static QuantizedVertexBuffer::Error QuantizeRange(
+      QuantizedVertexBuffer& buffer, std::size_t range_index, F&& input) {
+    QuantizedVertexBuffer::Range& range = buffer.ranges[range_index];
+    const std::size_t count = static_cast<std::size_t>(range.vertex_count);
+    std::array<float, 3> low = {0.f, 0.f, 0.f};
+    std::array<float, 3> high = {0.f, 0.f, 0.f};
+    for (std::size_t i = 0; i < count; i++) {
+      const float* position = input(i).position;
+      for (int k = 0; k < 3; k++) {
+        low[k] = i == 0 ? position[k] : std::min(low[k], position[k]);
+        high[k] = i == 0 ? position[k] : std::max(high[k], position[k]);
+      }
+    }
+    for (int k = 0; k < 3; k++) {
+      range.offset[k] = low[k];
+      range.scale[k] = (high[k] - low[k]) / 65535.f;
+    }
+
+    QuantizedVertexBuffer::Error error;
+    double squared_error_sum = 0.0;
+    double min_normal_dot = 1.0;
+    for (std::size_t i = 0; i < count; i++) {
+      const std::size_t vertex =
+          static_cast<std::size_t>(range.first_vertex) + i;
+      const Input attributes = input(i);
+      for (int k = 0; k < 3; k++) {
+        const float q = range.scale[k] == 0.f
+                            ? 0.f
+                            : (attributes.position[k] - range.offset[k]) /
+                                  range.scale[k];
+        const std::uint16_t quantized = static_cast<std::uint16_t>(
+            std::clamp(std::nearbyint(q), 0.f, 65535.f));
+        buffer.positions[vertex * 3 + k] = quantized;
+        const double difference =
+            static_cast<double>(range.offset[k] + range.scale[k] * quantized) -
+            attributes.position[k];
+        error.max_position_error =
+            std::max(error.max_position_error, std::fabs(difference));
+        squared_error_sum += difference * difference;
+      }
+      if (attributes.normal != nullptr &&
+          (!buffer.normals_16.empty() || !buffer.normals_8.empty())) {
+        std::array<float, 3> decoded;
+        if (buffer.normals_8.empty()) {
+          std::array<std::int16_t, 2> q =
+              EncodeOctahedral<std::int16_t>(attributes.normal);
+          std::copy(q.begin(), q.end(), &buffer.normals_16[vertex * 2]);
+          decoded = DecodeOctahedral(q);
+        } else {
+          std::array<std::int8_t, 2> q =
+              EncodeOctahedral<std::int8_t>(attributes.normal);
+          std::copy(q.begin(), q.end(), &buffer.normals_8[vertex * 2]);
+          decoded = DecodeOctahedral(q);
+        }
+        const float* n = attributes.normal;
+        const double length = std::sqrt(static_cast<double>(n[0]) * n[0] +
+                                        static_cast<double>(n[1]) * n[1] +
+                                        static_cast<double>(n[2]) * n[2]);
+        if (length > 0.0) {
+          min_normal_dot = std::min(
+              min_normal_dot,
+              (decoded[0] * n[0] + decoded[1] * n[1] + decoded[2] * n[2]) /
+                  length);
+        }
+      }
+      if (attributes.texture_coordinate != nullptr &&
+          !buffer.texture_coordinates.empty()) {
+        for (int k = 0; k < 2; k++) {
+          const std::uint16_t half =
+              FloatToHalf(attributes.texture_coordinate[k]);
+          buffer.texture_coordinates[vertex * 2 + k] = half;
+          error.max_texture_coordinate_error = std::max(
+              error.max_texture_coordinate_error,
+              std::fabs(static_cast<double>(HalfToFloat(half)) -
+                        attributes.texture_coordinate[k]));
+        }
+      }
+    }
+    if (count != 0) {
+      error.rms_position_error = std::sqrt(squared_error_sum / (count * 3));
+    }
+    error.max_normal_error_degrees =
+        std::acos(std::clamp(min_normal_dot, -1.0, 1.0)) * 180.0 /
+        std::acos(-1.0);
+    return error;
+  }
+
+  // Combines the errors of ranges holding first_count and second_count
+  // vertices.
+  static QuantizedVertexBuffer::Error MergeErrors(
+      const QuantizedVertexBuffer::Error& first, std::size_t first_count,
+      const QuantizedVertexBuffer::Error& second, std::size_t second_count) {
+    QuantizedVertexBuffer::Error error;
+    error.max_position_error =
+        std::max(first.max_position_error, second.max_position_error);
+    if (first_count + second_count != 0) {
+      error.rms_position_error = std::sqrt(
+          (first.rms_position_error * first.rms_position_error * first_count +
+           second.rms_position_error * second.rms_position_error *
+               second_count) /
+          (first_count + second_count));
+    }
+    error.max_normal_error_degrees = std::max(first.max_normal_error_degrees,
+                                              second.max_normal_error_degrees);
+    error.max_texture_coordinate_error =
+        std::max(first.max_texture_coordinate_error,
+                 second.max_texture_coordinate_error);
+    return error;
+  }
+
+  // Decodes vertex of buffer. Attributes the buffer does not store come back
+  // as zeros.
+  static void Dequantize(const QuantizedVertexBuffer& buffer,
+                         std::size_t vertex, std::array<float, 3>& position,
+                         std::array<float, 3>& normal,
+                         std::array<float, 2>& texture_coordinate) {
+    auto range = std::upper_bound(
+        buffer.ranges.begin(), buffer.ranges.end(), vertex,
+        [](std::size_t v, const QuantizedVertexBuffer::Range& r) {
+          return v < r.first_vertex;
+        });
+    position = {0.f, 0.f, 0.f};
+    if (range != buffer.ranges.begin()) {
+      --range;
+      for (int k = 0; k < 3; k++) {
+        position[k] = range->offset[k] +
+                      range->scale[k] * buffer.positions[vertex * 3 + k];
+      }
+    }
+    normal = {0.f, 0.f, 0.f};
+    if (!buffer.normals_16.empty()) {
+      normal = DecodeOctahedral(std::array<std::int16_t, 2>{
+          buffer.normals_16[vertex * 2], buffer.normals_16[vertex * 2 + 1]});
+    } else if (!buffer.normals_8.empty()) {
+      normal = DecodeOctahedral(std::array<std::int8_t, 2>{
+          buffer.normals_8[vertex * 2], buffer.normals_8[vertex * 2 + 1]});
+    }
+    texture_coordinate = {0.f, 0.f};
+    if (!buffer.texture_coordinates.empty()) {
+      texture_coordinate = {
+          HalfToFloat(buffer.texture_coordinates[vertex * 2]),
+          HalfToFloat(buffer.texture_coordinates[vertex * 2 + 1])};
+    }
+  }
+
+ private:
+  static float Sign(float value) { return value >= 0.f ? 1.f : -1.f; }
+};
+
+#endif  // _VERTEX_QUANTIZER_H_
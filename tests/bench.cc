@@ -0,0 +1,559 @@
+// Parser micro-benchmarks.
+//
+//   g++ -std=c++17 -O2 -pthread -I. tests/bench.cc -o bench
+//   ./bench [mesh.obj ...]
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "include/keyword_code.h"
+#include "include/normal_generator.h"
+#include "include/obj_bvh.h"
+#include "include/obj_parser.h"
+#include "include/obj_vertex_cache.h"
+
+namespace {
+
+// Deterministic grid mesh with v/vt/vn records and v/vt/vn triangle faces.
+std::string MakeGridObj(int grid) {
+  std::string obj = "o Grid\nusemtl Default\n";
+  char line[128];
+  for (int y = 0; y <= grid; y++) {
+    for (int x = 0; x <= grid; x++) {
+      std::snprintf(line, sizeof(line), "v %.6f %.6f %.6f\n", x * 0.01,
+                    y * 0.01, ((x * 31 + y * 17) % 97) * 0.001);
+      obj += line;
+      std::snprintf(line, sizeof(line), "vt %.6f %.6f\n",
+                    static_cast<double>(x) / grid,
+                    static_cast<double>(y) / grid);
+      obj += line;
+      std::snprintf(line, sizeof(line), "vn %.6f %.6f %.6f\n", 0.0, 0.0, 1.0);
+      obj += line;
+    }
+  }
+  for (int y = 0; y < grid; y++) {
+    for (int x = 0; x < grid; x++) {
+      int a = y * (grid + 1) + x + 1;
+      int b = a + 1;
+      int c = a + grid + 2;
+      int d = a + grid + 1;
+      std::snprintf(line, sizeof(line), "f %d/%d/%d %d/%d/%d %d/%d/%d\n", a, a,
+                    a, b, b, b, c, c, c);
+      obj += line;
+      std::snprintf(line, sizeof(line), "f %d/%d/%d %d/%d/%d %d/%d/%d\n", a, a,
+                    a, c, c, c, d, d, d);
+      obj += line;
+    }
+  }
+  return obj;
+}
+
+// Grid whose vertices come in mirrored pairs, (a, b, 0) and (b, a, 0), like
+// the symmetric CAD parts that made XOR-combined vertex hashes collide.
+std::string MakeSymmetricObj(int grid) {
+  std::string obj = "o Symmetric\nusemtl Default\n";
+  char line[128];
+  for (int y = 0; y <= grid; y++) {
+    for (int x = 0; x <= grid; x++) {
+      std::snprintf(line, sizeof(line), "v %.6f %.6f 0\nv %.6f %.6f 0\n",
+                    x * 0.01, y * 0.01, y * 0.01, x * 0.01);
+      obj += line;
+      std::snprintf(line, sizeof(line), "vn 0 0 1\nvn 0 0 -1\n");
+      obj += line;
+    }
+  }
+  for (int y = 0; y < grid; y++) {
+    for (int x = 0; x < grid; x++) {
+      int a = 2 * (y * (grid + 1) + x) + 1;
+      int b = a + 2;
+      int c = a + 2 * (grid + 2);
+      for (int mirror = 0; mirror < 2; mirror++) {
+        std::snprintf(line, sizeof(line), "f %d//%d %d//%d %d//%d\n",
+                      a + mirror, a + mirror, b + mirror, b + mirror,
+                      c + mirror, c + mirror);
+        obj += line;
+      }
+    }
+  }
+  return obj;
+}
+
+std::vector<std::string_view> SplitLines(const std::string& text) {
+  std::vector<std::string_view> lines;
+  std::size_t begin = 0;
+  while (begin < text.size()) {
+    std::size_t end = text.find('\n', begin);
+    if (end == std::string::npos) {
+      end = text.size();
+    }
+    lines.emplace_back(text.data() + begin, end - begin);
+    begin = end + 1;
+  }
+  return lines;
+}
+
+// The pre-from_chars tokenizer: one istringstream per record and per corner.
+double TokenizeWithStreams(const std::vector<std::string_view>& lines) {
+  double sum = 0.0;
+  for (std::string_view line : lines) {
+    std::size_t space = line.find(' ');
+    std::string_view kwd = line.substr(0, space);
+    std::string rest(line.substr(space + 1));
+    if (kwd == "f") {
+      std::istringstream iss(rest);
+      std::string corner;
+      while (iss >> corner) {
+        std::replace(corner.begin(), corner.end(), '/', ' ');
+        std::istringstream corner_iss(corner);
+        std::size_t v, vt, vn;
+        corner_iss >> v >> vt >> vn;
+        sum += static_cast<double>(v + vt + vn);
+      }
+    } else if (kwd[0] == 'v') {
+      std::istringstream iss(rest);
+      std::vector<REAL> components;
+      REAL component;
+      while (iss >> component) {
+        components.push_back(component);
+      }
+      sum += components[0];
+    }
+  }
+  return sum;
+}
+
+double TokenizeWithFromChars(const std::vector<std::string_view>& lines) {
+  double sum = 0.0;
+  for (std::string_view line : lines) {
+    std::size_t space = line.find(' ');
+    std::string_view kwd = line.substr(0, space);
+    const char* cursor = line.data() + space + 1;
+    const char* end = line.data() + line.size();
+    if (kwd == "f") {
+      std::size_t index;
+      while (cursor < end) {
+        std::from_chars_result result = std::from_chars(cursor, end, index);
+        sum += static_cast<double>(index);
+        cursor = result.ptr + 1;
+      }
+    } else if (kwd[0] == 'v') {
+      std::array<REAL, 4> components;
+      std::size_t count = 0;
+      while (cursor < end && count < components.size()) {
+        std::from_chars_result result =
+            std::from_chars(cursor, end, components[count++]);
+        cursor = result.ptr + 1;
+      }
+      sum += components[0];
+    }
+  }
+  return sum;
+}
+
+// Every MTL keyword in turn, so a chain of comparisons walks half its length
+// on average.
+const char* const kMtlKeywords[] = {
+    "newmtl", "Ka",     "Kd",     "Ks",    "Ke",     "Ns",       "d",
+    "Tr",     "Tf",     "Ni",     "illum", "map_Ka", "map_Kd",   "map_Ks",
+    "map_Ns", "map_d",  "bump",   "disp",  "Pr",     "map_Bump", "map_Pr",
+    "Pm",     "map_Pm"};
+
+std::vector<std::string_view> MakeKeywordLines(std::size_t count) {
+  std::vector<std::string_view> keywords;
+  for (std::size_t i = 0; i < count; i++) {
+    keywords.emplace_back(
+        kMtlKeywords[(i * 7) % (sizeof(kMtlKeywords) / sizeof(char*))]);
+  }
+  return keywords;
+}
+
+// The string comparisons MTLParser made before dispatching on KeywordCode.
+int DispatchWithCompares(std::string_view kwd) {
+  if (kwd == "#") {
+    return 0;
+  } else if (kwd == "newmtl") {
+    return 1;
+  } else if (kwd == "Ka" || kwd == "Kd" || kwd == "Ks" || kwd == "Ke") {
+    if (kwd == "Ka") {
+      return 2;
+    } else if (kwd == "Kd") {
+      return 3;
+    } else if (kwd == "Ks") {
+      return 4;
+    }
+    return 5;
+  } else if (kwd == "Ns") {
+    return 6;
+  } else if (kwd == "d" || kwd == "Tr") {
+    return kwd == "d" ? 7 : 8;
+  } else if (kwd == "Tf") {
+    return 9;
+  } else if (kwd == "Ni") {
+    return 10;
+  } else if (kwd == "illum") {
+    return 11;
+  } else if (kwd == "map_Ka") {
+    return 12;
+  } else if (kwd == "map_Kd") {
+    return 13;
+  } else if (kwd == "map_Ks") {
+    return 14;
+  } else if (kwd == "map_Ns") {
+    return 15;
+  } else if (kwd == "map_d") {
+    return 16;
+  } else if (kwd == "map_Bump" || kwd == "bump") {
+    return 17;
+  } else if (kwd == "disp") {
+    return 18;
+  } else if (kwd == "Pr" || kwd == "map_Pr") {
+    return 19;
+  } else if (kwd == "Pm" || kwd == "map_Pm") {
+    return 20;
+  }
+  return -1;
+}
+
+int DispatchWithCodes(std::string_view kwd) {
+  switch (KeywordCode(kwd)) {
+    case KeywordCode("#"):
+      return 0;
+    case KeywordCode("newmtl"):
+      return 1;
+    case KeywordCode("Ka"):
+      return 2;
+    case KeywordCode("Kd"):
+      return 3;
+    case KeywordCode("Ks"):
+      return 4;
+    case KeywordCode("Ke"):
+      return 5;
+    case KeywordCode("Ns"):
+      return 6;
+    case KeywordCode("d"):
+      return 7;
+    case KeywordCode("Tr"):
+      return 8;
+    case KeywordCode("Tf"):
+      return 9;
+    case KeywordCode("Ni"):
+      return 10;
+    case KeywordCode("illum"):
+      return 11;
+    case KeywordCode("map_Ka"):
+      return 12;
+    case KeywordCode("map_Kd"):
+      return 13;
+    case KeywordCode("map_Ks"):
+      return 14;
+    case KeywordCode("map_Ns"):
+      return 15;
+    case KeywordCode("map_d"):
+      return 16;
+    case KeywordCode("map_Bump"):
+    case KeywordCode("bump"):
+      return 17;
+    case KeywordCode("disp"):
+      return 18;
+    case KeywordCode("Pr"):
+    case KeywordCode("map_Pr"):
+      return 19;
+    case KeywordCode("Pm"):
+    case KeywordCode("map_Pm"):
+      return 20;
+    default:
+      return -1;
+  }
+}
+
+template <class F>
+double MeasureMBps(std::size_t bytes, int repeat, F&& f) {
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < repeat; i++) {
+    f();
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return static_cast<double>(bytes) * repeat / (1024.0 * 1024.0) /
+         elapsed.count();
+}
+
+// Counts streamed records, standing in for an out-of-core consumer.
+class CountingHandler : public OBJParser::StreamHandler {
+ public:
+  int OnBatch(const OBJParser::StreamBatch& batch) override {
+    record_count_ += batch.record_count();
+    return 0;
+  }
+  std::size_t record_count() const { return record_count_; }
+
+ private:
+  std::size_t record_count_ = 0;
+};
+
+void PrintDedupStats(const std::string& name, const OBJParser& parser,
+                     double mbps) {
+  VertexIndexMap::Stats stats = parser.dedup_stats();
+  std::cout << name << ": " << mbps << " MB/s, " << stats.size
+            << " vertices, load factor " << stats.load_factor()
+            << ", probes avg " << stats.average_probe_length() << " max "
+            << stats.max_probe_length << ", table "
+            << stats.memory_bytes() / (1024.0 * 1024.0) << " MB\n";
+}
+
+// Builds a BVH over every index group and times rays and box queries from a
+// fixed pseudo-random sequence inside the mesh bounds.
+void BenchmarkBvh(const std::string& name, const OBJParser::Mesh& mesh) {
+  const std::vector<OBJParser::Vertex>& vertices = mesh.vertex_buffer;
+  if (vertices.empty()) {
+    return;
+  }
+  std::array<float, 3> low = {vertices[0].position[0],
+                              vertices[0].position[1],
+                              vertices[0].position[2]};
+  std::array<float, 3> high = low;
+  for (const OBJParser::Vertex& vertex : vertices) {
+    for (std::size_t k = 0; k < 3; k++) {
+      low[k] = std::min(low[k], vertex.position[k]);
+      high[k] = std::max(high[k], vertex.position[k]);
+    }
+  }
+  ThreadPool pool(0);
+  std::size_t triangle_count = 0;
+  for (const OBJParser::IndexGroup* index_group :
+       OBJParser::IndexGroups(mesh.sub_objects)) {
+    triangle_count += index_group->index_buffer_.size() / 3;
+  }
+  auto start = std::chrono::steady_clock::now();
+  std::vector<TriangleBvh> bvhs = BuildBvhs(mesh, pool);
+  std::chrono::duration<double> build_time =
+      std::chrono::steady_clock::now() - start;
+
+  std::uint32_t state = 12345;
+  auto random_point = [&] {
+    std::array<float, 3> point;
+    for (std::size_t k = 0; k < 3; k++) {
+      state = state * 1664525u + 1013904223u;
+      point[k] = low[k] + (high[k] - low[k]) * (state >> 8) / 16777216.f;
+    }
+    return point;
+  };
+  const int query_count = 200000;
+  std::size_t hit_count = 0;
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < query_count; i++) {
+    std::array<float, 3> origin = random_point();
+    std::array<float, 3> target = random_point();
+    std::array<float, 3> direction = {target[0] - origin[0],
+                                      target[1] - origin[1],
+                                      target[2] - origin[2]};
+    TriangleBvh::Hit hit;
+    for (const TriangleBvh& bvh : bvhs) {
+      hit_count += bvh.Intersect(origin, direction, 1.f, hit);
+    }
+  }
+  std::chrono::duration<double> ray_time =
+      std::chrono::steady_clock::now() - start;
+  std::vector<std::uint32_t> triangles;
+  std::size_t overlap_count = 0;
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < query_count; i++) {
+    std::array<float, 3> box_min = random_point();
+    std::array<float, 3> box_max;
+    for (std::size_t k = 0; k < 3; k++) {
+      box_max[k] = box_min[k] + (high[k] - low[k]) * 0.01f;
+    }
+    for (const TriangleBvh& bvh : bvhs) {
+      triangles.clear();
+      bvh.Query(box_min, box_max, triangles);
+      overlap_count += triangles.size();
+    }
+  }
+  std::chrono::duration<double> box_time =
+      std::chrono::steady_clock::now() - start;
+  std::cout << name << ": " << triangle_count << " triangles, build "
+            << build_time.count() * 1000.0 << " ms ("
+            << triangle_count / build_time.count() / 1e6 << " M tris/s), "
+            << query_count / ray_time.count() / 1e6 << " M rays/s ("
+            << hit_count << " hits), "
+            << query_count / box_time.count() / 1e6 << " M box queries/s ("
+            << overlap_count << " overlaps)\n";
+}
+
+// Generates smooth normals and tangents for every mesh group, ignoring the
+// file's vn, with the SIMD kernels and then the scalar ones, and reports the
+// largest difference between the two.
+void BenchmarkNormals(const std::string& name, const OBJParser& parser) {
+  const std::vector<OBJParser::Vertex>& vertices = parser.vertex_buffer();
+  const std::array<REAL, 3> absent = {std::numeric_limits<REAL>::max(),
+                                      std::numeric_limits<REAL>::max(),
+                                      std::numeric_limits<REAL>::max()};
+  std::array<std::vector<std::array<float, 3>>, 2> normals;
+  std::array<std::vector<std::array<float, 4>>, 2> tangents;
+  std::array<double, 2> seconds = {0.0, 0.0};
+  std::size_t triangle_count = 0;
+  for (int use_simd = 1; use_simd >= 0; use_simd--) {
+    NormalGenerator generator(NormalWeighting::kAngle, use_simd != 0);
+    std::vector<std::array<float, 3>> group_normals;
+    std::vector<std::array<float, 4>> group_tangents;
+    triangle_count = 0;
+    for (const OBJParser::SubObject& sub_object : parser.sub_objects()) {
+      for (const OBJParser::MeshGroup& mesh_group : sub_object.mesh_groups) {
+        generator.Clear();
+        for (const OBJParser::IndexGroup& index_group :
+             mesh_group.index_groups) {
+          generator.AddTriangles(
+              index_group.index_buffer_, true, [&](INTEGER vertex) {
+                NormalGenerator::Input input;
+                input.position = vertices[vertex].position.data();
+                if (vertices[vertex].texture_coordinate != absent) {
+                  input.texture_coordinate =
+                      vertices[vertex].texture_coordinate.data();
+                }
+                return input;
+              });
+        }
+        triangle_count += generator.triangle_count();
+        auto start = std::chrono::steady_clock::now();
+        generator.GenerateNormals(group_normals);
+        generator.GenerateTangents(group_tangents);
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+        seconds[use_simd] += elapsed.count();
+        normals[use_simd].insert(normals[use_simd].end(),
+                                 group_normals.begin(), group_normals.end());
+        tangents[use_simd].insert(tangents[use_simd].end(),
+                                  group_tangents.begin(),
+                                  group_tangents.end());
+      }
+    }
+  }
+  float max_difference = 0.f;
+  for (std::size_t i = 0; i < normals[0].size(); i++) {
+    for (std::size_t k = 0; k < 3; k++) {
+      max_difference = std::max(
+          {max_difference, std::fabs(normals[0][i][k] - normals[1][i][k]),
+           std::fabs(tangents[0][i][k] - tangents[1][i][k])});
+    }
+  }
+  std::cout << name << ": " << triangle_count << " triangles, "
+            << NormalGenerator::simd_name() << " "
+            << triangle_count / seconds[1] / 1e6 << " M tris/s, scalar "
+            << triangle_count / seconds[0] / 1e6
+            << " M tris/s, max difference " << max_difference << "\n";
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const std::string obj = MakeGridObj(600);
+  const std::vector<std::string_view> lines = SplitLines(obj);
+  std::cout << "Input: " << obj.size() / (1024.0 * 1024.0) << " MB, "
+            << lines.size() << " lines\n";
+
+  double checksum = 0.0;
+  double stream_mbps = MeasureMBps(
+      obj.size(), 3, [&] { checksum += TokenizeWithStreams(lines); });
+  double from_chars_mbps = MeasureMBps(
+      obj.size(), 3, [&] { checksum += TokenizeWithFromChars(lines); });
+  std::cout << "Tokenize (istringstream): " << stream_mbps << " MB/s\n";
+  std::cout << "Tokenize (from_chars):    " << from_chars_mbps << " MB/s\n";
+
+  OBJParser parser;
+  double parse_mbps = MeasureMBps(obj.size(), 3, [&] {
+    if (parser.ParseFromMemory(obj.data(), obj.size()) != 0) {
+      std::cerr << "Failed to parse OBJ text.\n";
+    }
+  });
+  std::cout << "OBJParser::ParseFromMemory: " << parse_mbps << " MB/s\n";
+  CountingHandler handler;
+  double stream_parse_mbps = MeasureMBps(obj.size(), 3, [&] {
+    parser.ParseStreamFromMemory(obj.data(), obj.size(), handler);
+  });
+  std::cout << "OBJParser::ParseStreamFromMemory: " << stream_parse_mbps
+            << " MB/s\n";
+
+  std::cout << "\nKeyword dispatch (MTL keywords)\n";
+  const std::vector<std::string_view> keywords = MakeKeywordLines(1 << 22);
+  for (int codes = 0; codes < 2; codes++) {
+    long long sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int repeat = 0; repeat < 5; repeat++) {
+      for (std::string_view kwd : keywords) {
+        sum += codes ? DispatchWithCodes(kwd) : DispatchWithCompares(kwd);
+      }
+    }
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    checksum += static_cast<double>(sum);
+    std::cout << (codes ? "  KeywordCode switch: " : "  string compares:    ")
+              << keywords.size() * 5 / 1e6 / elapsed.count() << " M lines/s\n";
+  }
+
+  std::cout << "\nVertex deduplication\n";
+  PrintDedupStats("  grid (synthetic)", parser, parse_mbps);
+  const std::string symmetric = MakeSymmetricObj(600);
+  double symmetric_mbps = MeasureMBps(symmetric.size(), 3, [&] {
+    parser.ParseFromMemory(symmetric.data(), symmetric.size());
+  });
+  PrintDedupStats("  symmetric (synthetic)", parser, symmetric_mbps);
+  for (int i = 1; i < argc; i++) {
+    MappedFile file;
+    if (file.Open(argv[i]) != 0) {
+      std::cerr << "Failed to open " << argv[i] << ".\n";
+      continue;
+    }
+    double mbps = MeasureMBps(file.size(), 1, [&] {
+      parser.ParseFromMemory(file.data(), file.size());
+    });
+    PrintDedupStats("  " + std::string(argv[i]), parser, mbps);
+  }
+
+  std::cout << "\nVertex cache optimization\n";
+  OBJParser::ParseOptions options;
+  options.triangulate = true;
+  parser.set_parse_options(options);
+  VertexCacheReport report;
+  double optimize_mbps = MeasureMBps(obj.size(), 1, [&] {
+    parser.ParseFromMemory(obj.data(), obj.size());
+    OBJParser::Mesh mesh = parser.Release();
+    OptimizeVertexCache(mesh, 16, parser.thread_pool(), report);
+    OptimizeOverdraw(mesh, 16, 1.05f, parser.thread_pool());
+    OptimizeVertexFetch(mesh);
+  });
+  std::cout << "  grid (synthetic): " << optimize_mbps << " MB/s, ACMR "
+            << report.before.acmr() << " -> " << report.after.acmr()
+            << ", ATVR " << report.before.atvr() << " -> "
+            << report.after.atvr() << "\n";
+
+  std::cout << "\nBVH\n";
+  options = OBJParser::ParseOptions();
+  options.triangulate = true;
+  parser.set_parse_options(options);
+  parser.ParseFromMemory(obj.data(), obj.size());
+  BenchmarkBvh("  grid (synthetic)", parser.Release());
+  for (int i = 1; i < argc; i++) {
+    parser.Parse(argv[i]);
+    BenchmarkBvh("  " + std::string(argv[i]), parser.Release());
+  }
+
+  std::cout << "\nNormal and tangent generation\n";
+  parser.ParseFromMemory(obj.data(), obj.size());
+  BenchmarkNormals("  grid (synthetic)", parser);
+  for (int i = 1; i < argc; i++) {
+    parser.Parse(argv[i]);
+    BenchmarkNormals("  " + std::string(argv[i]), parser);
+  }
+  std::cout << "(checksum " << checksum << ")\n";
+  return 0;
+}
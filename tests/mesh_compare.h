@@ -0,0 +1,53 @@
+#ifndef _MESH_COMPARE_H_
+#define _MESH_COMPARE_H_
+
+#include <cstddef>
+
+#include "include/obj_parser.h"
+
+// Exact comparison of parse results for the tests and benchmarks, which
+// check that every way of parsing a file gives the same mesh. Materials are
+// left out; they are compared by name through material_names.
+inline bool SameIndexGroup(const OBJParser::IndexGroup& a,
+                           const OBJParser::IndexGroup& b) {
+  return a.mtl_name == b.mtl_name && a.material_id == b.material_id &&
+         a.is_smooth_shading == b.is_smooth_shading &&
+         a.is_smooth_shading_empty == b.is_smooth_shading_empty &&
+         a.index_buffer_ == b.index_buffer_ &&
+         a.index_buffer_16_ == b.index_buffer_16_ &&
+         a.base_vertex == b.base_vertex;
+}
+
+// Whether a and b are equal, vertex numbering included.
+inline bool SameMesh(const OBJParser::Mesh& a, const OBJParser::Mesh& b) {
+  if (a.mtl_name != b.mtl_name || a.material_names != b.material_names ||
+      a.vertex_buffer != b.vertex_buffer || a.tangents != b.tangents ||
+      a.line_indices != b.line_indices ||
+      a.sub_objects.size() != b.sub_objects.size()) {
+    return false;
+  }
+  for (std::size_t s = 0; s < a.sub_objects.size(); s++) {
+    const OBJParser::SubObject& sub_a = a.sub_objects[s];
+    const OBJParser::SubObject& sub_b = b.sub_objects[s];
+    if (sub_a.sub_object_name != sub_b.sub_object_name ||
+        sub_a.mesh_groups.size() != sub_b.mesh_groups.size()) {
+      return false;
+    }
+    for (std::size_t m = 0; m < sub_a.mesh_groups.size(); m++) {
+      const OBJParser::MeshGroup& mesh_a = sub_a.mesh_groups[m];
+      const OBJParser::MeshGroup& mesh_b = sub_b.mesh_groups[m];
+      if (mesh_a.mesh_group_name != mesh_b.mesh_group_name ||
+          mesh_a.index_groups.size() != mesh_b.index_groups.size()) {
+        return false;
+      }
+      for (std::size_t g = 0; g < mesh_a.index_groups.size(); g++) {
+        if (!SameIndexGroup(mesh_a.index_groups[g], mesh_b.index_groups[g])) {
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+#endif  // _MESH_COMPARE_H_
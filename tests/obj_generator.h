@@ -0,0 +1,371 @@
+#ifndef _OBJ_GENERATOR_H_
+#define _OBJ_GENERATOR_H_
+
+#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <string_view>
+
+// Writes synthetic OBJ and MTL files for benchmarks. Output depends only on
+// the mix, the seed and the requested size, so runs on different machines
+// measure the same input. Files are written in patches of a few thousand
+// faces and never held in memory, so sizes of several GB are fine.
+enum class ObjMix {
+  // v records and v triangles.
+  kPositionOnly,
+  // v/vt/vn triangles with texture coordinates and normals per face corner,
+  // as exporters write unwelded meshes. Few corners share a vertex.
+  kFull,
+  // v/vt faces of 5 to 12 corners, every other one concave.
+  kPolygons,
+  // Welded v/vt/vn triangles with a usemtl record every four triangles.
+  kMaterialSwitches,
+  // Large welded v/vt/vn quad grids, where every vertex is used by four
+  // faces.
+  kSharedVertices,
+};
+
+class ObjGenerator {
+ public:
+  struct Stats {
+    std::uint64_t bytes = 0;
+    std::uint64_t faces = 0;
+    std::uint64_t materials = 0;
+  };
+
+  static constexpr std::size_t kMixCount = 5;
+
+  static const char* MixName(ObjMix mix) {
+    switch (mix) {
+      case ObjMix::kPositionOnly:
+        return "position_only";
+      case ObjMix::kFull:
+        return "full";
+      case ObjMix::kPolygons:
+        return "polygons";
+      case ObjMix::kMaterialSwitches:
+        return "material_switches";
+      case ObjMix::kSharedVertices:
+        return "shared_vertices";
+    }
+    return "";
+  }
+
+  explicit ObjGenerator(std::uint64_t seed = 1) : seed_(seed) {}
+
+  // Writes an OBJ of at least target_bytes that refers to mtl_name, whose
+  // materials are named as by WriteMtl with material_count materials. The
+  // first patch has no o, g, s or usemtl record, so its faces land in the
+  // unnamed groups. Later ones open an o, every third of them a g, and
+  // alternate between s 1 and s off; every fourth has no usemtl, so its
+  // faces come before any usemtl of their object.
+  int WriteObj(const std::string& path, ObjMix mix, std::uint64_t target_bytes,
+               const std::string& mtl_name, std::size_t material_count,
+               Stats& stats) {
+    std::ofstream output(path, std::ios::binary | std::ios::trunc);
+    if (!output.is_open()) {
+      return 1;
+    }
+    state_ = seed_;
+    stats = Stats();
+    position_count_ = 0;
+    texture_coordinate_count_ = 0;
+    normal_count_ = 0;
+    buffer_.clear();
+    buffer_ += "# Synthetic ";
+    buffer_ += MixName(mix);
+    buffer_ += " mesh\nmtllib ";
+    buffer_ += mtl_name;
+    buffer_ += '\n';
+    for (std::uint64_t patch = 0; stats.bytes + buffer_.size() < target_bytes;
+         patch++) {
+      if (patch != 0) {
+        buffer_ += "o Patch";
+        AppendInteger(patch);
+        buffer_ += '\n';
+        if (patch % 3 == 2) {
+          buffer_ += "g Group";
+          AppendInteger(patch);
+          buffer_ += '\n';
+        }
+        buffer_ += patch % 2 == 0 ? "s 1\n" : "s off\n";
+        if (patch % 4 != 3) {
+          buffer_ += "usemtl ";
+          AppendMaterialName(Next() % material_count);
+          buffer_ += '\n';
+        }
+      }
+      switch (mix) {
+        case ObjMix::kPositionOnly:
+          stats.faces += WriteGrid(patch, 32, false, false, 0);
+          break;
+        case ObjMix::kFull:
+          stats.faces += WriteUnweldedGrid(patch, 32);
+          break;
+        case ObjMix::kPolygons:
+          stats.faces += WritePolygons(patch, 128);
+          break;
+        case ObjMix::kMaterialSwitches:
+          stats.faces += WriteGrid(patch, 32, true, false, material_count);
+          break;
+        case ObjMix::kSharedVertices:
+          stats.faces += WriteGrid(patch, 64, true, true, 0);
+          break;
+      }
+      if (buffer_.size() >= kFlushSize && Flush(output, stats) != 0) {
+        return 1;
+      }
+    }
+    return Flush(output, stats);
+  }
+
+  // Writes an MTL of material_count materials named Material_<i>, each
+  // with colors, scalars and texture maps.
+  int WriteMtl(const std::string& path, std::size_t material_count,
+               Stats& stats) {
+    std::ofstream output(path, std::ios::binary | std::ios::trunc);
+    if (!output.is_open()) {
+      return 1;
+    }
+    state_ = seed_;
+    stats = Stats();
+    buffer_ = "# Synthetic material library\n";
+    for (std::size_t i = 0; i < material_count; i++) {
+      buffer_ += "\nnewmtl ";
+      AppendMaterialName(i);
+      buffer_ += "\nNs ";
+      AppendReal(Uniform() * 1000.0);
+      for (const char* color : {"\nKa ", "\nKd ", "\nKs ", "\nKe "}) {
+        buffer_ += color;
+        AppendReal(Uniform());
+        buffer_ += ' ';
+        AppendReal(Uniform());
+        buffer_ += ' ';
+        AppendReal(Uniform());
+      }
+      buffer_ += "\nNi ";
+      AppendReal(1.0 + Uniform());
+      buffer_ += "\nd ";
+      AppendReal(Uniform());
+      buffer_ += "\nillum 2";
+      for (const char* map : {"\nmap_Kd ", "\nmap_Bump "}) {
+        buffer_ += map;
+        buffer_ += "textures/";
+        AppendMaterialName(i);
+        buffer_ += map[5] == 'K' ? "_albedo.png" : "_normal.png";
+      }
+      buffer_ += '\n';
+      stats.materials++;
+      if (buffer_.size() >= kFlushSize && Flush(output, stats) != 0) {
+        return 1;
+      }
+    }
+    return Flush(output, stats);
+  }
+
+ private:
+  static constexpr std::size_t kFlushSize = 1 << 20;
+
+  int Flush(std::ofstream& output, Stats& stats) {
+    output.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+    stats.bytes += buffer_.size();
+    buffer_.clear();
+    return output ? 0 : 1;
+  }
+
+  // SplitMix64, which is small, fast and identical everywhere.
+  std::uint64_t Next() {
+    std::uint64_t z = (state_ += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+  }
+
+  // Uniform in [0, 1) from the top 53 bits.
+  double Uniform() {
+    return static_cast<double>(Next() >> 11) / 9007199254740992.0;
+  }
+
+  void AppendInteger(std::uint64_t value) {
+    char text[24];
+    std::to_chars_result result =
+        std::to_chars(text, text + sizeof(text), value);
+    buffer_.append(text, result.ptr);
+  }
+
+  void AppendReal(double value) {
+    char text[64];
+    std::to_chars_result result = std::to_chars(
+        text, text + sizeof(text), value, std::chars_format::fixed, 6);
+    buffer_.append(text, result.ptr);
+  }
+
+  void AppendMaterialName(std::uint64_t index) {
+    buffer_ += "Material_";
+    AppendInteger(index);
+  }
+
+  void AppendRecord(std::string_view keyword, double x, double y) {
+    buffer_ += keyword;
+    AppendReal(x);
+    buffer_ += ' ';
+    AppendReal(y);
+    buffer_ += '\n';
+  }
+
+  void AppendRecord(std::string_view keyword, double x, double y, double z) {
+    buffer_ += keyword;
+    AppendReal(x);
+    buffer_ += ' ';
+    AppendReal(y);
+    buffer_ += ' ';
+    AppendReal(z);
+    buffer_ += '\n';
+  }
+
+  // Appends one face corner. Zero texture coordinate or normal indices are
+  // left out.
+  void AppendCorner(std::uint64_t v, std::uint64_t vt, std::uint64_t vn) {
+    buffer_ += ' ';
+    AppendInteger(v);
+    if (vt != 0 || vn != 0) {
+      buffer_ += '/';
+      if (vt != 0) {
+        AppendInteger(vt);
+      }
+      if (vn != 0) {
+        buffer_ += '/';
+        AppendInteger(vn);
+      }
+    }
+  }
+
+  // Height field over a size x size cell grid placed by patch, with a
+  // texture coordinate and a normal per grid vertex if has_attributes.
+  // Cells become two triangles, or one quad with use_quads. With
+  // material_count, every other cell switches material.
+  std::uint64_t WriteGrid(std::uint64_t patch, std::size_t size,
+                          bool has_attributes, bool use_quads,
+                          std::size_t material_count) {
+    const double origin = static_cast<double>(patch) * size;
+    const std::uint64_t base = position_count_;
+    const std::uint64_t texture_coordinate_base = texture_coordinate_count_;
+    const std::uint64_t normal_base = normal_count_;
+    for (std::size_t y = 0; y <= size; y++) {
+      for (std::size_t x = 0; x <= size; x++) {
+        AppendRecord("v ", origin + x, static_cast<double>(y),
+                     Uniform() * 0.25);
+        position_count_++;
+        if (has_attributes) {
+          AppendRecord("vt ", static_cast<double>(x) / size,
+                       static_cast<double>(y) / size);
+          AppendRecord("vn ", Uniform() * 0.1, Uniform() * 0.1, 1.0);
+          texture_coordinate_count_++;
+          normal_count_++;
+        }
+      }
+    }
+    std::uint64_t face_count = 0;
+    for (std::size_t y = 0; y < size; y++) {
+      for (std::size_t x = 0; x < size; x++) {
+        if (material_count != 0 && (x & 1) == 0) {
+          buffer_ += "usemtl ";
+          AppendMaterialName(Next() % material_count);
+          buffer_ += '\n';
+        }
+        const std::uint64_t a = y * (size + 1) + x + 1;
+        const std::uint64_t cell[4] = {a, a + 1, a + size + 2, a + size + 1};
+        const int faces[3][4] = {{0, 1, 2, 3}, {0, 1, 2, -1}, {0, 2, 3, -1}};
+        for (int f = use_quads ? 0 : 1; f < (use_quads ? 1 : 3); f++) {
+          buffer_ += 'f';
+          for (int c : faces[f]) {
+            if (c < 0) {
+              continue;
+            }
+            AppendCorner(base + cell[c],
+                         has_attributes ? texture_coordinate_base + cell[c] : 0,
+                         has_attributes ? normal_base + cell[c] : 0);
+          }
+          buffer_ += '\n';
+          face_count++;
+        }
+      }
+    }
+    return face_count;
+  }
+
+  // Welded positions with a texture coordinate and a normal per corner.
+  std::uint64_t WriteUnweldedGrid(std::uint64_t patch, std::size_t size) {
+    const double origin = static_cast<double>(patch) * size;
+    const std::uint64_t base = position_count_;
+    for (std::size_t y = 0; y <= size; y++) {
+      for (std::size_t x = 0; x <= size; x++) {
+        AppendRecord("v ", origin + x, static_cast<double>(y),
+                     Uniform() * 0.25);
+        position_count_++;
+      }
+    }
+    std::uint64_t face_count = 0;
+    for (std::size_t y = 0; y < size; y++) {
+      for (std::size_t x = 0; x < size; x++) {
+        const std::uint64_t a = y * (size + 1) + x + 1;
+        const std::uint64_t triangles[2][3] = {
+            {a, a + 1, a + size + 2}, {a, a + size + 2, a + size + 1}};
+        for (const std::uint64_t(&triangle)[3] : triangles) {
+          for (int c = 0; c < 3; c++) {
+            AppendRecord("vt ", Uniform(), Uniform());
+            AppendRecord("vn ", Uniform() * 0.1, Uniform() * 0.1, 1.0);
+          }
+          buffer_ += 'f';
+          for (int c = 0; c < 3; c++) {
+            AppendCorner(base + triangle[c], ++texture_coordinate_count_,
+                         ++normal_count_);
+          }
+          buffer_ += '\n';
+          face_count++;
+        }
+      }
+    }
+    return face_count;
+  }
+
+  // Separate n-gons on a row, with alternating radii on every other one so
+  // it becomes a concave star.
+  std::uint64_t WritePolygons(std::uint64_t patch, std::size_t count) {
+    const double kPi = 3.14159265358979323846;
+    std::uint64_t face_count = 0;
+    for (std::size_t i = 0; i < count; i++) {
+      const std::size_t corner_count = 5 + Next() % 8;
+      const bool is_star = (i & 1) != 0;
+      const double cx = static_cast<double>(i) * 2.0;
+      const double cy = static_cast<double>(patch) * 2.0;
+      for (std::size_t c = 0; c < corner_count; c++) {
+        const double angle = 2.0 * kPi * c / corner_count;
+        const double radius = is_star && (c & 1) != 0 ? 0.4 : 0.9;
+        AppendRecord("v ", cx + radius * std::cos(angle),
+                     cy + radius * std::sin(angle), Uniform() * 0.01);
+        AppendRecord("vt ", 0.5 + 0.5 * std::cos(angle),
+                     0.5 + 0.5 * std::sin(angle));
+      }
+      buffer_ += 'f';
+      for (std::size_t c = 0; c < corner_count; c++) {
+        AppendCorner(++position_count_, ++texture_coordinate_count_, 0);
+      }
+      buffer_ += '\n';
+      face_count++;
+    }
+    return face_count;
+  }
+
+  std::uint64_t seed_;
+  std::uint64_t state_ = 0;
+  std::uint64_t position_count_ = 0;
+  std::uint64_t texture_coordinate_count_ = 0;
+  std::uint64_t normal_count_ = 0;
+  std::string buffer_;
+};
+
+#endif  // _OBJ_GENERATOR_H_
@@ -0,0 +1,440 @@
+// Parse benchmarks on generated files.
+//
+//   g++ -std=c++17 -O2 -pthread -I. tests/parse_bench.cc -o parse_bench
+//   ./parse_bench [--dir DIR] [--threads N] [--repeat N] [--reuse]
+//                 [SIZE_MB ...]
+//
+// For every size (1, 16 and 128 MB by default) an OBJ of each mix in
+// tests/obj_generator.h and an MTL of about the same size are written to DIR
+// unless they exist already, then parsed with OBJParser::Parse and
+// MTLParser::Parse. Reported per file are throughput, faces (or materials)
+// per second, peak resident set size during the parse and the heap
+// allocations it made. With --reuse one parser per file parses it every
+// repeat with reuse_capacity set, so the best run shows the steady state.
+// A batch row per size loads all OBJs of that size at once with BatchLoader
+// on --threads threads; they share one material library. A stream row parses
+// the first OBJ of the size from an std::ifstream, through the background
+// reader used for pipes, instead of mapping it. An index row builds the part
+// index of that file and a part row parses its middle sub-object through
+// the index. Its MB/s is relative to the whole file, as if the part had
+// been found by parsing all of it.
+//
+// Every OBJ is also parsed threaded, with deferred deduplication and from
+// a stream, outside the measurements. The exit status is nonzero if any of
+// these meshes differs from the serial one or any parse fails.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#elif !defined(__linux__)
+#include <sys/resource.h>
+#endif
+
+#include "include/batch_loader.h"
+#include "include/mtl_parser.h"
+#include "include/obj_parser.h"
+#include "tests/mesh_compare.h"
+#include "tests/obj_generator.h"
+
+namespace {
+
+std::atomic<std::uint64_t> allocation_count{0};
+std::atomic<std::uint64_t> allocation_bytes{0};
+
+void* Allocate(std::size_t size) {
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  allocation_bytes.fetch_add(size, std::memory_order_relaxed);
+  void* p = std::malloc(size == 0 ? 1 : size);
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void* AllocateAligned(std::size_t size, std::size_t alignment) {
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  allocation_bytes.fetch_add(size, std::memory_order_relaxed);
+#if defined(_WIN32)
+  void* p = _aligned_malloc(size == 0 ? 1 : size, alignment);
+#else
+  void* p = nullptr;
+  if (posix_memalign(&p, std::max(alignment, sizeof(void*)),
+                     size == 0 ? 1 : size) != 0) {
+    p = nullptr;
+  }
+#endif
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void FreeAligned(void* p) {
+#if defined(_WIN32)
+  _aligned_free(p);
+#else
+  std::free(p);
+#endif
+}
+
+}  // namespace
+
+// Every heap allocation of the process goes through these, so the counters
+// cover the parsers and the standard containers they use.
+void* operator new(std::size_t size) { return Allocate(size); }
+void* operator new[](std::size_t size) { return Allocate(size); }
+void* operator new(std::size_t size, std::align_val_t alignment) {
+  return AllocateAligned(size, static_cast<std::size_t>(alignment));
+}
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+  return AllocateAligned(size, static_cast<std::size_t>(alignment));
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { FreeAligned(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { FreeAligned(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept {
+  FreeAligned(p);
+}
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept {
+  FreeAligned(p);
+}
+
+namespace {
+
+int failure_count = 0;
+
+// Starts a new peak resident set size measurement where the platform allows
+// it. Elsewhere peaks cover the whole process so far.
+void ResetPeakRss() {
+#if defined(__linux__)
+  std::ofstream clear_refs("/proc/self/clear_refs");
+  clear_refs << "5";
+#endif
+}
+
+std::uint64_t PeakRssBytes() {
+#if defined(_WIN32)
+  PROCESS_MEMORY_COUNTERS counters;
+  if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+    return counters.PeakWorkingSetSize;
+  }
+  return 0;
+#elif defined(__linux__)
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.compare(0, 6, "VmHWM:") == 0) {
+      return std::strtoull(line.c_str() + 6, nullptr, 10) * 1024;
+    }
+  }
+  return 0;
+#else
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+  return static_cast<std::uint64_t>(usage.ru_maxrss);
+#else
+  return static_cast<std::uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+struct Measurement {
+  double seconds = 0.0;
+  std::uint64_t peak_rss = 0;
+  std::uint64_t allocations = 0;
+  std::uint64_t allocated_bytes = 0;
+};
+
+// Best of repeat runs of f.
+template <class F>
+Measurement Measure(int repeat, F&& f) {
+  Measurement best;
+  for (int i = 0; i < repeat; i++) {
+    ResetPeakRss();
+    const std::uint64_t count = allocation_count.load();
+    const std::uint64_t bytes = allocation_bytes.load();
+    auto start = std::chrono::steady_clock::now();
+    if (f() != 0) {
+      std::cerr << "Parse failed.\n";
+      failure_count++;
+    }
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    if (i == 0 || elapsed.count() < best.seconds) {
+      best.seconds = elapsed.count();
+      best.peak_rss = PeakRssBytes();
+      best.allocations = allocation_count.load() - count;
+      best.allocated_bytes = allocation_bytes.load() - bytes;
+    }
+  }
+  return best;
+}
+
+// Counts f records, so files generated by an earlier run need no metadata.
+std::uint64_t CountFaces(const std::string& path) {
+  MappedFile file;
+  if (file.Open(path) != 0) {
+    return 0;
+  }
+  std::uint64_t count = 0;
+  const char* cursor = file.data();
+  const char* end = file.data() + file.size();
+  while (cursor < end) {
+    if (end - cursor > 1 && cursor[0] == 'f' && cursor[1] == ' ') {
+      count++;
+    }
+    const void* newline = std::memchr(cursor, '\n', end - cursor);
+    cursor = newline == nullptr ? end : static_cast<const char*>(newline) + 1;
+  }
+  return count;
+}
+
+// Parses path serially, then on thread_count threads (at least two), with
+// deferred deduplication and from a stream, and counts the failures and
+// meshes that differ from the serial one.
+int CheckParseModes(const std::string& name, const std::string& path,
+                    unsigned thread_count) {
+  auto parse = [&path](const OBJParser::ParseOptions& options,
+                       bool from_stream, OBJParser::Mesh& mesh) {
+    OBJParser parser;
+    parser.set_parse_options(options);
+    int result = 0;
+    if (from_stream) {
+      std::ifstream stream(path, std::ios::binary);
+      result = parser.Parse(stream);
+    } else {
+      result = parser.Parse(path);
+    }
+    mesh = parser.Release();
+    return result;
+  };
+  OBJParser::Mesh serial;
+  if (parse(OBJParser::ParseOptions(), false, serial) != 0) {
+    std::cerr << name << ": serial parse failed.\n";
+    return 1;
+  }
+  struct Mode {
+    const char* name;
+    bool deferred_dedup;
+    bool from_stream;
+  };
+  const Mode modes[] = {
+      {"threaded", false, false},
+      {"deferred", true, false},
+      {"stream", false, true},
+  };
+  int mismatch_count = 0;
+  for (const Mode& mode : modes) {
+    OBJParser::ParseOptions options;
+    options.thread_count = thread_count == 1 ? 2 : thread_count;
+    options.deferred_dedup = mode.deferred_dedup;
+    OBJParser::Mesh mesh;
+    if (parse(options, mode.from_stream, mesh) != 0 ||
+        !SameMesh(serial, mesh)) {
+      std::cerr << name << ": " << mode.name
+                << " parse differs from the serial one.\n";
+      mismatch_count++;
+    }
+  }
+  return mismatch_count;
+}
+
+bool FileExists(const std::string& path) {
+  std::ifstream file(path, std::ios::binary);
+  return file.is_open();
+}
+
+void PrintRow(const std::string& name, std::uint64_t bytes,
+              std::uint64_t items, const char* unit,
+              const Measurement& measurement) {
+  char row[256];
+  std::snprintf(row, sizeof(row),
+                "%-30s %9.1f MB %9.1f MB/s %8.2f M %s/s %9.1f MB peak RSS "
+                "%10llu allocations (%.1f MB)",
+                name.c_str(), bytes / (1024.0 * 1024.0),
+                bytes / (1024.0 * 1024.0) / measurement.seconds,
+                items / 1e6 / measurement.seconds, unit,
+                measurement.peak_rss / (1024.0 * 1024.0),
+                static_cast<unsigned long long>(measurement.allocations),
+                measurement.allocated_bytes / (1024.0 * 1024.0));
+  std::cout << row << "\n";
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::string directory = ".";
+  unsigned thread_count = 1;
+  int repeat = 1;
+  bool reuse = false;
+  std::vector<std::uint64_t> sizes_mb;
+  for (int i = 1; i < argc; i++) {
+    const std::string argument = argv[i];
+    if (argument == "--dir" && i + 1 < argc) {
+      directory = argv[++i];
+    } else if (argument == "--threads" && i + 1 < argc) {
+      thread_count = static_cast<unsigned>(std::atoi(argv[++i]));
+    } else if (argument == "--repeat" && i + 1 < argc) {
+      repeat = std::max(1, std::atoi(argv[++i]));
+    } else if (argument == "--reuse") {
+      reuse = true;
+    } else {
+      sizes_mb.push_back(std::strtoull(argv[i], nullptr, 10));
+    }
+  }
+  if (sizes_mb.empty()) {
+    sizes_mb = {1, 16, 128};
+  }
+  if (directory.back() != '/' && directory.back() != '\\') {
+    directory += '/';
+  }
+
+  // Material switches draw from the shared library; the per-size MTL files
+  // only measure MTLParser.
+  const std::size_t material_count = 256;
+  const std::string library_name = "bench_materials.mtl";
+  ObjGenerator generator;
+  ObjGenerator::Stats stats;
+  if (!FileExists(directory + library_name) &&
+      generator.WriteMtl(directory + library_name, material_count, stats) !=
+          0) {
+    std::cerr << "Failed to write " << directory + library_name << ".\n";
+    return 1;
+  }
+
+  std::cout << "threads " << thread_count << ", best of " << repeat
+            << (reuse ? ", reusing parsers" : "") << "\n";
+  for (std::uint64_t size_mb : sizes_mb) {
+    const std::uint64_t target_bytes = size_mb * 1024 * 1024;
+    std::vector<std::string> batch_paths;
+    std::uint64_t batch_bytes = 0;
+    std::uint64_t batch_faces = 0;
+    for (std::size_t m = 0; m < ObjGenerator::kMixCount; m++) {
+      const ObjMix mix = static_cast<ObjMix>(m);
+      const std::string name = std::string(ObjGenerator::MixName(mix)) + "_" +
+                               std::to_string(size_mb) + "mb.obj";
+      const std::string path = directory + "bench_" + name;
+      if (!FileExists(path) &&
+          generator.WriteObj(path, mix, target_bytes, library_name,
+                             material_count, stats) != 0) {
+        std::cerr << "Failed to write " << path << ".\n";
+        return 1;
+      }
+      OBJParser reused_parser;
+      Measurement measurement = Measure(repeat, [&] {
+        OBJParser fresh_parser;
+        OBJParser& parser = reuse ? reused_parser : fresh_parser;
+        OBJParser::ParseOptions options;
+        options.thread_count = thread_count;
+        options.reuse_capacity = reuse;
+        parser.set_parse_options(options);
+        return parser.Parse(path);
+      });
+      MappedFile file;
+      std::uint64_t bytes = file.Open(path) == 0 ? file.size() : 0;
+      const std::uint64_t faces = CountFaces(path);
+      PrintRow(name, bytes, faces, "faces", measurement);
+      failure_count += CheckParseModes(name, path, thread_count);
+      batch_paths.push_back(path);
+      batch_bytes += bytes;
+      batch_faces += faces;
+    }
+
+    BatchLoader loader(thread_count);
+    Measurement batch_measurement = Measure(repeat, [&] {
+      loader.material_cache().Clear();
+      int status = 0;
+      loader.Load(batch_paths, &status);
+      return status;
+    });
+    PrintRow("batch_" + std::to_string(size_mb) + "mb", batch_bytes,
+             batch_faces, "faces", batch_measurement);
+
+    Measurement stream_measurement = Measure(repeat, [&] {
+      std::ifstream stream(batch_paths.front(), std::ios::binary);
+      OBJParser parser;
+      OBJParser::ParseOptions options;
+      options.thread_count = thread_count;
+      parser.set_parse_options(options);
+      return parser.Parse(stream);
+    });
+    MappedFile stream_file;
+    PrintRow("stream_" + std::to_string(size_mb) + "mb",
+             stream_file.Open(batch_paths.front()) == 0 ? stream_file.size()
+                                                        : 0,
+             CountFaces(batch_paths.front()), "faces", stream_measurement);
+
+    OBJParser::PartIndex index;
+    Measurement index_measurement = Measure(repeat, [&] {
+      OBJParser parser;
+      return parser.IndexFile(batch_paths.front(), index);
+    });
+    PrintRow("index_" + std::to_string(size_mb) + "mb", stream_file.size(),
+             index.parts.size(), "parts", index_measurement);
+    const std::vector<std::size_t> parts =
+        index.parts.empty()
+            ? std::vector<std::size_t>()
+            : index.Find(index.parts[index.parts.size() / 2].sub_object_name);
+    std::uint64_t part_faces = 0;
+    Measurement part_measurement = Measure(repeat, [&] {
+      OBJParser parser;
+      OBJParser::ParseOptions options;
+      options.triangulate = true;
+      parser.set_parse_options(options);
+      const int result = parser.ParseParts(batch_paths.front(), index, parts);
+      part_faces = 0;
+      for (const OBJParser::SubObject& sub_object : parser.sub_objects()) {
+        for (const OBJParser::MeshGroup& mesh_group : sub_object.mesh_groups) {
+          for (const OBJParser::IndexGroup& index_group :
+               mesh_group.index_groups) {
+            part_faces += index_group.index_buffer_.size() / 3;
+          }
+        }
+      }
+      return result;
+    });
+    PrintRow("part_" + std::to_string(size_mb) + "mb", stream_file.size(),
+             part_faces, "faces", part_measurement);
+
+    // About 300 bytes per material.
+    const std::size_t mtl_material_count =
+        std::max<std::size_t>(1, target_bytes / 300);
+    const std::string name = "materials_" + std::to_string(size_mb) + "mb.mtl";
+    const std::string path = directory + "bench_" + name;
+    if (!FileExists(path) &&
+        generator.WriteMtl(path, mtl_material_count, stats) != 0) {
+      std::cerr << "Failed to write " << path << ".\n";
+      return 1;
+    }
+    MTLParser reused_parser;
+    reused_parser.set_reuse_capacity(reuse);
+    Measurement measurement = Measure(repeat, [&] {
+      MTLParser fresh_parser;
+      MTLParser& parser = reuse ? reused_parser : fresh_parser;
+      parser.Clear();
+      return parser.Parse(path);
+    });
+    MappedFile file;
+    std::uint64_t bytes = file.Open(path) == 0 ? file.size() : 0;
+    PrintRow(name, bytes, mtl_material_count, "materials", measurement);
+  }
+  return failure_count == 0 ? 0 : 1;
+}
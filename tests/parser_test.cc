@@ -0,0 +1,1263 @@
+// Behavioural tests of OBJParser and the stages after it, on the fixtures
+// in tests/data and on files from tests/obj_generator.h.
+//
+//   g++ -std=c++17 -O2 -pthread -I. tests/parser_test.cc -o parser_test
+//   ./parser_test DATA_DIR SCRATCH_DIR
+//
+// ctest runs it on tests/data with a scratch directory in the build tree.
+// Every failed expectation is printed with its line, and the exit status
+// is nonzero if any failed.
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <utime.h>
+#ifdef OBJ_PARSER_ZLIB
+#include <zlib.h>
+#endif
+#ifdef OBJ_PARSER_ZSTD
+#include <zstd.h>
+#endif
+
+#include "include/batch_loader.h"
+#include "include/obj_bvh.h"
+#include "include/obj_lods.h"
+#include "include/obj_meshlets.h"
+#include "include/obj_normals.h"
+#include "include/obj_parser.h"
+#include "include/obj_vertex_cache.h"
+#include "tests/mesh_compare.h"
+#include "tests/obj_generator.h"
+
+namespace {
+
+int failure_count = 0;
+
+#define EXPECT(condition)                                                \
+  do {                                                                   \
+    if (!(condition)) {                                                  \
+      std::cerr << __FILE__ << ":" << __LINE__ << ": Failed: " #condition \
+                << "\n";                                                 \
+      failure_count++;                                                   \
+    }                                                                    \
+  } while (0)
+
+using Vector3 = std::array<REAL, 3>;
+
+struct Paths {
+  std::string data;
+  std::string scratch;
+};
+
+Vector3 Subtract(const Vector3& a, const Vector3& b) {
+  return {a[0] - b[0], a[1] - b[1], a[2] - b[2]};
+}
+
+Vector3 Cross(const Vector3& a, const Vector3& b) {
+  return {a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2],
+          a[0] * b[1] - a[1] * b[0]};
+}
+
+REAL Dot(const Vector3& a, const Vector3& b) {
+  return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+REAL Length(const Vector3& a) { return std::sqrt(Dot(a, a)); }
+
+Vector3 Position(const OBJParser::Mesh& mesh, INTEGER vertex) {
+  const std::array<REAL, 4>& p = mesh.vertex_buffer[vertex].position;
+  return {p[0], p[1], p[2]};
+}
+
+bool Near(REAL a, REAL b, REAL tolerance = 1e-4f) {
+  return std::fabs(a - b) <= tolerance;
+}
+
+int Parse(const std::string& path, const OBJParser::ParseOptions& options,
+          OBJParser::Mesh& mesh) {
+  OBJParser parser;
+  parser.set_parse_options(options);
+  const int result = parser.Parse(path);
+  mesh = parser.Release();
+  return result;
+}
+
+// Face corners of one index group with their attributes, independent of how
+// vertices are numbered.
+struct GroupCorners {
+  std::string sub_object_name;
+  std::string mesh_group_name;
+  std::string mtl_name;
+  bool is_smooth_shading = true;
+  std::vector<OBJParser::Vertex> corners;
+
+  bool operator==(const GroupCorners& rhs) const {
+    return sub_object_name == rhs.sub_object_name &&
+           mesh_group_name == rhs.mesh_group_name &&
+           mtl_name == rhs.mtl_name &&
+           is_smooth_shading == rhs.is_smooth_shading &&
+           corners == rhs.corners;
+  }
+};
+
+// Corners of the index groups of mesh, or of those in the sub-objects named
+// sub_object_name when that is given. Empty groups are left out.
+std::vector<GroupCorners> Corners(const OBJParser::Mesh& mesh,
+                                  const std::string& sub_object_name = "") {
+  std::vector<GroupCorners> groups;
+  for (const OBJParser::SubObject& sub_object : mesh.sub_objects) {
+    if (!sub_object_name.empty() &&
+        sub_object.sub_object_name != sub_object_name) {
+      continue;
+    }
+    for (const OBJParser::MeshGroup& mesh_group : sub_object.mesh_groups) {
+      for (const OBJParser::IndexGroup& index_group :
+           mesh_group.index_groups) {
+        if (index_group.index_buffer_.empty()) {
+          continue;
+        }
+        GroupCorners group;
+        group.sub_object_name = sub_object.sub_object_name;
+        group.mesh_group_name = mesh_group.mesh_group_name;
+        group.mtl_name = index_group.mtl_name;
+        group.is_smooth_shading = index_group.is_smooth_shading;
+        for (INTEGER vertex : index_group.index_buffer_) {
+          group.corners.push_back(mesh.vertex_buffer[vertex]);
+        }
+        groups.push_back(std::move(group));
+      }
+    }
+  }
+  return groups;
+}
+
+std::size_t FaceCornerCount(const OBJParser::Mesh& mesh) {
+  std::size_t count = 0;
+  for (const OBJParser::IndexGroup* index_group :
+       OBJParser::IndexGroups(mesh.sub_objects)) {
+    count += index_group->index_buffer_.size();
+  }
+  return count;
+}
+
+int WriteGenerated(const Paths& paths, const std::string& name, ObjMix mix,
+                   std::uint64_t bytes, std::string& path) {
+  path = paths.scratch + "/" + name;
+  ObjGenerator generator;
+  ObjGenerator::Stats stats;
+  return generator.WriteObj(path, mix, bytes, "generated.mtl", 8, stats);
+}
+
+void TestThreadedParseMatchesSerial(const Paths& paths) {
+  const ObjMix mixes[] = {ObjMix::kFull, ObjMix::kPolygons};
+  for (ObjMix mix : mixes) {
+    std::string path;
+    EXPECT(WriteGenerated(paths, std::string(ObjGenerator::MixName(mix)) +
+                                     ".obj",
+                          mix, 3 << 20, path) == 0);
+    OBJParser::ParseOptions options;
+    options.triangulate = mix == ObjMix::kPolygons;
+    OBJParser::Mesh serial;
+    EXPECT(Parse(path, options, serial) == 0);
+    EXPECT(FaceCornerCount(serial) > 0);
+    for (unsigned thread_count : {2u, 4u}) {
+      options.thread_count = thread_count;
+      OBJParser::Mesh threaded;
+      EXPECT(Parse(path, options, threaded) == 0);
+      EXPECT(SameMesh(serial, threaded));
+    }
+  }
+}
+
+void TestDeferredDedup(const Paths& paths) {
+  std::string path;
+  EXPECT(WriteGenerated(paths, "shared_vertices.obj", ObjMix::kSharedVertices,
+                        1 << 20, path) == 0);
+  OBJParser::ParseOptions options;
+  OBJParser::Mesh inline_dedup;
+  EXPECT(Parse(path, options, inline_dedup) == 0);
+  // Every grid vertex is shared, so deduplication must have merged corners.
+  EXPECT(inline_dedup.vertex_buffer.size() < FaceCornerCount(inline_dedup));
+
+  options.deferred_dedup = true;
+  options.thread_count = 4;
+  OBJParser::Mesh first_occurrence;
+  EXPECT(Parse(path, options, first_occurrence) == 0);
+  EXPECT(SameMesh(inline_dedup, first_occurrence));
+
+  options.first_occurrence_order = false;
+  OBJParser::Mesh shard_order;
+  EXPECT(Parse(path, options, shard_order) == 0);
+  EXPECT(shard_order.vertex_buffer.size() ==
+         inline_dedup.vertex_buffer.size());
+  EXPECT(Corners(shard_order) == Corners(inline_dedup));
+}
+
+// Whether planar holds vertices with the components the planar layout
+// keeps.
+bool SamePlanarVertices(const OBJParser::PlanarVertexBuffer& planar,
+                        const std::vector<OBJParser::Vertex>& vertices) {
+  if (planar.vertex_count != vertices.size()) {
+    return false;
+  }
+  for (std::size_t i = 0; i < vertices.size(); i++) {
+    const OBJParser::Vertex& vertex = vertices[i];
+    for (std::size_t c = 0; c < planar.position_components; c++) {
+      if (planar.positions[i * planar.position_components + c] !=
+          vertex.position[c]) {
+        return false;
+      }
+    }
+    for (std::size_t c = 0; c < planar.texture_coordinate_components; c++) {
+      if (planar.texture_coordinates
+              [i * planar.texture_coordinate_components + c] !=
+          vertex.texture_coordinate[c]) {
+        return false;
+      }
+    }
+    for (std::size_t c = 0; c < planar.normal_components; c++) {
+      if (planar.normals[i * planar.normal_components + c] !=
+          vertex.normal[c]) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+void TestPlanarLayout(const Paths& paths) {
+  struct {
+    const char* name;
+    std::size_t texture_coordinate_components;
+    std::size_t normal_components;
+  } cases[] = {{"parts.obj", 2, 3}, {"polygons.obj", 0, 0}};
+  for (const auto& c : cases) {
+    const std::string path = paths.data + "/" + c.name;
+    for (bool deferred_dedup : {false, true}) {
+      OBJParser::ParseOptions options;
+      options.deferred_dedup = deferred_dedup;
+      options.triangulate = true;
+      OBJParser::Mesh interleaved;
+      EXPECT(Parse(path, options, interleaved) == 0);
+      options.vertex_layout = OBJParser::VertexLayout::kPlanar;
+      options.keep_position_w = deferred_dedup;
+      OBJParser::Mesh planar;
+      EXPECT(Parse(path, options, planar) == 0);
+      const OBJParser::PlanarVertexBuffer& streams =
+          planar.planar_vertex_buffer;
+      EXPECT(planar.vertex_buffer.empty());
+      EXPECT(streams.position_components == (deferred_dedup ? 4u : 3u));
+      EXPECT(streams.texture_coordinate_components ==
+             c.texture_coordinate_components);
+      EXPECT(streams.normal_components == c.normal_components);
+      EXPECT(SamePlanarVertices(streams, interleaved.vertex_buffer));
+      // Apart from the vertex streams both layouts give the same mesh.
+      planar.vertex_buffer = interleaved.vertex_buffer;
+      EXPECT(SameMesh(interleaved, planar));
+    }
+  }
+}
+
+void TestParsePartsMatchesFullParse(const Paths& paths) {
+  const std::string path = paths.data + "/parts.obj";
+  OBJParser::Mesh full;
+  EXPECT(Parse(path, OBJParser::ParseOptions(), full) == 0);
+  EXPECT(full.sub_objects.size() == 3);
+
+  OBJParser indexer;
+  OBJParser::PartIndex index;
+  EXPECT(indexer.IndexFile(path, index) == 0);
+  EXPECT(index.mtl_name == "parts.mtl");
+  for (const char* name : {"First", "Second", "Third"}) {
+    const std::vector<std::size_t> parts = index.Find(name);
+    EXPECT(!parts.empty());
+    OBJParser parser;
+    EXPECT(parser.ParseParts(path, index, parts) == 0);
+    OBJParser::Mesh part = parser.Release();
+    EXPECT(part.sub_objects.size() == 1);
+    EXPECT(!Corners(part).empty());
+    EXPECT(Corners(part) == Corners(full, name));
+  }
+
+  // Several parts at once, given out of order.
+  std::vector<std::size_t> parts = index.Find("Third");
+  const std::vector<std::size_t> first = index.Find("First");
+  parts.insert(parts.end(), first.begin(), first.end());
+  OBJParser parser;
+  EXPECT(parser.ParseParts(path, index, parts) == 0);
+  std::vector<GroupCorners> expected = Corners(full, "First");
+  const std::vector<GroupCorners> third = Corners(full, "Third");
+  expected.insert(expected.end(), third.begin(), third.end());
+  EXPECT(Corners(parser.Release()) == expected);
+}
+
+int WriteText(const std::string& path, const std::string& text) {
+  std::ofstream output(path, std::ios::binary | std::ios::trunc);
+  output << text;
+  return output.good() ? 0 : 1;
+}
+
+std::string ReadText(const std::string& path) {
+  std::ifstream input(path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(input),
+                     std::istreambuf_iterator<char>());
+}
+
+// Overwrites the bytes of value at offset in the file at path.
+template <typename T>
+int PatchFile(const std::string& path, std::ptrdiff_t offset, T value) {
+  std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+  file.seekp(offset);
+  file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+  return file.good() ? 0 : 1;
+}
+
+int SetModificationTime(const std::string& path, std::time_t time) {
+  utimbuf times;
+  times.actime = time;
+  times.modtime = time;
+  return utime(path.c_str(), &times);
+}
+
+void TestCacheRoundTrip(const Paths& paths) {
+  // The source is copied so that its content and time can be changed.
+  const std::string path = paths.scratch + "/cached.obj";
+  EXPECT(WriteText(path, ReadText(paths.data + "/parts.obj")) == 0);
+  EXPECT(WriteText(paths.scratch + "/parts.mtl",
+                   ReadText(paths.data + "/parts.mtl")) == 0);
+  OBJParser::ParseOptions options;
+  options.cache_directory = paths.scratch + "/cache";
+  options.load_materials = true;
+  mkdir(options.cache_directory.c_str(), 0755);
+  OBJParser parser;
+  parser.set_parse_options(options);
+  const std::string cache_path = parser.MeshCachePath(path);
+  std::remove(cache_path.c_str());
+
+  OBJParser::ParseOptions uncached_options = options;
+  uncached_options.cache_directory.clear();
+  OBJParser::Mesh parsed;
+  EXPECT(Parse(path, uncached_options, parsed) == 0);
+  EXPECT(parsed.materials.size() == 2);
+
+  EXPECT(parser.Parse(path) == 0);
+  EXPECT(parser.cached_mesh() == nullptr);
+  EXPECT(BlockReader::IsRegularFile(cache_path));
+  EXPECT(SameMesh(parsed, parser.Release()));
+
+  // The second parse reads the mesh through the mapped cache.
+  EXPECT(parser.Parse(path) == 0);
+  std::shared_ptr<const OBJParser::MeshView> view = parser.cached_mesh();
+  EXPECT(view != nullptr);
+  EXPECT(view->vertex_buffer().size == parsed.vertex_buffer.size());
+  EXPECT(parser.materials().size() == 2);
+  EXPECT(SameMesh(parsed, parser.Release()));
+
+  // Other options are cached under another name.
+  OBJParser triangulating;
+  OBJParser::ParseOptions triangulating_options = options;
+  triangulating_options.triangulate = true;
+  triangulating.set_parse_options(triangulating_options);
+  EXPECT(triangulating.MeshCachePath(path) != cache_path);
+
+  // A cache is used as is while its source keeps size and time...
+  const char* cache_data = view->reader().data();
+  const std::ptrdiff_t x_offset =
+      reinterpret_cast<const char*>(&view->vertex_buffer()[0].position[0]) -
+      cache_data;
+  const std::ptrdiff_t index_offset =
+      reinterpret_cast<const char*>(
+          view->index_buffer(view->index_groups()[0]).data) -
+      cache_data;
+  view.reset();
+  EXPECT(PatchFile(cache_path, x_offset, REAL(42)) == 0);
+  EXPECT(parser.Parse(path) == 0);
+  EXPECT(parser.cached_mesh() != nullptr);
+  EXPECT(parser.vertex_buffer()[0].position[0] == 42);
+
+  // ...or, once its time changed, its content hash.
+  const std::time_t time = 1000000000;
+  EXPECT(SetModificationTime(path, time) == 0);
+  EXPECT(parser.Parse(path) == 0);
+  EXPECT(parser.cached_mesh() != nullptr);
+  EXPECT(parser.vertex_buffer()[0].position[0] == 42);
+
+  // The new time is recorded, so a change that keeps both size and time
+  // goes unnoticed since the source is not hashed again.
+  std::string text = ReadText(path);
+  text.replace(text.find("v 0 0 0"), 7, "v 9 0 0");
+  EXPECT(WriteText(path, text) == 0);
+  EXPECT(SetModificationTime(path, time) == 0);
+  EXPECT(parser.Parse(path) == 0);
+  EXPECT(parser.cached_mesh() != nullptr);
+  EXPECT(parser.vertex_buffer()[0].position[0] == 42);
+
+  // Another time and content parse the file again.
+  EXPECT(SetModificationTime(path, time + 1) == 0);
+  EXPECT(Parse(path, uncached_options, parsed) == 0);
+  EXPECT(parser.Parse(path) == 0);
+  EXPECT(parser.cached_mesh() == nullptr);
+  EXPECT(SameMesh(parsed, parser.Release()));
+
+  // So does an index that points past the vertices.
+  EXPECT(PatchFile(cache_path, index_offset,
+                   static_cast<INTEGER>(parsed.vertex_buffer.size())) == 0);
+  EXPECT(parser.Parse(path) == 0);
+  EXPECT(parser.cached_mesh() == nullptr);
+  EXPECT(SameMesh(parsed, parser.Release()));
+
+  // The planar layout is cached too, under its own name.
+  OBJParser planar_parser;
+  OBJParser::ParseOptions planar_options = options;
+  planar_options.vertex_layout = OBJParser::VertexLayout::kPlanar;
+  planar_parser.set_parse_options(planar_options);
+  EXPECT(planar_parser.MeshCachePath(path) != cache_path);
+  std::remove(planar_parser.MeshCachePath(path).c_str());
+  EXPECT(planar_parser.Parse(path) == 0);
+  const OBJParser::Mesh planar = planar_parser.Release();
+  EXPECT(planar_parser.Parse(path) == 0);
+  EXPECT(planar_parser.cached_mesh() != nullptr);
+  EXPECT(planar_parser.planar_vertex_buffer().normals ==
+         planar.planar_vertex_buffer.normals);
+  EXPECT(SameMesh(planar, planar_parser.Release()));
+
+  // BatchLoader hands out cache hits as views.
+  BatchLoader loader(1);
+  loader.set_parse_options(options);
+  std::vector<BatchLoader::Result> results = loader.Load({path});
+  EXPECT(results[0].status == 0);
+  EXPECT(results[0].cached_mesh != nullptr);
+  EXPECT(results[0].mesh.material_names == parsed.material_names);
+  EXPECT(results[0].mesh.materials.size() == 2);
+}
+
+// Files whose faces, g, s or usemtl records come before the records that
+// would open their group, with the sub-object and mesh group the face lands
+// in.
+struct LeadingRecordsCase {
+  const char* records;
+  const char* sub_object_name;
+  const char* mesh_group_name;
+  const char* mtl_name;
+  bool is_smooth_shading;
+};
+
+constexpr LeadingRecordsCase kLeadingRecordsCases[] = {
+    {"f 1 2 3\n", "Unnamed", "Unnamed", "", true},
+    {"g Group\nf 1 2 3\n", "Unnamed", "Group", "", true},
+    {"s off\nf 1 2 3\n", "Unnamed", "Unnamed", "", false},
+    {"usemtl Red\nf 1 2 3\n", "Unnamed", "Unnamed", "Red", true},
+    {"o Object\nf 1 2 3\n", "Object", "Unnamed", "", true},
+    {"o Object\ns off\nf 1 2 3\n", "Object", "Unnamed", "", false},
+};
+
+int ParsePipe(const std::string& text, OBJParser::Mesh& mesh) {
+  int fds[2];
+  if (pipe(fds) != 0) {
+    return 1;
+  }
+  std::thread writer([&text, fd = fds[1]] {
+    for (std::size_t written = 0; written < text.size();) {
+      const ssize_t n = write(fd, text.data() + written, text.size() - written);
+      if (n <= 0) {
+        break;
+      }
+      written += static_cast<std::size_t>(n);
+    }
+    close(fd);
+  });
+  OBJParser parser;
+  const int result = parser.Parse(fds[0]);
+  writer.join();
+  close(fds[0]);
+  mesh = parser.Release();
+  return result;
+}
+
+void TestRecordsBeforeAnyGroup(const Paths& paths) {
+  const std::string positions = "v 0 0 0\nv 1 0 0\nv 0 1 0\n";
+  // Pushes the records into the last chunk of a threaded parse.
+  std::string padding;
+  while (padding.size() < (3 << 20)) {
+    padding += "# padding\n";
+  }
+  for (const LeadingRecordsCase& test_case : kLeadingRecordsCases) {
+    const std::string text = positions + test_case.records;
+    const std::string path = paths.scratch + "/leading.obj";
+    EXPECT(WriteText(path, text) == 0);
+    OBJParser::Mesh serial;
+    EXPECT(Parse(path, OBJParser::ParseOptions(), serial) == 0);
+    const std::vector<GroupCorners> corners = Corners(serial);
+    EXPECT(corners.size() == 1);
+    if (corners.size() != 1) {
+      std::cerr << "  records: " << test_case.records;
+      continue;
+    }
+    EXPECT(corners[0].sub_object_name == test_case.sub_object_name);
+    EXPECT(corners[0].mesh_group_name == test_case.mesh_group_name);
+    EXPECT(corners[0].mtl_name == test_case.mtl_name);
+    EXPECT(corners[0].is_smooth_shading == test_case.is_smooth_shading);
+    EXPECT(corners[0].corners.size() == 3);
+
+    std::istringstream stream(text);
+    OBJParser stream_parser;
+    EXPECT(stream_parser.Parse(stream) == 0);
+    EXPECT(SameMesh(serial, stream_parser.Release()));
+    OBJParser::Mesh piped;
+    EXPECT(ParsePipe(text, piped) == 0);
+    EXPECT(SameMesh(serial, piped));
+
+    OBJParser indexer;
+    OBJParser::PartIndex index;
+    EXPECT(indexer.IndexFile(path, index) == 0);
+    std::vector<std::size_t> parts(index.parts.size());
+    for (std::size_t i = 0; i < parts.size(); i++) {
+      parts[i] = i;
+    }
+    OBJParser part_parser;
+    EXPECT(part_parser.ParseParts(path, index, parts) == 0);
+    EXPECT(Corners(part_parser.Release()) == corners);
+
+    const std::string padded_path = paths.scratch + "/leading_padded.obj";
+    EXPECT(WriteText(padded_path, padding + text) == 0);
+    OBJParser::ParseOptions options;
+    OBJParser::Mesh padded;
+    EXPECT(Parse(padded_path, options, padded) == 0);
+    EXPECT(SameMesh(serial, padded));
+    options.thread_count = 4;
+    OBJParser::Mesh threaded;
+    EXPECT(Parse(padded_path, options, threaded) == 0);
+    EXPECT(SameMesh(serial, threaded));
+    options.deferred_dedup = true;
+    OBJParser::Mesh deferred;
+    EXPECT(Parse(padded_path, options, deferred) == 0);
+    EXPECT(SameMesh(serial, deferred));
+  }
+}
+
+#ifdef OBJ_PARSER_ZLIB
+// text as one gzip member.
+std::string Gzip(const std::string& text) {
+  z_stream stream = z_stream();
+  std::string compressed;
+  if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+                   Z_DEFAULT_STRATEGY) != Z_OK) {
+    return compressed;
+  }
+  compressed.resize(deflateBound(&stream, static_cast<uLong>(text.size())));
+  stream.next_in =
+      reinterpret_cast<Bytef*>(const_cast<char*>(text.data()));
+  stream.avail_in = static_cast<uInt>(text.size());
+  stream.next_out = reinterpret_cast<Bytef*>(&compressed[0]);
+  stream.avail_out = static_cast<uInt>(compressed.size());
+  const int result = deflate(&stream, Z_FINISH);
+  compressed.resize(result == Z_STREAM_END ? stream.total_out : 0);
+  deflateEnd(&stream);
+  return compressed;
+}
+#endif
+
+#ifdef OBJ_PARSER_ZSTD
+// text as one zstd frame.
+std::string Zstd(const std::string& text) {
+  std::string compressed(ZSTD_compressBound(text.size()), '\0');
+  const std::size_t size = ZSTD_compress(&compressed[0], compressed.size(),
+                                         text.data(), text.size(), 3);
+  compressed.resize(ZSTD_isError(size) ? 0 : size);
+  return compressed;
+}
+#endif
+
+void TestCompressedInput(const Paths& paths) {
+  std::string path;
+  EXPECT(WriteGenerated(paths, "compressed.obj", ObjMix::kFull, 2 << 20,
+                        path) == 0);
+  OBJParser::Mesh plain;
+  EXPECT(Parse(path, OBJParser::ParseOptions(), plain) == 0);
+  std::ifstream input(path, std::ios::binary);
+  std::ostringstream buffer;
+  buffer << input.rdbuf();
+  const std::string text = buffer.str();
+  // Compressed as two members or frames, which must decode as one text.
+  const std::size_t half = text.find('\n', text.size() / 2) + 1;
+
+  struct Case {
+    std::string suffix;
+    std::string data;
+    bool is_supported;
+  };
+  std::vector<Case> cases;
+#ifdef OBJ_PARSER_ZLIB
+  cases.push_back({".obj.gz", Gzip(text.substr(0, half)) +
+                                  Gzip(text.substr(half)),
+                   true});
+#else
+  cases.push_back({".obj.gz", "\x1f\x8b\x08", false});
+#endif
+#ifdef OBJ_PARSER_ZSTD
+  cases.push_back({".obj.zst", Zstd(text.substr(0, half)) +
+                                   Zstd(text.substr(half)),
+                   true});
+#else
+  cases.push_back({".obj.zst", "\x28\xb5\x2f\xfd", false});
+#endif
+  for (const Case& c : cases) {
+    const std::string compressed_path =
+        paths.scratch + "/compressed" + c.suffix;
+    EXPECT(WriteText(compressed_path, c.data) == 0);
+    OBJParser::Mesh mesh;
+    const int result = Parse(compressed_path, OBJParser::ParseOptions(), mesh);
+    if (!c.is_supported) {
+      // A missing decoder is told apart from a file that cannot be opened.
+      EXPECT(result == BlockReader::kUnsupportedCompression);
+      continue;
+    }
+    EXPECT(result == 0);
+    EXPECT(SameMesh(plain, mesh));
+    OBJParser::Mesh piped;
+    EXPECT(ParsePipe(c.data, piped) == 0);
+    EXPECT(SameMesh(plain, piped));
+    // Input that ends inside a member or frame fails.
+    EXPECT(WriteText(compressed_path, c.data.substr(0, c.data.size() - 16)) ==
+           0);
+    EXPECT(Parse(compressed_path, OBJParser::ParseOptions(), mesh) == 1);
+  }
+}
+
+// Corner count of every face in polygons.obj.
+constexpr std::size_t kPolygonFaceSizes[] = {4, 5, 6, 5, 5, 3, 2};
+
+void TestTriangulation(const Paths& paths) {
+  const std::string path = paths.data + "/polygons.obj";
+  OBJParser::ParseOptions options;
+  OBJParser::Mesh polygons;
+  EXPECT(Parse(path, options, polygons) == 0);
+  options.triangulate = true;
+  OBJParser::Mesh triangles;
+  EXPECT(Parse(path, options, triangles) == 0);
+
+  const std::vector<const OBJParser::IndexGroup*> polygon_groups =
+      OBJParser::IndexGroups(std::as_const(polygons.sub_objects));
+  const std::vector<const OBJParser::IndexGroup*> triangle_groups =
+      OBJParser::IndexGroups(std::as_const(triangles.sub_objects));
+  EXPECT(polygon_groups.size() == 1);
+  EXPECT(triangle_groups.size() == 1);
+  if (polygon_groups.size() != 1 || triangle_groups.size() != 1) {
+    return;
+  }
+  const std::vector<INTEGER>& corners = polygon_groups[0]->index_buffer_;
+  const std::vector<INTEGER>& indices = triangle_groups[0]->index_buffer_;
+  EXPECT(triangle_groups[0]->face_sizes.empty());
+
+  std::size_t corner_count = 0;
+  std::size_t triangle_count = 0;
+  for (std::size_t face_size : kPolygonFaceSizes) {
+    corner_count += face_size;
+    triangle_count += face_size < 3 ? 0 : face_size - 2;
+  }
+  EXPECT(corners.size() == corner_count);
+  // The two-corner face is dropped.
+  EXPECT(indices.size() == triangle_count * 3);
+  if (corners.size() != corner_count || indices.size() != triangle_count * 3) {
+    return;
+  }
+
+  std::size_t first_corner = 0;
+  std::size_t first_index = 0;
+  for (std::size_t face_size : kPolygonFaceSizes) {
+    // Newell's normal, whose length is twice the polygon's area.
+    std::vector<Vector3> face;
+    for (std::size_t c = 0; c < face_size; c++) {
+      face.push_back(Position(polygons, corners[first_corner + c]));
+    }
+    Vector3 normal = {0.f, 0.f, 0.f};
+    for (std::size_t c = 0; c < face_size; c++) {
+      const Vector3 cross = Cross(face[c], face[(c + 1) % face_size]);
+      for (std::size_t k = 0; k < 3; k++) {
+        normal[k] += cross[k];
+      }
+    }
+    const REAL area = Length(normal) / 2;
+    REAL triangle_area = 0.f;
+    for (std::size_t t = 0; face_size >= 3 && t < face_size - 2; t++) {
+      std::array<Vector3, 3> triangle;
+      for (std::size_t c = 0; c < 3; c++) {
+        triangle[c] = Position(triangles, indices[first_index + t * 3 + c]);
+        EXPECT(std::find(face.begin(), face.end(), triangle[c]) !=
+               face.end());
+      }
+      const Vector3 cross = Cross(Subtract(triangle[1], triangle[0]),
+                                  Subtract(triangle[2], triangle[0]));
+      // Triangles keep the winding of their polygon.
+      EXPECT(Dot(cross, normal) > 0.f);
+      triangle_area += Length(cross) / 2;
+    }
+    // So the triangles cover the polygon exactly once.
+    EXPECT(Near(triangle_area, area));
+    first_corner += face_size;
+    first_index += face_size < 3 ? 0 : (face_size - 2) * 3;
+  }
+}
+
+// Rewrites the narrowed groups of mesh as 32-bit indices and returns how
+// many there were.
+std::size_t WidenIndexBuffers(OBJParser::Mesh& mesh) {
+  std::size_t narrowed_count = 0;
+  for (OBJParser::IndexGroup* index_group :
+       OBJParser::IndexGroups(mesh.sub_objects)) {
+    if (index_group->index_buffer_16_.empty()) {
+      continue;
+    }
+    EXPECT(index_group->index_buffer_.empty());
+    for (std::uint16_t offset : index_group->index_buffer_16_) {
+      index_group->index_buffer_.push_back(index_group->base_vertex + offset);
+    }
+    index_group->index_buffer_16_.clear();
+    index_group->base_vertex = 0;
+    narrowed_count++;
+  }
+  return narrowed_count;
+}
+
+void TestNarrowIndices(const Paths& paths) {
+  std::string generated_path;
+  EXPECT(WriteGenerated(paths, "narrow.obj", ObjMix::kMaterialSwitches,
+                        256 << 10, generated_path) == 0);
+  // The second group reuses vertices below the ones it starts with.
+  const std::string reused_path = paths.scratch + "/narrow_reused.obj";
+  EXPECT(WriteText(reused_path,
+                   "v 0 0 0\nv 1 0 0\nv 0 1 0\nv 1 1 0\nv 2 1 0\n"
+                   "v 2 2 0\nusemtl a\nf 1 2 3\nusemtl b\nf 4 5 6\n"
+                   "f 1 2 3 4\n") == 0);
+  // One group whose vertices span more than 16 bits.
+  const std::string wide_path = paths.scratch + "/narrow_wide.obj";
+  const std::size_t wide_vertex_count = 70002;
+  std::string wide_text;
+  for (std::size_t i = 0; i < wide_vertex_count; i++) {
+    wide_text += "v " + std::to_string(i) + " 0 0\n";
+  }
+  for (std::size_t i = 1; i <= wide_vertex_count; i += 3) {
+    wide_text += "f " + std::to_string(i) + " " + std::to_string(i + 1) +
+                 " " + std::to_string(i + 2) + "\n";
+  }
+  EXPECT(WriteText(wide_path, wide_text) == 0);
+
+  for (bool deferred_dedup : {false, true}) {
+    for (bool triangulate : {false, true}) {
+      OBJParser::ParseOptions options;
+      options.deferred_dedup = deferred_dedup;
+      options.thread_count = deferred_dedup ? 4 : 1;
+      options.triangulate = triangulate;
+      for (const std::string& path : {generated_path, reused_path}) {
+        OBJParser::Mesh wide;
+        EXPECT(Parse(path, options, wide) == 0);
+        OBJParser::ParseOptions narrow_options = options;
+        narrow_options.narrow_indices = true;
+        OBJParser::Mesh narrow;
+        EXPECT(Parse(path, narrow_options, narrow) == 0);
+        std::size_t face_group_count = 0;
+        for (const OBJParser::IndexGroup* index_group :
+             OBJParser::IndexGroups(std::as_const(wide.sub_objects))) {
+          face_group_count += !index_group->index_buffer_.empty();
+        }
+        EXPECT(face_group_count > 0);
+        EXPECT(WidenIndexBuffers(narrow) == face_group_count);
+        EXPECT(SameMesh(wide, narrow));
+      }
+
+      options.narrow_indices = true;
+      OBJParser::Mesh mesh;
+      EXPECT(Parse(wide_path, options, mesh) == 0);
+      const std::vector<const OBJParser::IndexGroup*> index_groups =
+          OBJParser::IndexGroups(std::as_const(mesh.sub_objects));
+      EXPECT(index_groups.size() == 1);
+      if (index_groups.size() == 1) {
+        EXPECT(index_groups[0]->index_buffer_16_.empty());
+        EXPECT(index_groups[0]->index_buffer_.size() == wide_vertex_count);
+      }
+    }
+  }
+
+  // Narrowed groups go through the mesh cache as they are.
+  OBJParser::ParseOptions options;
+  options.narrow_indices = true;
+  OBJParser::Mesh expected;
+  EXPECT(Parse(generated_path, options, expected) == 0);
+  options.cache_directory = paths.scratch + "/cache";
+  mkdir(options.cache_directory.c_str(), 0755);
+  OBJParser parser;
+  parser.set_parse_options(options);
+  std::remove(parser.MeshCachePath(generated_path).c_str());
+  EXPECT(parser.Parse(generated_path) == 0);
+  EXPECT(parser.Parse(generated_path) == 0);
+  EXPECT(parser.cached_mesh() != nullptr);
+  EXPECT(SameMesh(expected, parser.Release()));
+  EXPECT(WidenIndexBuffers(expected) > 0);
+}
+
+void TestNormalsAndTangents(const Paths& paths) {
+  OBJParser::ParseOptions options;
+  options.triangulate = true;
+  OBJParser::Mesh mesh;
+  EXPECT(Parse(paths.data + "/cube.obj", options, mesh) == 0);
+  ThreadPool pool(2);
+  // Index buffers that are not triangle lists are refused untouched.
+  OBJParser::Mesh polygons = mesh;
+  OBJParser::IndexGroups(polygons.sub_objects)
+      .front()
+      ->index_buffer_.pop_back();
+  const OBJParser::Mesh unchanged = polygons;
+  EXPECT(GenerateNormals(polygons, NormalWeighting::kAngle, true, pool) == 1);
+  EXPECT(SameMesh(polygons, unchanged));
+
+  EXPECT(GenerateNormals(mesh, NormalWeighting::kAngle, true, pool) == 0);
+  EXPECT(mesh.tangents.size() == mesh.vertex_buffer.size());
+
+  std::size_t faceted_corners = 0;
+  std::size_t smooth_corners = 0;
+  for (const OBJParser::SubObject& sub_object : mesh.sub_objects) {
+    const bool is_faceted = sub_object.sub_object_name == "Faceted";
+    const Vector3 center = is_faceted ? Vector3{0.5f, 0.5f, 0.5f}
+                                      : Vector3{2.5f, 0.5f, 0.5f};
+    for (const OBJParser::MeshGroup& mesh_group : sub_object.mesh_groups) {
+      for (const OBJParser::IndexGroup& index_group :
+           mesh_group.index_groups) {
+        EXPECT(index_group.is_smooth_shading == !is_faceted);
+        const std::vector<INTEGER>& indices = index_group.index_buffer_;
+        for (std::size_t i = 0; i + 2 < indices.size(); i += 3) {
+          const Vector3 p0 = Position(mesh, indices[i]);
+          Vector3 face_normal =
+              Cross(Subtract(Position(mesh, indices[i + 1]), p0),
+                    Subtract(Position(mesh, indices[i + 2]), p0));
+          const REAL length = Length(face_normal);
+          for (REAL& x : face_normal) {
+            x /= length;
+          }
+          for (std::size_t c = 0; c < 3; c++) {
+            const INTEGER vertex = indices[i + c];
+            const Vector3& n = mesh.vertex_buffer[vertex].normal;
+            EXPECT(Near(Length(n), 1.f));
+            if (is_faceted) {
+              EXPECT(Near(Dot(n, face_normal), 1.f));
+              faceted_corners++;
+            } else {
+              // Three faces meet at right angles at every corner of the
+              // cube, so angle weights point the normal along the diagonal.
+              const Vector3 outward =
+                  Subtract(Position(mesh, vertex), center);
+              for (std::size_t k = 0; k < 3; k++) {
+                EXPECT(Near(n[k], outward[k] * 2 / std::sqrt(3.f)));
+              }
+              smooth_corners++;
+            }
+            if (mesh.vertex_buffer[vertex].texture_coordinate ==
+                OBJParser::kMissingAttribute) {
+              continue;
+            }
+            const std::array<REAL, 4>& tangent = mesh.tangents[vertex];
+            const Vector3 t = {tangent[0], tangent[1], tangent[2]};
+            EXPECT(Near(Length(t), 1.f));
+            EXPECT(Near(Dot(t, n), 0.f));
+            EXPECT(tangent[3] == 1.f || tangent[3] == -1.f);
+          }
+        }
+      }
+    }
+  }
+  EXPECT(faceted_corners == 36);
+  EXPECT(smooth_corners == 36);
+}
+
+// A triangulated generated mesh for the BVH and meshlet tests.
+OBJParser::Mesh GeneratedTriangles(const Paths& paths) {
+  std::string path;
+  EXPECT(WriteGenerated(paths, "polygons_small.obj", ObjMix::kPolygons,
+                        256 << 10, path) == 0);
+  OBJParser::ParseOptions options;
+  options.triangulate = true;
+  OBJParser::Mesh mesh;
+  EXPECT(Parse(path, options, mesh) == 0);
+  return mesh;
+}
+
+bool Contains(const BvhNode& outer, const std::array<float, 3>& min,
+              const std::array<float, 3>& max) {
+  for (std::size_t k = 0; k < 3; k++) {
+    if (min[k] < outer.bounds_min[k] || max[k] > outer.bounds_max[k]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void TestBvh(const OBJParser::Mesh& mesh) {
+  ThreadPool pool(2);
+  const std::vector<TriangleBvh> bvhs = BuildBvhs(mesh, pool);
+  const std::vector<const OBJParser::IndexGroup*> index_groups =
+      OBJParser::IndexGroups(mesh.sub_objects);
+  EXPECT(bvhs.size() == index_groups.size());
+  for (std::size_t g = 0; g < bvhs.size() && g < index_groups.size(); g++) {
+    const TriangleBvh& bvh = bvhs[g];
+    const std::vector<INTEGER>& indices = index_groups[g]->index_buffer_;
+    const std::size_t triangle_count = indices.size() / 3;
+    EXPECT(bvh.triangles().size() == triangle_count);
+    std::vector<std::uint32_t> sorted = bvh.triangles();
+    std::sort(sorted.begin(), sorted.end());
+    for (std::size_t t = 0; t < sorted.size(); t++) {
+      EXPECT(sorted[t] == t);
+    }
+    if (triangle_count == 0 || sorted.size() != triangle_count) {
+      continue;
+    }
+
+    std::size_t leaf_triangles = 0;
+    std::vector<std::uint32_t> stack = {0};
+    while (!stack.empty()) {
+      const BvhNode& node = bvh.node(stack.back());
+      stack.pop_back();
+      if (node.is_leaf()) {
+        EXPECT(node.first + node.count <= triangle_count);
+        for (std::uint32_t i = node.first;
+             i < node.first + node.count && i < triangle_count; i++) {
+          const std::uint32_t t = bvh.triangles()[i];
+          for (std::size_t c = 0; c < 3; c++) {
+            const Vector3 p = Position(mesh, indices[t * 3 + c]);
+            EXPECT(Contains(node, p, p));
+          }
+        }
+        leaf_triangles += node.count;
+        continue;
+      }
+      EXPECT(node.first % 2 == 0 && node.first >= 2);
+      EXPECT(node.first + 1 < bvh.node_count());
+      if (node.first < 2 || node.first + 1 >= bvh.node_count()) {
+        continue;
+      }
+      for (std::uint32_t child = node.first; child <= node.first + 1;
+           child++) {
+        EXPECT(Contains(node, bvh.node(child).bounds_min,
+                        bvh.node(child).bounds_max));
+        stack.push_back(child);
+      }
+    }
+    EXPECT(leaf_triangles == triangle_count);
+  }
+}
+
+// The triangle rotated to start at its smallest index, keeping its winding.
+std::array<INTEGER, 3> CanonicalTriangle(INTEGER a, INTEGER b, INTEGER c) {
+  if (b < a && b < c) {
+    return {b, c, a};
+  }
+  if (c < a && c < b) {
+    return {c, a, b};
+  }
+  return {a, b, c};
+}
+
+void TestMeshlets(const OBJParser::Mesh& mesh) {
+  constexpr std::size_t kMaxVertices = 64;
+  constexpr std::size_t kMaxTriangles = 124;
+  ThreadPool pool(2);
+  const std::vector<IndexGroupMeshlets> meshlets =
+      BuildMeshlets(mesh, kMaxVertices, kMaxTriangles, pool);
+  const std::vector<const OBJParser::IndexGroup*> index_groups =
+      OBJParser::IndexGroups(mesh.sub_objects);
+  EXPECT(meshlets.size() == index_groups.size());
+  for (std::size_t g = 0; g < meshlets.size() && g < index_groups.size();
+       g++) {
+    const IndexGroupMeshlets& group = meshlets[g];
+    const std::vector<INTEGER>& indices = index_groups[g]->index_buffer_;
+    std::vector<std::array<INTEGER, 3>> expected;
+    for (std::size_t i = 0; i + 2 < indices.size(); i += 3) {
+      expected.push_back(
+          CanonicalTriangle(indices[i], indices[i + 1], indices[i + 2]));
+    }
+    std::vector<std::array<INTEGER, 3>> rebuilt;
+    for (const Meshlet& meshlet : group.meshlets) {
+      EXPECT(meshlet.vertex_count > 0 && meshlet.vertex_count <= kMaxVertices);
+      EXPECT(meshlet.triangle_count > 0 &&
+             meshlet.triangle_count <= kMaxTriangles);
+      EXPECT(meshlet.vertex_offset + meshlet.vertex_count <=
+             group.vertices.size());
+      EXPECT((meshlet.triangle_offset + meshlet.triangle_count) * 3 <=
+             group.triangles.size());
+      if (meshlet.vertex_offset + meshlet.vertex_count >
+              group.vertices.size() ||
+          (meshlet.triangle_offset + meshlet.triangle_count) * 3 >
+              group.triangles.size()) {
+        continue;
+      }
+      for (std::uint32_t t = 0; t < meshlet.triangle_count; t++) {
+        std::array<INTEGER, 3> triangle;
+        for (std::size_t c = 0; c < 3; c++) {
+          const std::uint8_t local =
+              group.triangles[(meshlet.triangle_offset + t) * 3 + c];
+          EXPECT(local < meshlet.vertex_count);
+          triangle[c] = group.vertices[meshlet.vertex_offset +
+                                       std::min<std::uint32_t>(
+                                           local, meshlet.vertex_count - 1)];
+        }
+        rebuilt.push_back(
+            CanonicalTriangle(triangle[0], triangle[1], triangle[2]));
+      }
+    }
+    std::sort(expected.begin(), expected.end());
+    std::sort(rebuilt.begin(), rebuilt.end());
+    EXPECT(rebuilt == expected);
+  }
+}
+
+}  // namespace
+
+// Triangles of every index group, each rotated to start at its smallest
+// index and sorted, so that reordered triangle lists compare equal.
+std::vector<std::vector<std::array<INTEGER, 3>>> TriangleSets(
+    const OBJParser::Mesh& mesh) {
+  std::vector<std::vector<std::array<INTEGER, 3>>> sets;
+  for (const OBJParser::IndexGroup* index_group :
+       OBJParser::IndexGroups(mesh.sub_objects)) {
+    const std::vector<INTEGER>& indices = index_group->index_buffer_;
+    sets.emplace_back();
+    for (std::size_t i = 0; i + 2 < indices.size(); i += 3) {
+      sets.back().push_back(
+          CanonicalTriangle(indices[i], indices[i + 1], indices[i + 2]));
+    }
+    std::sort(sets.back().begin(), sets.back().end());
+  }
+  return sets;
+}
+
+// Triangulated quad grids, whose file order leaves room for the vertex
+// cache.
+OBJParser::Mesh GeneratedGrid(const Paths& paths) {
+  std::string path;
+  EXPECT(WriteGenerated(paths, "grid_small.obj", ObjMix::kSharedVertices,
+                        256 << 10, path) == 0);
+  OBJParser::ParseOptions options;
+  options.triangulate = true;
+  OBJParser::Mesh mesh;
+  EXPECT(Parse(path, options, mesh) == 0);
+  return mesh;
+}
+
+void TestVertexCache(OBJParser::Mesh mesh) {
+  ThreadPool pool(2);
+  VertexCacheReport report;
+  // Index buffers that are not triangle lists are refused untouched.
+  OBJParser::Mesh broken = mesh;
+  OBJParser::IndexGroups(broken.sub_objects)
+      .front()
+      ->index_buffer_.pop_back();
+  const OBJParser::Mesh unchanged = broken;
+  EXPECT(OptimizeVertexCache(broken, 16, pool, report) == 1);
+  EXPECT(OptimizeOverdraw(broken, 16, 1.05f, pool) == 1);
+  EXPECT(SameMesh(broken, unchanged));
+  OBJParser::IndexGroups(broken.sub_objects).front()->index_buffer_.back() =
+      static_cast<INTEGER>(broken.vertex_buffer.size());
+  const OBJParser::Mesh out_of_range = broken;
+  EXPECT(OptimizeVertexFetch(broken) == 1);
+  EXPECT(SameMesh(broken, out_of_range));
+
+  const auto triangles = TriangleSets(mesh);
+  EXPECT(OptimizeVertexCache(mesh, 16, pool, report) == 0);
+  EXPECT(TriangleSets(mesh) == triangles);
+  EXPECT(report.after.triangle_count == report.before.triangle_count);
+  EXPECT(report.after.acmr() < report.before.acmr());
+
+  // Sorting clusters keeps every triangle and its winding, and a threshold
+  // of 1 costs next to no cache misses.
+  OBJParser::Mesh sorted = mesh;
+  EXPECT(OptimizeOverdraw(sorted, 16, 1.0f, pool) == 0);
+  EXPECT(TriangleSets(sorted) == triangles);
+  VertexCacheOptimizer optimizer(16);
+  VertexCacheOptimizer::Stats sorted_stats;
+  for (const OBJParser::IndexGroup* index_group :
+       OBJParser::IndexGroups(sorted.sub_objects)) {
+    sorted_stats += optimizer.Measure(index_group->index_buffer_);
+  }
+  EXPECT(sorted_stats.acmr() <= report.after.acmr() * 1.05);
+  EXPECT(OptimizeOverdraw(mesh, 16, 1.05f, pool) == 0);
+  EXPECT(TriangleSets(mesh) == triangles);
+
+  // Of two patches facing +z, the upper one faces away from the center and
+  // is drawn first.
+  const std::vector<Vector3> points = {{0, 0, 0}, {1, 0, 0}, {0, 1, 0},
+                                       {0, 0, 1}, {1, 0, 1}, {0, 1, 1}};
+  std::vector<INTEGER> patches = {0, 1, 2, 3, 4, 5};
+  optimizer.OptimizeOverdraw(
+      patches, [&](INTEGER vertex) { return points[vertex]; }, 1.05f);
+  EXPECT((patches == std::vector<INTEGER>{3, 4, 5, 0, 1, 2}));
+
+  // Fetch order renumbers vertices by first use without moving corners.
+  const std::vector<GroupCorners> corners = Corners(mesh);
+  EXPECT(OptimizeVertexFetch(mesh) == 0);
+  EXPECT(Corners(mesh) == corners);
+  INTEGER next = 0;
+  for (const OBJParser::IndexGroup* index_group :
+       OBJParser::IndexGroups(mesh.sub_objects)) {
+    for (INTEGER index : index_group->index_buffer_) {
+      EXPECT(index <= next);
+      next = std::max<INTEGER>(next, index + 1);
+    }
+  }
+}
+
+// A flat grid with a UV seam down its middle column: the quads left of it
+// use texture coordinates with u below 1, the ones right of it u above 1.
+void TestLods(const Paths& paths) {
+  const int size = 16;
+  const int vertex_count = (size + 1) * (size + 1);
+  std::ostringstream text;
+  for (int side = 0; side < 2; side++) {
+    for (int y = 0; y <= size; y++) {
+      for (int x = 0; x <= size; x++) {
+        if (side == 0) {
+          text << "v " << x << " " << y << " 0\n";
+        }
+        text << "vt " << side + 0.5 * x / size << " " << 1.0 * y / size
+             << "\n";
+      }
+    }
+  }
+  for (int y = 0; y < size; y++) {
+    for (int x = 0; x < size; x++) {
+      const int offset = x < size / 2 ? 0 : vertex_count;
+      auto corner = [&](int cx, int cy) {
+        const int v = cy * (size + 1) + cx + 1;
+        return std::to_string(v) + "/" + std::to_string(v + offset);
+      };
+      text << "f " << corner(x, y) << " " << corner(x + 1, y) << " "
+           << corner(x + 1, y + 1) << "\n";
+      text << "f " << corner(x, y) << " " << corner(x + 1, y + 1) << " "
+           << corner(x, y + 1) << "\n";
+    }
+  }
+  const std::string path = paths.scratch + "/seam_grid.obj";
+  EXPECT(WriteText(path, text.str()) == 0);
+  OBJParser::Mesh mesh;
+  EXPECT(Parse(path, OBJParser::ParseOptions(), mesh) == 0);
+  EXPECT(mesh.vertex_buffer.size() ==
+         static_cast<std::size_t>(vertex_count + size + 1));
+
+  ThreadPool pool(2);
+  const std::vector<LodLevel> levels = {{0.5, 0.01}, {0.25, 0.01}};
+  const std::vector<SubObjectLods> lods = BuildLods(mesh, levels, pool);
+  std::vector<INTEGER> full;
+  std::vector<const std::vector<std::vector<INTEGER>>*> lod_groups;
+  for (std::size_t i = 0; i < lods.size(); i++) {
+    std::size_t g = 0;
+    for (const OBJParser::MeshGroup& mesh_group :
+         mesh.sub_objects[i].mesh_groups) {
+      for (const OBJParser::IndexGroup& index_group :
+           mesh_group.index_groups) {
+        if (!index_group.index_buffer_.empty()) {
+          full = index_group.index_buffer_;
+          lod_groups.push_back(&lods[i].index_buffers[g]);
+          EXPECT(lods[i].errors.size() == levels.size());
+        }
+        g++;
+      }
+    }
+  }
+  EXPECT(lod_groups.size() == 1);
+  if (lod_groups.size() != 1 || lod_groups[0]->size() != levels.size()) {
+    return;
+  }
+  std::size_t previous_count = full.size();
+  for (std::size_t level = 0; level < levels.size(); level++) {
+    const std::vector<INTEGER>& indices = (*lod_groups[0])[level];
+    EXPECT(indices.size() <= full.size() * levels[level].triangle_ratio);
+    EXPECT(indices.size() < previous_count);
+    previous_count = indices.size();
+    // No triangle mixes the two sides of the seam, and both sides still
+    // meet edge to edge: only the outer border has edges of one triangle.
+    std::vector<std::pair<Vector3, Vector3>> edges;
+    std::vector<Vector3> seam_positions;
+    for (std::size_t i = 0; i + 2 < indices.size(); i += 3) {
+      int left_count = 0;
+      for (std::size_t c = 0; c < 3; c++) {
+        const OBJParser::Vertex& vertex = mesh.vertex_buffer[indices[i + c]];
+        left_count += vertex.texture_coordinate[0] < 1;
+        const Vector3 a = Position(mesh, indices[i + c]);
+        const Vector3 b = Position(mesh, indices[i + (c + 1) % 3]);
+        edges.emplace_back(std::min(a, b), std::max(a, b));
+        if (a[0] == size / 2) {
+          seam_positions.push_back(a);
+        }
+      }
+      EXPECT(left_count == 0 || left_count == 3);
+    }
+    std::sort(edges.begin(), edges.end());
+    std::size_t open_edge_count = 0;
+    for (std::size_t i = 0; i < edges.size();) {
+      std::size_t j = i;
+      while (j < edges.size() && edges[j] == edges[i]) {
+        j++;
+      }
+      EXPECT(j - i <= 2);
+      open_edge_count += j - i == 1;
+      i = j;
+    }
+    EXPECT(open_edge_count == 4 * size);
+    // The seam itself was simplified, not just kept in place.
+    std::sort(seam_positions.begin(), seam_positions.end());
+    seam_positions.erase(
+        std::unique(seam_positions.begin(), seam_positions.end()),
+        seam_positions.end());
+    EXPECT(seam_positions.size() < static_cast<std::size_t>(size + 1));
+  }
+}
+
+int main(int argc, char** argv) {
+  Paths paths;
+  paths.data = argc > 1 ? argv[1] : "tests/data";
+  paths.scratch = argc > 2 ? argv[2] : "parser_test_scratch";
+  mkdir(paths.scratch.c_str(), 0755);
+
+  const std::pair<const char*, void (*)(const Paths&)> tests[] = {
+      {"ThreadedParseMatchesSerial", TestThreadedParseMatchesSerial},
+      {"DeferredDedup", TestDeferredDedup},
+      {"PlanarLayout", TestPlanarLayout},
+      {"ParsePartsMatchesFullParse", TestParsePartsMatchesFullParse},
+      {"CacheRoundTrip", TestCacheRoundTrip},
+      {"RecordsBeforeAnyGroup", TestRecordsBeforeAnyGroup},
+      {"CompressedInput", TestCompressedInput},
+      {"Triangulation", TestTriangulation},
+      {"NarrowIndices", TestNarrowIndices},
+      {"NormalsAndTangents", TestNormalsAndTangents},
+      {"Bvh", [](const Paths& p) { TestBvh(GeneratedTriangles(p)); }},
+      {"Meshlets", [](const Paths& p) { TestMeshlets(GeneratedTriangles(p)); }},
+      {"VertexCache",
+       [](const Paths& p) { TestVertexCache(GeneratedGrid(p)); }},
+      {"Lods", TestLods},
+  };
+  int failed_tests = 0;
+  for (const auto& test : tests) {
+    const int failures_before = failure_count;
+    test.second(paths);
+    const bool passed = failure_count == failures_before;
+    std::cout << (passed ? "[  PASSED  ] " : "[  FAILED  ] ") << test.first
+              << "\n";
+    failed_tests += passed ? 0 : 1;
+  }
+  std::cout << failed_tests << " of " << std::size(tests)
+            << " tests failed.\n";
+  return failed_tests == 0 ? 0 : 1;
+}
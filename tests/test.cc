@@ -1,12 +1,15 @@
 #include <iostream>
+#include <string>
 
 #include "include/mtl_parser.h"
 #include "include/obj_parser.h"
 
-int main() {
+// Prints what the parsers read from Mug.obj and Mug.mtl in the directory
+// given as the first argument, tests by default.
+int main(int argc, char** argv) {
+  const std::string directory = argc > 1 ? argv[1] : "tests";
   OBJParser parser;
-  if (parser.Parse(
-          "C:/Users/zghdl/Desktop/local_repo/obj_parser/tests/Mug.obj") != 0) {
+  if (parser.Parse(directory + "/Mug.obj") != 0) {
     std::cerr << "Failed to parse OBJ file.\n";
     return 1;
   }
@@ -28,14 +31,13 @@ int main() {
   }
 
   MTLParser m_parser;
-  int result = m_parser.Parse(
-      "C:/Users/zghdl/Desktop/local_repo/obj_parser/tests/Mug.mtl");
+  int result = m_parser.Parse(directory + "/Mug.mtl");
   if (result != 0) {
     std::cerr << "Failed to parse MTL file.\n";
     return 1;
   }
 
-  auto materials = m_parser.material_map();
+  const auto& materials = m_parser.material_map();
   std::cout << "Parsed " << materials.size() << " materials.\n";
 
   for (const auto& pair : materials) {